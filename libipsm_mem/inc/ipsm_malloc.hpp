@@ -14,6 +14,7 @@
 
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 
 #include "ipsm_mem.hpp"
@@ -26,12 +27,21 @@
 namespace ipsm {
 
 struct msg_channels;
+class chained_heaps;
+
+/**
+ * @brief tag type to select the constructor of ipsm_malloc that places the heap on the persistent file
+ */
+struct persistent_file_t {
+	explicit persistent_file_t( void ) = default;
+};
+constexpr persistent_file_t persistent_file {};
 
 class ipsm_malloc {
 public:
 	~ipsm_malloc();
 	ipsm_malloc( void );
-	ipsm_malloc( ipsm_malloc&& src ) = default;
+	ipsm_malloc( ipsm_malloc&& src );
 	ipsm_malloc& operator=( ipsm_malloc&& src );
 
 	/**
@@ -40,18 +50,54 @@ public:
 	 * This constructor allocates a shared memory during constructor.
 	 * If an instance got as a primary role, it calls a functor initfunctor_arg() after finish setup of a shared memory
 	 *
+	 * If options.max_length is bigger than length, the heap grows on demand. when the heap is exhausted, a chained shared memory object "<p_shm_name>.<n>" is created
+	 * and offset_malloc spans it. the other processes attach the chained shared memory object lazily when they see it by allocate(), deallocate(), receive() or attach_segments().
+	 * The chained shared memory objects are mapped in the virtual address range of max_length that is reserved by each process.
+	 * therefore offset_ptr is available between the shared memory objects. options.max_length must be agreed upon in advance between processes.
+	 *
 	 * @exception if failed creation by any reason, throw std::bad_alloc(in case of new operator throws) or std::run_time_error
 	 *
 	 * @note p_shm_name string AAA must follow POSIX semaphore name specifications. please refer sem_open or sem_overview
 	 */
 	ipsm_malloc(
-		const char* p_shm_name,                   //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
-		const char* p_lifetime_ctrl_fname,        //!< [in] lifetime control file name.
-		size_t      length,                       //!< [in] shared memory size
-		mode_t      mode,                         //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
-		size_t      channel_size        = 2,      //!< [in] the number of channels for message passing. this value must be agreed upon in advance between communicating processes.
-		int         timeout_msec        = 1000,   //!< [in] timeout in milliseconds for waiting for shared memory initialization.
-		int         retry_interval_msec = 100     //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		const char*                    p_shm_name,                                       //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
+		const char*                    p_lifetime_ctrl_fname,                            //!< [in] lifetime control file name.
+		size_t                         length,                                           //!< [in] shared memory size
+		mode_t                         mode,                                             //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		size_t                         channel_size        = 2,                          //!< [in] the number of channels for message passing. this value must be agreed upon in advance between communicating processes.
+		int                            timeout_msec        = 1000,                       //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                            retry_interval_msec = 100,                        //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization. the waiting process is woken up as soon as the initializing process finishes, so this matters only if the notification is lost.
+		size_t                         num_of_arenas       = 1,                          //!< [in] the number of arenas that have own lock and free lists in the heap. this value is used only by the primary process that sets up the shared memory.
+		const ipsm_mem::setup_options& options             = ipsm_mem::setup_options()   //!< [in] optional settings of the heap. options.max_length is the maximum size of the heap that grows by chained shared memory objects. please refer to ipsm_mem::setup_options for the pages.
+	);
+
+	/**
+	 * @brief Construct and allocate a new cooperative startup heap on the persistent file that survives the restart of all processes
+	 *
+	 * please refer to ipsm_mem::setup_persistent() for the persistent mode.
+	 * if the file was shut down cleanly with the same layout_version, channel_size and length, the heap and the message channels of the previous run are reattached as they are.
+	 * i.e. the allocated memory blocks and the messages that are not received yet are kept. is_reattached() tells which one happens.
+	 *
+	 * the heap does not grow in this mode.
+	 *
+	 * @exception if failed creation by any reason, throw std::bad_alloc(in case of new operator throws) or std::run_time_error
+	 *
+	 * @note
+	 * the file may be mapped at a different address after the restart. the data in the heap should refer each other by offset_ptr.
+	 * when the heap is reattached, the owner tags of the memory blocks are cleared, because the instances of the previous run are gone. therefore reclaim_dead_owners() does not reclaim them.
+	 */
+	ipsm_malloc(
+		persistent_file_t,                                                               //!< [in] tag to select this constructor. use ipsm::persistent_file
+		const char*                    p_file_path,                                      //!< [in] path of the regular file that backs the heap
+		const char*                    p_lifetime_ctrl_fname,                            //!< [in] lifetime control file name.
+		size_t                         length,                                           //!< [in] shared memory size
+		mode_t                         mode,                                             //!< [in] access mode of the files. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		std::uint64_t                  layout_version      = 0,                          //!< [in] version of the layout of the data that the application places in the heap. change it when the layout is changed, then the heap of the previous run is discarded.
+		size_t                         channel_size        = 2,                          //!< [in] the number of channels for message passing. this value must be agreed upon in advance between communicating processes.
+		int                            timeout_msec        = 1000,                       //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                            retry_interval_msec = 100,                        //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization.
+		size_t                         num_of_arenas       = 1,                          //!< [in] the number of arenas that have own lock and free lists in the heap. this value is used only by the primary process that initializes the heap.
+		const ipsm_mem::setup_options& options             = ipsm_mem::setup_options()   //!< [in] optional settings of the heap. only the prefault and the lock of the pages are applied.
 	);
 
 	/**
@@ -81,6 +127,47 @@ public:
 	 */
 	void deallocate( void* p, size_t alignment = alignof( std::max_align_t ) );
 
+	/**
+	 * @brief Change the size of the memory in shared memory
+	 *
+	 * please refer to offset_malloc::reallocate() for details.
+	 *
+	 * @note
+	 * This interface is analogy to std::realloc();
+	 */
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	void* reallocate( void* p, size_t new_size, size_t alignment = alignof( std::max_align_t ) );
+
+	/**
+	 * @brief Try to expand the memory in shared memory in place
+	 *
+	 * please refer to offset_malloc::try_expand() for details.
+	 */
+	bool try_expand( void* p, size_t new_size );
+
+	/**
+	 * @brief Allocate n memory blocks of the same size from shared memory in one critical section
+	 *
+	 * @param n_bytes the number of bytes of each memory block
+	 * @param alignment the alignment of allocated memory. if alignment is 0, it is treated as 1.
+	 * @param n the number of memory blocks to allocate
+	 * @param pp_out [out] array that has n elements to store the pointers to allocated memory as the address of a process.
+	 *
+	 * @return the number of allocated memory blocks that are stored from pp_out[0]. the rest of pp_out is filled by nullptr.
+	 */
+	size_t allocate_bulk( size_t n_bytes, size_t alignment, size_t n, void** pp_out );
+
+	/**
+	 * @brief Deallocate n memory blocks from shared memory in one critical section
+	 *
+	 * @param pp array of pointers to the memory to deallocate. nullptr in the array is ignored.
+	 * @param n the number of elements of pp
+	 * @param alignment the alignment of the memory to deallocate.
+	 */
+	void deallocate_bulk( void* const* pp, size_t n, size_t alignment = alignof( std::max_align_t ) );
+
 	/**
 	 * @brief allocate and construct T instance.
 	 *
@@ -155,6 +242,79 @@ public:
 	 */
 	int get_bind_count( void ) const;
 
+	/**
+	 * @brief check whether the heap of the previous run is reattached
+	 *
+	 * please refer to ipsm_mem::is_reattached() for details.
+	 */
+	bool is_reattached( void ) const;
+
+	/**
+	 * @brief Get the statistics of the heap memory in shared memory
+	 *
+	 * please refer to offset_malloc::get_stats() for details.
+	 */
+	offset_malloc_stats get_stats( void ) const;
+
+	/**
+	 * @brief Get the page size of the shared memory
+	 *
+	 * please refer to ipsm_mem::get_page_size() for details.
+	 */
+	size_t get_page_size( void ) const;
+
+	/**
+	 * @brief enable or disable the deferred free for deallocation via this instance
+	 *
+	 * please refer to offset_malloc::set_deferred_free() for details.
+	 */
+	void set_deferred_free( bool enable );
+
+	/**
+	 * @brief enable or disable the owner tracking of the memory blocks that are allocated via this instance
+	 *
+	 * if enabled, the memory blocks are tagged by the owner id of this instance. please refer to offset_malloc::set_owner_id() for details.
+	 * when the process terminates without releasing the memory blocks, the other process is able to reclaim them by reclaim_dead_owners().
+	 *
+	 * @note
+	 * if the memory block is handed over to the other process, e.g. by send(), call disown() before sending. otherwise the receiver loses the memory block when this process terminates.
+	 */
+	void set_owner_tracking( bool enable );
+
+	/**
+	 * @brief clear the owner tag of the memory block
+	 *
+	 * please refer to offset_malloc::disown() for details.
+	 */
+	void disown( void* p );
+
+	/**
+	 * @brief reclaim the memory blocks that are left by the terminated processes or the destructed instances
+	 *
+	 * the liveness of the process is checked by the process id and the start time of the process.
+	 *
+	 * @return the number of the reclaimed memory blocks
+	 */
+	size_t reclaim_dead_owners( void );
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	/**
+	 * @brief Get the histogram of the allocation per size class of the heap memory in shared memory
+	 *
+	 * please refer to offset_malloc::get_size_class_histogram() for details.
+	 */
+	offset_malloc_size_class_histogram get_size_class_histogram( void ) const;
+#endif
+
+	/**
+	 * @brief attach the chained shared memory objects that are created by the other processes
+	 *
+	 * allocate(), deallocate() and receive() call this implicitly. call this before accessing the memory that is allocated by the other processes via the other path than receive().
+	 *
+	 * @return the number of the chained shared memory objects that are attached by this process
+	 */
+	size_t attach_segments( void );
+
 	/**
 	 * @brief Get the offset malloc object reference
 	 *
@@ -229,10 +389,12 @@ private:
 	ipsm_malloc& operator=( const ipsm_malloc& src ) = delete;
 
 	void swap( ipsm_malloc& src );
+	void bind_heap_and_msg_channels( void );   //!< bind shm_heap_ and p_msgch_ to the heap and the message channels on shm_obj_
 
-	ipsm_mem      shm_obj_;    //!< shared memory object. this member variable declaration order required like ipsm_mem, then offset_malloc
-	offset_malloc shm_heap_;   //!< offset base memory allocator on shared memory. this member variable declaration order required like ipsm_mem, then offset_malloc
-	msg_channels* p_msgch_;
+	ipsm_mem       shm_obj_;     //!< shared memory object. this member variable declaration order required like ipsm_mem, then offset_malloc
+	offset_malloc  shm_heap_;    //!< offset base memory allocator on shared memory. this member variable declaration order required like ipsm_mem, then offset_malloc
+	msg_channels*  p_msgch_;
+	chained_heaps* p_chained_;   //!< owned. heaps on the chained shared memory objects. nullptr if the heap does not grow.
 };
 
 }   // namespace ipsm
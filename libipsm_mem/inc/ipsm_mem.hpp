@@ -33,6 +33,58 @@ public:
 		ready        = 0x2222'2222'2222'2222UL,   //!< ready to use
 	};
 
+	/**
+	 * @brief type of the pages that back the shared memory
+	 *
+	 * the huge pages reduce the TLB misses when the large shared memory is accessed randomly.
+	 * the length of the shared memory is rounded up to the huge page size if the huge pages are requested.
+	 */
+	enum class page_type {
+		normal,             //!< regular pages of the POSIX shared memory object
+		transparent_huge,   //!< the POSIX shared memory object with madvise(MADV_HUGEPAGE). the huge pages are used if /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it.
+		hugetlbfs,          //!< the file "<hugetlbfs dir><shm name>" on hugetlbfs. if hugetlbfs is not available or no huge page is reserved, fall back to transparent_huge.
+	};
+
+	/**
+	 * @brief how to fault in the pages of the shared memory in advance
+	 *
+	 * without the prefault, the first touch of each page takes a page fault, e.g. in offset_malloc::allocate().
+	 * the page tables are per process. therefore each process that attaches the shared memory prefaults its own mapping.
+	 * the chained segments are also prefaulted when they are added or attached.
+	 */
+	enum class prefault_type {
+		none,         //!< the pages are faulted in at the first touch
+		populate,     //!< map the shared memory with MAP_POPULATE
+		parallel,     //!< fault in the pages by multiple threads before setup returns
+		background,   //!< fault in the pages by a background thread after the shared memory becomes ready. setup returns without waiting for it. the chained segments are prefaulted like parallel.
+	};
+
+	/**
+	 * @brief optional settings of the mapping of the shared memory for setup(), setup_memfd() and setup_persistent()
+	 *
+	 * the default constructed value is the plain shared memory that does not grow. change the fields by name, e.g. opts.prefault = prefault_type::parallel.
+	 * setup_memfd() and setup_persistent() apply only prefault and lock_pages, because no chained segment nor huge page is available in those modes.
+	 */
+	struct setup_options {
+		size_t        max_length;        //!< size of the virtual address range that is reserved from the top of the shared memory for chained segments. if this is not bigger than length, no chained segment is available.
+		page_type     page;              //!< type of the pages that back the shared memory. this value should be agreed upon in advance between processes. the page size is detected from the shared memory object when the other process attaches it.
+		const char*   p_hugetlbfs_dir;   //!< mount point of hugetlbfs. if nullptr, "/dev/hugepages" is used. this is used only if page is page_type::hugetlbfs.
+		prefault_type prefault;          //!< how to fault in the pages of the shared memory in advance.
+		bool          lock_pages;        //!< lock the pages of the shared memory in RAM by mlock(). if it fails by RLIMIT_MEMLOCK etc., the pages are left unlocked with a warning log.
+
+		setup_options( void )
+		  : max_length( 0 )
+		  , page( page_type::normal )
+		  , p_hugetlbfs_dir( nullptr )
+		  , prefault( prefault_type::none )
+		  , lock_pages( false )
+		{
+		}
+	};
+
+	static constexpr size_t max_num_of_chained_segments = 32;   //!< maximum number of chained segments that are added by add_chained_segment()
+	static constexpr size_t max_num_of_owners           = 64;   //!< maximum number of instances that are registered in the process table of the shared memory at the same time
+
 	~ipsm_mem();
 	ipsm_mem( void );   //<! Construct a new procshared mem object that is empty
 	ipsm_mem( ipsm_mem&& src );
@@ -41,13 +93,14 @@ public:
 	void swap( ipsm_mem& src );
 
 	ipsm_mem(
-		const char*                            p_shm_name,                   //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
-		const char*                            p_lifetime_ctrl_fname,        //!< [in] lifetime control file name.
-		size_t                                 length,                       //!< [in] shared memory size
-		mode_t                                 mode,                         //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
-		std::function<size_t( void*, size_t )> init_functor_arg,             //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size. this functor is called multiple by internal retry caused by shared mamory creation collision or shared memory initialization failure of other process.
-		int                                    timeout_msec        = 1000,   //!< [in] timeout in milliseconds for waiting for shared memory initialization.
-		int                                    retry_interval_msec = 100     //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		const char*                            p_shm_name,                             //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
+		const char*                            p_lifetime_ctrl_fname,                  //!< [in] lifetime control file name.
+		size_t                                 length,                                 //!< [in] shared memory size
+		mode_t                                 mode,                                   //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		std::function<size_t( void*, size_t )> init_functor_arg,                       //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size. this functor is called multiple by internal retry caused by shared mamory creation collision or shared memory initialization failure of other process.
+		int                                    timeout_msec        = 1000,             //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                                    retry_interval_msec = 100,              //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization. the waiting process is woken up as soon as the initializing process finishes, so this matters only if the notification is lost.
+		const setup_options&                   options             = setup_options()   //!< [in] optional settings of the mapping, e.g. the chained segments, the huge pages, the prefault and the lock of the pages.
 	);
 
 	/**
@@ -58,21 +111,145 @@ public:
 	 * @exception ipsm_mem_error
 	 */
 	bool setup(
-		const char*                            p_shm_name,                   //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
-		const char*                            p_lifetime_ctrl_fname,        //!< [in] lifetime control file name.
-		size_t                                 length,                       //!< [in] shared memory size
-		mode_t                                 mode,                         //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
-		std::function<size_t( void*, size_t )> init_functor_arg,             //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size. this functor is called multiple by internal retry caused by shared mamory creation collision or shared memory initialization failure of other process.
-		int                                    timeout_msec        = 1000,   //!< [in] timeout in milliseconds for waiting for shared memory initialization.
-		int                                    retry_interval_msec = 100     //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		const char*                            p_shm_name,                             //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
+		const char*                            p_lifetime_ctrl_fname,                  //!< [in] lifetime control file name.
+		size_t                                 length,                                 //!< [in] shared memory size
+		mode_t                                 mode,                                   //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		std::function<size_t( void*, size_t )> init_functor_arg,                       //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size. this functor is called multiple by internal retry caused by shared mamory creation collision or shared memory initialization failure of other process.
+		int                                    timeout_msec        = 1000,             //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                                    retry_interval_msec = 100,              //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization. the waiting process is woken up as soon as the initializing process finishes, so this matters only if the notification is lost.
+		const setup_options&                   options             = setup_options()   //!< [in] optional settings of the mapping, e.g. the chained segments, the huge pages, the prefault and the lock of the pages.
 	);
 
-	void*  get( void ) const;              //!< get top address of memory area
+	/**
+	 * @brief allocate a cooperative startup shared memory object that is backed by memfd and handed over by ipsm_memfd_broker
+	 *
+	 * no shared memory object nor lifetime control file is created in the file system. the file descriptor of the segment is received from the broker by SCM_RIGHTS.
+	 * the process that receives the new segment at first calls init_functor_arg. the other processes wait until the initialization is completed.
+	 * if the initializing process exits before the completion, the broker discards the segment, and the waiting processes retry with a new segment.
+	 * the segment is released when all instances of it are destructed.
+	 *
+	 * no chained segment is available in this mode.
+	 *
+	 * @pre this instance is default constructed instance
+	 *
+	 * @return true: success. false: timeout, e.g. the broker is not running.
+	 *
+	 * @exception ipsm_mem_error if the broker fails to create the segment, or the received segment is not sealed against shrinking.
+	 */
+	bool setup_memfd(
+		const char*                            p_broker_name,                          //!< [in] name of the socket of ipsm_memfd_broker
+		const char*                            p_shm_name,                             //!< [in] name of the segment in the broker. this string should be shorter than NAME_MAX
+		size_t                                 length,                                 //!< [in] shared memory size
+		std::function<size_t( void*, size_t )> init_functor_arg,                       //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size.
+		int                                    timeout_msec        = 1000,             //!< [in] timeout in milliseconds for waiting for the broker and shared memory initialization.
+		int                                    retry_interval_msec = 100,              //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization. the waiting process is notified by the broker as soon as the initializing process finishes.
+		const setup_options&                   options             = setup_options()   //!< [in] optional settings of the mapping. only the prefault and the lock of the pages are applied.
+	);
+
+	/**
+	 * @brief allocate a cooperative startup shared memory object that is backed by a regular file and survives the restart of all processes
+	 *
+	 * the file is mapped by MAP_SHARED, and is not removed when all instances are destructed. the last instance writes back the contents by msync() and records the clean shutdown in the header.
+	 * when the process that acquires the exclusive lock finds the file that was shut down cleanly with the same layout_version and length, it reattaches the contents without calling init_functor_arg, and the hint value of the previous run is kept.
+	 * in that case, the process table is reset, because all owners of the previous run are gone. the resources that are tagged by the owner ids of the previous run should be disowned by reattach_functor_arg.
+	 * otherwise, e.g. the file does not exist, the previous run crashed, or layout_version differs, the file is truncated and init_functor_arg is called like setup().
+	 *
+	 * no chained segment is available in this mode.
+	 *
+	 * @note
+	 * the contents should consist of offset based data only, e.g. offset_ptr and offset_malloc, because the file may be mapped at a different address after the restart.
+	 *
+	 * @pre this instance is default constructed instance
+	 *
+	 * @return true: success. false: timeout.
+	 *
+	 * @exception ipsm_mem_error if the file is not able to be created or mapped
+	 */
+	bool setup_persistent(
+		const char*                            p_file_path,                              //!< [in] path of the regular file that backs the shared memory. a symbolic link is not followed.
+		const char*                            p_lifetime_ctrl_fname,                    //!< [in] lifetime control file name.
+		size_t                                 length,                                   //!< [in] shared memory size
+		mode_t                                 mode,                                     //!< [in] access mode of the file and the lifetime control file. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		std::function<size_t( void*, size_t )> init_functor_arg,                         //!< [in] a functor to initialize a shared memory area. this functor is not called if the contents are reattached.
+		std::uint64_t                          layout_version,                           //!< [in] version of the layout of the contents that init_functor_arg constructs. change it when the layout is changed, then the contents of the previous run are discarded.
+		int                                    timeout_msec         = 1000,              //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                                    retry_interval_msec  = 100,               //!< [in] upper bound of the interval in milliseconds to re-check shared memory initialization.
+		const setup_options&                   options              = setup_options(),   //!< [in] optional settings of the mapping. only the prefault and the lock of the pages are applied.
+		std::function<void( void*, size_t )>   reattach_functor_arg = nullptr            //!< [in] a functor that is called when the contents are reattached, before the other processes are allowed to use them. the arguments are same as init_functor_arg. if it throws, the exception is propagated, and the contents are reinitialized at the next setup.
+	);
+
+	/**
+	 * @brief check whether the contents of the previous run are reattached by setup_persistent()
+	 *
+	 * @return true: the contents of the previous run are reattached, and init_functor_arg was not called by this instance. false: otherwise, including the instance that attaches the shared memory initialized by the other process.
+	 */
+	bool is_reattached( void ) const;
+
+	void*  get( void ) const;            //!< get top address of memory area
 	size_t available_size( void ) const;   //!< larger than or equal to the size specified in constructor or allocate_shm_as_both.
 
 	status         get_status( void ) const;
 	std::uintptr_t get_hint_value( void ) const;
 
+	/**
+	 * @brief get the page size of the shared memory that is decided by the process that created it
+	 *
+	 * if the huge pages are requested, this is the huge page size even if it falls back to transparent_huge. in that case, whether the kernel really uses the huge pages depends on the system configuration.
+	 */
+	size_t get_page_size( void ) const;
+
+	/**
+	 * @brief add a chained segment "<shm name>.<n>" just after the last segment in the reserved virtual address range
+	 *
+	 * the chained segments are placed at the same offset from the top of the shared memory in all processes. therefore offset_ptr is available between the segments.
+	 * the new segment is created under the lock in the shared memory, and init_functor_arg is called to initialize it before it is published to the other processes.
+	 * if the other process has already added a chained segment that is not attached by this process yet, this function attaches it instead of creating a new one.
+	 *
+	 * @return true: a chained segment is attached or created. false: there is no room in the reserved virtual address range, or the number of chained segments reaches max_num_of_chained_segments.
+	 *
+	 * @exception ipsm_mem_error if failed creation by system call failure
+	 */
+	bool add_chained_segment(
+		size_t                                      length,            //!< [in] required size of the new chained segment
+		const std::function<void( void*, size_t )>& init_functor_arg   //!< [in] a functor to initialize the new chained segment. first argument is the pointer to the top of the segment. second argument is the assigned length.
+	);
+
+	/**
+	 * @brief attach the chained segments that are added by the other processes and not attached by this process yet
+	 *
+	 * @return the number of chained segments that are attached by this process
+	 */
+	size_t attach_chained_segments( void );
+
+	/**
+	 * @brief get the owner id of this instance in the process table of the shared memory
+	 *
+	 * each instance registers its process id to the process table in the header of the shared memory during the construction.
+	 * the owner id is index of the entry + 1. once this function is called, the entry is kept after the destruction of this instance until reclaim_dead_owners() is called by the other instance.
+	 * if this function is never called, no resource is tagged by the owner id. therefore the entry is released by the destruction of this instance.
+	 *
+	 * @return owner id. if the process table is full, return 0.
+	 */
+	unsigned int get_owner_id( void ) const;
+
+	/**
+	 * @brief find the owners whose process does not exist, or whose instance has been destructed, and release their entries of the process table
+	 *
+	 * the liveness of the process is checked by kill(pid, 0) and the start time of the process in /proc to detect the reuse of the process id.
+	 * reclaim_functor is called for each of the owners under the lock of the process table, and then the entry is released.
+	 * if reclaim_functor throws an exception, the entry is kept and the exception is propagated.
+	 *
+	 * @return the number of the released entries
+	 */
+	size_t reclaim_dead_owners(
+		const std::function<void( unsigned int )>& reclaim_functor   //!< [in] a functor to release the resources of the owner. the argument is the owner id.
+	);
+
+	size_t get_num_of_chained_segments( void ) const;      //!< get the number of chained segments that are added by any process. this may be bigger than the number of the attached segments in this process.
+	void*  get_chained_segment( size_t idx ) const;        //!< get top address of idx-th chained segment. idx starts from 0. if it is not attached by this process, return nullptr.
+	size_t get_chained_segment_size( size_t idx ) const;   //!< get the size of idx-th chained segment. if it is not attached by this process, return 0.
+
 private:
 	ipsm_mem( const ipsm_mem& )            = delete;
 	ipsm_mem& operator=( const ipsm_mem& ) = delete;
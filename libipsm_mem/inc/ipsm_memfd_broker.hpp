@@ -0,0 +1,66 @@
+/**
+ * @file ipsm_memfd_broker.hpp
+ * @author PFA03027@nifty.com
+ * @brief broker that hands the memfd based shared memory to the processes over UNIX domain socket
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef IPSM_MEMFD_BROKER_HPP_
+#define IPSM_MEMFD_BROKER_HPP_
+
+#include <cstddef>
+
+namespace ipsm {
+
+/**
+ * @brief broker that creates the anonymous shared memory by memfd_create() and hands its file descriptor to the processes
+ *
+ * the broker listens on the UNIX domain socket in the abstract namespace. therefore no file is left in the file system even if the processes crash.
+ * ipsm_mem::setup_memfd() connects to the broker, and receives the file descriptor of the segment by SCM_RIGHTS.
+ * the first process that requests a segment initializes it. the memfd is sealed by F_SEAL_SHRINK and F_SEAL_GROW, so no process is able to truncate the segment under the mapping of the others.
+ *
+ * the broker keeps the segment while any process keeps the connection for it, i.e. until all ipsm_mem instances of the segment are destructed.
+ * after that, the broker closes its file descriptor, and the memory is released by the kernel when the last mapping is unmapped.
+ *
+ * the broker runs a thread to serve the connections. it accepts the connections only from the processes of the same effective user id or root.
+ *
+ * @note
+ * the broker does not persist the segments. if the broker is restarted, the segments that are requested after that are new ones.
+ * therefore the broker should live longer than the processes that attach the segments, e.g. in the parent process or a supervisor process.
+ */
+class ipsm_memfd_broker {
+public:
+	~ipsm_memfd_broker();        // stop the broker. the segments that are handed over are alive until the processes unmap them
+	ipsm_memfd_broker( void );   //<! Construct an empty broker that does nothing
+	ipsm_memfd_broker( ipsm_memfd_broker&& src );
+	ipsm_memfd_broker& operator=( ipsm_memfd_broker&& src );
+
+	void swap( ipsm_memfd_broker& src );
+
+	/**
+	 * @brief start the broker
+	 *
+	 * @exception ipsm_mem_error if the socket is not able to be listened, e.g. the other broker with the same name is running.
+	 * @exception std::invalid_argument if p_broker_name is null, empty or too long for the socket address
+	 */
+	explicit ipsm_memfd_broker(
+		const char* p_broker_name   //!< [in] name of the socket in the abstract namespace. this string should be shorter than 107 bytes
+	);
+
+	size_t get_num_of_segments( void ) const;   //!< get the number of segments that the broker keeps
+
+private:
+	ipsm_memfd_broker( const ipsm_memfd_broker& )            = delete;
+	ipsm_memfd_broker& operator=( const ipsm_memfd_broker& ) = delete;
+
+	class impl;
+	impl* p_impl_;
+};
+
+}   // namespace ipsm
+
+#endif   // IPSM_MEMFD_BROKER_HPP_
@@ -47,7 +47,7 @@ private:
 			// TODO: メモリーリークになるが、とりあえず何もしない。例外を投げるとか(bad_free?)、エラーログを出力するとかできるけど。
 			return;
 		}
-		p_malloc_->deallocate( p );
+		p_malloc_->deallocate_sized( p, bytes, alignment );
 	}
 
 	bool do_is_equal( const memory_resource& other ) const noexcept override
@@ -35,6 +35,13 @@ public:
 	bool try_lock( void );
 	void unlock( void );
 
+	/**
+	 * @brief lock the mutex, and check whether the previous owner died during holding the mutex
+	 *
+	 * @return true: the previous owner died during holding the mutex. the mutex is recovered, but the data that is protected by the mutex may be inconsistent.
+	 */
+	bool lock_and_check_owner_dead( void );
+
 	native_handle_type native_handle( void )
 	{
 		return &fastmutex_;
@@ -72,6 +79,10 @@ public:
 	{
 		mtx_.unlock();
 	}
+	bool lock_and_check_owner_dead( void )   // see ipsm_mutex_base::lock_and_check_owner_dead()
+	{
+		return mtx_.lock_and_check_owner_dead();
+	}
 	native_handle_type native_handle( void )
 	{
 		return mtx_.native_handle();
@@ -56,8 +56,7 @@ public:
 	}
 	void deallocate( value_type* p, size_type n )
 	{
-		// TODO: nを使って、解放サイズの不整合をチェックできるようにする？
-		my_allocator_.deallocate( p );
+		my_allocator_.deallocate_sized( p, sizeof( value_type[n] ) );
 	}
 
 	offset_allocator select_on_container_copy_construction( void ) const;
@@ -0,0 +1,316 @@
+/**
+ * @file offset_handle.hpp
+ * @author PFA03027@nifty.com
+ * @brief handle based movable memory blocks and the compaction of them that are shareable b/w processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef OFFSET_HANDLE_HPP_
+#define OFFSET_HANDLE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "ipsm_mutex.hpp"
+#include "offset_malloc.hpp"
+#include "offset_ptr.hpp"
+
+namespace ipsm {
+
+class offset_handle_table;
+
+/**
+ * @brief slot of offset_handle_table that holds the current address of a movable memory block
+ *
+ * the memory block is not moved while it is pinned.
+ */
+struct offset_handle_slot {
+	static constexpr int moving                   = -1;     //!< value of pin_cnt_ while the memory block is moved or released
+	static constexpr int max_num_of_moving_yields = 1000;   //!< number of yields to wait for the moving before pin() locks the mutex of the table
+
+	offset_ptr<void>                op_block_;       //!< current address of the movable memory block. nullptr if this slot is free
+	offset_ptr<offset_handle_slot>  op_next_free_;   //!< next free slot. valid only if this slot is free
+	offset_ptr<offset_handle_table> op_table_;       //!< table that this slot belongs to
+	size_t                          alignment_;      //!< alignment of the memory block
+	std::atomic<int>                pin_cnt_;        //!< number of pins. moving means the memory block is moved or released
+
+	/**
+	 * @brief pin the memory block to prevent moving
+	 *
+	 * if the memory block is being moved, wait for the completion of the moving.
+	 * if the moving does not complete soon, this locks the mutex of the table to wait for the mover.
+	 * if the mover died during the moving, the slot is recovered by the lock.
+	 *
+	 * @return current address of the memory block
+	 */
+	void* pin( void ) noexcept;
+	void  unpin( void ) noexcept;
+};
+
+template <typename T>
+class offset_handle;
+
+/**
+ * @brief pointer to the memory block of offset_handle that keeps the memory block pinned during the lifetime of this instance
+ *
+ * this class instance should be placed on the stack of the process. the address that is got from this class is valid only until this instance is destructed.
+ *
+ * @tparam T
+ */
+template <typename T>
+class offset_pinned_ptr {
+public:
+	offset_pinned_ptr( void ) noexcept
+	  : p_slot_( nullptr )
+	  , p_( nullptr )
+	{
+	}
+	~offset_pinned_ptr()
+	{
+		reset();
+	}
+	offset_pinned_ptr( offset_pinned_ptr&& src ) noexcept
+	  : p_slot_( src.p_slot_ )
+	  , p_( src.p_ )
+	{
+		src.p_slot_ = nullptr;
+		src.p_      = nullptr;
+	}
+	offset_pinned_ptr& operator=( offset_pinned_ptr&& src ) noexcept
+	{
+		if ( this == &src ) {
+			return *this;
+		}
+		reset();
+		p_slot_     = src.p_slot_;
+		p_          = src.p_;
+		src.p_slot_ = nullptr;
+		src.p_      = nullptr;
+		return *this;
+	}
+
+	void reset( void ) noexcept
+	{
+		if ( p_slot_ != nullptr ) {
+			p_slot_->unpin();
+		}
+		p_slot_ = nullptr;
+		p_      = nullptr;
+	}
+
+	T* get( void ) const noexcept
+	{
+		return p_;
+	}
+	T* operator->() const noexcept
+	{
+		return p_;
+	}
+	T& operator*() const noexcept
+	{
+		return *p_;
+	}
+	explicit operator bool() const noexcept
+	{
+		return p_ != nullptr;
+	}
+
+private:
+	offset_pinned_ptr( const offset_pinned_ptr& )            = delete;
+	offset_pinned_ptr& operator=( const offset_pinned_ptr& ) = delete;
+
+	explicit offset_pinned_ptr( offset_handle_slot* p_slot ) noexcept
+	  : p_slot_( p_slot )
+	  , p_( reinterpret_cast<T*>( p_slot->pin() ) )
+	{
+	}
+
+	offset_handle_slot* p_slot_;   //!< プロセスローカルなスタック上に配置されるため、通常のポインタで保持する。
+	T*                  p_;
+
+	friend class offset_handle<T>;
+};
+
+/**
+ * @brief handle to a movable memory block that is allocated by offset_handle_table
+ *
+ * the handle indirects through the slot of offset_handle_table. therefore the handle is still valid after the memory block is moved by the compaction.
+ * to access the memory block, get offset_pinned_ptr by pin().
+ *
+ * this class could be placed on the shared memory. the handle does not become the owner of the memory block.
+ *
+ * @tparam T trivially copyable type, because the memory block is moved by memcpy().
+ */
+template <typename T>
+class offset_handle {
+public:
+	using element_type = T;
+
+	constexpr offset_handle( void ) noexcept                  = default;
+	offset_handle( const offset_handle& ) noexcept            = default;
+	offset_handle& operator=( const offset_handle& ) noexcept = default;
+
+	/**
+	 * @brief pin the memory block and get the pointer to it
+	 *
+	 * the memory block is not moved by the compaction until the returned offset_pinned_ptr is destructed.
+	 */
+	offset_pinned_ptr<T> pin( void ) const noexcept
+	{
+		if ( op_slot_ == nullptr ) {
+			return offset_pinned_ptr<T>();
+		}
+		return offset_pinned_ptr<T>( op_slot_.get() );
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return op_slot_ != nullptr;
+	}
+
+private:
+	explicit offset_handle( offset_handle_slot* p_slot ) noexcept
+	  : op_slot_( p_slot )
+	{
+	}
+
+	offset_ptr<offset_handle_slot> op_slot_;
+
+	friend class offset_handle_table;
+};
+
+/**
+ * @brief table of the slots of movable memory blocks and the compaction of them
+ *
+ * this class allocates the array of slots from offset_malloc, and the memory blocks that are referred via offset_handle.
+ * compact() slides the memory blocks that are not pinned to the lower address, and patches the slots.
+ * this recovers contiguous free memory of the long-lived heap memory without restarting the processes that attach it.
+ *
+ * this class could be placed on the shared memory. all pointers are the offset based pointer.
+ * if a process dies during the compaction or the release, the next process that locks the mutex recovers the slots.
+ *
+ * @note
+ * the slot array itself is not moved. the memory blocks that are allocated from offset_malloc directly are also not moved.
+ */
+class offset_handle_table {
+public:
+	offset_handle_table( const offset_malloc& src, size_t num_of_slots );
+	~offset_handle_table();   // release the all memory blocks and the slot array
+
+	offset_handle_table( const offset_handle_table& )            = delete;
+	offset_handle_table( offset_handle_table&& )                 = delete;
+	offset_handle_table& operator=( const offset_handle_table& ) = delete;
+	offset_handle_table& operator=( offset_handle_table&& )      = delete;
+
+	/**
+	 * @brief allocate a movable memory block and construct T on it
+	 *
+	 * @exception std::bad_alloc if there is no free slot or the memory block could not be allocated.
+	 */
+	template <typename T, typename... Args>
+	offset_handle<T> new_handle( Args&&... args )
+	{
+		static_assert( std::is_trivially_copyable<T>::value, "T should be trivially copyable, because the memory block is moved by memcpy()" );
+
+		offset_handle_slot* p_slot = allocate_slot( sizeof( T ), alignof( T ) );
+		if ( p_slot == nullptr ) {
+			throw std::bad_alloc();
+		}
+		// allocate_slot()は、コンパクションで移動されないように、ピン止めした状態のスロットを返す。
+		try {
+			new ( p_slot->op_block_.get() ) T( std::forward<Args>( args )... );
+		} catch ( ... ) {
+			p_slot->unpin();
+			release_slot( p_slot );
+			throw;
+		}
+		p_slot->unpin();
+		return offset_handle<T>( p_slot );
+	}
+
+	/**
+	 * @brief release the memory block of h
+	 *
+	 * if the memory block is pinned, wait for the unpinning until timeout. after the release, h and its copies become invalid.
+	 *
+	 * @return true: released, or h is empty. false: the memory block is still pinned after timeout, and h is still valid.
+	 */
+	template <typename T>
+	bool delete_handle( offset_handle<T>& h, int timeout_msec = 1000 )
+	{
+		if ( h.op_slot_ == nullptr ) {
+			return true;
+		}
+		if ( !release_slot( h.op_slot_.get(), timeout_msec ) ) {
+			return false;
+		}
+		h.op_slot_ = nullptr;
+		return true;
+	}
+
+	/**
+	 * @brief slide the memory blocks that are not pinned to the lower address
+	 *
+	 * this is able to be called by any process that attaches the heap memory. the pinned memory blocks are skipped.
+	 *
+	 * @return the number of the moved memory blocks
+	 */
+	size_t compact( void );
+
+	/**
+	 * @brief allocate a slot and its memory block
+	 *
+	 * @return pointer to the slot that is pinned once. the caller should unpin it after the initialization of the memory block. if fail, return nullptr.
+	 */
+	offset_handle_slot* allocate_slot( size_t req_bytes, size_t alignment );
+
+	/**
+	 * @brief release the memory block and the slot
+	 *
+	 * if the memory block is pinned, wait for the unpinning until timeout. the mutex is not held while waiting.
+	 * the pin that is left by the dead process is not released. in this case, this returns false after timeout.
+	 *
+	 * @return true: released. false: the memory block is still pinned after timeout, or p_slot is not a slot in use of this table.
+	 */
+	bool release_slot( offset_handle_slot* p_slot, int timeout_msec = 1000 );
+
+	size_t capacity( void ) const noexcept
+	{
+		return num_of_slots_;
+	}
+	size_t get_num_of_handles( void ) const;   // get the number of the slots in use
+
+	/**
+	 * @brief get offset_malloc that this table allocates the memory blocks from
+	 */
+	offset_malloc& get_offset_malloc( void ) noexcept
+	{
+		return allocator_;
+	}
+
+private:
+	class recovering_lock_guard;
+
+	void recover_nolock( void );            // 所有者が終了した場合に、移動中のスロットを戻し、空きスロットのリストと使用中のスロットの数を再構築する。
+	void wait_for_moving( void ) noexcept;   // mtx_を取得して、移動中のスロットの移動の完了、または回復を待つ。
+
+	offset_malloc                  allocator_;        //!< offset_malloc that the slot array and the memory blocks are allocated from
+	offset_ptr<offset_handle_slot> op_slots_;         //!< top address of the slot array
+	size_t                         num_of_slots_;     //!< number of slots in the slot array
+	mutable ipsm_mutex             mtx_;              //!< mutex to protect the following member variables and to serialize the compaction
+	offset_ptr<offset_handle_slot> op_free_top_;      //!< top of the free slot list
+	size_t                         num_of_handles_;   //!< number of the slots in use
+
+	friend struct offset_handle_slot;
+};
+
+}   // namespace ipsm
+
+#endif   // OFFSET_HANDLE_HPP_
@@ -170,6 +170,16 @@ private:
 	using node_allocator_type        = typename std::allocator_traits<allocator_type>::template rebind_alloc<node>;
 	using node_allocator_traits_type = std::allocator_traits<node_allocator_type>;
 
+public:
+	/**
+	 * @brief type of the memory block that is allocated from allocator_type per element
+	 *
+	 * this is available to prepare a fixed size memory pool for this container, e.g. offset_pool<node_storage_type>
+	 */
+	using node_storage_type = node;
+
+private:
+
 	template <typename... Args,
 	          typename std::enable_if<
 				  ( !std::uses_allocator<T, Allocator>::value ) &&
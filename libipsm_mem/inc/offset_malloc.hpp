@@ -19,10 +19,61 @@
 
 namespace ipsm {
 
+/**
+ * @brief statistics of the heap memory of offset_malloc
+ *
+ * the sizes include the block headers. the memory blocks that are cached by the per-thread cache are counted as allocated.
+ */
+struct offset_malloc_stats {
+	size_t total_bytes_;                //!< bytes of the memory area that is available for allocation
+	size_t free_bytes_;                 //!< bytes of free memory blocks
+	size_t num_of_free_blocks_;         //!< number of free memory blocks
+	size_t largest_free_block_bytes_;   //!< bytes of the largest free memory block
+	size_t num_of_allocated_blocks_;    //!< number of allocated memory blocks
+	double fragmentation_ratio_;        //!< 1 - largest_free_block_bytes_ / free_bytes_. 0 means that all free memory is available as one memory block
+};
+
+/**
+ * @brief counters of one size class of offset_malloc
+ *
+ * the size class is decided by the size of the memory block that is actually assigned, not by the requested size.
+ * the in-place resizing by reallocate()/try_expand() is counted as one deallocation of the old size class and one allocation of the new size class.
+ * the failed allocation is counted by the size class of the request.
+ */
+struct offset_malloc_size_class_stats {
+	size_t block_bytes_;                 //!< size of the memory block of this size class including the block header. 0 means the class of the larger memory blocks
+	size_t num_of_allocations_;          //!< number of successful allocations
+	size_t num_of_deallocations_;        //!< number of deallocations
+	size_t live_bytes_;                  //!< bytes of the memory blocks that are allocated currently
+	size_t num_of_failed_allocations_;   //!< number of allocations that returned nullptr
+};
+
+/**
+ * @brief histogram of the allocation per size class of offset_malloc
+ *
+ * this is filled by get_size_class_histogram() that is available only if ENABLE_SIZE_CLASS_STATISTICS is defined.
+ */
+struct offset_malloc_size_class_histogram {
+	static constexpr size_t num_of_classes = 17;   //!< 16 size classes of small memory blocks and 1 class of the larger memory blocks
+
+	offset_malloc_size_class_stats classes_[num_of_classes];   //!< counters of each size class. the last one is the class of the larger memory blocks
+};
+
+/**
+ * @brief allocation policy of offset_malloc
+ */
+enum class offset_malloc_policy : int {
+	kFirstFit,   //!< K&R first-fit from the roving pointer. this is the default policy.
+	kBestFit     //!< best-fit by the size ordered index of free blocks. this reduces the fragmentation under mixed size allocation.
+};
+
 /**
  * @brief memory allocator from internal heap memory
  *
  * heap memory is managed by offset pointer. therefore this class is constructed on the shared memory and sharable with other processes.
+ *
+ * heap memory can be split into multiple arenas that have own lock and free lists. a thread allocates from the arena that is mapped to the thread,
+ * and if the arena has no enough memory, it allocates from the other arenas. deallocate() returns the memory to the arena that the memory belongs to.
  */
 class offset_malloc {
 public:
@@ -31,6 +82,9 @@ public:
 	~offset_malloc();
 	constexpr offset_malloc( void ) noexcept
 	  : p_impl_( nullptr )
+	  , use_thread_cache_( false )
+	  , use_deferred_free_( false )
+	  , owner_id_( 0 )
 	{
 	}
 	offset_malloc( const offset_malloc& src );                  // bind to memory allocator that has already setup
@@ -40,8 +94,8 @@ public:
 
 	void swap( offset_malloc& src );
 
-	explicit offset_malloc( void* p_mem, size_t mem_bytes );   // bind and setup memory allocator implementation. caution: this instance does not become not p_mem area owner.
-	explicit offset_malloc( void* p_mem );                     // bind to memory that has already setup. caution: this instance does not become not p_mem area owner.
+	explicit offset_malloc( void* p_mem, size_t mem_bytes, offset_malloc_policy policy = offset_malloc_policy::kFirstFit, size_t num_of_arenas = 1 );   // bind and setup memory allocator implementation. caution: this instance does not become not p_mem area owner.
+	explicit offset_malloc( void* p_mem );                                                                                                            // bind to memory that has already setup. caution: this instance does not become not p_mem area owner.
 
 	/**
 	 * @brief Allocate memory from internal heap memory
@@ -70,6 +124,98 @@ public:
 	 */
 	void deallocate( void* p, size_t alignment = alignof( std::max_align_t ) );
 
+	/**
+	 * @brief Deallocate memory with the size that was passed to allocate()
+	 *
+	 * @param p pointer to the memory to deallocate
+	 * @param req_bytes the number of bytes that was passed to allocate()
+	 * @param alignment the alignment that was passed to allocate()
+	 *
+	 * the memory that is never cached by the per-thread cache is known from the size, and it is returned to the arena directly.
+	 * in debug build(NDEBUG is not defined), req_bytes is checked against the block header, and std::logic_error is thrown if it does not match.
+	 *
+	 * @note
+	 * This interface is analogy to free_sized() of C23;
+	 */
+	void deallocate_sized( void* p, size_t req_bytes, size_t alignment = alignof( std::max_align_t ) );
+
+	/**
+	 * @brief Change the size of the allocated memory
+	 *
+	 * @param p pointer to the memory that is allocated by this heap memory. if p is nullptr, this is same to allocate(new_size, alignment).
+	 * @param new_size new number of bytes
+	 * @param alignment the alignment that was passed to allocate().
+	 *
+	 * @return pointer to the memory that has new_size bytes. if reallocation failed, return nullptr and p is not changed.
+	 *
+	 * the memory is expanded in place if the adjacent memory is free, and the tail is returned to the heap memory if new_size is smaller.
+	 * otherwise, new memory is allocated, the contents are copied and p is deallocated.
+	 *
+	 * @note
+	 * This interface is analogy to std::realloc();
+	 */
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	void* reallocate( void* p, size_t new_size, size_t alignment = alignof( std::max_align_t ) );
+
+	/**
+	 * @brief Try to expand the allocated memory in place
+	 *
+	 * @param p pointer to the memory that is allocated by this heap memory
+	 * @param new_size new number of bytes
+	 *
+	 * @return true: the memory of p has new_size bytes at least. false: the adjacent memory is not free enough. p is not changed.
+	 */
+	bool try_expand( void* p, size_t new_size );
+
+	/**
+	 * @brief Move the allocated memory to the lowest free memory that is placed at the lower address in the same arena
+	 *
+	 * @param p pointer to the memory that is allocated by this heap memory
+	 * @param alignment the alignment that was passed to allocate().
+	 * @param p_referrer if not nullptr, the pointer that refers p. it is updated to the new address together with the move,
+	 *                   so even if the process dies during the move, it refers either the old memory or the new memory consistently.
+	 *                   it should be placed in the memory that is allocated by this heap memory.
+	 *
+	 * @return new address of the memory. if there is no free memory at the lower address to move to, return p.
+	 *
+	 * the contents are moved under the lock of the arena. by calling this for the allocated memories in ascending address order,
+	 * the allocated memories slide to the lower address and the free memories are coalesced at the higher address.
+	 * this is the building block of the compaction by offset_handle_table.
+	 *
+	 * @pre no other thread/process accesses the memory of p during this call, and nobody refers the memory of p by the address after this call.
+	 */
+	void* relocate_to_lower_address( void* p, size_t alignment = alignof( std::max_align_t ), offset_ptr<void>* p_referrer = nullptr );
+
+	/**
+	 * @brief Allocate n memory blocks of the same size in one critical section
+	 *
+	 * @param req_bytes the number of bytes of each memory block
+	 * @param alignment the alignment of allocated memory. if alignment is 0, it is treated as 1.
+	 * @param n the number of memory blocks to allocate
+	 * @param pp_out [out] array that has n elements to store the pointers to allocated memory.
+	 *
+	 * @return the number of allocated memory blocks that are stored from pp_out[0]. the rest of pp_out is filled by nullptr.
+	 *
+	 * @note
+	 * the mutex of each arena is locked once per call, instead of once per memory block. the per-thread cache is not used.
+	 */
+	size_t allocate_bulk( size_t req_bytes, size_t alignment, size_t n, void** pp_out );
+
+	/**
+	 * @brief Deallocate n memory blocks with a few critical sections
+	 *
+	 * @param pp array of pointers to the memory to deallocate. nullptr in the array is ignored.
+	 * @param n the number of elements of pp
+	 * @param alignment the alignment of the memory to deallocate.
+	 *
+	 * @note
+	 * the pointers are sorted by address in chunks of 64 pointers on the stack, and the memory blocks of each chunk are coalesced in one pass of the free list.
+	 * the mutex of each arena is locked once per chunk, instead of once per memory block.
+	 */
+	void deallocate_bulk( void* const* pp, size_t n, size_t alignment = alignof( std::max_align_t ) );
+
 	/**
 	 * @brief allocate and construct T instance.
 	 *
@@ -180,11 +326,152 @@ public:
 		deallocate( p_size, need_header_size );
 	}
 
-	int  get_bind_count( void ) const;
-	bool is_belong_to( void* p_mem ) const noexcept;
+	int    get_bind_count( void ) const;
+	bool   is_belong_to( void* p_mem ) const noexcept;   // check whether p_mem belongs to any arena of this heap memory
+	size_t get_num_of_arenas( void ) const noexcept;
+
+	/**
+	 * @brief Get the statistics of the heap memory
+	 *
+	 * each arena is read under its mutex. if there are multiple arenas, the statistics is the sum of arenas, and it is not a snapshot at the same time.
+	 */
+	offset_malloc_stats get_stats( void ) const;
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	/**
+	 * @brief Get the histogram of the allocation per size class
+	 *
+	 * the counters are read by relaxed atomic load without the mutex of the heap memory.
+	 * therefore this is available from the monitoring process that attaches to the same shared memory without disturbing the allocation,
+	 * but the counters are not a consistent snapshot b/w each other.
+	 */
+	offset_malloc_size_class_histogram get_size_class_histogram( void ) const;
+#endif
+
+	/**
+	 * @brief enable or disable the per-thread cache of small memory blocks for allocation via this instance
+	 *
+	 * If enabled, allocate() and deallocate() of small memory blocks via this instance use a process local per-thread cache,
+	 * and the mutex of the heap that is shared by all threads and processes is locked only when the cache is refilled or flushed by batch.
+	 *
+	 * The cached memory blocks are returned to the heap when the thread exits, when this instance is destroyed, or when this instance is disabled.
+	 *
+	 * @note
+	 * this setting is not copied by copy constructor and copy assignment. therefore a copy of this instance that is placed on shared memory(e.g. offset_allocator) does not use the cache.
+	 * @note
+	 * when this instance is destroyed or disabled, all cached memory blocks of this heap in this process are returned. this instance should be alive while the cache is used.
+	 */
+	void set_thread_cache( bool enable );
+
+	bool is_thread_cache_enabled( void ) const noexcept
+	{
+		return use_thread_cache_;
+	}
+
+	/**
+	 * @brief enable or disable the deferred free for deallocation via this instance
+	 *
+	 * If enabled, deallocate() via this instance does not lock the mutex of the heap. the memory block is pushed to a lock-free stack of the arena in shared memory,
+	 * and it is returned to the free list by the next allocation that locks the mutex, or by the deallocation that finds many memory blocks in the stack.
+	 * This takes the deallocation off the critical section of the allocating side, e.g. a consumer process that frees the memory allocated by a producer process.
+	 *
+	 * The memory blocks in the stack are counted as allocated by get_stats() until they are returned.
+	 * deallocate_bulk() is not deferred, because it already locks the mutex only once per arena.
+	 *
+	 * @note
+	 * this setting is not copied by copy constructor and copy assignment as same as set_thread_cache().
+	 * @note
+	 * when this instance is destroyed or disabled, the memory blocks in the stack are returned to the free list.
+	 */
+	void set_deferred_free( bool enable );
+
+	bool is_deferred_free_enabled( void ) const noexcept
+	{
+		return use_deferred_free_;
+	}
+
+	/**
+	 * @brief enable or disable deferred coalescing mode of the heap memory
+	 *
+	 * If enabled, deallocate() does not coalesce the memory block with the neighbors. the memory block is linked to the quick list of the arena,
+	 * and it is reused as is by the next allocation of the same size. this avoids repeating coalescing and splitting for the churn of the same size
+	 * like nodes of offset_list.
+	 * the uncoalesced memory blocks are coalesced when the allocation would otherwise fail, or when the number of them crosses the threshold.
+	 *
+	 * @note
+	 * different from set_thread_cache(), this setting is stored in the heap memory. therefore it affects all instances and processes that share the heap memory.
+	 * @note
+	 * when this mode is disabled, all uncoalesced memory blocks are coalesced.
+	 */
+	void set_deferred_coalescing( bool enable );
+	bool is_deferred_coalescing_enabled( void ) const;
+
+	/**
+	 * @brief set the page size of the memory area of the heap memory
+	 *
+	 * the pages of the freed large memory block are returned to OS by this unit. the default is the system page size.
+	 * if the heap memory is placed on hugetlbfs, set the huge page size, because the pages could be returned only by the huge page.
+	 *
+	 * @note
+	 * this setting is stored in the heap memory as same as set_deferred_coalescing(). it is not applied to the heap memories that are added by the growth.
+	 */
+	void set_page_bytes( size_t page_bytes );
+
+	/**
+	 * @brief set the owner id that tags the memory blocks allocated via this instance
+	 *
+	 * the owner id is stored in the block header of the allocated memory block, and reclaim_owner() deallocates all memory blocks of the owner at once.
+	 * 0 means no owner, and it is the default. the memory blocks allocated via the per-thread cache are not tagged. therefore the per-thread cache is bypassed
+	 * by allocate() while the owner id is set.
+	 *
+	 * @note
+	 * this setting is not copied by copy constructor and copy assignment as same as set_thread_cache().
+	 * @note
+	 * the memory block that is handed over to the other owner should be disowned by disown(). otherwise, it is deallocated by reclaim_owner() of the original owner.
+	 */
+	void set_owner_id( unsigned int owner_id ) noexcept
+	{
+		owner_id_ = owner_id;
+	}
+	unsigned int get_owner_id( void ) const noexcept
+	{
+		return owner_id_;
+	}
+
+	/**
+	 * @brief clear the owner id of the memory of p. after this call, reclaim_owner() does not deallocate it
+	 *
+	 * @param p pointer to the memory that is allocated by this heap memory
+	 */
+	void disown( void* p );
+
+	/**
+	 * @brief deallocate all memory blocks that are tagged with owner_id in all arenas and additional heaps
+	 *
+	 * this is used to reclaim the memory blocks of the process that died or detached without deallocating them.
+	 *
+	 * @pre nobody accesses the memory blocks of owner_id.
+	 *
+	 * @return the number of the deallocated memory blocks
+	 */
+	size_t reclaim_owner( unsigned int owner_id );
+
+	/**
+	 * @brief clear the owner id of all memory blocks in all arenas and additional heaps
+	 *
+	 * this is used when the owner ids of the memory blocks become meaningless, e.g. the heap is reattached after the restart of all processes.
+	 *
+	 * @return the number of the memory blocks whose owner id is cleared
+	 */
+	size_t disown_all( void );
 
 private:
+	void drain_deferred_free( void );
+
 	offset_ptr<offset_malloc_impl> p_impl_;
+	bool                           use_thread_cache_;    //!< true: use per-thread cache. this is not copied. see set_thread_cache()
+	bool                           use_deferred_free_;   //!< true: deallocate() pushes the memory block to the deferred free stack. this is not copied. see set_deferred_free()
+	unsigned int                   owner_id_;            //!< owner id that tags the allocated memory blocks. 0 means no owner. this is not copied. see set_owner_id()
 
 	friend constexpr bool operator==( const offset_malloc& a, const offset_malloc& b ) noexcept;
 	friend constexpr bool operator!=( const offset_malloc& a, const offset_malloc& b ) noexcept;
@@ -0,0 +1,263 @@
+/**
+ * @file offset_pool.hpp
+ * @author PFA03027@nifty.com
+ * @brief lock-free fixed size memory pool that is shareable b/w processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef OFFSET_POOL_HPP_
+#define OFFSET_POOL_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "offset_malloc.hpp"
+#include "offset_ptr.hpp"
+
+namespace ipsm {
+
+/**
+ * @brief type independent part of offset_pool
+ *
+ * this class carves one chunk from offset_malloc, and divides it into fixed size slots.
+ * free slots are linked by atomic_offset_ptr, and allocate()/deallocate() are a single CAS to the head of the free list without mutex.
+ *
+ * to avoid ABA problem, the head of the free list is a pair of the slot index and the version tag that is counted up by each update.
+ * the pair is packed into a 64bit word, therefore CAS of the head is lock-free on the major platform.
+ *
+ * this class could be placed on the shared memory. all pointers are the offset based pointer.
+ *
+ * @note
+ * the chunk is returned to offset_malloc by the destructor. all slots should be returned before the destruction.
+ */
+class offset_pool_base {
+public:
+	offset_pool_base( const offset_malloc& src, size_t slot_bytes, size_t slot_alignment, size_t num_of_slots );
+	~offset_pool_base();
+
+	offset_pool_base( const offset_pool_base& )            = delete;
+	offset_pool_base( offset_pool_base&& )                 = delete;
+	offset_pool_base& operator=( const offset_pool_base& ) = delete;
+	offset_pool_base& operator=( offset_pool_base&& )      = delete;
+
+	/**
+	 * @brief allocate one slot
+	 *
+	 * @return pointer to the allocated slot. if there is no free slot, return nullptr.
+	 */
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	void* allocate_slot( void ) noexcept;
+
+	/**
+	 * @brief return the slot to this pool
+	 *
+	 * @pre p should be the slot that is allocated by allocate_slot() of this pool.
+	 */
+	void deallocate_slot( void* p );
+
+	bool is_belong_to( const void* p ) const noexcept;   // check whether p is a slot of this pool
+
+	size_t capacity( void ) const noexcept
+	{
+		return num_of_slots_;
+	}
+	size_t slot_bytes( void ) const noexcept
+	{
+		return slot_bytes_;
+	}
+	size_t slot_alignment( void ) const noexcept
+	{
+		return slot_alignment_;
+	}
+
+	/**
+	 * @brief get offset_malloc that this pool carves the chunk from
+	 *
+	 * offset_pool_allocator uses this as the fallback of the request that does not fit to the slot.
+	 */
+	offset_malloc& get_offset_malloc( void ) noexcept
+	{
+		return allocator_;
+	}
+
+private:
+	struct free_slot {
+		atomic_offset_ptr<free_slot> op_next_;
+	};
+
+	static constexpr uint64_t version_tag_shift = 32;
+	static constexpr uint64_t slot_index_mask   = ( static_cast<uint64_t>( 1 ) << version_tag_shift ) - 1;
+
+	free_slot* get_slot( uint64_t head ) const noexcept;
+	uint64_t   make_head( uint64_t old_head, const free_slot* p_slot ) const noexcept;
+
+	offset_malloc             allocator_;        //!< offset_malloc that the chunk is carved from
+	offset_ptr<unsigned char> op_chunk_;         //!< top address of the chunk of slots
+	size_t                    slot_bytes_;       //!< size of a slot. this is the stride of slots
+	size_t                    slot_alignment_;   //!< alignment of a slot
+	size_t                    num_of_slots_;     //!< number of slots in the chunk
+	std::atomic<uint64_t>     head_;             //!< upper 32bit: version tag, lower 32bit: 1 + index of the top free slot. 0 means no free slot
+};
+
+/**
+ * @brief lock-free fixed size memory pool of T
+ *
+ * @tparam T type of the element that is allocated from this pool
+ */
+template <typename T>
+class offset_pool : public offset_pool_base {
+public:
+	using value_type = T;
+
+	offset_pool( const offset_malloc& src, size_t num_of_slots )
+	  : offset_pool_base( src, sizeof( T ), alignof( T ), num_of_slots )
+	{
+	}
+
+	/**
+	 * @brief allocate memory for one T
+	 *
+	 * @return pointer to the allocated memory. if there is no free slot, return nullptr.
+	 * @note this does not construct T.
+	 */
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	T* allocate( void ) noexcept
+	{
+		return reinterpret_cast<T*>( allocate_slot() );
+	}
+
+	/**
+	 * @brief return memory for one T
+	 *
+	 * @note this does not destruct T.
+	 */
+	void deallocate( T* p )
+	{
+		deallocate_slot( p );
+	}
+};
+
+/**
+ * @brief Allocator from offset_pool
+ *
+ * the request of one element that fits to the slot of the pool is allocated from the pool.
+ * the other requests and the request after the pool is exhausted are allocated from offset_malloc of the pool.
+ *
+ * since this allocator refers the pool by the offset based pointer, this allocator is rebindable to the other type like node of offset_list.
+ * to prepare the pool for node of offset_list, offset_list::node_storage_type is available like below.
+ * @code
+ * using list_t = ipsm::offset_list<int, ipsm::offset_pool_allocator<int>>;
+ * ipsm::offset_pool<list_t::node_storage_type> pool( om, 100 );
+ * list_t l( ipsm::offset_pool_allocator<int>( pool ) );
+ * @endcode
+ *
+ * @tparam T
+ */
+template <typename T>
+class offset_pool_allocator {
+public:
+	using value_type                             = T;
+	using propagate_on_container_move_assignment = std::false_type;   // offset_allocatorと同じ理由で伝搬しない。
+	using propagate_on_container_copy_assignment = std::false_type;   // offset_allocatorと同じ理由で伝搬しない。
+	using size_type                              = size_t;
+	using difference_type                        = ptrdiff_t;
+	using is_always_equal                        = std::false_type;
+
+	constexpr offset_pool_allocator() noexcept                       = default;
+	~offset_pool_allocator()                                         = default;
+	offset_pool_allocator( const offset_pool_allocator& )            = default;
+	offset_pool_allocator& operator=( const offset_pool_allocator& ) = default;
+
+	explicit offset_pool_allocator( offset_pool_base& pool ) noexcept   // bind to pool. caution: this instance does not become the owner of pool.
+	  : op_pool_( &pool )
+	{
+	}
+	template <typename U>
+	offset_pool_allocator( const offset_pool_allocator<U>& src ) noexcept
+	  : op_pool_( src.op_pool_ )
+	{
+	}
+
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	value_type* allocate( size_type n )
+	{
+		if ( op_pool_ == nullptr ) {
+			throw std::bad_alloc();
+		}
+		if ( is_fit_to_slot( n ) ) {
+			void* p = op_pool_->allocate_slot();
+			if ( p != nullptr ) {
+				return reinterpret_cast<value_type*>( p );
+			}
+		}
+		void* p = op_pool_->get_offset_malloc().allocate( sizeof( value_type ) * n, alignof( value_type ) );
+		if ( p == nullptr ) {
+			throw std::bad_alloc();
+		}
+		return reinterpret_cast<value_type*>( p );
+	}
+	void deallocate( value_type* p, size_type n )
+	{
+		if ( p == nullptr ) {
+			return;
+		}
+		if ( op_pool_->is_belong_to( p ) ) {
+			op_pool_->deallocate_slot( p );
+		} else {
+			op_pool_->get_offset_malloc().deallocate( p, alignof( value_type ) );
+		}
+	}
+
+	offset_pool_allocator select_on_container_copy_construction( void ) const
+	{
+		return offset_pool_allocator( *this );
+	}
+
+private:
+	offset_pool_allocator( offset_pool_allocator&& )            = delete;   // allocatorの性質上、moveはありえない。
+	offset_pool_allocator& operator=( offset_pool_allocator&& ) = delete;   // allocatorの性質上、moveはありえない。
+
+	bool is_fit_to_slot( size_type n ) const noexcept
+	{
+		return ( n == 1 ) &&
+		       ( sizeof( value_type ) <= op_pool_->slot_bytes() ) &&
+		       ( alignof( value_type ) <= op_pool_->slot_alignment() );
+	}
+
+	offset_ptr<offset_pool_base> op_pool_;
+
+	template <class XT, class XU>
+	friend constexpr bool operator==( const offset_pool_allocator<XT>& a, const offset_pool_allocator<XU>& b ) noexcept;
+
+	template <typename U>
+	friend class offset_pool_allocator;
+};
+
+template <class T, class U>
+constexpr bool operator==( const offset_pool_allocator<T>& a, const offset_pool_allocator<U>& b ) noexcept
+{
+	return ( a.op_pool_ == b.op_pool_ );
+}
+template <class T, class U>
+constexpr bool operator!=( const offset_pool_allocator<T>& a, const offset_pool_allocator<U>& b ) noexcept
+{
+	return !( a == b );
+}
+
+}   // namespace ipsm
+
+#endif   // OFFSET_POOL_HPP_
@@ -797,8 +797,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_weak( expected_offset, desired_offset, success, failure );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_weak( expected_offset, desired_offset, success, failure );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 	bool compare_exchange_weak( value_type&       expected,
@@ -808,8 +808,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_weak( expected_offset, desired_offset, success, failure );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_weak( expected_offset, desired_offset, success, failure );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 
@@ -819,8 +819,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_weak( expected_offset, desired_offset, order );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_weak( expected_offset, desired_offset, order );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 	bool compare_exchange_weak( value_type&       expected,
@@ -829,8 +829,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_weak( expected_offset, desired_offset, order );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_weak( expected_offset, desired_offset, order );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 
@@ -841,8 +841,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_strong( expected_offset, desired_offset, success, failure );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_strong( expected_offset, desired_offset, success, failure );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 	bool compare_exchange_strong( value_type&       expected,
@@ -852,8 +852,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_strong( expected_offset, desired_offset, success, failure );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_strong( expected_offset, desired_offset, success, failure );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 
@@ -863,8 +863,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_strong( expected_offset, desired_offset, order );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_strong( expected_offset, desired_offset, order );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 	bool compare_exchange_strong( value_type&       expected,
@@ -873,8 +873,8 @@ public:
 	{
 		uintptr_t expected_offset = calc_offset( this, expected.get() );
 		uintptr_t desired_offset  = calc_offset( this, desired.get() );
-		bool      ans             = compare_exchange_strong( expected_offset, desired_offset, order );
-		expected                  = calc_address( expected_offset );
+		bool      ans             = at_offset_.compare_exchange_strong( expected_offset, desired_offset, order );
+		expected                  = value_type( calc_address( expected_offset ) );
 		return ans;
 	}
 
@@ -986,9 +986,13 @@ private:
 	using element_pointer = T*;
 	inline constexpr element_pointer calc_address( uintptr_t offset ) const noexcept
 	{
+		if ( offset == 0 ) {
+			// offset値ゼロはnullptrを表す。offset_ptrと同じ扱いとする。
+			return nullptr;
+		}
 		return reinterpret_cast<element_pointer>( reinterpret_cast<uintptr_t>( this ) + offset );
 	}
-	static inline constexpr uintptr_t calc_offset( const atomic_offset_ptr* base_p, element_pointer p ) noexcept
+	static inline constexpr uintptr_t calc_offset( const atomic_offset_ptr* base_p, const T* p ) noexcept
 	{
 		if ( p == nullptr ) {
 			return 0;
@@ -0,0 +1,195 @@
+/**
+ * @file offset_region.hpp
+ * @author PFA03027@nifty.com
+ * @brief lock-free monotonic memory region that is shareable b/w processes and released at once
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef OFFSET_REGION_HPP_
+#define OFFSET_REGION_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "offset_malloc.hpp"
+#include "offset_ptr.hpp"
+
+namespace ipsm {
+
+/**
+ * @brief monotonic memory region
+ *
+ * this class carves one chunk from offset_malloc, and allocates memory blocks from the chunk by bumping the used size with CAS.
+ * there is no deallocation of an individual memory block. all memory blocks are released at once by release(), reset() or the destructor.
+ * this is suitable for the data that dies together, e.g. the data of a request, because it avoids the lock and the free list walk of offset_malloc per object.
+ *
+ * this class could be placed on the shared memory. all pointers are the offset based pointer.
+ *
+ * @note
+ * the destructors of the objects in the region are not called by release() and reset().
+ * if the objects need the destruction, the user should destruct them before release() or reset().
+ */
+class offset_region {
+public:
+	offset_region( const offset_malloc& src, size_t chunk_bytes );
+	~offset_region();   // release the chunk
+
+	offset_region( const offset_region& )            = delete;
+	offset_region( offset_region&& )                 = delete;
+	offset_region& operator=( const offset_region& ) = delete;
+	offset_region& operator=( offset_region&& )      = delete;
+
+	/**
+	 * @brief allocate memory block from the chunk
+	 *
+	 * this is lock-free, and is able to be called from multiple threads/processes concurrently.
+	 *
+	 * @return pointer to the allocated memory block. if the chunk is exhausted or released, return nullptr.
+	 */
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	void* allocate( size_t n, size_t alignment = alignof( std::max_align_t ) ) noexcept;
+
+	/**
+	 * @brief rewind the region to reuse the chunk
+	 *
+	 * all memory blocks that were allocated from this region become invalid.
+	 *
+	 * @pre no other thread/process accesses this region during this call.
+	 */
+	void reset( void ) noexcept;
+
+	/**
+	 * @brief return the chunk to offset_malloc in one call
+	 *
+	 * all memory blocks that were allocated from this region become invalid. after this call, allocate() returns nullptr.
+	 *
+	 * @pre no other thread/process accesses this region during this call.
+	 */
+	void release( void );
+
+	bool is_belong_to( const void* p ) const noexcept;   // check whether p is in the chunk of this region
+
+	size_t capacity( void ) const noexcept
+	{
+		return chunk_bytes_;
+	}
+	size_t used_bytes( void ) const noexcept
+	{
+		return used_bytes_.load( std::memory_order_acquire );
+	}
+
+	/**
+	 * @brief get offset_malloc that this region carves the chunk from
+	 */
+	offset_malloc& get_offset_malloc( void ) noexcept
+	{
+		return allocator_;
+	}
+
+private:
+	offset_malloc             allocator_;     //!< offset_malloc that the chunk is carved from
+	offset_ptr<unsigned char> op_chunk_;      //!< top address of the chunk. nullptr after release()
+	size_t                    chunk_bytes_;   //!< size of the chunk
+	std::atomic<size_t>       used_bytes_;    //!< allocated size from the top of the chunk including padding for alignment
+};
+
+/**
+ * @brief Allocator from offset_region
+ *
+ * deallocate() does nothing. the memory is released when the region is released.
+ * since this allocator refers the region by the offset based pointer, this allocator is rebindable to the other type like node of offset_list,
+ * and is available for offset_list and offset_basic_string like below.
+ * @code
+ * ipsm::offset_region region( om, 1024 * 64 );
+ * ipsm::offset_list<int, ipsm::offset_region_allocator<int>> l( ipsm::offset_region_allocator<int>( region ) );
+ * @endcode
+ *
+ * @tparam T
+ */
+template <typename T>
+class offset_region_allocator {
+public:
+	using value_type                             = T;
+	using propagate_on_container_move_assignment = std::false_type;   // offset_allocatorと同じ理由で伝搬しない。
+	using propagate_on_container_copy_assignment = std::false_type;   // offset_allocatorと同じ理由で伝搬しない。
+	using size_type                              = size_t;
+	using difference_type                        = ptrdiff_t;
+	using is_always_equal                        = std::false_type;
+
+	constexpr offset_region_allocator() noexcept                         = default;
+	~offset_region_allocator()                                           = default;
+	offset_region_allocator( const offset_region_allocator& )            = default;
+	offset_region_allocator& operator=( const offset_region_allocator& ) = default;
+
+	explicit offset_region_allocator( offset_region& region ) noexcept   // bind to region. caution: this instance does not become the owner of region.
+	  : op_region_( &region )
+	{
+	}
+	template <typename U>
+	offset_region_allocator( const offset_region_allocator<U>& src ) noexcept
+	  : op_region_( src.op_region_ )
+	{
+	}
+
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	value_type* allocate( size_type n )
+	{
+		if ( ( op_region_ == nullptr ) || ( n > ( std::numeric_limits<size_type>::max() / sizeof( value_type ) ) ) ) {
+			throw std::bad_alloc();
+		}
+		void* p = op_region_->allocate( sizeof( value_type ) * n, alignof( value_type ) );
+		if ( p == nullptr ) {
+			throw std::bad_alloc();
+		}
+		return reinterpret_cast<value_type*>( p );
+	}
+	void deallocate( value_type*, size_type )
+	{
+		// 領域は、offset_regionの解放時にまとめて解放するため、個別には何もしない。
+	}
+
+	offset_region_allocator select_on_container_copy_construction( void ) const
+	{
+		return offset_region_allocator( *this );
+	}
+
+private:
+	offset_region_allocator( offset_region_allocator&& )            = delete;   // allocatorの性質上、moveはありえない。
+	offset_region_allocator& operator=( offset_region_allocator&& ) = delete;   // allocatorの性質上、moveはありえない。
+
+	offset_ptr<offset_region> op_region_;
+
+	template <class XT, class XU>
+	friend constexpr bool operator==( const offset_region_allocator<XT>& a, const offset_region_allocator<XU>& b ) noexcept;
+
+	template <typename U>
+	friend class offset_region_allocator;
+};
+
+template <class T, class U>
+constexpr bool operator==( const offset_region_allocator<T>& a, const offset_region_allocator<U>& b ) noexcept
+{
+	return ( a.op_region_ == b.op_region_ );
+}
+template <class T, class U>
+constexpr bool operator!=( const offset_region_allocator<T>& a, const offset_region_allocator<U>& b ) noexcept
+{
+	return !( a == b );
+}
+
+}   // namespace ipsm
+
+#endif   // OFFSET_REGION_HPP_
@@ -79,12 +79,7 @@ public:
 
 	size_t size( void ) const
 	{
-		value_type* p   = op_string_.get();
-		size_t      ans = 0;
-		while ( *p != 0 ) {
-			ans++;
-		}
-		return ans;
+		return traits::length( op_string_.get() );
 	}
 
 	void clear( void )
@@ -162,7 +157,7 @@ void offset_basic_string<charT, traits, Allocator>::allocate_outer_buffer( size_
 			}
 			allocator_traits::destroy( alloc_, &( p[0] ) );
 		}
-		allocator_traits::deallocate( alloc_, n );
+		allocator_traits::deallocate( alloc_, p, n );
 		throw;
 	}
 
@@ -237,14 +232,10 @@ template <typename charT, class traits, class Allocator>
 offset_basic_string<charT, traits, Allocator>::offset_basic_string( const charT* s, const Allocator& a )
   : offset_basic_string( a )
 {
-	size_t num_chars = 0;
-	charT* p         = s;
-	while ( *p != 0 ) {
-		num_chars++;
-	}
+	size_t num_chars = traits::length( s );
 	num_chars++;   // null文字分を追加
 
-	const size_t copy_bytes = sizeof( charT[num_chars] );
+	const size_t copy_bytes = sizeof( charT ) * num_chars;
 	if ( num_chars <= soo_buff_size_ ) {
 		std::memcpy( soo_buff_, s, copy_bytes );
 	} else {
@@ -9,12 +9,18 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <mutex>
 #include <type_traits>
 
 #include "ipsm_condition_variable.hpp"
 #include "ipsm_logger_internal.hpp"
 #include "ipsm_malloc.hpp"
+#include "offset_malloc_growth.hpp"
+#include "offset_mallloc_impl.hpp"
 
 namespace ipsm {
 
@@ -47,15 +53,131 @@ size_t msg_channels::calc_required_bytes( size_t channel_size_arg )
 	return required_bytes;
 }
 
+/**
+ * @brief heaps on the chained shared memory objects of ipsm_malloc
+ *
+ * the heap on each chained shared memory object is offset_malloc_impl that has one arena. it is registered as the additional heaps of the heap on the 1st shared memory object.
+ *
+ * このクラスのインスタンスは、プロセスローカルなメモリ上に配置される。共有メモリ上には配置されない。
+ */
+class chained_heaps : public offset_malloc_growth_handler {
+public:
+	chained_heaps( ipsm_mem* p_shm_obj, offset_malloc::offset_malloc_impl* p_base );
+	~chained_heaps() override;
+
+	offset_malloc::offset_malloc_impl* get_heap( size_t idx ) override;
+	bool                               grow( size_t req_bytes, size_t alignment ) override;
+
+	size_t attach( void );
+
+	ipsm_mem* p_shm_obj_;   //!< ipsm_mallocのムーブにより、所有者のshm_obj_を指すように更新される。
+
+private:
+	offset_malloc::offset_malloc_impl* p_base_;                                        //!< 先頭の共有メモリ上のヒープ。レジストリへの登録のキー
+	std::mutex                         mtx_;                                           //!< heaps_の追加を、このプロセス内で排他するためのミューテックス
+	std::atomic<size_t>                num_of_heaps_;                                  //!< heaps_の[0, num_of_heaps_)は、変更されない。
+	offset_malloc::offset_malloc_impl* heaps_[ipsm_mem::max_num_of_chained_segments];   //!< チェーンセグメント上のヒープ
+};
+
+chained_heaps::chained_heaps( ipsm_mem* p_shm_obj, offset_malloc::offset_malloc_impl* p_base )
+  : p_shm_obj_( p_shm_obj )
+  , p_base_( p_base )
+  , mtx_()
+  , num_of_heaps_( 0 )
+  , heaps_ {}
+{
+	offset_malloc_growth::regist( p_base_, this );
+}
+
+chained_heaps::~chained_heaps()
+{
+	offset_malloc_growth::unregist( p_base_ );
+	for ( size_t i = 0; i < num_of_heaps_.load( std::memory_order_acquire ); i++ ) {
+		offset_malloc::offset_malloc_impl::unbind( heaps_[i] );
+	}
+}
+
+offset_malloc::offset_malloc_impl* chained_heaps::get_heap( size_t idx )
+{
+	if ( idx >= num_of_heaps_.load( std::memory_order_acquire ) ) {
+		// 他のプロセスが追加したチェーンセグメントがあれば、ここでアタッチする。
+		if ( idx >= attach() ) {
+			return nullptr;
+		}
+	}
+	return heaps_[idx];
+}
+
+bool chained_heaps::grow( size_t req_bytes, size_t alignment )
+{
+	// 要求サイズに加えて、offset_malloc_implの管理領域と、アライメントやページ単位への補正のための余裕を確保する。
+	constexpr size_t margin_bytes = sizeof( offset_malloc::offset_malloc_impl ) + 1024 * 8;
+	if ( ( req_bytes > ( std::numeric_limits<size_t>::max() / 2 ) ) || ( alignment > ( std::numeric_limits<size_t>::max() / 4 ) ) ) {
+		return false;
+	}
+	const size_t min_length = req_bytes + alignment + margin_bytes;
+
+	// ヒープ全体の大きさが倍になるようにすることで、セグメントの数を抑える。
+	size_t cur_total_length = p_shm_obj_->available_size();
+	for ( size_t i = 0; i < num_of_heaps_.load( std::memory_order_acquire ); i++ ) {
+		cur_total_length += p_shm_obj_->get_chained_segment_size( i );
+	}
+
+	// チェーンセグメントも、先頭のセグメントと同じページ種別でマッピングされるため、同じページサイズを設定する。
+	const size_t page_bytes = p_shm_obj_->get_page_size();
+
+	auto init_heap = [page_bytes]( void* p_mem, size_t len ) {
+		offset_malloc heap_setup( p_mem, len, offset_malloc_policy::kFirstFit );
+		heap_setup.set_page_bytes( page_bytes );
+	};
+	bool ret = p_shm_obj_->add_chained_segment( std::max( cur_total_length, min_length ), init_heap );
+	if ( !ret && ( cur_total_length > min_length ) ) {
+		// 予約した仮想アドレス範囲の残りが不足する場合は、要求を満たす最小の大きさで再度試みる。
+		ret = p_shm_obj_->add_chained_segment( min_length, init_heap );
+	}
+	if ( !ret ) {
+		psm_logoutput( psm_log_lv::kDebug, "Debug: fail to add a chained segment, req_bytes=%zu", req_bytes );
+		return false;
+	}
+	attach();
+	return true;
+}
+
+size_t chained_heaps::attach( void )
+{
+	size_t num_of_segments = p_shm_obj_->attach_chained_segments();
+	if ( num_of_segments <= num_of_heaps_.load( std::memory_order_acquire ) ) {
+		return num_of_heaps_.load( std::memory_order_acquire );
+	}
+
+	std::lock_guard<std::mutex> lk( mtx_ );
+	size_t                      i = num_of_heaps_.load( std::memory_order_acquire );
+	for ( ; i < num_of_segments; i++ ) {
+		heaps_[i] = offset_malloc::offset_malloc_impl::bind( reinterpret_cast<offset_malloc::offset_malloc_impl*>( p_shm_obj_->get_chained_segment( i ) ) );
+		num_of_heaps_.store( i + 1, std::memory_order_release );
+	}
+	return i;
+}
+
 ipsm_malloc::ipsm_malloc( void )
   : shm_obj_()
   , shm_heap_()
   , p_msgch_( nullptr )
+  , p_chained_( nullptr )
 {
 }
 
 ipsm_malloc::~ipsm_malloc()
 {
+	// チェーンセグメント上のヒープは、shm_obj_がマッピングを解除する前に、登録を解除する。
+	delete p_chained_;
+	p_chained_ = nullptr;
+}
+
+ipsm_malloc::ipsm_malloc( ipsm_malloc&& src )
+  : ipsm_malloc()
+{
+	swap( src );
 }
 
 ipsm_malloc& ipsm_malloc::operator=( ipsm_malloc&& src )
@@ -68,47 +190,144 @@ ipsm_malloc& ipsm_malloc::operator=( ipsm_malloc&& src )
 	return *this;
 }
 
+namespace {
+
+// ipsm_mallocが共有メモリ上に構築するデータ構造(offset_malloc_impl, msg_channels)のレイアウトのバージョン。
+// 永続化モードで、前回のデータ構造を引き継げるかを判定するために使用する。データ構造のレイアウトを変更した場合は、値を変更すること。
+constexpr std::uint64_t ipsm_malloc_layout_version = 1;
+
+// 共有メモリ上に、ヒープとメッセージチャネルを構築する。
+// 戻り値は、セカンダリ側に通知する情報として、message channelへのオフセットを返す。
+std::uintptr_t setup_heap_and_msg_channels( void* p_mem, size_t len, size_t channel_size, size_t num_of_arenas )
+{
+	offset_malloc                      shm_heap_setup = offset_malloc( p_mem, len, offset_malloc_policy::kFirstFit, num_of_arenas );
+	offset_allocator<msg_channels>     msg_channels_allocator_obj( shm_heap_setup );
+	offset_allocator<offset_ptr<void>> chdata_t_allocator_obj( shm_heap_setup );
+
+	using target_allocator_traits_type = std::allocator_traits<offset_allocator<msg_channels>>;
+
+	// msg_channels* p_msgch_setup = target_allocator_traits_type::allocate( msg_channels_allocator_obj, 1 );
+	msg_channels* p_msgch_setup = reinterpret_cast<msg_channels*>( shm_heap_setup.allocate( msg_channels::calc_required_bytes( channel_size ), alignof( msg_channels ) ) );
+	target_allocator_traits_type::construct( msg_channels_allocator_obj, p_msgch_setup, chdata_t_allocator_obj, channel_size );
+
+	std::uintptr_t p_msgch_offset = reinterpret_cast<std::uintptr_t>( p_msgch_setup ) - reinterpret_cast<std::uintptr_t>( p_mem );
+
+	return p_msgch_offset;   // セカンダリ側に通知する情報は、message channelへのオフセット。
+}
+
+// 永続化モードで、前回のデータ構造を引き継げるかを判定するためのバージョンを作る。
+// offset_malloc_implのレイアウトを変更した場合も検出できるように、その大きさも含める。
+// チャネル数が異なる場合もmsg_channelsのレイアウトが異なるため、含める。アリーナ数は、offset_malloc_implに記録されているため、含めない。
+std::uint64_t make_persistent_layout_version( size_t channel_size, std::uint64_t user_layout_version )
+{
+	const std::uint64_t elements[] = {
+		ipsm_malloc_layout_version,
+		sizeof( offset_malloc::offset_malloc_impl ),
+		sizeof( msg_channels ),
+		static_cast<std::uint64_t>( channel_size ),
+		user_layout_version,
+	};
+
+	// FNV-1a
+	std::uint64_t ans = 0xcbf2'9ce4'8422'2325UL;
+	for ( auto e : elements ) {
+		for ( size_t i = 0; i < sizeof( e ); i++ ) {
+			ans ^= ( e >> ( i * 8 ) ) & 0xFFU;
+			ans *= 0x0000'0100'0000'01B3UL;
+		}
+	}
+	return ans;
+}
+
+}   // namespace
+
 ipsm_malloc::ipsm_malloc(
-	const char* p_shm_name,
-	const char* p_lifetime_ctrl_fname,
-	size_t      length,
-	mode_t      mode,
-	size_t      channel_size,
-	int         timeout_msec,
-	int         retry_interval_msec )
+	const char*                    p_shm_name,
+	const char*                    p_lifetime_ctrl_fname,
+	size_t                         length,
+	mode_t                         mode,
+	size_t                         channel_size,
+	int                            timeout_msec,
+	int                            retry_interval_msec,
+	size_t                         num_of_arenas,
+	const ipsm_mem::setup_options& options )
   : shm_obj_()
   , shm_heap_()
   , p_msgch_( nullptr )
+  , p_chained_( nullptr )
 {
 	size_t actual_request_length = length + msg_channels::calc_required_bytes( channel_size ) + alignof( msg_channels );
-	bool   setup_ret             = shm_obj_.setup(
+	// max_lengthはヒープの最大サイズなので、メッセージチャネルの分を加えて、共有メモリとして予約する仮想アドレス範囲にする。
+	ipsm_mem::setup_options shm_options = options;
+	shm_options.max_length              = ( options.max_length > length ) ? ( options.max_length + ( actual_request_length - length ) ) : 0;
+	bool                    setup_ret   = shm_obj_.setup(
         p_shm_name, p_lifetime_ctrl_fname, actual_request_length, mode,
-        [channel_size]( void* p_mem, size_t len ) -> std::uintptr_t {
-            offset_malloc                      shm_heap_setup = offset_malloc( p_mem, len );
-            offset_allocator<msg_channels>     msg_channels_allocator_obj( shm_heap_setup );
-            offset_allocator<offset_ptr<void>> chdata_t_allocator_obj( shm_heap_setup );
-
-            using target_allocator_traits_type = std::allocator_traits<offset_allocator<msg_channels>>;
+        [channel_size, num_of_arenas]( void* p_mem, size_t len ) -> std::uintptr_t {
+            return setup_heap_and_msg_channels( p_mem, len, channel_size, num_of_arenas );
+        },
+        timeout_msec, retry_interval_msec, shm_options );
 
-            // msg_channels* p_msgch_setup = target_allocator_traits_type::allocate( msg_channels_allocator_obj, 1 );
-            msg_channels* p_msgch_setup = reinterpret_cast<msg_channels*>( shm_heap_setup.allocate( msg_channels::calc_required_bytes( channel_size ), alignof( msg_channels ) ) );
-            target_allocator_traits_type::construct( msg_channels_allocator_obj, p_msgch_setup, chdata_t_allocator_obj, channel_size );
+	if ( !setup_ret ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "fail to construct offset_malloc on shared memory: %s", p_shm_name );
+		throw std::runtime_error( "fail to construct offset_malloc on shared memory: " + std::string( p_shm_name ) );
+	}
 
-            std::uintptr_t p_msgch_offset = reinterpret_cast<std::uintptr_t>( p_msgch_setup ) - reinterpret_cast<std::uintptr_t>( p_mem );
+	bind_heap_and_msg_channels();
+	if ( shm_options.max_length > 0 ) {
+		p_chained_ = new chained_heaps( &shm_obj_, reinterpret_cast<offset_malloc::offset_malloc_impl*>( shm_obj_.get() ) );
+		p_chained_->attach();
+	}
+}
 
-            return p_msgch_offset;   // セカンダリ側に通知する情報は、message channelへのオフセット。
+ipsm_malloc::ipsm_malloc(
+	persistent_file_t,
+	const char*                    p_file_path,
+	const char*                    p_lifetime_ctrl_fname,
+	size_t                         length,
+	mode_t                         mode,
+	std::uint64_t                  layout_version,
+	size_t                         channel_size,
+	int                            timeout_msec,
+	int                            retry_interval_msec,
+	size_t                         num_of_arenas,
+	const ipsm_mem::setup_options& options )
+  : shm_obj_()
+  , shm_heap_()
+  , p_msgch_( nullptr )
+  , p_chained_( nullptr )
+{
+	size_t actual_request_length = length + msg_channels::calc_required_bytes( channel_size ) + alignof( msg_channels );
+	bool   setup_ret             = shm_obj_.setup_persistent(
+        p_file_path, p_lifetime_ctrl_fname, actual_request_length, mode,
+        [channel_size, num_of_arenas]( void* p_mem, size_t len ) -> std::uintptr_t {
+            return setup_heap_and_msg_channels( p_mem, len, channel_size, num_of_arenas );
         },
-        timeout_msec, retry_interval_msec );
+        make_persistent_layout_version( channel_size, layout_version ), timeout_msec, retry_interval_msec, options,
+        []( void* p_mem, size_t ) {
+            // 前回のオーナーIDは、今回のプロセスに割り当てられるため、タグを消しておく。残しておくと、reclaim_dead_owners()で回収されてしまう。
+            offset_malloc( p_mem ).disown_all();
+        } );
 
 	if ( !setup_ret ) {
-		psm_logoutput( ipsm::psm_log_lv::kWarn, "fail to construct offset_malloc on shared memory: %s", p_shm_name );
-		throw std::runtime_error( "fail to construct offset_malloc on shared memory: " + std::string( p_shm_name ) );
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "fail to construct offset_malloc on persistent shared memory: %s", p_file_path );
+		throw std::runtime_error( "fail to construct offset_malloc on persistent shared memory: " + std::string( p_file_path ) );
 	}
 
+	bind_heap_and_msg_channels();
+}
+
+void ipsm_malloc::bind_heap_and_msg_channels( void )
+{
 	shm_heap_ = offset_malloc( shm_obj_.get() );   // setup()では、必ずしもコールバック関数が呼び出されるとは限らないため、get()で取得したアドレスを利用して、改めてoffset_mallocを初期化する。
+	shm_heap_.set_page_bytes( shm_obj_.get_page_size() );   // hugetlbfs上では、huge page単位でしかページを返却できない。どのプロセスが設定しても同じ値となる。
 	p_msgch_  = reinterpret_cast<msg_channels*>( reinterpret_cast<std::uintptr_t>( shm_obj_.get() ) + reinterpret_cast<std::uintptr_t>( shm_obj_.get_hint_value() ) );
 }
 
+bool ipsm_malloc::is_reattached( void ) const
+{
+	return shm_obj_.is_reattached();
+}
+
 #if __has_cpp_attribute( nodiscard )
 [[nodiscard]]
 #endif
@@ -122,11 +341,46 @@ void ipsm_malloc::deallocate( void* p, size_t alignment )
 	shm_heap_.deallocate( p, alignment );
 }
 
+void* ipsm_malloc::reallocate( void* p, size_t new_size, size_t alignment )
+{
+	return shm_heap_.reallocate( p, new_size, alignment );
+}
+
+bool ipsm_malloc::try_expand( void* p, size_t new_size )
+{
+	return shm_heap_.try_expand( p, new_size );
+}
+
+size_t ipsm_malloc::allocate_bulk( size_t n_bytes, size_t alignment, size_t n, void** pp_out )
+{
+	return shm_heap_.allocate_bulk( n_bytes, alignment, n, pp_out );
+}
+
+void ipsm_malloc::deallocate_bulk( void* const* pp, size_t n, size_t alignment )
+{
+	shm_heap_.deallocate_bulk( pp, n, alignment );
+}
+
 void ipsm_malloc::swap( ipsm_malloc& src )
 {
 	shm_obj_.swap( src.shm_obj_ );
 	shm_heap_.swap( src.shm_heap_ );
 	std::swap( p_msgch_, src.p_msgch_ );
+	std::swap( p_chained_, src.p_chained_ );
+	if ( p_chained_ != nullptr ) {
+		p_chained_->p_shm_obj_ = &shm_obj_;
+	}
+	if ( src.p_chained_ != nullptr ) {
+		src.p_chained_->p_shm_obj_ = &src.shm_obj_;
+	}
+}
+
+size_t ipsm_malloc::attach_segments( void )
+{
+	if ( p_chained_ == nullptr ) {
+		return 0;
+	}
+	return p_chained_->attach();
 }
 
 int ipsm_malloc::get_bind_count( void ) const
@@ -134,6 +388,50 @@ int ipsm_malloc::get_bind_count( void ) const
 	return shm_heap_.get_bind_count();
 }
 
+offset_malloc_stats ipsm_malloc::get_stats( void ) const
+{
+	return shm_heap_.get_stats();
+}
+
+size_t ipsm_malloc::get_page_size( void ) const
+{
+	return shm_obj_.get_page_size();
+}
+
+void ipsm_malloc::set_deferred_free( bool enable )
+{
+	shm_heap_.set_deferred_free( enable );
+}
+
+void ipsm_malloc::set_owner_tracking( bool enable )
+{
+	shm_heap_.set_owner_id( enable ? shm_obj_.get_owner_id() : 0 );
+}
+
+void ipsm_malloc::disown( void* p )
+{
+	shm_heap_.disown( p );
+}
+
+size_t ipsm_malloc::reclaim_dead_owners( void )
+{
+	// 終了したプロセスが拡張したヒープのブロックも回収対象とするため、先にチェーンセグメントをアタッチする。
+	attach_segments();
+
+	size_t num_of_reclaimed_blocks = 0;
+	shm_obj_.reclaim_dead_owners( [this, &num_of_reclaimed_blocks]( unsigned int owner_id ) {
+		num_of_reclaimed_blocks += shm_heap_.reclaim_owner( owner_id );
+	} );
+	return num_of_reclaimed_blocks;
+}
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+offset_malloc_size_class_histogram ipsm_malloc::get_size_class_histogram( void ) const
+{
+	return shm_heap_.get_size_class_histogram();
+}
+#endif
+
 void ipsm_malloc::send( unsigned int ch, offset_ptr<void> sending_value )
 {
 	if ( p_msgch_ == nullptr ) {
@@ -168,6 +466,9 @@ offset_ptr<void> ipsm_malloc::receive( unsigned int ch )
 	p_msgch_->cond_.wait( lk, [this, ch]() -> bool {
 		return !( p_msgch_->msgch_[ch].empty() );
 	} );
+	// キューのノードや受信したポインタが、他のプロセスが追加したチェーンセグメントを指している可能性があるため、参照前にアタッチする。
+	// 送信側もメッセージチャネルのロック中にチェーンセグメントを追加するため、ロックの順序は同じ。
+	attach_segments();
 	offset_ptr<void> ans = p_msgch_->msgch_[ch].front();
 	p_msgch_->msgch_[ch].pop_front();
 	return ans;
@@ -188,6 +489,9 @@ std::optional<offset_ptr<void>> ipsm_malloc::try_receive( unsigned int ch )
 	if ( p_msgch_->msgch_[ch].empty() ) {
 		return std::nullopt;
 	}
+	// キューのノードや受信したポインタが、他のプロセスが追加したチェーンセグメントを指している可能性があるため、参照前にアタッチする。
+	// 送信側もメッセージチャネルのロック中にチェーンセグメントを追加するため、ロックの順序は同じ。
+	attach_segments();
 	offset_ptr<void> ans = p_msgch_->msgch_[ch].front();
 	p_msgch_->msgch_[ch].pop_front();
 	return ans;
@@ -211,6 +515,9 @@ std::optional<offset_ptr<void>> ipsm_malloc::try_receive_until( unsigned int ch,
 	if ( !has_msg ) {
 		return std::nullopt;
 	}
+	// キューのノードや受信したポインタが、他のプロセスが追加したチェーンセグメントを指している可能性があるため、参照前にアタッチする。
+	// 送信側もメッセージチャネルのロック中にチェーンセグメントを追加するため、ロックの順序は同じ。
+	attach_segments();
 	offset_ptr<void> ans = p_msgch_->msgch_[ch].front();
 	p_msgch_->msgch_[ch].pop_front();
 	return ans;
@@ -9,20 +9,31 @@
  *
  */
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <system_error>
 #include <thread>
+#include <vector>
 
 #include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/magic.h>
+#include <signal.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include "ipsm_logger_internal.hpp"
+#include "ipsm_mutex.hpp"
 #include "misc_utility.hpp"
 
 #include "ipsm_mem.hpp"
@@ -30,12 +41,85 @@
 
 namespace ipsm {
 
-static size_t roundup_to_page_size( size_t length )
+static size_t get_system_page_size( void )
+{
+	return static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+}
+
+static size_t roundup_to_page_size( size_t length, size_t page_size )
 {
-	size_t page_size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
 	return ( ( length + page_size - 1 ) / page_size ) * page_size;
 }
 
+/**
+ * @brief fault in the pages of [p_top, p_top + length) without changing the contents
+ */
+static void prefault_range( void* p_top, size_t length )
+{
+#ifdef MADV_POPULATE_WRITE
+	// 内容を変更せずに、書き込み可能なページテーブルのエントリを作成する。
+	if ( madvise( p_top, length, MADV_POPULATE_WRITE ) == 0 ) {
+		return;
+	}
+#endif
+	// MADV_POPULATE_WRITEが使えないカーネルでは、読み出しでページフォールトを発生させる。共有マッピングのため、読み出しでも物理ページが割り当てられる。
+	const size_t                  page_size = get_system_page_size();
+	const volatile unsigned char* p_bytes   = reinterpret_cast<const volatile unsigned char*>( p_top );
+	for ( size_t offset = 0; offset < length; offset += page_size ) {
+		(void)p_bytes[offset];
+	}
+}
+
+static std::string make_hugetlbfs_path( const std::string& hugetlbfs_dir, const std::string& shm_name )
+{
+	// shm_nameは'/'から始まるため、そのまま連結する。
+	return hugetlbfs_dir + shm_name;
+}
+
+/**
+ * @brief read the state and the start time of the process from /proc/<pid>/stat
+ *
+ * @return true: success to read. false: the process does not exist, or /proc is not available.
+ */
+static bool read_process_stat( pid_t pid, char& state, unsigned long long& start_time )
+{
+	std::string fname = "/proc/" + std::to_string( pid ) + "/stat";
+	int         fd    = open( fname.c_str(), O_RDONLY );
+	if ( fd < 0 ) {
+		return false;
+	}
+	char    buff[1024];
+	ssize_t len = read( fd, buff, sizeof( buff ) - 1 );
+	close( fd );
+	if ( len <= 0 ) {
+		return false;
+	}
+	buff[len] = '\0';
+
+	// コマンド名は空白や括弧を含む可能性があるため、最後の')'より後ろを解析する。3番目のフィールドが状態、22番目のフィールドが起動時刻となる。
+	const char* p_rest = strrchr( buff, ')' );
+	if ( p_rest == nullptr ) {
+		return false;
+	}
+	int ret = sscanf( p_rest + 1, " %c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu", &state, &start_time );
+	return ret == 2;
+}
+
+static bool is_process_alive( pid_t pid, unsigned long long start_time )
+{
+	if ( ( kill( pid, 0 ) != 0 ) && ( errno == ESRCH ) ) {
+		return false;
+	}
+	char               state          = '\0';
+	unsigned long long cur_start_time = 0;
+	if ( !read_process_stat( pid, state, cur_start_time ) ) {
+		// /procが参照できない環境では、kill()の結果のみで判定する。
+		return true;
+	}
+	// ゾンビプロセスは、終了済みとして扱う。また、起動時刻が異なる場合は、プロセスIDが再利用されている。
+	return ( state != 'Z' ) && ( ( start_time == 0 ) || ( start_time == cur_start_time ) );
+}
+
 // ==============================================================================
 lock_file_guard::~lock_file_guard()
 {
@@ -49,12 +133,17 @@ lock_file_guard::~lock_file_guard()
 	} catch ( ... ) {
 		psm_logoutput( ipsm::psm_log_lv::kErr, "unknown exception in lock_file_guard destructor" );
 	}
+	if ( p_unlock_gen_ != nullptr ) {
+		munmap( reinterpret_cast<void*>( p_unlock_gen_ ), sizeof( std::atomic<std::uint32_t> ) );
+	}
 	close( fd_ );
 }
 
 lock_file_guard::lock_file_guard( const std::string& fname, mode_t mode )
   : fd_( -1 )
   , is_locked_( false )
+  , is_exclusive_( false )
+  , p_unlock_gen_( nullptr )
 {
 	if ( fname.empty() ) {
 		// same as default constructor
@@ -68,6 +157,25 @@ lock_file_guard::lock_file_guard( const std::string& fname, mode_t mode )
 		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to open lock file: %s, error: %s", fname.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
 		throw ipsm::ipsm_mem_error( cur_errno, "  failed to open lock file: " + fname );
 	}
+
+	// ロックファイルの先頭に、排他ロックの解放を通知するための世代カウンタを配置し、futexで待ち合わせる。
+	// ロックファイルは、初期化処理を行うプロセスがいない状態でも存在するため、共有メモリの作成前から待ち合わせることができる。
+	// マッピングできない場合は、通知なしで動作する。
+	struct stat st;
+	if ( fstat( fd_, &st ) != 0 ) {
+		return;
+	}
+	if ( ( static_cast<size_t>( st.st_size ) < sizeof( std::atomic<std::uint32_t> ) ) && ( ftruncate( fd_, sizeof( std::atomic<std::uint32_t> ) ) != 0 ) ) {
+		// 他のプロセスが同時に拡張した場合も、同じサイズに拡張するだけなので、問題ない。
+		return;
+	}
+	void* p_mapped = mmap( nullptr, sizeof( std::atomic<std::uint32_t> ), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0 );
+	if ( p_mapped == MAP_FAILED ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kDebug, "failed to map lock file: %s, error: %s", fname.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		return;
+	}
+	p_unlock_gen_ = reinterpret_cast<std::atomic<std::uint32_t>*>( p_mapped );
 }
 
 bool lock_file_guard::try_exclusive_lock( void )
@@ -78,7 +186,8 @@ bool lock_file_guard::try_exclusive_lock( void )
 
 	int ret = flock( fd_, LOCK_EX | LOCK_NB );
 	if ( ret == 0 ) {
-		is_locked_ = true;
+		is_locked_    = true;
+		is_exclusive_ = true;
 		return true;
 	} else {
 		auto cur_errno = errno;
@@ -98,7 +207,8 @@ bool lock_file_guard::try_shared_lock( void )
 
 	int ret = flock( fd_, LOCK_SH | LOCK_NB );
 	if ( ret == 0 ) {
-		is_locked_ = true;
+		is_locked_    = true;
+		is_exclusive_ = false;
 		return true;
 	} else {
 		auto cur_errno = errno;
@@ -126,13 +236,75 @@ void lock_file_guard::release_lock( void )
 #endif
 	}
 	is_locked_ = false;
+	if ( is_exclusive_ ) {
+		is_exclusive_ = false;
+		notify_unlock();
+	}
+}
+
+std::uint32_t lock_file_guard::get_unlock_generation( void ) const
+{
+	if ( p_unlock_gen_ == nullptr ) {
+		return 0;
+	}
+	return p_unlock_gen_->load( std::memory_order_acquire );
+}
+
+void lock_file_guard::wait_for_unlock( std::uint32_t gen, int timeout_msec )
+{
+	if ( p_unlock_gen_ == nullptr ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( timeout_msec ) );
+		return;
+	}
+
+	// 世代カウンタがgenから変化している場合、futexは待たずに戻る。よって、gen取得後の解放の通知は取りこぼさない。
+	// 異常終了したプロセスは通知を行わないため、timeout_msecで待ち時間を区切る。
+	struct timespec rel_timeout;
+	rel_timeout.tv_sec  = timeout_msec / 1000;
+	rel_timeout.tv_nsec = static_cast<long>( timeout_msec % 1000 ) * 1000000L;
+	int ret             = static_cast<int>( syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( p_unlock_gen_ ), FUTEX_WAIT, gen, &rel_timeout, nullptr, 0 ) );
+	if ( ret != 0 ) {
+		auto cur_errno = errno;
+		if ( ( cur_errno != ETIMEDOUT ) && ( cur_errno != EAGAIN ) && ( cur_errno != EINTR ) ) {
+			psm_logoutput( ipsm::psm_log_lv::kDebug, "failed to wait for unlock, error: %s", ipsm::make_strerror( cur_errno ).c_str() );
+			std::this_thread::sleep_for( std::chrono::milliseconds( timeout_msec ) );
+		}
+	}
+}
+
+void lock_file_guard::notify_unlock( void )
+{
+	if ( p_unlock_gen_ == nullptr ) {
+		return;
+	}
+	p_unlock_gen_->fetch_add( 1, std::memory_order_acq_rel );
+	syscall( SYS_futex, reinterpret_cast<std::uint32_t*>( p_unlock_gen_ ), FUTEX_WAKE, std::numeric_limits<int>::max(), nullptr, nullptr, 0 );
+}
+
+// ==============================================================================
+shm_page_config::shm_page_config( ipsm_mem::page_type type, const char* p_hugetlbfs_dir, ipsm_mem::prefault_type prefault, bool lock_pages )
+  : type_( type )
+  , hugetlbfs_dir_( ( p_hugetlbfs_dir == nullptr ) ? "/dev/hugepages" : p_hugetlbfs_dir )
+  , prefault_( prefault )
+  , lock_pages_( lock_pages )
+{
+	// 共有メモリ名の先頭の'/'と連結するため、末尾の'/'を取り除く
+	while ( ( hugetlbfs_dir_.size() > 1 ) && ( hugetlbfs_dir_.back() == '/' ) ) {
+		hugetlbfs_dir_.pop_back();
+	}
 }
 
 // ==============================================================================
 shm_guard::~shm_guard()
 {
 	if ( p_addr_ != nullptr ) {
-		munmap( p_addr_, length_ );
+		if ( reserved_length_ == 0 ) {
+			// 他のshm_guardが予約した仮想アドレス範囲内にマッピングしているため、解除せずに予約状態に戻す。
+			// 解除すると、予約範囲に穴が開き、無関係なマッピングがその穴に配置される可能性がある。
+			mmap( p_addr_, length_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0 );
+		} else {
+			munmap( p_addr_, reserved_length_ );
+		}
 		p_addr_ = nullptr;
 	}
 	if ( fd_ >= 0 ) {
@@ -145,6 +317,9 @@ shm_guard::shm_guard( void )
   : fd_( -1 )
   , p_addr_( nullptr )
   , length_( 0 )
+  , reserved_length_( 0 )
+  , page_size_( get_system_page_size() )
+  , is_hugetlbfs_( false )
 {
 }
 
@@ -152,10 +327,15 @@ shm_guard::shm_guard( shm_guard&& src )
   : fd_( src.fd_ )
   , p_addr_( src.p_addr_ )
   , length_( src.length_ )
+  , reserved_length_( src.reserved_length_ )
+  , page_size_( src.page_size_ )
+  , is_hugetlbfs_( src.is_hugetlbfs_ )
 {
-	src.fd_     = -1;
-	src.p_addr_ = nullptr;
-	src.length_ = 0;
+	src.fd_              = -1;
+	src.p_addr_          = nullptr;
+	src.length_          = 0;
+	src.reserved_length_ = 0;
+	src.is_hugetlbfs_    = false;
 }
 
 shm_guard& shm_guard::operator=( shm_guard&& src )
@@ -174,9 +354,185 @@ void shm_guard::swap( shm_guard& src )
 	std::swap( fd_, src.fd_ );
 	std::swap( p_addr_, src.p_addr_ );
 	std::swap( length_, src.length_ );
+	std::swap( reserved_length_, src.reserved_length_ );
+	std::swap( page_size_, src.page_size_ );
+	std::swap( is_hugetlbfs_, src.is_hugetlbfs_ );
+}
+
+void shm_guard::map_fd( int fd, size_t aligned_length, size_t reserve_length, void* p_fixed_addr, size_t page_size, bool is_populate )
+{
+	const int populate_flag = is_populate ? MAP_POPULATE : 0;
+
+	if ( p_fixed_addr != nullptr ) {
+		// 予約済みの仮想アドレス範囲を、共有メモリのマッピングで置き換える。
+		void* p_addr_ret = mmap( p_fixed_addr, aligned_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | populate_flag, fd, 0 );
+		if ( p_addr_ret == MAP_FAILED ) {
+			auto cur_errno = errno;
+			throw ipsm::ipsm_mem_error( cur_errno, "failed to map shared memory object at the fixed address" );
+		}
+		p_addr_          = p_addr_ret;
+		length_          = aligned_length;
+		reserved_length_ = 0;
+		page_size_       = page_size;
+		return;
+	}
+
+	size_t aligned_reserve_length = roundup_to_page_size( reserve_length, page_size );
+	if ( aligned_reserve_length <= aligned_length ) {
+		void* p_addr_ret = mmap( nullptr, aligned_length, PROT_READ | PROT_WRITE, MAP_SHARED | populate_flag, fd, 0 );
+		if ( p_addr_ret == MAP_FAILED ) {
+			auto cur_errno = errno;
+			throw ipsm::ipsm_mem_error( cur_errno, "failed to map shared memory object" );
+		}
+		p_addr_          = p_addr_ret;
+		length_          = aligned_length;
+		reserved_length_ = aligned_length;
+		page_size_       = page_size;
+		return;
+	}
+
+	// チェーンセグメントを後ろに連続して配置できるように、先に仮想アドレス範囲を予約してから、その先頭に共有メモリをマッピングする。
+	// ヒュージページは、ページサイズの境界にマッピングする必要があるため、ページサイズ分だけ余分に予約して、先頭を境界に揃える。
+	const size_t margin_length = ( page_size > get_system_page_size() ) ? page_size : 0;
+	void*        p_margined    = mmap( nullptr, aligned_reserve_length + margin_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+	if ( p_margined == MAP_FAILED ) {
+		auto cur_errno = errno;
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to reserve virtual address range for shared memory object" );
+	}
+	const std::uintptr_t margined_top = reinterpret_cast<std::uintptr_t>( p_margined );
+	const std::uintptr_t reserved_top = roundup_to_page_size( margined_top, page_size );
+	const std::uintptr_t reserved_end = reserved_top + aligned_reserve_length;
+	if ( reserved_top > margined_top ) {
+		munmap( p_margined, reserved_top - margined_top );
+	}
+	if ( ( margined_top + aligned_reserve_length + margin_length ) > reserved_end ) {
+		munmap( reinterpret_cast<void*>( reserved_end ), ( margined_top + aligned_reserve_length + margin_length ) - reserved_end );
+	}
+	void* p_reserved = reinterpret_cast<void*>( reserved_top );
+	void* p_addr_ret = mmap( p_reserved, aligned_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | populate_flag, fd, 0 );
+	if ( p_addr_ret == MAP_FAILED ) {
+		auto cur_errno = errno;
+		munmap( p_reserved, aligned_reserve_length );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to map shared memory object" );
+	}
+	p_addr_          = p_addr_ret;
+	length_          = aligned_length;
+	reserved_length_ = aligned_reserve_length;
+	page_size_       = page_size;
+}
+
+bool shm_guard::is_populated_by_mmap( const shm_page_config& page_cfg, bool is_hugetlbfs )
+{
+	// 透過的ヒュージページを使う場合は、madvise(MADV_HUGEPAGE)の前にページが割り当てられないように、マッピング後にプリフォルトする。
+	return ( page_cfg.prefault_ == ipsm_mem::prefault_type::populate ) && ( ( page_cfg.type_ == ipsm_mem::page_type::normal ) || is_hugetlbfs );
+}
+
+void shm_guard::apply_page_config( const shm_page_config& page_cfg )
+{
+	if ( ( page_cfg.type_ != ipsm_mem::page_type::normal ) && !is_hugetlbfs_ ) {
+#ifdef MADV_HUGEPAGE
+		// 透過的ヒュージページが使われるかはカーネルの設定に依存するため、失敗しても通常のページのまま使用を継続する。
+		if ( madvise( p_addr_, length_, MADV_HUGEPAGE ) != 0 ) {
+			auto cur_errno = errno;
+			psm_logoutput( ipsm::psm_log_lv::kDebug, "Debug: fail to advise huge pages, addr=%p, length=%zu, error: %s", p_addr_, length_, ipsm::make_strerror( cur_errno ).c_str() );
+		}
+#endif
+	}
+
+	if ( page_cfg.prefault_ == ipsm_mem::prefault_type::parallel ) {
+		prefault( 0 );
+	} else if ( ( page_cfg.prefault_ == ipsm_mem::prefault_type::populate ) && !is_populated_by_mmap( page_cfg, is_hugetlbfs_ ) ) {
+		prefault( 1 );
+	}
+
+	if ( page_cfg.lock_pages_ ) {
+		// RLIMIT_MEMLOCKの制限で失敗した場合でも、ロックしないまま使用を継続する。
+		if ( mlock( p_addr_, length_ ) != 0 ) {
+			auto cur_errno = errno;
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "Warning: fail to lock pages of shared memory, addr=%p, length=%zu, error: %s", p_addr_, length_, ipsm::make_strerror( cur_errno ).c_str() );
+		}
+	}
+}
+
+void shm_guard::prefault( size_t num_of_threads, const std::atomic<bool>* p_cancel ) const
+{
+	if ( p_addr_ == nullptr ) {
+		return;
+	}
+
+	// 1回のmadvise()で処理する大きさ。中止の要求は、この大きさ毎に確認する。
+	const size_t     chunk_bytes   = 2 * 1024 * 1024;
+	const size_t     num_of_chunks = ( length_ + chunk_bytes - 1 ) / chunk_bytes;
+	if ( num_of_threads == 0 ) {
+		num_of_threads = std::max<size_t>( 1, std::thread::hardware_concurrency() );
+	}
+	num_of_threads = std::min( num_of_threads, num_of_chunks );
+
+	// 各スレッドは、スレッド数おきのチャンクを担当する。
+	auto prefault_chunks = [this, p_cancel, chunk_bytes, num_of_chunks, num_of_threads]( size_t first_idx ) {
+		for ( size_t i = first_idx; i < num_of_chunks; i += num_of_threads ) {
+			if ( ( p_cancel != nullptr ) && p_cancel->load( std::memory_order_acquire ) ) {
+				return;
+			}
+			const size_t offset = i * chunk_bytes;
+			prefault_range( reinterpret_cast<void*>( reinterpret_cast<std::uintptr_t>( p_addr_ ) + offset ), std::min( chunk_bytes, length_ - offset ) );
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for ( size_t t = 1; t < num_of_threads; t++ ) {
+		try {
+			threads.emplace_back( prefault_chunks, t );
+		} catch ( const std::system_error& e ) {
+			// スレッドを起動できなかった分は、呼び出し元のスレッドで処理する。
+			psm_logoutput( ipsm::psm_log_lv::kDebug, "Debug: fail to start prefault thread: %s", e.what() );
+			prefault_chunks( t );
+		}
+	}
+	prefault_chunks( 0 );
+	for ( auto& th : threads ) {
+		th.join();
+	}
+}
+
+size_t shm_guard::get_huge_page_size( void )
+{
+	static const size_t huge_page_size = []() -> size_t {
+		const size_t system_page_size = get_system_page_size();
+
+		int fd = ::open( "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY );
+		if ( fd < 0 ) {
+			return system_page_size;
+		}
+		char    buff[64];
+		ssize_t len = read( fd, buff, sizeof( buff ) - 1 );
+		close( fd );
+		if ( len <= 0 ) {
+			return system_page_size;
+		}
+		buff[len] = '\0';
+
+		unsigned long long value = 0;
+		if ( ( sscanf( buff, "%llu", &value ) != 1 ) || ( value <= system_page_size ) ) {
+			return system_page_size;
+		}
+		return static_cast<size_t>( value );
+	}();
+	return huge_page_size;
+}
+
+bool shm_guard::unlink( const std::string& shm_name, const shm_page_config& page_cfg )
+{
+	bool ans = ( shm_unlink( shm_name.c_str() ) == 0 );
+	if ( page_cfg.type_ == ipsm_mem::page_type::hugetlbfs ) {
+		if ( ::unlink( make_hugetlbfs_path( page_cfg.hugetlbfs_dir_, shm_name ).c_str() ) == 0 ) {
+			ans = true;
+		}
+	}
+	return ans;
 }
 
-bool shm_guard::open( const std::string& shm_name, size_t length, mode_t mode )
+bool shm_guard::open( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length, void* p_fixed_addr, const shm_page_config& page_cfg )
 {
 	if ( shm_name.empty() ) {
 		throw std::invalid_argument( "shared memory name is empty" );
@@ -188,34 +544,51 @@ bool shm_guard::open( const std::string& shm_name, size_t length, mode_t mode )
 		throw std::invalid_argument( "shared memory length is too large" );
 	}
 
-	// 共有メモリオブジェクトを開くために、shm_openを呼び出す
-	int fd_ret = shm_open( shm_name.c_str(), O_RDWR, mode );
+	int fd_ret = -1;
+	if ( page_cfg.type_ == ipsm_mem::page_type::hugetlbfs ) {
+		// 作成したプロセスがhugetlbfsを使えずにフォールバックした場合、ファイルは存在しないため、共有メモリオブジェクトを開く。
+		fd_ret = ::open( make_hugetlbfs_path( page_cfg.hugetlbfs_dir_, shm_name ).c_str(), O_RDWR | O_CLOEXEC );
+	}
 	if ( fd_ret < 0 ) {
-		auto cur_errno = errno;
-		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to open shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
-		return false;
+		// 共有メモリオブジェクトを開くために、shm_openを呼び出す
+		fd_ret = shm_open( shm_name.c_str(), O_RDWR, mode );
+		if ( fd_ret < 0 ) {
+			auto cur_errno = errno;
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to open shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+			return false;
+		}
 	}
 
-	// sysconf(_SC_PAGESIZE)で、ページサイズを取得して、lengthをページサイズの倍数に切り上げる
-	size_t aligned_length = roundup_to_page_size( length );
+	// ページサイズは、作成したプロセスの指定に依らず、開いたオブジェクトのファイルシステムから検出する。
+	struct statfs fs_info;
+	const bool    is_hugetlbfs = ( fstatfs( fd_ret, &fs_info ) == 0 ) && ( fs_info.f_type == HUGETLBFS_MAGIC );
+	const size_t  page_size    = is_hugetlbfs ? static_cast<size_t>( fs_info.f_bsize ) : get_system_page_size();
+
+	// lengthをページサイズの倍数に切り上げる。
+	// 作成したプロセスがヒュージページのサイズに切り上げている場合があるため、オブジェクトの大きさの方が大きい場合は、オブジェクト全体をマッピングする。
+	size_t      aligned_length = roundup_to_page_size( length, page_size );
+	struct stat st_info;
+	if ( ( fstat( fd_ret, &st_info ) == 0 ) && ( static_cast<size_t>( st_info.st_size ) > aligned_length ) ) {
+		aligned_length = static_cast<size_t>( st_info.st_size );
+	}
 
 	// 共有メモリをマッピングするために、mmapを呼び出す
-	void* p_addr_ret = mmap( nullptr, aligned_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_ret, 0 );
-	if ( p_addr_ret == MAP_FAILED ) {
-		auto cur_errno = errno;
-		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+	try {
+		map_fd( fd_ret, aligned_length, reserve_length, p_fixed_addr, page_size, is_populated_by_mmap( page_cfg, is_hugetlbfs ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( e.code() ).c_str() );
 		close( fd_ret );
 		return false;
 	}
 
-	fd_     = fd_ret;
-	p_addr_ = p_addr_ret;
-	length_ = aligned_length;
+	fd_           = fd_ret;
+	is_hugetlbfs_ = is_hugetlbfs;
+	apply_page_config( page_cfg );
 
 	return true;
 }
 
-void shm_guard::create( const std::string& shm_name, size_t length, mode_t mode )
+void shm_guard::create( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length, void* p_fixed_addr, const shm_page_config& page_cfg )
 {
 	if ( shm_name.empty() ) {
 		throw std::invalid_argument( "shared memory name is empty" );
@@ -230,6 +603,16 @@ void shm_guard::create( const std::string& shm_name, size_t length, mode_t mode
 		throw std::invalid_argument( "shared memory length is too large" );
 	}
 
+	if ( page_cfg.type_ == ipsm_mem::page_type::hugetlbfs ) {
+		if ( try_create_on_hugetlbfs( shm_name, length, mode, reserve_length, p_fixed_addr, page_cfg ) ) {
+			// 前回の使用時に、フォールバックして作成された共有メモリオブジェクトが残っている場合は削除する。
+			shm_unlink( shm_name.c_str() );
+			apply_page_config( page_cfg );
+			return;
+		}
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "hugetlbfs is not available for %s, fall back to transparent huge pages", shm_name.c_str() );
+	}
+
 	// 共有メモリオブジェクトを作成するために、shm_openを呼び出す
 	// O_CREAT | O_TRUNCを指定して、共有メモリオブジェクトを作成する。すでに同名の共有メモリオブジェクトが存在する場合は、サイズをゼロに切り詰めて作り直しができるようにする。
 	int fd_ret = shm_open( shm_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, mode );
@@ -239,8 +622,9 @@ void shm_guard::create( const std::string& shm_name, size_t length, mode_t mode
 		throw ipsm::ipsm_mem_error( cur_errno, "failed to create shared memory object: " + shm_name );
 	}
 
-	// sysconf(_SC_PAGESIZE)で、ページサイズを取得して、lengthをページサイズの倍数に切り上げる
-	size_t aligned_length = roundup_to_page_size( length );
+	// lengthをページサイズの倍数に切り上げる。ヒュージページを要求された場合は、透過的ヒュージページで埋められるように、ヒュージページのサイズに切り上げる。
+	const size_t page_size      = ( page_cfg.type_ == ipsm_mem::page_type::normal ) ? get_system_page_size() : get_huge_page_size();
+	const size_t aligned_length = roundup_to_page_size( length, page_size );
 
 	// 共有メモリのサイズを設定するために、ftruncateを呼び出す
 	int ret = ftruncate( fd_ret, static_cast<off_t>( aligned_length ) );
@@ -252,27 +636,224 @@ void shm_guard::create( const std::string& shm_name, size_t length, mode_t mode
 	}
 
 	// 共有メモリをマッピングするために、mmapを呼び出す
-	void* p_addr_ret = mmap( nullptr, aligned_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_ret, 0 );
-	if ( p_addr_ret == MAP_FAILED ) {
+	try {
+		map_fd( fd_ret, aligned_length, reserve_length, p_fixed_addr, page_size, is_populated_by_mmap( page_cfg, false ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( e.code() ).c_str() );
+		close( fd_ret );
+		throw ipsm::ipsm_mem_error( e.code(), "failed to map shared memory object: " + shm_name );
+	}
+
+	fd_           = fd_ret;
+	is_hugetlbfs_ = false;
+	apply_page_config( page_cfg );
+}
+
+void shm_guard::create_file( const std::string& path, size_t length, mode_t mode, bool is_truncate, const shm_page_config& page_cfg )
+{
+	if ( path.empty() ) {
+		throw std::invalid_argument( "file path is empty" );
+	}
+	if ( length == 0 ) {
+		throw std::invalid_argument( "shared memory length is zero" );
+	}
+	if ( length > static_cast<size_t>( std::numeric_limits<off_t>::max() ) ) {
+		throw std::invalid_argument( "shared memory length is too large" );
+	}
+
+	// create()と異なり、O_TRUNCは、作り直す場合にのみ指定する。既存のファイルの内容を引き継ぐことができる。
+	int fd_ret = ::open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW | ( is_truncate ? O_TRUNC : 0 ), mode );
+	if ( fd_ret < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to create file: %s, error: %s", path.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to create file: " + path );
+	}
+
+	const size_t page_size      = get_system_page_size();
+	const size_t aligned_length = roundup_to_page_size( length, page_size );
+
+	// ファイルの大きさが異なる場合は、マッピングの範囲外へのアクセスとならないように、大きさを揃える。
+	struct stat st_info;
+	if ( ( fstat( fd_ret, &st_info ) != 0 ) || ( static_cast<size_t>( st_info.st_size ) != aligned_length ) ) {
+		if ( ftruncate( fd_ret, static_cast<off_t>( aligned_length ) ) != 0 ) {
+			auto cur_errno = errno;
+			psm_logoutput( ipsm::psm_log_lv::kErr, "failed to set size of file: %s, error: %s", path.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+			close( fd_ret );
+			throw ipsm::ipsm_mem_error( cur_errno, "failed to set size of file: " + path );
+		}
+	}
+
+	try {
+		map_fd( fd_ret, aligned_length, 0, nullptr, page_size, is_populated_by_mmap( page_cfg, false ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map file: %s, error: %s", path.c_str(), ipsm::make_strerror( e.code() ).c_str() );
+		close( fd_ret );
+		throw ipsm::ipsm_mem_error( e.code(), "failed to map file: " + path );
+	}
+
+	fd_           = fd_ret;
+	is_hugetlbfs_ = false;
+	apply_page_config( page_cfg );
+}
+
+bool shm_guard::open_file( const std::string& path, size_t length, const shm_page_config& page_cfg )
+{
+	if ( path.empty() ) {
+		throw std::invalid_argument( "file path is empty" );
+	}
+	if ( length == 0 ) {
+		throw std::invalid_argument( "shared memory length is zero" );
+	}
+
+	int fd_ret = ::open( path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW );
+	if ( fd_ret < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to open file: %s, error: %s", path.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		return false;
+	}
+
+	const size_t page_size      = get_system_page_size();
+	size_t       aligned_length = roundup_to_page_size( length, page_size );
+	struct stat  st_info;
+	if ( ( fstat( fd_ret, &st_info ) == 0 ) && ( static_cast<size_t>( st_info.st_size ) > aligned_length ) ) {
+		aligned_length = static_cast<size_t>( st_info.st_size );
+	}
+
+	try {
+		map_fd( fd_ret, aligned_length, 0, nullptr, page_size, is_populated_by_mmap( page_cfg, false ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map file: %s, error: %s", path.c_str(), ipsm::make_strerror( e.code() ).c_str() );
+		close( fd_ret );
+		return false;
+	}
+
+	fd_           = fd_ret;
+	is_hugetlbfs_ = false;
+	apply_page_config( page_cfg );
+
+	return true;
+}
+
+void shm_guard::attach_fd( int fd, const shm_page_config& page_cfg )
+{
+	if ( fd < 0 ) {
+		throw std::invalid_argument( "file descriptor of shared memory is invalid" );
+	}
+
+	// 受け取ったオブジェクトの大きさは、作成したプロセスが決定しているため、オブジェクト全体をマッピングする。
+	struct stat st_info;
+	if ( fstat( fd, &st_info ) != 0 ) {
+		auto cur_errno = errno;
+		close( fd );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to get size of shared memory object" );
+	}
+	if ( st_info.st_size <= 0 ) {
+		close( fd );
+		throw ipsm::ipsm_mem_error( EINVAL, "shared memory object is empty" );
+	}
+	const size_t page_size      = get_system_page_size();
+	const size_t aligned_length = roundup_to_page_size( static_cast<size_t>( st_info.st_size ), page_size );
+
+	try {
+		map_fd( fd, aligned_length, 0, nullptr, page_size, is_populated_by_mmap( page_cfg, false ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map shared memory object of fd=%d, error: %s", fd, ipsm::make_strerror( e.code() ).c_str() );
+		close( fd );
+		throw;
+	}
+
+	fd_           = fd;
+	is_hugetlbfs_ = false;
+	apply_page_config( page_cfg );
+}
+
+bool shm_guard::try_create_on_hugetlbfs( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length, void* p_fixed_addr, const shm_page_config& page_cfg )
+{
+	const std::string path   = make_hugetlbfs_path( page_cfg.hugetlbfs_dir_, shm_name );
+	int               fd_ret = ::open( path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, mode );
+	if ( fd_ret < 0 ) {
 		auto cur_errno = errno;
-		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to map shared memory object: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "failed to create the file on hugetlbfs: %s, error: %s", path.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		return false;
+	}
+
+	struct statfs fs_info;
+	if ( ( fstatfs( fd_ret, &fs_info ) != 0 ) || ( fs_info.f_type != HUGETLBFS_MAGIC ) ) {
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "the file is not on hugetlbfs: %s", path.c_str() );
+		close( fd_ret );
+		::unlink( path.c_str() );
+		return false;
+	}
+	const size_t page_size      = static_cast<size_t>( fs_info.f_bsize );
+	const size_t aligned_length = roundup_to_page_size( length, page_size );
+
+	// 予約済みのヒュージページが不足している場合、ftruncate()は成功し、mmap()がENOMEMで失敗する。
+	try {
+		if ( ftruncate( fd_ret, static_cast<off_t>( aligned_length ) ) != 0 ) {
+			auto cur_errno = errno;
+			throw ipsm::ipsm_mem_error( cur_errno, "failed to set size of the file on hugetlbfs" );
+		}
+		map_fd( fd_ret, aligned_length, reserve_length, p_fixed_addr, page_size, is_populated_by_mmap( page_cfg, true ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "failed to map the file on hugetlbfs: %s, error: %s", path.c_str(), ipsm::make_strerror( e.code() ).c_str() );
 		close( fd_ret );
-		throw ipsm::ipsm_mem_error( cur_errno, "failed to map shared memory object: " + shm_name );
+		::unlink( path.c_str() );
+		return false;
 	}
 
-	fd_     = fd_ret;
-	p_addr_ = p_addr_ret;
-	length_ = aligned_length;
+	fd_           = fd_ret;
+	is_hugetlbfs_ = true;
+	return true;
 }
 
 // ==============================================================================
 struct ipsm_mem_header {
+	struct chained_segment_info {
+		size_t offset_;   // ヘッダ領域の先頭からチェーンセグメントの先頭までのオフセット
+		size_t length_;   // チェーンセグメントのマッピングサイズ
+	};
+
+	enum class owner_state : int {
+		kFree = 0,   // 未使用のエントリ
+		kAttached,   // インスタンスが使用中。プロセスが終了している場合は、回収の対象となる。
+		kDetached,   // インスタンスは破棄済み。回収の対象となる。
+	};
+	struct owner_entry {
+		owner_state        state_;        // エントリの状態
+		pid_t              pid_;          // 登録したプロセスのプロセスID
+		unsigned long long start_time_;   // 登録したプロセスの起動時刻。プロセスIDの再利用の検出に使用する。取得できなかった場合は0
+	};
+
+	// 永続化モードで、前回の内容を引き継げるかを判定するための情報。ヘッダのレイアウトが変わっても判定できるように、先頭に配置する。
+	struct persistent_info {
+		std::uint64_t              magic_;               // 永続化モードで初期化済みの場合、persistent_magic。それ以外は0
+		std::uint64_t              header_size_;         // 初期化したプロセスのsizeof(ipsm_mem_header)。ヘッダのレイアウトの変更を検出する。
+		std::uint64_t              layout_version_;      // 初期化したプロセスが指定した、内容のレイアウトのバージョン
+		std::uint64_t              length_;              // 初期化したプロセスのマッピングの大きさ
+		std::atomic<std::uint32_t> is_clean_shutdown_;   // 最後のインスタンスが、内容をファイルに書き出してから破棄された場合、1。使用中、あるいは異常終了した場合は0
+	};
+	static constexpr std::uint64_t persistent_magic = 0x4950'534D'5045'5253UL;   // "IPSMPERS"
+
+	persistent_info               persistent_;
 	std::atomic<ipsm_mem::status> status_;
-	std::atomic<std::uintptr_t>   sharing_value_;   // 共有メモリの初期化後、共有ロックでオープンしたプロセスと共有する値。共有ロックでオープンしたプロセスは、この値を参照して、共有メモリの使用開始処理に反映する。
-
-	ipsm_mem_header()
-	  : status_( ipsm_mem::status::initializing )
+	std::atomic<std::uintptr_t>   sharing_value_;                                             // 共有メモリの初期化後、共有ロックでオープンしたプロセスと共有する値。共有ロックでオープンしたプロセスは、この値を参照して、共有メモリの使用開始処理に反映する。
+	size_t                        page_size_;                                                 // 共有メモリを作成したプロセスが決定したページサイズ。チェーンセグメントの大きさは、このページサイズの倍数とする。
+	ipsm_mutex                    chained_mtx_;                                               // チェーンセグメントの追加を、プロセス間で排他するためのミューテックス
+	std::atomic<size_t>           num_of_chained_segments_;                                   // 追加済みのチェーンセグメントの数。chained_segments_の[0, num_of_chained_segments_)は変更されない。
+	chained_segment_info          chained_segments_[ipsm_mem::max_num_of_chained_segments];   // チェーンセグメントの配置情報
+	ipsm_mutex                    owners_mtx_;                                                // プロセステーブルのアクセスを、プロセス間で排他するためのミューテックス
+	owner_entry                   owners_[ipsm_mem::max_num_of_owners];                       // プロセステーブル
+
+	explicit ipsm_mem_header( size_t page_size )
+	  : persistent_ {}
+	  , status_( ipsm_mem::status::initializing )
 	  , sharing_value_( 0 )
+	  , page_size_( page_size )
+	  , chained_mtx_()
+	  , num_of_chained_segments_( 0 )
+	  , chained_segments_ {}
+	  , owners_mtx_()
+	  , owners_ {}
 	{
 	}
 
@@ -291,15 +872,27 @@ struct ipsm_mem_header {
 // ==============================================================================
 ipsm_mem::impl::~impl()
 {
+	// バックグラウンドのプリフォルトは、マッピングを解除する前に中止させる。
+	prefault_cancel_.store( true, std::memory_order_release );
+	if ( prefault_thread_.joinable() ) {
+		prefault_thread_.join();
+	}
+
 	try {
+		unregister_owner();
 		shared_lock_guard_.release_lock();
 
 		lock_file_guard exclusive_lock_guard( lifetime_ctrl_fname_, mode_ );
 		if ( exclusive_lock_guard.try_exclusive_lock() ) {
 			// 排他ロックが確保できた場合、このプロセスが最後のプロセスであることを示す。
-			// よって、共有メモリオブジェクトを削除する。
+			// よって、共有メモリオブジェクトを削除する。永続化モードの場合は、ファイルを残し、次回の起動時に引き継げるように正常終了を記録する。
 			// psm_logoutput( ipsm::psm_log_lv::kInfo, "This process is last process for shared memory: %s, unlinking that shared memory.", shm_name_.c_str() );
-			shm_unlink( shm_name_.c_str() );
+			if ( is_persistent_ ) {
+				mark_clean_shutdown();
+			} else {
+				shm_guard::unlink( shm_name_, page_cfg_ );
+				unlink_chained_segments();
+			}
 		}
 	} catch ( const std::exception& e ) {
 		psm_logoutput( ipsm::psm_log_lv::kErr, "exception in ipsm_mem::impl destructor: %s", e.what() );
@@ -315,53 +908,106 @@ ipsm_mem::impl::impl(
 	mode_t                                         mode,
 	std::function<std::uintptr_t( void*, size_t )> creater_init_functor_arg,
 	int                                            timeout_msec,
-	int                                            retry_interval_msec )
+	int                                            retry_interval_msec,
+	size_t                                         max_length,
+	const shm_page_config&                         page_cfg,
+	bool                                           is_persistent,
+	std::uint64_t                                  layout_version,
+	std::function<void( void*, size_t )>           reattach_functor )
   : shm_name_( p_shm_name )
   , lifetime_ctrl_fname_( p_lifetime_ctrl_fname )
   , req_length_( length )
   , mode_( mode )
+  , page_cfg_( page_cfg )
+  , is_persistent_( is_persistent )
+  , layout_version_( layout_version )
+  , is_reattached_( false )
   , shared_lock_guard_( lifetime_ctrl_fname_, mode )
+  , broker_conn_()
   , shm_guard_()
   , shm_length_( 0 )
   , available_length_( 0 )
+  , owner_id_( 0 )
+  , is_owner_id_published_( false )
+  , prefault_cancel_( false )
+  , prefault_thread_()
+  , chained_mtx_()
+  , num_of_attached_( 0 )
+  , chained_guards_ {}
 {
 	const size_t nessesary_size     = req_length_ + sizeof( ipsm_mem_header );
 	const auto   timeout_time_point = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout_msec );
 
 	while ( true ) {
 		shm_guard shm_create_guard;
+		is_reattached_ = false;
 
 		// 排他ロックの取得を試みる。排他ロックを取得出来た場合、このプロセスが共有メモリの初期化を行うプロセスとなる。
 		{
 			lock_file_guard exclusive_lock_guard( lifetime_ctrl_fname_, mode_ );
 			if ( exclusive_lock_guard.try_exclusive_lock() ) {
 				// 共有メモリの初期化を行うプロセスの場合、共有メモリを作成してマッピングする
-				shm_create_guard.create( shm_name_, nessesary_size, mode_ );
-
-				// 共有メモリのヘッダ領域の初期化
-				ipsm_mem_header* p_header = new ( shm_create_guard.get() ) ipsm_mem_header();
-
-				// ヘッダ領域の後ろに配置される領域の初期化を、init_functor_argで指定された関数オブジェクトを呼び出す形で実装する。
-				std::uintptr_t addr               = reinterpret_cast<std::uintptr_t>( p_header ) + sizeof( ipsm_mem_header );
-				size_t         cur_available_size = shm_create_guard.mmap_length() - sizeof( ipsm_mem_header );
-				std::uintptr_t hint_value         = creater_init_functor_arg( reinterpret_cast<void*>( addr ), cur_available_size );
+				if ( is_persistent_ ) {
+					// 前回の内容を引き継げない場合は、ファイルを切り詰めて作り直す。
+					shm_create_guard.create_file( shm_name_, nessesary_size, mode_, false, page_cfg_ );
+					is_reattached_ = can_reattach( shm_create_guard );
+					if ( !is_reattached_ ) {
+						shm_create_guard = shm_guard();
+						shm_create_guard.create_file( shm_name_, nessesary_size, mode_, true, page_cfg_ );
+					}
+				} else {
+					shm_create_guard.create( shm_name_, nessesary_size, mode_, 0, nullptr, page_cfg_ );
+					unlink_chained_segments();   // 前回の使用時に削除されずに残ったチェーンセグメントを削除する
+				}
 
-				// 共有メモリの初期化処理が完了したら、ヘッダ領域とその後ろの領域で消費されたサイズを指定して、readyに変更する。
-				p_header->set_ready_with_sharing_value( hint_value );
+				if ( is_reattached_ ) {
+					// 前回の内容とヒントの値をそのまま使用するため、init_functor_argは呼び出さない。
+					// 先に使用中であることを記録しておくことで、reattach_functorが失敗した場合は、次回の起動時に作り直される。
+					ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_create_guard.get() );
+					mark_in_use( shm_create_guard );
+					reset_owners( shm_create_guard );
+					if ( reattach_functor ) {
+						std::uintptr_t addr = reinterpret_cast<std::uintptr_t>( p_header ) + sizeof( ipsm_mem_header );
+						reattach_functor( reinterpret_cast<void*>( addr ), shm_create_guard.mmap_length() - sizeof( ipsm_mem_header ) );
+					}
+					p_header->status_.store( ipsm_mem::status::ready, std::memory_order_release );
+				} else {
+					// 共有メモリのヘッダ領域の初期化
+					ipsm_mem_header* p_header = new ( shm_create_guard.get() ) ipsm_mem_header( shm_create_guard.page_size() );
+
+					// ヘッダ領域の後ろに配置される領域の初期化を、init_functor_argで指定された関数オブジェクトを呼び出す形で実装する。
+					std::uintptr_t addr               = reinterpret_cast<std::uintptr_t>( p_header ) + sizeof( ipsm_mem_header );
+					size_t         cur_available_size = shm_create_guard.mmap_length() - sizeof( ipsm_mem_header );
+					std::uintptr_t hint_value         = creater_init_functor_arg( reinterpret_cast<void*>( addr ), cur_available_size );
+
+					if ( is_persistent_ ) {
+						mark_in_use( shm_create_guard );
+					}
+
+					// 共有メモリの初期化処理が完了したら、ヘッダ領域とその後ろの領域で消費されたサイズを指定して、readyに変更する。
+					p_header->set_ready_with_sharing_value( hint_value );
+				}
 			}
 		}
 		{
 			// 共有ロックの取得を試みる。共有ロックを取得出来た場合、共有メモリの初期化を行うプロセスが初期化処理を完了していることを示す。
-			while ( !shared_lock_guard_.try_shared_lock() ) {
-				std::this_thread::sleep_for( std::chrono::milliseconds( retry_interval_msec ) );
-				if ( std::chrono::steady_clock::now() > timeout_time_point ) {
+			// 取得できない場合は、初期化を行うプロセスが排他ロックを解放した時点で起床する。retry_interval_msecは、通知を受けられない場合の待ち時間の上限となる。
+			while ( true ) {
+				std::uint32_t unlock_gen = shared_lock_guard_.get_unlock_generation();
+				if ( shared_lock_guard_.try_shared_lock() ) {
+					break;
+				}
+				auto now = std::chrono::steady_clock::now();
+				if ( now > timeout_time_point ) {
 					throw ipsm::ipsm_mem_error( ETIMEDOUT, "timeout while waiting for shared memory initialization: " + shm_name_ );
 				}
+				auto remaining_msec = std::chrono::duration_cast<std::chrono::milliseconds>( timeout_time_point - now ).count() + 1;
+				shared_lock_guard_.wait_for_unlock( unlock_gen, static_cast<int>( std::min<decltype( remaining_msec )>( retry_interval_msec, remaining_msec ) ) );
 			}
 
 			// 共有ロックの取得に成功した場合、共有メモリのオープンと状態の確認を行う
 			// 共有メモリのオープンに失敗した場合、共有メモリの初期化を行うプロセスが初期化処理中にプロセスが終了したことを示す。
-			bool ret = shm_guard_.open( shm_name_, nessesary_size, mode_ );
+			bool ret = is_persistent_ ? shm_guard_.open_file( shm_name_, nessesary_size, page_cfg_ ) : shm_guard_.open( shm_name_, nessesary_size, mode_, max_length, nullptr, page_cfg_ );
 			if ( !ret ) {
 				shared_lock_guard_.release_lock();
 				psm_logoutput( ipsm::psm_log_lv::kInfo, "Because fail to open shared memory, retry setup of %s", shm_name_.c_str() );
@@ -383,22 +1029,202 @@ ipsm_mem::impl::impl(
 		}
 	}
 
-	shm_length_       = shm_guard_.mmap_length();
-	available_length_ = shm_length_ - sizeof( ipsm_mem_header );
+	complete_setup();
 }
 
-void* ipsm_mem::impl::get( void ) const
+ipsm_mem::impl::impl(
+	const char*                                    p_broker_name,
+	const char*                                    p_shm_name,
+	size_t                                         length,
+	std::function<std::uintptr_t( void*, size_t )> creater_init_functor_arg,
+	int                                            timeout_msec,
+	int                                            retry_interval_msec,
+	const shm_page_config&                         page_cfg )
+  : shm_name_( p_shm_name )
+  , lifetime_ctrl_fname_()
+  , req_length_( length )
+  , mode_( 0 )
+  , page_cfg_( page_cfg )
+  , is_persistent_( false )
+  , layout_version_( 0 )
+  , is_reattached_( false )
+  , shared_lock_guard_( lifetime_ctrl_fname_, 0 )
+  , broker_conn_()
+  , shm_guard_()
+  , shm_length_( 0 )
+  , available_length_( 0 )
+  , owner_id_( 0 )
+  , is_owner_id_published_( false )
+  , prefault_cancel_( false )
+  , prefault_thread_()
+  , chained_mtx_()
+  , num_of_attached_( 0 )
+  , chained_guards_ {}
 {
-	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
-	if ( p_header == nullptr ) {
-		return nullptr;
-	}
-	std::uintptr_t addr = reinterpret_cast<std::uintptr_t>( p_header );
-	addr += sizeof( ipsm_mem_header );
-	return reinterpret_cast<void*>( addr );
-}
-
-size_t ipsm_mem::impl::available_size( void ) const
+	// ライフタイム制御ファイルは使用しない。空のファイル名のlock_file_guardはロックを取得できないため、デストラクタでの共有メモリの削除も行われない。
+	// セグメントは、ブローカーとの接続がすべて切断され、最後のマッピングが解除された時点で、カーネルによって解放される。
+	const size_t nessesary_size     = req_length_ + sizeof( ipsm_mem_header );
+	const auto   timeout_time_point = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout_msec );
+	auto         get_remaining_msec = [&timeout_time_point]() -> int {
+		auto now = std::chrono::steady_clock::now();
+		if ( now > timeout_time_point ) {
+			throw ipsm::ipsm_mem_error( ETIMEDOUT, "timeout while waiting for memfd broker or shared memory initialization" );
+		}
+		return static_cast<int>( std::chrono::duration_cast<std::chrono::milliseconds>( timeout_time_point - now ).count() + 1 );
+	};
+
+	while ( true ) {
+		memfd_broker_connection conn;
+		if ( !conn.connect( p_broker_name ) ) {
+			// ブローカーが起動していない場合は、起動を待つ。
+			std::this_thread::sleep_for( std::chrono::milliseconds( std::min( retry_interval_msec, get_remaining_msec() ) ) );
+			continue;
+		}
+
+		bool is_creator = false;
+		int  fd         = conn.request_segment( shm_name_, nessesary_size, is_creator, get_remaining_msec() );
+		if ( fd < 0 ) {
+			psm_logoutput( ipsm::psm_log_lv::kInfo, "Because memfd broker closes the connection, retry setup of %s", shm_name_.c_str() );
+			continue;
+		}
+		shm_guard shm_attach_guard;
+		shm_attach_guard.attach_fd( fd, page_cfg_ );
+		ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_attach_guard.get() );
+
+		if ( is_creator ) {
+			// 新たに作成されたセグメントは、ゼロで埋められている。ヘッダ領域とその後ろの領域を初期化してから、ブローカー経由で待っているプロセスに通知する。
+			p_header = new ( shm_attach_guard.get() ) ipsm_mem_header( shm_attach_guard.page_size() );
+
+			std::uintptr_t addr               = reinterpret_cast<std::uintptr_t>( p_header ) + sizeof( ipsm_mem_header );
+			size_t         cur_available_size = shm_attach_guard.mmap_length() - sizeof( ipsm_mem_header );
+			std::uintptr_t hint_value         = creater_init_functor_arg( reinterpret_cast<void*>( addr ), cur_available_size );
+
+			p_header->set_ready_with_sharing_value( hint_value );
+			conn.notify_ready();
+		} else {
+			// 初期化を行うプロセスの完了を、ブローカーからの通知で待つ。retry_interval_msecは、通知を受けられない場合の待ち時間の上限となる。
+			bool is_discarded = false;
+			while ( p_header->get_status() != ipsm_mem::status::ready ) {
+				if ( !conn.wait_for_notification( std::min( retry_interval_msec, get_remaining_msec() ) ) ) {
+					is_discarded = true;
+					break;
+				}
+			}
+			if ( is_discarded ) {
+				// 初期化を行うプロセスが、初期化の途中で終了したため、ブローカーがセグメントを破棄した。新たなセグメントで、最初からやり直す。
+				psm_logoutput( ipsm::psm_log_lv::kInfo, "Because memfd broker discards the segment during initialization, retry setup of %s", shm_name_.c_str() );
+				continue;
+			}
+		}
+
+		shm_guard_   = std::move( shm_attach_guard );
+		broker_conn_ = std::move( conn );
+		break;
+	}
+
+	complete_setup();
+}
+
+void ipsm_mem::impl::complete_setup( void )
+{
+	shm_length_       = shm_guard_.mmap_length();
+	available_length_ = shm_length_ - sizeof( ipsm_mem_header );
+	owner_id_         = register_owner();
+
+	if ( page_cfg_.prefault_ == ipsm_mem::prefault_type::background ) {
+		// 共有メモリはready状態になっているため、呼び出し元を待たせずに、このプロセスのマッピングをプリフォルトする。
+		prefault_thread_ = std::thread( [this]() {
+			shm_guard_.prefault( 1, &prefault_cancel_ );
+		} );
+	}
+}
+
+bool ipsm_mem::impl::can_reattach( const shm_guard& guard ) const
+{
+	// 前回の最後のインスタンスが内容を書き出して破棄され、かつ、ヘッダと内容のレイアウトが同じ場合にのみ、引き継ぐ。
+	// 使用中に異常終了した場合は、ヒープ等の内容が不整合となっている可能性があるため、引き継がない。
+	const ipsm_mem_header::persistent_info& info = reinterpret_cast<const ipsm_mem_header*>( guard.get() )->persistent_;
+	if ( info.magic_ != ipsm_mem_header::persistent_magic ) {
+		if ( info.magic_ != 0 ) {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "file is not initialized as persistent shared memory: %s", shm_name_.c_str() );
+		}
+		return false;   // 新たに作成したファイルの場合は、0で埋められている。
+	}
+	if ( ( info.header_size_ != sizeof( ipsm_mem_header ) ) || ( info.layout_version_ != layout_version_ ) || ( info.length_ != guard.mmap_length() ) ) {
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "layout of persistent shared memory is changed: %s, layout version=%llu(recorded %llu), length=%zu(recorded %llu)",
+		               shm_name_.c_str(),
+		               static_cast<unsigned long long>( layout_version_ ), static_cast<unsigned long long>( info.layout_version_ ),
+		               guard.mmap_length(), static_cast<unsigned long long>( info.length_ ) );
+		return false;
+	}
+	if ( info.is_clean_shutdown_.load( std::memory_order_acquire ) != 1 ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "persistent shared memory was not detached cleanly. it is reinitialized: %s", shm_name_.c_str() );
+		return false;
+	}
+	return true;
+}
+
+void ipsm_mem::impl::reset_owners( const shm_guard& guard ) const
+{
+	// 前回のプロセステーブルのエントリは、すべて破棄済みの状態となっている。残しておくと、reclaim_dead_owners()で前回の資源が回収されてしまうため、すべて解放する。
+	// 前回のオーナーIDでタグ付けされた資源は、reattach_functorでタグを消す。
+	ipsm_mem_header*            p_header = reinterpret_cast<ipsm_mem_header*>( guard.get() );
+	std::lock_guard<ipsm_mutex> lk( p_header->owners_mtx_ );
+	for ( auto& entry : p_header->owners_ ) {
+		entry.state_ = ipsm_mem_header::owner_state::kFree;
+	}
+}
+
+void ipsm_mem::impl::mark_in_use( const shm_guard& guard ) const
+{
+	ipsm_mem_header::persistent_info& info = reinterpret_cast<ipsm_mem_header*>( guard.get() )->persistent_;
+	info.magic_                            = ipsm_mem_header::persistent_magic;
+	info.header_size_                      = sizeof( ipsm_mem_header );
+	info.layout_version_                   = layout_version_;
+	info.length_                           = guard.mmap_length();
+	info.is_clean_shutdown_.store( 0, std::memory_order_release );
+
+	// OSが停止した場合にも、前回の正常終了の記録が残らないように、使用中であることをファイルに書き出す。
+	if ( msync( guard.get(), sizeof( ipsm_mem_header ), MS_SYNC ) != 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to sync header of persistent shared memory: %s, error: %s", shm_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+	}
+}
+
+void ipsm_mem::impl::mark_clean_shutdown( void ) const
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		return;
+	}
+
+	// 内容をファイルに書き出してから、正常終了を記録する。書き出しに失敗した場合は記録せず、次回の起動時に作り直させる。
+	if ( msync( shm_guard_.get(), shm_guard_.mmap_length(), MS_SYNC ) != 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to sync persistent shared memory: %s, error: %s", shm_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		return;
+	}
+	// 終了処理中に起動したプロセスが、セカンダリとして使用を開始しないように、readyを取り消す。そのプロセスは、排他ロックの取得からやり直し、内容を引き継ぐ。
+	p_header->status_.store( ipsm_mem::status::initializing, std::memory_order_release );
+	p_header->persistent_.is_clean_shutdown_.store( 1, std::memory_order_release );
+	if ( msync( shm_guard_.get(), sizeof( ipsm_mem_header ), MS_SYNC ) != 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to sync header of persistent shared memory: %s, error: %s", shm_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+	}
+}
+
+void* ipsm_mem::impl::get( void ) const
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		return nullptr;
+	}
+	std::uintptr_t addr = reinterpret_cast<std::uintptr_t>( p_header );
+	addr += sizeof( ipsm_mem_header );
+	return reinterpret_cast<void*>( addr );
+}
+
+size_t ipsm_mem::impl::available_size( void ) const
 {
 	return available_length_;
 }
@@ -424,6 +1250,224 @@ std::uintptr_t ipsm_mem::impl::get_hint_value( void ) const
 	return p_header->sharing_value_.load( std::memory_order_acquire );
 }
 
+std::string ipsm_mem::impl::make_chained_segment_name( size_t idx ) const
+{
+	return shm_name_ + "." + std::to_string( idx + 1 );
+}
+
+void ipsm_mem::impl::unlink_chained_segments( void ) const
+{
+	// チェーンセグメントは、番号順に追加されるため、存在しない番号が見つかった時点で終了する。
+	for ( size_t i = 0; i < ipsm_mem::max_num_of_chained_segments; i++ ) {
+		if ( !shm_guard::unlink( make_chained_segment_name( i ), page_cfg_ ) ) {
+			break;
+		}
+	}
+}
+
+bool ipsm_mem::impl::add_chained_segment( size_t length, const std::function<void( void*, size_t )>& init_functor_arg )
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "shared memory is not allocated" );
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lk_local( chained_mtx_ );
+	std::lock_guard<ipsm_mutex> lk( p_header->chained_mtx_ );
+
+	size_t num_of_segments = p_header->num_of_chained_segments_.load( std::memory_order_acquire );
+	if ( num_of_segments > num_of_attached_.load( std::memory_order_acquire ) ) {
+		// 他のプロセスが追加したチェーンセグメントを、新たなセグメントとして利用する。
+		return attach_chained_segments_nolock() > 0;
+	}
+	if ( num_of_segments >= ipsm_mem::max_num_of_chained_segments ) {
+		psm_logoutput( ipsm::psm_log_lv::kDebug, "number of chained segments reaches the limit: %s", shm_name_.c_str() );
+		return false;
+	}
+
+	const size_t offset = ( num_of_segments == 0 ) ? shm_length_ : ( p_header->chained_segments_[num_of_segments - 1].offset_ + p_header->chained_segments_[num_of_segments - 1].length_ );
+	const size_t aligned_length = roundup_to_page_size( length, p_header->page_size_ );
+	if ( ( aligned_length < length ) || ( offset > shm_guard_.reserved_length() ) || ( aligned_length > ( shm_guard_.reserved_length() - offset ) ) ) {
+		psm_logoutput( ipsm::psm_log_lv::kDebug, "reserved virtual address range has no room for the chained segment: %s, length=%zu", shm_name_.c_str(), length );
+		return false;
+	}
+
+	shm_guard   new_guard;
+	std::string name   = make_chained_segment_name( num_of_segments );
+	void*       p_addr = reinterpret_cast<void*>( reinterpret_cast<std::uintptr_t>( p_header ) + offset );
+	new_guard.create( name, aligned_length, mode_, 0, p_addr, page_cfg_ );
+	prefault_chained_segment( new_guard );
+	init_functor_arg( new_guard.get(), new_guard.mmap_length() );
+
+	// 初期化が完了してから、他のプロセスに公開する。
+	p_header->chained_segments_[num_of_segments].offset_ = offset;
+	p_header->chained_segments_[num_of_segments].length_ = new_guard.mmap_length();
+	p_header->num_of_chained_segments_.store( num_of_segments + 1, std::memory_order_release );
+
+	chained_guards_[num_of_segments] = std::move( new_guard );
+	num_of_attached_.store( num_of_segments + 1, std::memory_order_release );
+	return true;
+}
+
+size_t ipsm_mem::impl::attach_chained_segments( void )
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		return 0;
+	}
+	size_t num_of_attached = num_of_attached_.load( std::memory_order_acquire );
+	if ( p_header->num_of_chained_segments_.load( std::memory_order_acquire ) <= num_of_attached ) {
+		return num_of_attached;
+	}
+
+	std::lock_guard<std::mutex> lk_local( chained_mtx_ );
+	return attach_chained_segments_nolock();
+}
+
+size_t ipsm_mem::impl::attach_chained_segments_nolock( void )
+{
+	ipsm_mem_header* p_header        = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	size_t           num_of_segments = p_header->num_of_chained_segments_.load( std::memory_order_acquire );
+	size_t           i               = num_of_attached_.load( std::memory_order_acquire );
+	for ( ; i < num_of_segments; i++ ) {
+		const ipsm_mem_header::chained_segment_info& info = p_header->chained_segments_[i];
+		if ( ( info.offset_ > shm_guard_.reserved_length() ) || ( info.length_ > ( shm_guard_.reserved_length() - info.offset_ ) ) ) {
+			psm_logoutput( ipsm::psm_log_lv::kErr, "Error: chained segment is out of the reserved virtual address range of this process: %s, idx=%zu. max_length should be agreed between processes", shm_name_.c_str(), i );
+			break;
+		}
+		shm_guard   new_guard;
+		std::string name   = make_chained_segment_name( i );
+		void*       p_addr = reinterpret_cast<void*>( reinterpret_cast<std::uintptr_t>( p_header ) + info.offset_ );
+		if ( !new_guard.open( name, info.length_, mode_, 0, p_addr, page_cfg_ ) ) {
+			break;
+		}
+		prefault_chained_segment( new_guard );
+		chained_guards_[i] = std::move( new_guard );
+		num_of_attached_.store( i + 1, std::memory_order_release );
+	}
+	return i;
+}
+
+void ipsm_mem::impl::prefault_chained_segment( const shm_guard& guard ) const
+{
+	// チェーンセグメントは、ヒープの拡張時に追加されるため、バックグラウンドではなく、追加時に並列にプリフォルトする。
+	if ( page_cfg_.prefault_ == ipsm_mem::prefault_type::background ) {
+		guard.prefault( 0 );
+	}
+}
+
+unsigned int ipsm_mem::impl::register_owner( void )
+{
+	ipsm_mem_header*            p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	std::lock_guard<ipsm_mutex> lk( p_header->owners_mtx_ );
+
+	for ( size_t i = 0; i < ipsm_mem::max_num_of_owners; i++ ) {
+		ipsm_mem_header::owner_entry& entry = p_header->owners_[i];
+		if ( entry.state_ != ipsm_mem_header::owner_state::kFree ) {
+			continue;
+		}
+		char               state      = '\0';
+		unsigned long long start_time = 0;
+		if ( !read_process_stat( getpid(), state, start_time ) ) {
+			start_time = 0;
+		}
+		entry.pid_        = getpid();
+		entry.start_time_ = start_time;
+		entry.state_      = ipsm_mem_header::owner_state::kAttached;   // 途中で終了した場合に備えて、最後に状態を変更する。
+		return static_cast<unsigned int>( i + 1 );
+	}
+
+	psm_logoutput( ipsm::psm_log_lv::kWarn, "process table of shared memory is full: %s. the memory blocks of this instance are not reclaimed", shm_name_.c_str() );
+	return 0;
+}
+
+void ipsm_mem::impl::unregister_owner( void )
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( ( p_header == nullptr ) || ( owner_id_ == 0 ) ) {
+		return;
+	}
+	// オーナーIDを取得された場合は、そのIDで資源がタグ付けされている可能性がある。
+	// 他のプロセスが、このインスタンスの資源を回収してからエントリを解放するため、ここでは破棄済みの状態にするだけとする。
+	// 取得されていない場合は、回収する資源がないため、ここでエントリを解放する。解放しないと、reclaim_dead_owners()を呼び出さない利用者では、プロセステーブルが埋まってしまう。
+	std::lock_guard<ipsm_mutex> lk( p_header->owners_mtx_ );
+	p_header->owners_[owner_id_ - 1].state_ = is_owner_id_published_.load( std::memory_order_acquire ) ? ipsm_mem_header::owner_state::kDetached : ipsm_mem_header::owner_state::kFree;
+	owner_id_                               = 0;
+}
+
+size_t ipsm_mem::impl::get_page_size( void ) const
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		return 0;
+	}
+	return p_header->page_size_;
+}
+
+bool ipsm_mem::impl::is_reattached( void ) const
+{
+	return is_reattached_;
+}
+
+unsigned int ipsm_mem::impl::get_owner_id( void ) const
+{
+	is_owner_id_published_.store( true, std::memory_order_release );
+	return owner_id_;
+}
+
+size_t ipsm_mem::impl::reclaim_dead_owners( const std::function<void( unsigned int )>& reclaim_functor )
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "shared memory is not allocated" );
+		return 0;
+	}
+
+	std::lock_guard<ipsm_mutex> lk( p_header->owners_mtx_ );
+
+	size_t num_of_reclaimed = 0;
+	for ( size_t i = 0; i < ipsm_mem::max_num_of_owners; i++ ) {
+		ipsm_mem_header::owner_entry& entry = p_header->owners_[i];
+		if ( ( entry.state_ == ipsm_mem_header::owner_state::kFree ) || ( ( i + 1 ) == owner_id_ ) ) {
+			continue;
+		}
+		if ( ( entry.state_ == ipsm_mem_header::owner_state::kAttached ) && is_process_alive( entry.pid_, entry.start_time_ ) ) {
+			continue;
+		}
+		// 回収中にこのプロセスが終了した場合は、エントリが残るため、次の呼び出しで回収をやり直す。
+		reclaim_functor( static_cast<unsigned int>( i + 1 ) );
+		entry.state_ = ipsm_mem_header::owner_state::kFree;
+		num_of_reclaimed++;
+	}
+	return num_of_reclaimed;
+}
+
+size_t ipsm_mem::impl::get_num_of_chained_segments( void ) const
+{
+	ipsm_mem_header* p_header = reinterpret_cast<ipsm_mem_header*>( shm_guard_.get() );
+	if ( p_header == nullptr ) {
+		return 0;
+	}
+	return p_header->num_of_chained_segments_.load( std::memory_order_acquire );
+}
+
+void* ipsm_mem::impl::get_chained_segment( size_t idx ) const
+{
+	if ( idx >= num_of_attached_.load( std::memory_order_acquire ) ) {
+		return nullptr;
+	}
+	return chained_guards_[idx].get();
+}
+
+size_t ipsm_mem::impl::get_chained_segment_size( size_t idx ) const
+{
+	if ( idx >= num_of_attached_.load( std::memory_order_acquire ) ) {
+		return 0;
+	}
+	return chained_guards_[idx].mmap_length();
+}
+
 // ==============================================================================
 ipsm_mem::~ipsm_mem()
 {
@@ -462,10 +1506,11 @@ ipsm_mem::ipsm_mem(
 	mode_t                                 mode,
 	std::function<size_t( void*, size_t )> init_functor_arg,
 	int                                    timeout_msec,
-	int                                    retry_interval_msec )
+	int                                    retry_interval_msec,
+	const setup_options&                   options )
   : p_impl_( nullptr )
 {
-	bool ret = setup( p_shm_name, p_lifetime_ctrl_fname, length, mode, init_functor_arg, timeout_msec, retry_interval_msec );
+	bool ret = setup( p_shm_name, p_lifetime_ctrl_fname, length, mode, init_functor_arg, timeout_msec, retry_interval_msec, options );
 	if ( !ret ) {
 		// 共有メモリの初期化に失敗した場合、共有メモリの初期化完了、あるいは初期化完了待ちに時間がかかりすぎて、timeoutが発生したことを示す。
 		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to setup shared memory: %s", p_shm_name );
@@ -483,7 +1528,8 @@ bool ipsm_mem::setup(
 	mode_t                                 mode,                    //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
 	std::function<size_t( void*, size_t )> init_functor_arg,        //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is consumed memory size.
 	int                                    timeout_msec,            //!< [in] timeout in milliseconds for waiting for shared memory initialization.
-	int                                    retry_interval_msec      //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+	int                                    retry_interval_msec,     //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+	const setup_options&                   options                  //!< [in] optional settings of the mapping.
 )
 {
 	if ( p_impl_ != nullptr ) {
@@ -504,7 +1550,7 @@ bool ipsm_mem::setup(
 	}
 
 	try {
-		p_impl_ = new impl( p_shm_name, p_lifetime_ctrl_fname, length, mode, init_functor_arg, timeout_msec, retry_interval_msec );
+		p_impl_ = new impl( p_shm_name, p_lifetime_ctrl_fname, length, mode, init_functor_arg, timeout_msec, retry_interval_msec, options.max_length, shm_page_config( options.page, options.p_hugetlbfs_dir, options.prefault, options.lock_pages ) );
 	} catch ( const ipsm::ipsm_mem_error& e ) {
 		if ( e.code() == ETIMEDOUT ) {
 			psm_logoutput( ipsm::psm_log_lv::kWarn, "timeout while waiting for shared memory initialization: %s", p_shm_name );
@@ -518,6 +1564,87 @@ bool ipsm_mem::setup(
 	return true;
 }
 
+bool ipsm_mem::setup_persistent(
+	const char*                            p_file_path,             //!< [in] path of the regular file that backs the shared memory
+	const char*                            p_lifetime_ctrl_fname,   //!< [in] lifetime control file name.
+	size_t                                 length,                  //!< [in] shared memory size
+	mode_t                                 mode,                    //!< [in] access mode of the files.
+	std::function<size_t( void*, size_t )> init_functor_arg,        //!< [in] a functor to initialize a shared memory area.
+	std::uint64_t                          layout_version,          //!< [in] version of the layout of the data that init_functor_arg constructs.
+	int                                    timeout_msec,            //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+	int                                    retry_interval_msec,     //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+	const setup_options&                   options,                 //!< [in] optional settings of the mapping. only the prefault and the lock of the pages are applied.
+	std::function<void( void*, size_t )>   reattach_functor_arg     //!< [in] a functor that is called when the contents are reattached.
+)
+{
+	if ( p_impl_ != nullptr ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "shared memory is already allocated" );
+		return true;
+	}
+	if ( p_file_path == nullptr || p_file_path[0] == '\0' ) {
+		throw std::invalid_argument( "file path is null or empty" );
+	}
+	if ( p_lifetime_ctrl_fname == nullptr || p_lifetime_ctrl_fname[0] == '\0' ) {
+		throw std::invalid_argument( "lifetime control file name is null or empty" );
+	}
+	if ( length == 0 ) {
+		throw std::invalid_argument( "shared memory length is zero" );
+	}
+
+	try {
+		p_impl_ = new impl( p_file_path, p_lifetime_ctrl_fname, length, mode, init_functor_arg, timeout_msec, retry_interval_msec, 0, shm_page_config( page_type::normal, nullptr, options.prefault, options.lock_pages ), true, layout_version, reattach_functor_arg );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		if ( e.code() == ETIMEDOUT ) {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "timeout while waiting for shared memory initialization: %s", p_file_path );
+			return false;
+		} else {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "ipsm_mem_error is thrown with errno=%d: %s", e.code(), p_file_path );
+			throw;   // それ以外の例外は呼び出し元に伝える
+		}
+	}   // 上記以外の例外も呼び出し元に伝える
+
+	return true;
+}
+
+bool ipsm_mem::setup_memfd(
+	const char*                            p_broker_name,         //!< [in] name of the socket of ipsm_memfd_broker
+	const char*                            p_shm_name,            //!< [in] name of the segment in the broker
+	size_t                                 length,                //!< [in] shared memory size
+	std::function<size_t( void*, size_t )> init_functor_arg,      //!< [in] a functor to initialize a shared memory area.
+	int                                    timeout_msec,          //!< [in] timeout in milliseconds for waiting for the broker and shared memory initialization.
+	int                                    retry_interval_msec,   //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+	const setup_options&                   options                //!< [in] optional settings of the mapping. only the prefault and the lock of the pages are applied.
+)
+{
+	if ( p_impl_ != nullptr ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "shared memory is already allocated" );
+		return true;
+	}
+	if ( p_broker_name == nullptr || p_broker_name[0] == '\0' ) {
+		throw std::invalid_argument( "memfd broker name is null or empty" );
+	}
+	if ( p_shm_name == nullptr || p_shm_name[0] == '\0' ) {
+		throw std::invalid_argument( "shared memory name is null or empty" );
+	}
+	if ( length == 0 ) {
+		throw std::invalid_argument( "shared memory length is zero" );
+	}
+
+	try {
+		p_impl_ = new impl( p_broker_name, p_shm_name, length, init_functor_arg, timeout_msec, retry_interval_msec, shm_page_config( page_type::normal, nullptr, options.prefault, options.lock_pages ) );
+	} catch ( const ipsm::ipsm_mem_error& e ) {
+		if ( e.code() == ETIMEDOUT ) {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "timeout while waiting for memfd broker or shared memory initialization: %s", p_shm_name );
+			return false;
+		} else {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "ipsm_mem_error is thrown with errno=%d: %s", e.code(), p_shm_name );
+			throw;   // それ以外の例外は呼び出し元に伝える
+		}
+	}   // 上記以外の例外も呼び出し元に伝える
+
+	return true;
+}
+
 void* ipsm_mem::get( void ) const
 {
 	if ( p_impl_ == nullptr ) {
@@ -554,4 +1681,85 @@ std::uintptr_t ipsm_mem::get_hint_value( void ) const
 	return p_impl_->get_hint_value();
 }
 
+bool ipsm_mem::add_chained_segment( size_t length, const std::function<void( void*, size_t )>& init_functor_arg )
+{
+	if ( p_impl_ == nullptr ) {
+		return false;
+	}
+
+	return p_impl_->add_chained_segment( length, init_functor_arg );
+}
+
+size_t ipsm_mem::attach_chained_segments( void )
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->attach_chained_segments();
+}
+
+size_t ipsm_mem::get_page_size( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->get_page_size();
+}
+
+bool ipsm_mem::is_reattached( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return false;
+	}
+
+	return p_impl_->is_reattached();
+}
+
+unsigned int ipsm_mem::get_owner_id( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->get_owner_id();
+}
+
+size_t ipsm_mem::reclaim_dead_owners( const std::function<void( unsigned int )>& reclaim_functor )
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->reclaim_dead_owners( reclaim_functor );
+}
+
+size_t ipsm_mem::get_num_of_chained_segments( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->get_num_of_chained_segments();
+}
+
+void* ipsm_mem::get_chained_segment( size_t idx ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return nullptr;
+	}
+
+	return p_impl_->get_chained_segment( idx );
+}
+
+size_t ipsm_mem::get_chained_segment_size( size_t idx ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->get_chained_segment_size( idx );
+}
+
 }   // namespace ipsm
@@ -12,6 +12,12 @@
 #ifndef IPSM_MEM_INTERNAL_HPP_
 #define IPSM_MEM_INTERNAL_HPP_
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include "ipsm_mem.hpp"
 
 namespace ipsm {
@@ -23,11 +29,48 @@ public:
 
 	bool try_exclusive_lock( void );
 	bool try_shared_lock( void );
-	void release_lock( void );
+	void release_lock( void );   // if the exclusive lock is released, wake up the waiters of wait_for_unlock()
+
+	/**
+	 * @brief get the generation counter that is incremented whenever the exclusive lock of the lock file is released
+	 *
+	 * read this before try_shared_lock(), and pass it to wait_for_unlock() if try_shared_lock() fails.
+	 */
+	std::uint32_t get_unlock_generation( void ) const;
+
+	/**
+	 * @brief wait until the exclusive lock is released after get_unlock_generation() returns gen, or timeout_msec elapses
+	 *
+	 * if the lock file is not able to be mapped, this just sleeps timeout_msec.
+	 */
+	void wait_for_unlock( std::uint32_t gen, int timeout_msec );
 
 private:
-	int  fd_;
-	bool is_locked_;
+	void notify_unlock( void );
+
+	int                         fd_;
+	bool                        is_locked_;
+	bool                        is_exclusive_;   // true: is_locked_ is the exclusive lock
+	std::atomic<std::uint32_t>* p_unlock_gen_;   // the generation counter on the mapping of the lock file. nullptr if the lock file is not able to be mapped
+};
+
+/**
+ * @brief page configuration of the shared memory objects
+ */
+struct shm_page_config {
+	ipsm_mem::page_type     type_;            //!< type of the pages that back the shared memory objects
+	std::string             hugetlbfs_dir_;   //!< mount point of hugetlbfs. valid only if type_ is ipsm_mem::page_type::hugetlbfs
+	ipsm_mem::prefault_type prefault_;        //!< how to fault in the pages of the mapping. shm_guard does not handle ipsm_mem::prefault_type::background. the owner of shm_guard calls prefault().
+	bool                    lock_pages_;      //!< true: lock the pages of the mapping by mlock()
+
+	shm_page_config( void )
+	  : type_( ipsm_mem::page_type::normal )
+	  , hugetlbfs_dir_()
+	  , prefault_( ipsm_mem::prefault_type::none )
+	  , lock_pages_( false )
+	{
+	}
+	shm_page_config( ipsm_mem::page_type type, const char* p_hugetlbfs_dir, ipsm_mem::prefault_type prefault = ipsm_mem::prefault_type::none, bool lock_pages = false );
 };
 
 class shm_guard {
@@ -46,8 +89,13 @@ public:
 	 *
 	 * @param shm_name shared memory name. this string should start '/' and shorter than NAME_MAX-4
 	 * @param length shared memory size
+	 * @param reserve_length size of the virtual address range that is reserved from the top of the mapping. if this is not bigger than length, no address range is reserved.
+	 * @param p_fixed_addr if this is not nullptr, the shared memory is mapped at this address in the address range that is reserved by the other shm_guard.
+	 * @param page_cfg if the type is hugetlbfs, the file on hugetlbfs is opened at first. if it does not exist, the shared memory object is opened.
+	 *
+	 * the page size is detected from the file system of the opened object, and the whole size of the object is mapped even if it is bigger than length.
 	 */
-	bool open( const std::string& shm_name, size_t length, mode_t mode );
+	bool open( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length = 0, void* p_fixed_addr = nullptr, const shm_page_config& page_cfg = shm_page_config() );
 
 	/**
 	 * @brief create a shared memory object and map it to the process's address space.
@@ -57,12 +105,73 @@ public:
 	 * @param shm_name shared memory name. this string should start '/' and shorter than NAME_MAX-4
 	 * @param length shared memory size
 	 * @param mode access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+	 * @param reserve_length size of the virtual address range that is reserved from the top of the mapping. if this is not bigger than length, no address range is reserved.
+	 * @param p_fixed_addr if this is not nullptr, the shared memory is mapped at this address in the address range that is reserved by the other shm_guard.
+	 * @param page_cfg if the type is hugetlbfs, the file is created on hugetlbfs. if it fails, fall back to the shared memory object with transparent huge pages.
+	 *
+	 * @exception ipsm_mem_error if failed creation by any reason(in case of system call failure)
+	 * @exception std::invalid_argument in case of invalid argument
+	 */
+	void create( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length = 0, void* p_fixed_addr = nullptr, const shm_page_config& page_cfg = shm_page_config() );
+
+	/**
+	 * @brief open or create a regular file and map it to the process's address space.
+	 *
+	 * unlike create(), the contents of the existing file are kept unless is_truncate is true. if the size of the file is not the aligned length, the file is resized.
+	 *
+	 * @param path path of the regular file
+	 * @param length size of the mapping
+	 * @param mode access mode of the file that is newly created. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+	 * @param is_truncate true: truncate the file to zero size before resizing it. the contents become zero.
+	 * @param page_cfg only the prefault and the lock of the pages are applied.
 	 *
 	 * @exception ipsm_mem_error if failed creation by any reason(in case of system call failure)
 	 * @exception std::invalid_argument in case of invalid argument
 	 */
-	void create( const std::string& shm_name, size_t length, mode_t mode );
+	void create_file( const std::string& path, size_t length, mode_t mode, bool is_truncate, const shm_page_config& page_cfg = shm_page_config() );
+
+	/**
+	 * @brief open an existing regular file and map it to the process's address space.
+	 *
+	 * the whole size of the file is mapped even if it is bigger than length.
+	 *
+	 * @return true: success. false: the file does not exist, or it is not able to be mapped.
+	 */
+	bool open_file( const std::string& path, size_t length, const shm_page_config& page_cfg = shm_page_config() );
+
+	/**
+	 * @brief map the shared memory that is referred by the file descriptor, e.g. the memfd that is received from ipsm_memfd_broker
+	 *
+	 * the whole size of the object is mapped. the ownership of fd is moved to this instance even if this function fails.
+	 *
+	 * @param fd file descriptor of the shared memory
+	 * @param page_cfg only the prefault and the lock of the pages are applied.
+	 *
+	 * @exception ipsm_mem_error if failed mapping by system call failure
+	 */
+	void attach_fd( int fd, const shm_page_config& page_cfg = shm_page_config() );
+
+	/**
+	 * @brief remove the shared memory object, and the file on hugetlbfs if page_cfg specifies it
+	 *
+	 * @return true: any of them is removed. false: nothing is removed.
+	 */
+	static bool unlink( const std::string& shm_name, const shm_page_config& page_cfg );
+
+	/**
+	 * @brief get the size of the transparent huge page
+	 *
+	 * @return size of the huge page. if the transparent huge page is not supported, return the size of the regular page.
+	 */
+	static size_t get_huge_page_size( void );
 
+	/**
+	 * @brief fault in the pages of the mapping without changing the contents
+	 *
+	 * @param num_of_threads the number of threads that fault in the pages. if 0, std::thread::hardware_concurrency() is used.
+	 * @param p_cancel if this is not nullptr and becomes true, stop faulting in the remaining pages.
+	 */
+	void prefault( size_t num_of_threads, const std::atomic<bool>* p_cancel = nullptr ) const;
 	void* get( void ) const
 	{
 		return p_addr_;
@@ -71,11 +180,84 @@ public:
 	{
 		return length_;
 	}   //!< get mapped length of shared memory area
+	size_t reserved_length( void ) const
+	{
+		return reserved_length_;
+	}   //!< get length of virtual address range that is reserved from the top of memory area. this includes the mapped length.
+	size_t page_size( void ) const
+	{
+		return page_size_;
+	}   //!< get the page size that the mapped length and the reserved length are aligned to
+	bool is_hugetlbfs( void ) const
+	{
+		return is_hugetlbfs_;
+	}   //!< true: the mapped object is a file on hugetlbfs
 
 private:
+	bool        try_create_on_hugetlbfs( const std::string& shm_name, size_t length, mode_t mode, size_t reserve_length, void* p_fixed_addr, const shm_page_config& page_cfg );
+	void        map_fd( int fd, size_t aligned_length, size_t reserve_length, void* p_fixed_addr, size_t page_size, bool is_populate );
+	void        apply_page_config( const shm_page_config& page_cfg );   // madvise(), prefault and mlock() after mapping
+	static bool is_populated_by_mmap( const shm_page_config& page_cfg, bool is_hugetlbfs );
+
 	int    fd_;
 	void*  p_addr_;
 	size_t length_;
+	size_t reserved_length_;   //!< 先頭から予約している仮想アドレス範囲の大きさ。p_fixed_addrを指定してマッピングした場合は、0となる。
+	size_t page_size_;         //!< マッピングの長さと予約範囲の大きさを揃えるページサイズ
+	bool   is_hugetlbfs_;      //!< hugetlbfs上のファイルをマッピングしている場合、true
+};
+
+/**
+ * @brief connection from the process to ipsm_memfd_broker
+ *
+ * the broker keeps the segment while the connection is alive. therefore the owner of the segment keeps this instance until it unmaps the segment.
+ */
+class memfd_broker_connection {
+public:
+	~memfd_broker_connection();
+	memfd_broker_connection( void );
+	memfd_broker_connection( const memfd_broker_connection& )            = delete;
+	memfd_broker_connection& operator=( const memfd_broker_connection& ) = delete;
+	memfd_broker_connection( memfd_broker_connection&& src );
+	memfd_broker_connection& operator=( memfd_broker_connection&& src );
+
+	void swap( memfd_broker_connection& src );
+
+	/**
+	 * @brief connect to the broker
+	 *
+	 * @return true: connected. false: the broker is not listening.
+	 *
+	 * @exception ipsm_mem_error if failed by system call failure
+	 * @exception std::invalid_argument if broker_name is empty or too long for the socket address
+	 */
+	bool connect( const std::string& broker_name );
+
+	/**
+	 * @brief request the segment to the broker, and receive the file descriptor of it
+	 *
+	 * @param shm_name name of the segment in the broker
+	 * @param length required size of the segment. if the segment already exists and is smaller than this, the broker replies EINVAL.
+	 * @param is_creator true is returned if this connection caused the creation of the segment. the caller should initialize it, and call notify_ready().
+	 * @param timeout_msec timeout in milliseconds for waiting for the reply
+	 *
+	 * @return file descriptor of the segment that is sealed against shrinking. the caller takes the ownership. if the broker closes the connection, return -1.
+	 *
+	 * @exception ipsm_mem_error if the broker replies an error, timeout, or the received segment is not sealed.
+	 */
+	int request_segment( const std::string& shm_name, size_t length, bool& is_creator, int timeout_msec );
+
+	void notify_ready( void );   //!< notify the broker that the initialization of the segment is completed. the broker relays it to the waiting processes.
+
+	/**
+	 * @brief wait for the notification from the broker, or timeout_msec elapses
+	 *
+	 * @return true: notified or timeout. false: the broker discards the segment, because the initializing process exits before the completion of the initialization.
+	 */
+	bool wait_for_notification( int timeout_msec );
+
+private:
+	int sock_;
 };
 
 /**
@@ -85,13 +267,27 @@ class ipsm_mem::impl {
 public:
 	~impl();
 	impl(
-		const char*                                    p_shm_name,                 //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
-		const char*                                    p_lifetime_ctrl_fname,      //!< [in] lifetime control file name.
+		const char*                                    p_shm_name,                  //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
+		const char*                                    p_lifetime_ctrl_fname,       //!< [in] lifetime control file name.
+		size_t                                         length,                      //!< [in] shared memory size
+		mode_t                                         mode,                        //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+		std::function<std::uintptr_t( void*, size_t )> creater_init_functor_arg,    //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is hint value for secondary process.
+		int                                            timeout_msec,                //!< [in] timeout in milliseconds for waiting for shared memory initialization.
+		int                                            retry_interval_msec,         //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		size_t                                         max_length,                  //!< [in] size of the virtual address range that is reserved for chained segments.
+		const shm_page_config&                         page_cfg,                    //!< [in] page configuration of the shared memory objects.
+		bool                                           is_persistent    = false,    //!< [in] true: p_shm_name is the path of the regular file that keeps the contents after all instances are destructed.
+		std::uint64_t                                  layout_version   = 0,        //!< [in] version of the layout of the contents. this is used only if is_persistent is true.
+		std::function<void( void*, size_t )>           reattach_functor = nullptr   //!< [in] a functor that is called when the contents are reattached, before the other processes are allowed to use them. this is used only if is_persistent is true.
+	);
+	impl(
+		const char*                                    p_broker_name,              //!< [in] name of the socket of ipsm_memfd_broker
+		const char*                                    p_shm_name,                 //!< [in] name of the segment in the broker
 		size_t                                         length,                     //!< [in] shared memory size
-		mode_t                                         mode,                       //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
 		std::function<std::uintptr_t( void*, size_t )> creater_init_functor_arg,   //!< [in] a functor to initialize a shared memory area. first argument is the pointer to the top of memory. second argument is the assigned memory length. return value is hint value for secondary process.
-		int                                            timeout_msec,               //!< [in] timeout in milliseconds for waiting for shared memory initialization.
-		int                                            retry_interval_msec         //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		int                                            timeout_msec,               //!< [in] timeout in milliseconds for waiting for the broker and shared memory initialization.
+		int                                            retry_interval_msec,        //!< [in] retry interval in milliseconds for waiting for shared memory initialization.
+		const shm_page_config&                         page_cfg                    //!< [in] page configuration of the shared memory. only the prefault and the lock of the pages are applied.
 	);
 
 	void*  get( void ) const;              //!< get top address of memory area
@@ -100,16 +296,56 @@ public:
 	ipsm_mem::status get_status( void ) const;
 	std::uintptr_t   get_hint_value( void ) const;
 
+	bool   add_chained_segment( size_t length, const std::function<void( void*, size_t )>& init_functor_arg );
+	size_t attach_chained_segments( void );
+	size_t get_num_of_chained_segments( void ) const;
+	void*  get_chained_segment( size_t idx ) const;
+	size_t get_chained_segment_size( size_t idx ) const;
+
+	size_t get_page_size( void ) const;
+	bool   is_reattached( void ) const;
+
+	unsigned int get_owner_id( void ) const;
+	size_t       reclaim_dead_owners( const std::function<void( unsigned int )>& reclaim_functor );
+
 private:
-	std::string shm_name_;              //!< shared memory name. this string should start '/' and shorter than NAME_MAX-4
-	std::string lifetime_ctrl_fname_;   //!< lifetime control file name.
-	size_t      req_length_;            //!< requested shared memory size
-	mode_t      mode_;                  //!< access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
-
-	lock_file_guard shared_lock_guard_;   //<! guard for shared lock of lifetime control file
-	shm_guard       shm_guard_;           //!< guard for shared memory object
-	size_t          shm_length_;          //!< shared memory size. actual size of shared memory area.  req_length_ =< available_length_ < shm_length_
-	size_t          available_length_;    //!< available size in shared memory. this size excludes the header area of the shared memory. req_length_ =< available_length_ < shm_length_
+	void         complete_setup( void );
+	bool         can_reattach( const shm_guard& guard ) const;
+	void         reset_owners( const shm_guard& guard ) const;
+	void         mark_in_use( const shm_guard& guard ) const;
+	void         mark_clean_shutdown( void ) const;
+	std::string  make_chained_segment_name( size_t idx ) const;
+	size_t       attach_chained_segments_nolock( void );
+	void         unlink_chained_segments( void ) const;
+	unsigned int register_owner( void );
+	void         prefault_chained_segment( const shm_guard& guard ) const;
+	void         unregister_owner( void );
+
+
+	std::string     shm_name_;              //!< shared memory name. this string should start '/' and shorter than NAME_MAX-4
+	std::string     lifetime_ctrl_fname_;   //!< lifetime control file name.
+	size_t          req_length_;            //!< requested shared memory size
+	mode_t          mode_;                  //!< access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+	shm_page_config page_cfg_;              //!< page configuration of the shared memory objects
+	bool            is_persistent_;         //!< true: shm_name_は、全インスタンスの破棄後も内容を保持する通常のファイルのパス
+	std::uint64_t   layout_version_;        //!< 永続化モードで、内容のレイアウトのバージョン。記録されたバージョンと異なる場合は、作り直す。
+	bool            is_reattached_;         //!< true: このインスタンスが、前回の内容を初期化せずにそのまま使用した
+
+	lock_file_guard         shared_lock_guard_;   //<! guard for shared lock of lifetime control file
+	memfd_broker_connection broker_conn_;         //!< memfdのセグメントを使用する場合の、ブローカーとの接続。ブローカーは、接続が切断されるまでセグメントを保持する。
+	shm_guard               shm_guard_;           //!< guard for shared memory object
+	size_t                  shm_length_;          //!< shared memory size. actual size of shared memory area.  req_length_ =< available_length_ < shm_length_
+	size_t                  available_length_;    //!< available size in shared memory. this size excludes the header area of the shared memory. req_length_ =< available_length_ < shm_length_
+	unsigned int            owner_id_;            //!< プロセステーブルのエントリのインデックス+1。プロセステーブルに空きがなかった場合は、0となる。
+
+	mutable std::atomic<bool> is_owner_id_published_;   //!< get_owner_id()でオーナーIDを取得された場合、true。falseの場合は、破棄時にエントリを直接解放する。
+
+	std::atomic<bool> prefault_cancel_;   //!< バックグラウンドのプリフォルトを中止させる場合、true
+	std::thread       prefault_thread_;   //!< バックグラウンドでプリフォルトを行うスレッド。デストラクタで、マッピングの解除前に終了を待つ。
+
+	std::mutex          chained_mtx_;                                                //!< このプロセス内で、chained_guards_の追加を排他するためのミューテックス
+	std::atomic<size_t> num_of_attached_;                                            //!< このプロセスでマッピング済みのチェーンセグメントの数。chained_guards_の[0, num_of_attached_)は変更されない。
+	shm_guard           chained_guards_[ipsm_mem::max_num_of_chained_segments];   //!< チェーンセグメントのガード。shm_guard_の予約範囲内にマッピングされるため、shm_guard_より後に宣言する。
 };
 
 }   // namespace ipsm
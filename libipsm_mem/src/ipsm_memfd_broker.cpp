@@ -0,0 +1,696 @@
+/**
+ * @file ipsm_memfd_broker.cpp
+ * @author PFA03027@nifty.com
+ * @brief broker that hands the memfd based shared memory to the processes over UNIX domain socket
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ipsm_logger_internal.hpp"
+#include "misc_utility.hpp"
+
+#include "ipsm_mem_internal.hpp"
+#include "ipsm_memfd_broker.hpp"
+
+namespace ipsm {
+
+// ==============================================================================
+// ブローカーとの間でやり取りするメッセージ。SOCK_SEQPACKETを使用するため、1回の送受信で1つのメッセージが届く。
+static constexpr std::uint32_t memfd_broker_magic = 0x4950'4D46U;   // "IPMF"
+
+enum class memfd_broker_cmd : std::uint32_t {
+	request = 1,   // プロセス -> ブローカー: セグメントの要求
+	reply,         // ブローカー -> プロセス: 要求への応答。成功した場合は、SCM_RIGHTSでセグメントのファイルディスクリプタを添付する。
+	ready,         // プロセス -> ブローカー: 初期化の完了の通知。ブローカー -> プロセス: 初期化の完了を待っているプロセスへの中継
+};
+
+struct memfd_broker_request {
+	std::uint32_t    magic_;
+	memfd_broker_cmd cmd_;
+	std::uint64_t    length_;                  // 要求するセグメントの大きさ
+	char             shm_name_[NAME_MAX + 1];   // セグメントの名前
+};
+
+struct memfd_broker_reply {
+	std::uint32_t    magic_;
+	memfd_broker_cmd cmd_;
+	std::int32_t     errno_;        // 0: 成功。それ以外は、セグメントを用意できなかった理由
+	std::uint32_t    is_creator_;   // 1: 要求したプロセスがセグメントを初期化する。
+};
+
+struct memfd_broker_notice {
+	std::uint32_t    magic_;
+	memfd_broker_cmd cmd_;
+};
+
+static socklen_t make_broker_addr( const std::string& broker_name, struct sockaddr_un& addr )
+{
+	// 抽象名前空間のソケットは、sun_pathの先頭を'\0'とし、続くバイト列を名前とする。ファイルシステム上にファイルは作成されない。
+	if ( broker_name.empty() ) {
+		throw std::invalid_argument( "memfd broker name is empty" );
+	}
+	if ( broker_name.size() > ( sizeof( addr.sun_path ) - 1 ) ) {
+		throw std::invalid_argument( "memfd broker name is too long: " + broker_name );
+	}
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sun_family = AF_UNIX;
+	memcpy( addr.sun_path + 1, broker_name.data(), broker_name.size() );
+	return static_cast<socklen_t>( offsetof( struct sockaddr_un, sun_path ) + 1 + broker_name.size() );
+}
+
+// ==============================================================================
+memfd_broker_connection::~memfd_broker_connection()
+{
+	if ( sock_ >= 0 ) {
+		close( sock_ );
+		sock_ = -1;
+	}
+}
+
+memfd_broker_connection::memfd_broker_connection( void )
+  : sock_( -1 )
+{
+}
+
+memfd_broker_connection::memfd_broker_connection( memfd_broker_connection&& src )
+  : sock_( src.sock_ )
+{
+	src.sock_ = -1;
+}
+
+memfd_broker_connection& memfd_broker_connection::operator=( memfd_broker_connection&& src )
+{
+	if ( this == &src ) {
+		return *this;
+	}
+
+	memfd_broker_connection( std::move( src ) ).swap( *this );
+
+	return *this;
+}
+
+void memfd_broker_connection::swap( memfd_broker_connection& src )
+{
+	std::swap( sock_, src.sock_ );
+}
+
+bool memfd_broker_connection::connect( const std::string& broker_name )
+{
+	struct sockaddr_un addr;
+	socklen_t          addr_len = make_broker_addr( broker_name, addr );
+
+	int sock = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if ( sock < 0 ) {
+		auto cur_errno = errno;
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to create socket for memfd broker: " + broker_name );
+	}
+	if ( ::connect( sock, reinterpret_cast<struct sockaddr*>( &addr ), addr_len ) != 0 ) {
+		auto cur_errno = errno;
+		close( sock );
+		if ( ( cur_errno == ECONNREFUSED ) || ( cur_errno == ENOENT ) ) {
+			psm_logoutput( ipsm::psm_log_lv::kDebug, "memfd broker is not listening: %s", broker_name.c_str() );
+			return false;
+		}
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to connect to memfd broker: %s, error: %s", broker_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to connect to memfd broker: " + broker_name );
+	}
+
+	if ( sock_ >= 0 ) {
+		close( sock_ );   // 接続済みの場合は、以前の接続を切断する。
+	}
+	sock_ = sock;
+	return true;
+}
+
+int memfd_broker_connection::request_segment( const std::string& shm_name, size_t length, bool& is_creator, int timeout_msec )
+{
+	if ( sock_ < 0 ) {
+		throw std::logic_error( "memfd broker is not connected" );
+	}
+	if ( shm_name.empty() || ( shm_name.size() > NAME_MAX ) ) {
+		throw std::invalid_argument( "name of the segment is empty or too long: " + shm_name );
+	}
+
+	memfd_broker_request req;
+	memset( &req, 0, sizeof( req ) );
+	req.magic_  = memfd_broker_magic;
+	req.cmd_    = memfd_broker_cmd::request;
+	req.length_ = length;
+	memcpy( req.shm_name_, shm_name.data(), shm_name.size() );
+	if ( send( sock_, &req, sizeof( req ), MSG_NOSIGNAL ) < 0 ) {
+		auto cur_errno = errno;
+		if ( ( cur_errno == EPIPE ) || ( cur_errno == ECONNRESET ) ) {
+			return -1;
+		}
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to send request to memfd broker: " + shm_name );
+	}
+
+	struct pollfd pfd;
+	pfd.fd      = sock_;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+	int ret     = poll( &pfd, 1, timeout_msec );
+	if ( ret == 0 ) {
+		throw ipsm::ipsm_mem_error( ETIMEDOUT, "timeout while waiting for the reply of memfd broker: " + shm_name );
+	}
+	if ( ret < 0 ) {
+		auto cur_errno = errno;
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to wait for the reply of memfd broker: " + shm_name );
+	}
+
+	memfd_broker_reply reply;
+	memset( &reply, 0, sizeof( reply ) );
+	struct iovec iov;
+	iov.iov_base = &reply;
+	iov.iov_len  = sizeof( reply );
+	union {
+		char           buff[CMSG_SPACE( sizeof( int ) )];
+		struct cmsghdr align;
+	} ctrl;
+	memset( &ctrl, 0, sizeof( ctrl ) );
+	struct msghdr msg;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = ctrl.buff;
+	msg.msg_controllen = sizeof( ctrl.buff );
+
+	ssize_t len = recvmsg( sock_, &msg, MSG_CMSG_CLOEXEC );
+	if ( len <= 0 ) {
+		auto cur_errno = errno;
+		if ( ( len == 0 ) || ( cur_errno == ECONNRESET ) ) {
+			return -1;
+		}
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to receive the reply of memfd broker: " + shm_name );
+	}
+
+	int fd = -1;
+	for ( struct cmsghdr* p_cmsg = CMSG_FIRSTHDR( &msg ); p_cmsg != nullptr; p_cmsg = CMSG_NXTHDR( &msg, p_cmsg ) ) {
+		if ( ( p_cmsg->cmsg_level == SOL_SOCKET ) && ( p_cmsg->cmsg_type == SCM_RIGHTS ) && ( p_cmsg->cmsg_len == CMSG_LEN( sizeof( int ) ) ) ) {
+			memcpy( &fd, CMSG_DATA( p_cmsg ), sizeof( int ) );
+		}
+	}
+	if ( ( static_cast<size_t>( len ) != sizeof( reply ) ) || ( reply.magic_ != memfd_broker_magic ) || ( reply.cmd_ != memfd_broker_cmd::reply ) ) {
+		if ( fd >= 0 ) {
+			close( fd );
+		}
+		throw ipsm::ipsm_mem_error( EPROTO, "unexpected reply from memfd broker: " + shm_name );
+	}
+	if ( reply.errno_ != 0 ) {
+		if ( fd >= 0 ) {
+			close( fd );
+		}
+		psm_logoutput( ipsm::psm_log_lv::kErr, "memfd broker fails to prepare the segment: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( reply.errno_ ).c_str() );
+		throw ipsm::ipsm_mem_error( reply.errno_, "memfd broker fails to prepare the segment: " + shm_name );
+	}
+	if ( fd < 0 ) {
+		throw ipsm::ipsm_mem_error( EPROTO, "no file descriptor is attached to the reply of memfd broker: " + shm_name );
+	}
+
+	// 縮小を禁止するシールがない場合、他のプロセスの縮小によって、マッピングへのアクセスがSIGBUSとなる可能性があるため、使用しない。
+	int seals = fcntl( fd, F_GET_SEALS );
+	if ( ( seals < 0 ) || ( ( seals & F_SEAL_SHRINK ) == 0 ) ) {
+		close( fd );
+		throw ipsm::ipsm_mem_error( EPERM, "the segment from memfd broker is not sealed against shrinking: " + shm_name );
+	}
+
+	is_creator = ( reply.is_creator_ != 0 );
+	return fd;
+}
+
+void memfd_broker_connection::notify_ready( void )
+{
+	memfd_broker_notice notice;
+	notice.magic_ = memfd_broker_magic;
+	notice.cmd_   = memfd_broker_cmd::ready;
+	if ( send( sock_, &notice, sizeof( notice ), MSG_NOSIGNAL ) < 0 ) {
+		// 待っているプロセスは、retry_interval_msec毎に状態を確認するため、通知できなくても継続する。
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "failed to notify memfd broker of the completion of the initialization, error: %s", ipsm::make_strerror( cur_errno ).c_str() );
+	}
+}
+
+bool memfd_broker_connection::wait_for_notification( int timeout_msec )
+{
+	struct pollfd pfd;
+	pfd.fd      = sock_;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+	int ret     = poll( &pfd, 1, timeout_msec );
+	if ( ret <= 0 ) {
+		return true;
+	}
+
+	if ( ( pfd.revents & POLLIN ) != 0 ) {
+		memfd_broker_notice notice;
+		ssize_t             len = recv( sock_, &notice, sizeof( notice ), MSG_DONTWAIT );
+		if ( len > 0 ) {
+			return true;
+		}
+		if ( ( len < 0 ) && ( ( errno == EAGAIN ) || ( errno == EINTR ) ) ) {
+			return true;
+		}
+		return false;   // ブローカーが接続を切断した。
+	}
+	return ( pfd.revents & ( POLLHUP | POLLERR | POLLNVAL ) ) == 0;
+}
+
+// ==============================================================================
+class ipsm_memfd_broker::impl {
+public:
+	explicit impl( const std::string& broker_name );
+	~impl();
+
+	size_t get_num_of_segments( void ) const;
+
+private:
+	struct segment_entry {
+		int    fd_;               // memfdのファイルディスクリプタ
+		size_t length_;           // セグメントの大きさ
+		bool   is_ready_;         // 初期化を行うプロセスから、初期化の完了が通知された場合、true
+		size_t num_of_clients_;   // セグメントを受け取った接続の数
+	};
+	struct client_entry {
+		int         sock_;         // 接続したプロセスとのソケット
+		std::string shm_name_;     // 受け取ったセグメントの名前。セグメントを受け取る前、あるいはセグメントが破棄された場合は、空
+		bool        is_creator_;   // セグメントの初期化を行うプロセスの場合、true
+	};
+
+	void run( void );
+	void accept_client( void );
+	bool handle_client( client_entry& client, short revents );
+	bool handle_request( client_entry& client, const memfd_broker_request& req );
+	void handle_ready( const client_entry& client );
+	void release_client( client_entry& client );
+	int  create_segment( const std::string& shm_name, size_t length ) const;
+
+	std::string                          broker_name_;
+	int                                  listen_sock_;   //!< 接続を待ち受けるソケット
+	int                                  stop_fd_;       //!< ブローカーのスレッドに終了を通知するeventfd
+	mutable std::mutex                   mtx_;           //!< segments_の変更と、get_num_of_segments()からの参照を排他するためのミューテックス
+	std::map<std::string, segment_entry> segments_;      //!< 名前毎のセグメント
+	std::vector<client_entry>            clients_;       //!< 接続中のプロセス。ブローカーのスレッドのみがアクセスする。
+	std::thread                          thread_;        //!< 接続を処理するスレッド
+};
+
+ipsm_memfd_broker::impl::impl( const std::string& broker_name )
+  : broker_name_( broker_name )
+  , listen_sock_( -1 )
+  , stop_fd_( -1 )
+  , mtx_()
+  , segments_()
+  , clients_()
+  , thread_()
+{
+	struct sockaddr_un addr;
+	socklen_t          addr_len = make_broker_addr( broker_name_, addr );
+
+	listen_sock_ = socket( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0 );
+	if ( listen_sock_ < 0 ) {
+		auto cur_errno = errno;
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to create socket for memfd broker: " + broker_name_ );
+	}
+	// 同名のブローカーが動作している場合、bind()はEADDRINUSEで失敗する。抽象名前空間の名前は、ソケットが閉じられた時点で解放される。
+	if ( ( bind( listen_sock_, reinterpret_cast<struct sockaddr*>( &addr ), addr_len ) != 0 ) || ( listen( listen_sock_, SOMAXCONN ) != 0 ) ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to listen on the socket of memfd broker: %s, error: %s", broker_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		close( listen_sock_ );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to listen on the socket of memfd broker: " + broker_name_ );
+	}
+
+	stop_fd_ = eventfd( 0, EFD_CLOEXEC );
+	if ( stop_fd_ < 0 ) {
+		auto cur_errno = errno;
+		close( listen_sock_ );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to create eventfd for memfd broker: " + broker_name_ );
+	}
+
+	try {
+		thread_ = std::thread( [this]() {
+			run();
+		} );
+	} catch ( ... ) {
+		close( stop_fd_ );
+		close( listen_sock_ );
+		throw;
+	}
+}
+
+ipsm_memfd_broker::impl::~impl()
+{
+	std::uint64_t value = 1;
+	if ( write( stop_fd_, &value, sizeof( value ) ) < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to stop memfd broker: %s, error: %s", broker_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+	}
+	if ( thread_.joinable() ) {
+		thread_.join();
+	}
+
+	// 受け渡し済みのセグメントは、各プロセスのマッピングが解除されるまで、カーネルによって保持される。
+	for ( auto& client : clients_ ) {
+		close( client.sock_ );
+	}
+	for ( auto& seg : segments_ ) {
+		close( seg.second.fd_ );
+	}
+	close( stop_fd_ );
+	close( listen_sock_ );
+}
+
+size_t ipsm_memfd_broker::impl::get_num_of_segments( void ) const
+{
+	std::lock_guard<std::mutex> lk( mtx_ );
+	return segments_.size();
+}
+
+void ipsm_memfd_broker::impl::run( void )
+{
+	std::vector<struct pollfd> pfds;
+	std::vector<size_t>        closing_idxs;
+	while ( true ) {
+		// [0]: 終了の通知、[1]: 接続の待ち受け、[2..]: 接続中のプロセス
+		pfds.clear();
+		pfds.push_back( pollfd { stop_fd_, POLLIN, 0 } );
+		pfds.push_back( pollfd { listen_sock_, POLLIN, 0 } );
+		for ( const auto& client : clients_ ) {
+			pfds.push_back( pollfd { client.sock_, POLLIN, 0 } );
+		}
+
+		int ret = poll( pfds.data(), static_cast<nfds_t>( pfds.size() ), -1 );
+		if ( ret < 0 ) {
+			auto cur_errno = errno;
+			if ( cur_errno == EINTR ) {
+				continue;
+			}
+			psm_logoutput( ipsm::psm_log_lv::kErr, "memfd broker stops by the failure of poll(): %s, error: %s", broker_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+			return;
+		}
+		if ( pfds[0].revents != 0 ) {
+			return;
+		}
+
+		closing_idxs.clear();
+		for ( size_t i = 0; i < clients_.size(); i++ ) {
+			short revents = pfds[i + 2].revents;
+			if ( revents == 0 ) {
+				continue;
+			}
+			if ( !handle_client( clients_[i], revents ) ) {
+				closing_idxs.push_back( i );
+			}
+		}
+		// インデックスがずれないように、後ろから削除する。
+		for ( auto it = closing_idxs.rbegin(); it != closing_idxs.rend(); ++it ) {
+			release_client( clients_[*it] );
+			close( clients_[*it].sock_ );
+			clients_.erase( clients_.begin() + static_cast<std::ptrdiff_t>( *it ) );
+		}
+
+		if ( ( pfds[1].revents & POLLIN ) != 0 ) {
+			accept_client();
+		}
+	}
+}
+
+void ipsm_memfd_broker::impl::accept_client( void )
+{
+	int sock = accept4( listen_sock_, nullptr, nullptr, SOCK_CLOEXEC );
+	if ( sock < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kDebug, "memfd broker fails to accept the connection: %s, error: %s", broker_name_.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		return;
+	}
+
+	// 抽象名前空間のソケットには、ファイルのアクセス権による制限がないため、接続したプロセスの実効ユーザーIDで制限する。
+	struct ucred cred;
+	socklen_t    cred_len = sizeof( cred );
+	if ( ( getsockopt( sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len ) != 0 ) || ( ( cred.uid != geteuid() ) && ( cred.uid != 0 ) ) ) {
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "memfd broker rejects the connection from the other user: %s", broker_name_.c_str() );
+		close( sock );
+		return;
+	}
+
+	clients_.push_back( client_entry { sock, std::string(), false } );
+}
+
+bool ipsm_memfd_broker::impl::handle_client( client_entry& client, short revents )
+{
+	if ( ( revents & POLLIN ) != 0 ) {
+		memfd_broker_request req;
+		memset( &req, 0, sizeof( req ) );
+		ssize_t len = recv( client.sock_, &req, sizeof( req ), MSG_DONTWAIT );
+		if ( len == 0 ) {
+			return false;
+		}
+		if ( len < 0 ) {
+			return ( errno == EAGAIN ) || ( errno == EINTR );
+		}
+		if ( ( static_cast<size_t>( len ) < sizeof( memfd_broker_notice ) ) || ( req.magic_ != memfd_broker_magic ) ) {
+			psm_logoutput( ipsm::psm_log_lv::kWarn, "memfd broker receives an unexpected message: %s", broker_name_.c_str() );
+			return false;
+		}
+		switch ( req.cmd_ ) {
+			case memfd_broker_cmd::request:
+				if ( ( static_cast<size_t>( len ) != sizeof( req ) ) || !client.shm_name_.empty() ) {
+					psm_logoutput( ipsm::psm_log_lv::kWarn, "memfd broker receives an unexpected request: %s", broker_name_.c_str() );
+					return false;
+				}
+				return handle_request( client, req );
+			case memfd_broker_cmd::ready:
+				handle_ready( client );
+				return true;
+			default:
+				psm_logoutput( ipsm::psm_log_lv::kWarn, "memfd broker receives an unexpected command(%u): %s", static_cast<unsigned int>( req.cmd_ ), broker_name_.c_str() );
+				return false;
+		}
+	}
+
+	return ( revents & ( POLLHUP | POLLERR | POLLNVAL ) ) == 0;
+}
+
+bool ipsm_memfd_broker::impl::handle_request( client_entry& client, const memfd_broker_request& req )
+{
+	const std::string shm_name( req.shm_name_, strnlen( req.shm_name_, NAME_MAX ) );
+
+	memfd_broker_reply reply;
+	memset( &reply, 0, sizeof( reply ) );
+	reply.magic_ = memfd_broker_magic;
+	reply.cmd_   = memfd_broker_cmd::reply;
+
+	int  fd         = -1;
+	bool is_created = false;
+	auto it         = segments_.find( shm_name );
+	if ( shm_name.empty() || ( req.length_ == 0 ) || ( req.length_ > static_cast<std::uint64_t>( std::numeric_limits<off_t>::max() ) ) ) {
+		reply.errno_ = EINVAL;
+	} else if ( it == segments_.end() ) {
+		try {
+			fd = create_segment( shm_name, static_cast<size_t>( req.length_ ) );
+			std::lock_guard<std::mutex> lk( mtx_ );
+			it         = segments_.emplace( shm_name, segment_entry { fd, static_cast<size_t>( req.length_ ), false, 0 } ).first;
+			is_created = true;
+		} catch ( const ipsm::ipsm_mem_error& e ) {
+			reply.errno_ = e.code();
+		}
+	} else if ( it->second.length_ < req.length_ ) {
+		// 既存のセグメントより大きな領域を要求された場合、マッピングの範囲外へのアクセスとなるため、拒否する。
+		psm_logoutput( ipsm::psm_log_lv::kWarn, "requested length(%zu) is bigger than the segment(%zu): %s", static_cast<size_t>( req.length_ ), it->second.length_, shm_name.c_str() );
+		reply.errno_ = EINVAL;
+	} else {
+		fd = it->second.fd_;
+	}
+	reply.is_creator_ = is_created ? 1 : 0;
+
+	struct iovec iov;
+	iov.iov_base = &reply;
+	iov.iov_len  = sizeof( reply );
+	union {
+		char           buff[CMSG_SPACE( sizeof( int ) )];
+		struct cmsghdr align;
+	} ctrl;
+	memset( &ctrl, 0, sizeof( ctrl ) );
+	struct msghdr msg;
+	memset( &msg, 0, sizeof( msg ) );
+	msg.msg_iov    = &iov;
+	msg.msg_iovlen = 1;
+	if ( fd >= 0 ) {
+		msg.msg_control            = ctrl.buff;
+		msg.msg_controllen         = sizeof( ctrl.buff );
+		struct cmsghdr* p_cmsg     = CMSG_FIRSTHDR( &msg );
+		p_cmsg->cmsg_level         = SOL_SOCKET;
+		p_cmsg->cmsg_type          = SCM_RIGHTS;
+		p_cmsg->cmsg_len           = CMSG_LEN( sizeof( int ) );
+		memcpy( CMSG_DATA( p_cmsg ), &fd, sizeof( int ) );
+	}
+
+	if ( sendmsg( client.sock_, &msg, MSG_NOSIGNAL ) < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kDebug, "memfd broker fails to send the reply: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		if ( is_created ) {
+			std::lock_guard<std::mutex> lk( mtx_ );
+			close( it->second.fd_ );
+			segments_.erase( it );
+		}
+		return false;
+	}
+	if ( fd < 0 ) {
+		return true;
+	}
+
+	it->second.num_of_clients_++;
+	client.shm_name_   = shm_name;
+	client.is_creator_ = is_created;
+	return true;
+}
+
+void ipsm_memfd_broker::impl::handle_ready( const client_entry& client )
+{
+	if ( !client.is_creator_ ) {
+		return;
+	}
+	auto it = segments_.find( client.shm_name_ );
+	if ( it == segments_.end() ) {
+		return;
+	}
+	it->second.is_ready_ = true;
+
+	// 初期化の完了を待っているプロセスに中継する。待っていないプロセスは、未読のまま使用しないため、影響しない。
+	memfd_broker_notice notice;
+	notice.magic_ = memfd_broker_magic;
+	notice.cmd_   = memfd_broker_cmd::ready;
+	for ( const auto& other : clients_ ) {
+		if ( ( &other != &client ) && ( other.shm_name_ == client.shm_name_ ) ) {
+			send( other.sock_, &notice, sizeof( notice ), MSG_NOSIGNAL | MSG_DONTWAIT );
+		}
+	}
+}
+
+void ipsm_memfd_broker::impl::release_client( client_entry& client )
+{
+	if ( client.shm_name_.empty() ) {
+		return;
+	}
+	auto it = segments_.find( client.shm_name_ );
+	if ( it == segments_.end() ) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lk( mtx_ );
+	it->second.num_of_clients_--;
+	if ( client.is_creator_ && !it->second.is_ready_ ) {
+		// 初期化を行うプロセスが、初期化の途中で終了した。初期化の完了を待っているプロセスとの接続を切断して、新たなセグメントでやり直させる。
+		psm_logoutput( ipsm::psm_log_lv::kInfo, "memfd broker discards the segment that is not initialized: %s", client.shm_name_.c_str() );
+		for ( auto& other : clients_ ) {
+			if ( ( &other != &client ) && ( other.shm_name_ == client.shm_name_ ) ) {
+				other.shm_name_.clear();
+				shutdown( other.sock_, SHUT_RDWR );
+			}
+		}
+		it->second.num_of_clients_ = 0;
+	}
+	if ( it->second.num_of_clients_ == 0 ) {
+		// ブローカーのファイルディスクリプタを閉じる。セグメントは、最後のマッピングが解除された時点で解放される。
+		close( it->second.fd_ );
+		segments_.erase( it );
+	}
+	client.shm_name_.clear();
+}
+
+int ipsm_memfd_broker::impl::create_segment( const std::string& shm_name, size_t length ) const
+{
+	// memfdの名前は、/proc/<pid>/fd等での表示にのみ使われる。長さの上限は、"memfd:"を含めて249バイトのため、切り詰める。
+	const std::string memfd_name = shm_name.substr( 0, 200 );
+	int               fd         = memfd_create( memfd_name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING );
+	if ( fd < 0 ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to create memfd: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to create memfd: " + shm_name );
+	}
+
+	const size_t page_size      = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+	const size_t aligned_length = ( ( length + page_size - 1 ) / page_size ) * page_size;
+
+	// 大きさを確定した後、縮小と拡大を禁止する。以降、シールの追加も禁止し、受け取ったプロセスが書き込みを禁止できないようにする。
+	if ( ( ftruncate( fd, static_cast<off_t>( aligned_length ) ) != 0 ) || ( fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL ) != 0 ) ) {
+		auto cur_errno = errno;
+		psm_logoutput( ipsm::psm_log_lv::kErr, "failed to set size and seals of memfd: %s, error: %s", shm_name.c_str(), ipsm::make_strerror( cur_errno ).c_str() );
+		close( fd );
+		throw ipsm::ipsm_mem_error( cur_errno, "failed to set size and seals of memfd: " + shm_name );
+	}
+	return fd;
+}
+
+// ==============================================================================
+ipsm_memfd_broker::~ipsm_memfd_broker()
+{
+	delete p_impl_;
+	p_impl_ = nullptr;
+}
+ipsm_memfd_broker::ipsm_memfd_broker( void )
+  : p_impl_( nullptr )
+{
+}
+ipsm_memfd_broker::ipsm_memfd_broker( ipsm_memfd_broker&& src )
+  : p_impl_( src.p_impl_ )
+{
+	src.p_impl_ = nullptr;
+}
+ipsm_memfd_broker& ipsm_memfd_broker::operator=( ipsm_memfd_broker&& src )
+{
+	if ( this == &src ) {
+		return *this;
+	}
+
+	ipsm_memfd_broker( std::move( src ) ).swap( *this );
+
+	return *this;
+}
+
+void ipsm_memfd_broker::swap( ipsm_memfd_broker& src )
+{
+	std::swap( p_impl_, src.p_impl_ );
+}
+
+ipsm_memfd_broker::ipsm_memfd_broker( const char* p_broker_name )
+  : p_impl_( nullptr )
+{
+	if ( p_broker_name == nullptr || p_broker_name[0] == '\0' ) {
+		throw std::invalid_argument( "memfd broker name is null or empty" );
+	}
+	p_impl_ = new impl( p_broker_name );
+}
+
+size_t ipsm_memfd_broker::get_num_of_segments( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+
+	return p_impl_->get_num_of_segments();
+}
+
+}   // namespace ipsm
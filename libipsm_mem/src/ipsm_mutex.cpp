@@ -79,10 +79,18 @@ ipsm_mutex_base::~ipsm_mutex_base()
 
 void ipsm_mutex_base::lock( void )
 {
-	int ret = pthread_mutex_lock( &fastmutex_ );
+	lock_and_check_owner_dead();
+}
+
+bool ipsm_mutex_base::lock_and_check_owner_dead( void )
+{
+	bool is_owner_dead = false;
+	int  ret           = pthread_mutex_lock( &fastmutex_ );
 	if ( ret == 0 ) {
 		// OK
 	} else if ( ret == EOWNERDEAD ) {
+		// 前の所有者が、ロックを保持したまま終了している。ミューテックス自体は回復させるが、保護対象のデータの回復は呼び出し側で行う。
+		is_owner_dead = true;
 		// try recover
 		ret = pthread_mutex_consistent( &fastmutex_ );
 		if ( ret == 0 ) {
@@ -103,6 +111,7 @@ void ipsm_mutex_base::lock( void )
 		std::error_code ec( ret, std::system_category() );
 		throw std::system_error( ec, "Fail to call pthread_mutex_lock()" );
 	}
+	return is_owner_dead;
 }
 bool ipsm_mutex_base::try_lock( void )
 {
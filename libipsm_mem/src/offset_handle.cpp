@@ -0,0 +1,280 @@
+/**
+ * @file offset_handle.cpp
+ * @author PFA03027@nifty.com
+ * @brief handle based movable memory blocks and the compaction of them that are shareable b/w processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ipsm_logger_internal.hpp"
+#include "offset_handle.hpp"
+
+namespace ipsm {
+
+class offset_handle_table::recovering_lock_guard {
+public:
+	explicit recovering_lock_guard( const offset_handle_table& table )
+	  : p_table_( const_cast<offset_handle_table*>( &table ) )
+	{
+		if ( !p_table_->mtx_.lock_and_check_owner_dead() ) {
+			return;
+		}
+		// 移動中または解放中に所有者が終了した場合、スロットが移動中のまま残り、ピン止めが永久に待たされるため、回復させる。
+		p_table_->recover_nolock();
+	}
+	~recovering_lock_guard()
+	{
+		p_table_->mtx_.unlock();
+	}
+
+private:
+	recovering_lock_guard( const recovering_lock_guard& )            = delete;
+	recovering_lock_guard& operator=( const recovering_lock_guard& ) = delete;
+
+	offset_handle_table* p_table_;
+};
+
+void* offset_handle_slot::pin( void ) noexcept
+{
+	int num_of_yields = 0;
+	int cur_cnt       = pin_cnt_.load( std::memory_order_acquire );
+	while ( true ) {
+		if ( cur_cnt == moving ) {
+			if ( num_of_yields < max_num_of_moving_yields ) {
+				// 移動は、memcpy1回分の時間で完了するため、スリープせずに待つ。
+				std::this_thread::yield();
+				num_of_yields++;
+			} else {
+				// 移動するプロセスはmtx_を保持しているため、mtx_の取得で移動の完了を待つ。移動中に終了していた場合は、取得時に回復される。
+				op_table_->wait_for_moving();
+				num_of_yields = 0;
+			}
+			cur_cnt = pin_cnt_.load( std::memory_order_acquire );
+			continue;
+		}
+		if ( pin_cnt_.compare_exchange_weak( cur_cnt, cur_cnt + 1, std::memory_order_acquire, std::memory_order_acquire ) ) {
+			break;
+		}
+	}
+	// 移動中の更新は、pin_cnt_がmovingの間に行われ、release順序でpin_cnt_が戻されるため、ここで読み出すアドレスは移動後のアドレスとなる。
+	return op_block_.get();
+}
+
+void offset_handle_slot::unpin( void ) noexcept
+{
+	pin_cnt_.fetch_sub( 1, std::memory_order_release );
+}
+
+offset_handle_table::offset_handle_table( const offset_malloc& src, size_t num_of_slots )
+  : allocator_( src )
+  , op_slots_( nullptr )
+  , num_of_slots_( num_of_slots )
+  , mtx_()
+  , op_free_top_( nullptr )
+  , num_of_handles_( 0 )
+{
+	if ( num_of_slots == 0 ) {
+		throw std::length_error( "Error: number of slots of offset_handle_table should be bigger than 0" );
+	}
+
+	void* p_slots = allocator_.allocate( sizeof( offset_handle_slot ) * num_of_slots_, alignof( offset_handle_slot ) );
+	if ( p_slots == nullptr ) {
+		throw std::bad_alloc();
+	}
+	op_slots_ = reinterpret_cast<offset_handle_slot*>( p_slots );
+
+	// 先頭のスロットから順に使用されるように、末尾から空きリストを構築する。
+	offset_handle_slot* p_next = nullptr;
+	for ( size_t i = num_of_slots_; i > 0; i-- ) {
+		offset_handle_slot* p_slot = new ( op_slots_.get() + ( i - 1 ) ) offset_handle_slot;
+		p_slot->op_block_          = nullptr;
+		p_slot->op_next_free_      = p_next;
+		p_slot->op_table_          = this;
+		p_slot->alignment_         = 0;
+		p_slot->pin_cnt_.store( 0, std::memory_order_relaxed );
+		p_next = p_slot;
+	}
+	op_free_top_ = p_next;
+}
+
+offset_handle_table::~offset_handle_table()
+{
+	if ( op_slots_ == nullptr ) {
+		return;
+	}
+	if ( num_of_handles_ != 0 ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_handle_table(%p) is destructed with %zu live handles. the memory blocks are released", this, num_of_handles_ );
+	}
+	for ( size_t i = 0; i < num_of_slots_; i++ ) {
+		offset_handle_slot& slot = op_slots_.get()[i];
+		if ( slot.op_block_ != nullptr ) {
+			allocator_.deallocate( slot.op_block_.get(), slot.alignment_ );
+		}
+		slot.~offset_handle_slot();
+	}
+	allocator_.deallocate( op_slots_.get(), alignof( offset_handle_slot ) );
+}
+
+offset_handle_slot* offset_handle_table::allocate_slot( size_t req_bytes, size_t alignment )
+{
+	recovering_lock_guard lk( *this );
+
+	offset_handle_slot* p_slot = op_free_top_.get();
+	if ( p_slot == nullptr ) {
+		return nullptr;
+	}
+	void* p_block = allocator_.allocate( req_bytes, alignment );
+	if ( p_block == nullptr ) {
+		return nullptr;
+	}
+	op_free_top_          = p_slot->op_next_free_;
+	p_slot->op_next_free_ = nullptr;
+	p_slot->op_block_     = p_block;
+	p_slot->alignment_    = alignment;
+	p_slot->pin_cnt_.store( 1, std::memory_order_release );
+	num_of_handles_++;
+	return p_slot;
+}
+
+bool offset_handle_table::release_slot( offset_handle_slot* p_slot, int timeout_msec )
+{
+	if ( p_slot == nullptr ) {
+		return false;
+	}
+	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p_slot );
+	uintptr_t addr_top = reinterpret_cast<uintptr_t>( op_slots_.get() );
+	uintptr_t addr_end = reinterpret_cast<uintptr_t>( op_slots_.get() + num_of_slots_ );
+	if ( ( addr_p < addr_top ) || ( addr_end <= addr_p ) || ( ( addr_p - addr_top ) % sizeof( offset_handle_slot ) ) != 0 ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: incorrect release is requested. it is not a slot of this table, p_slot=%p", p_slot );
+#ifdef NDEBUG
+		return false;
+#else
+		throw std::out_of_range( "Error: release requested addr of p_slot is not a slot of this table" );
+#endif
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds( timeout_msec );
+	while ( true ) {
+		{
+			recovering_lock_guard lk( *this );
+
+			if ( p_slot->op_block_ == nullptr ) {
+				psm_logoutput( psm_log_lv::kErr, "Error: the slot(%p) is already released", p_slot );
+#ifdef NDEBUG
+				return false;
+#else
+				throw std::logic_error( "Error: the slot is already released" );
+#endif
+			}
+
+			// ピン止めが解除されていれば、以降のピン止めを待たせる。解放後のスロットをピン止めすることは、ハンドルの誤用となる。
+			int expected = 0;
+			if ( p_slot->pin_cnt_.compare_exchange_strong( expected, offset_handle_slot::moving, std::memory_order_acquire, std::memory_order_relaxed ) ) {
+				// 解放の途中で所有者が終了しても、解放済みのブロックを参照し続けないように、先にスロットから外す。その場合、ブロックはリークする。
+				void* p_block         = p_slot->op_block_.get();
+				p_slot->op_block_     = nullptr;
+				p_slot->op_next_free_ = op_free_top_;
+				op_free_top_          = p_slot;
+				num_of_handles_--;
+				allocator_.deallocate( p_block, p_slot->alignment_ );
+				p_slot->pin_cnt_.store( 0, std::memory_order_release );
+				return true;
+			}
+		}
+
+		// ピン止めしたまま終了したプロセスのピン止めは解除されないため、待ち時間に上限を設ける。
+		// 待っている間は、ピン止めしているスレッドがスロットの確保やコンパクションを行えるように、mtx_を保持しない。
+		if ( std::chrono::steady_clock::now() >= deadline ) {
+			psm_logoutput( psm_log_lv::kWarn, "Warning: the slot(%p) is still pinned after %d msec. it is not released", p_slot, timeout_msec );
+			return false;
+		}
+		std::this_thread::yield();
+	}
+}
+
+size_t offset_handle_table::compact( void )
+{
+	recovering_lock_guard lk( *this );
+
+	// 低いアドレスのブロックから順に移動することで、移動元の領域が後続のブロックの移動先として使われ、空き領域が高いアドレス側に集まる。
+	std::vector<offset_handle_slot*> live_slots;
+	live_slots.reserve( num_of_handles_ );
+	for ( size_t i = 0; i < num_of_slots_; i++ ) {
+		offset_handle_slot* p_slot = op_slots_.get() + i;
+		if ( p_slot->op_block_ != nullptr ) {
+			live_slots.push_back( p_slot );
+		}
+	}
+	std::sort( live_slots.begin(), live_slots.end(), []( offset_handle_slot* p_a, offset_handle_slot* p_b ) {
+		return p_a->op_block_.get() < p_b->op_block_.get();
+	} );
+
+	size_t num_of_moved = 0;
+	for ( auto p_slot : live_slots ) {
+		int expected = 0;
+		if ( !p_slot->pin_cnt_.compare_exchange_strong( expected, offset_handle_slot::moving, std::memory_order_acquire, std::memory_order_relaxed ) ) {
+			continue;   // ピン止めされているブロックは移動しない。
+		}
+		// op_block_は、ヒープの更新と同じ取り消しエントリで書き換わるため、移動の途中で終了しても、解放済みのブロックを参照しない。
+		void* p_cur_block = p_slot->op_block_.get();
+		void* p_new_block = allocator_.relocate_to_lower_address( p_cur_block, p_slot->alignment_, &( p_slot->op_block_ ) );
+		if ( p_new_block != p_cur_block ) {
+			num_of_moved++;
+		}
+		p_slot->pin_cnt_.store( 0, std::memory_order_release );
+	}
+	return num_of_moved;
+}
+
+size_t offset_handle_table::get_num_of_handles( void ) const
+{
+	recovering_lock_guard lk( *this );
+	return num_of_handles_;
+}
+
+void offset_handle_table::recover_nolock( void )
+{
+	// 移動の途中で所有者が終了した場合、op_block_はヒープの回復で移動前に戻るため、スロットを参照する前にヒープを回復させる。
+	// 全アリーナのロックを取得する統計の取得で、中断された更新を回復する。
+	static_cast<void>( allocator_.get_stats() );
+
+	// 空きスロットのリストと使用中のスロットの数は、更新の途中で所有者が終了した可能性があるため、op_block_から再構築する。
+	offset_handle_slot* p_next         = nullptr;
+	size_t              num_of_handles = 0;
+	for ( size_t i = num_of_slots_; i > 0; i-- ) {
+		offset_handle_slot* p_slot = op_slots_.get() + ( i - 1 );
+		if ( p_slot->pin_cnt_.load( std::memory_order_acquire ) == offset_handle_slot::moving ) {
+			p_slot->pin_cnt_.store( 0, std::memory_order_release );
+		}
+		if ( p_slot->op_block_ == nullptr ) {
+			p_slot->op_next_free_ = p_next;
+			p_next                = p_slot;
+		} else {
+			num_of_handles++;
+		}
+	}
+	op_free_top_    = p_next;
+	num_of_handles_ = num_of_handles;
+	psm_logoutput( psm_log_lv::kWarn, "Warning: offset_handle_table(%p) is recovered, because the owner of the mutex died. number of handles=%zu", this, num_of_handles_ );
+}
+
+void offset_handle_table::wait_for_moving( void ) noexcept
+{
+	try {
+		recovering_lock_guard lk( *this );
+	} catch ( std::exception& e ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: fail to lock the mutex of offset_handle_table(%p) to wait for the moving, %s", this, e.what() );
+	}
+}
+
+}   // namespace ipsm
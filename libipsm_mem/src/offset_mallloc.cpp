@@ -9,27 +9,156 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/types.h>
+#include <unistd.h>
+
 #include "ipsm_logger_internal.hpp"
+#include "offset_malloc_growth.hpp"
+#include "offset_malloc_thread_cache.hpp"
 #include "offset_mallloc_impl.hpp"
 #include "offset_malloc.hpp"
 
 namespace ipsm {
 
+namespace {
+
+/**
+ * @brief get the seed to map the calling thread to an arena
+ *
+ * threads in a process are mapped to arenas by round robin, and the start position depends on the process id.
+ * therefore threads in different processes are also spread over arenas.
+ */
+size_t get_arena_seed_of_this_thread( void )
+{
+	static std::atomic<size_t> next_seed( static_cast<size_t>( getpid() ) );
+	thread_local size_t        seed = next_seed.fetch_add( 1, std::memory_order_relaxed );
+	return seed;
+}
+
+/**
+ * @brief find the arena of the additional heaps that p_mem belongs to via the growth handler of p_impl
+ *
+ * @return pointer to the arena. if p_mem does not belong to any additional heap, or no growth handler is registered for p_impl, return nullptr.
+ */
+offset_malloc::offset_malloc_impl* find_arena_of_additional_heaps( offset_malloc::offset_malloc_impl* p_impl, void* p_mem )
+{
+	offset_malloc_growth_handler* p_handler = offset_malloc_growth::find_handler( p_impl );
+	if ( p_handler == nullptr ) {
+		return nullptr;
+	}
+	for ( size_t i = 0;; i++ ) {
+		offset_malloc::offset_malloc_impl* p_heap = p_handler->get_heap( i );
+		if ( p_heap == nullptr ) {
+			return nullptr;
+		}
+		offset_malloc::offset_malloc_impl* p_arena = p_heap->find_arena( p_mem );
+		if ( p_arena != nullptr ) {
+			return p_arena;
+		}
+	}
+}
+
+/**
+ * @brief number of pointers that deallocate_bulk() sorts at once on the stack
+ */
+constexpr size_t bulk_free_chunk_size = 64;
+
+/**
+ * @brief deallocate the pointers that are sorted by address. the pointers of each arena are deallocated by one call of deallocate_bulk() of the arena.
+ */
+void deallocate_sorted_ptrs( offset_malloc::offset_malloc_impl* p_impl, void* const* sorted_ptrs, size_t n, size_t alignment )
+{
+	// アリーナはアドレス順に配置されているため、アドレス順に並べたポインタはアリーナごとに連続する。
+	size_t i = 0;
+	while ( i < n ) {
+		offset_malloc::offset_malloc_impl* p_arena = p_impl->find_arena( sorted_ptrs[i] );
+		if ( p_arena == nullptr ) {
+			// 拡張されたヒープにも属さない場合のエラー処理は、先頭のアリーナに任せる。
+			p_arena = find_arena_of_additional_heaps( p_impl, sorted_ptrs[i] );
+			if ( p_arena == nullptr ) {
+				p_arena = p_impl;
+			}
+			p_arena->deallocate( sorted_ptrs[i], alignment );
+			i++;
+			continue;
+		}
+		size_t j = i + 1;
+		while ( ( j < n ) && p_arena->is_belong_to( sorted_ptrs[j] ) ) {
+			j++;
+		}
+		p_arena->deallocate_bulk( &( sorted_ptrs[i] ), j - i, alignment );
+		i = j;
+	}
+}
+
+/**
+ * @brief allocate from the additional heaps via the growth handler of p_impl. if the additional heaps could not allocate, add a new heap.
+ */
+void* allocate_from_additional_heaps( offset_malloc::offset_malloc_impl* p_impl, size_t req_bytes, size_t alignment, unsigned int owner_id )
+{
+	offset_malloc_growth_handler* p_handler = offset_malloc_growth::find_handler( p_impl );
+	if ( p_handler == nullptr ) {
+		return nullptr;
+	}
+	while ( true ) {
+		size_t num_of_heaps = 0;
+		while ( p_handler->get_heap( num_of_heaps ) != nullptr ) {
+			num_of_heaps++;
+		}
+		// 後から追加されたヒープほど大きく、空きが多いため、後ろから確保を試みる。
+		for ( size_t i = num_of_heaps; i > 0; i-- ) {
+			offset_malloc::offset_malloc_impl* p_heap = p_handler->get_heap( i - 1 );
+			for ( size_t j = 0; j < p_heap->get_num_of_arenas(); j++ ) {
+				void* p_ans = p_heap->get_arena( j )->allocate( req_bytes, alignment, owner_id );
+				if ( p_ans != nullptr ) {
+					return p_ans;
+				}
+			}
+		}
+		// 追加できるヒープの数には上限があるため、このループは有限回で終了する。
+		if ( !p_handler->grow( req_bytes, alignment ) ) {
+			return nullptr;
+		}
+	}
+}
+
+}   // namespace
+
 offset_malloc::~offset_malloc()
 {
+	if ( use_thread_cache_ ) {
+		offset_malloc_thread_cache::drain_all_threads( p_impl_ );
+	}
+	if ( use_deferred_free_ ) {
+		drain_deferred_free();
+	}
 	offset_malloc_impl::unbind( p_impl_ );
 	p_impl_ = nullptr;
 }
 
 offset_malloc::offset_malloc( const offset_malloc& src )
   : p_impl_( offset_malloc_impl::bind( src.p_impl_ ) )
+  , use_thread_cache_( false )
+  , use_deferred_free_( false )
+  , owner_id_( 0 )
 {
 }
 
 offset_malloc::offset_malloc( offset_malloc&& src ) noexcept
   : p_impl_( src.p_impl_ )   // NOLINT(cert-oop11-cpp)
+  , use_thread_cache_( src.use_thread_cache_ )
+  , use_deferred_free_( src.use_deferred_free_ )
+  , owner_id_( src.owner_id_ )
 {
-	src.p_impl_ = nullptr;
+	src.p_impl_            = nullptr;
+	src.use_thread_cache_  = false;
+	src.use_deferred_free_ = false;
+	src.owner_id_          = 0;
 }
 
 offset_malloc& offset_malloc::operator=( const offset_malloc& src )
@@ -37,6 +166,12 @@ offset_malloc& offset_malloc::operator=( const offset_malloc& src )
 	if ( this == &src ) return *this;
 	if ( p_impl_ == src.p_impl_ ) return *this;   // 同一のメモリ領域を指している場合は、何もしない
 
+	if ( use_thread_cache_ ) {
+		offset_malloc_thread_cache::drain_all_threads( p_impl_ );
+	}
+	if ( use_deferred_free_ ) {
+		drain_deferred_free();
+	}
 	offset_malloc_impl::unbind( p_impl_ );
 	p_impl_ = offset_malloc_impl::bind( src.p_impl_ );
 
@@ -48,14 +183,33 @@ offset_malloc& offset_malloc::operator=( offset_malloc&& src ) noexcept
 	if ( this == &src ) return *this;
 	if ( p_impl_ == src.p_impl_ ) {
 		// 同一のメモリ領域を指している場合は、src側を開放するだけ。
+		// src側のキャッシュ設定は、同一のメモリ領域に対する設定なので引き継ぐ。
 		offset_malloc_impl::unbind( src.p_impl_ );
-		src.p_impl_ = nullptr;
+		use_thread_cache_      = use_thread_cache_ || src.use_thread_cache_;
+		use_deferred_free_     = use_deferred_free_ || src.use_deferred_free_;
+		owner_id_              = ( owner_id_ != 0 ) ? owner_id_ : src.owner_id_;
+		src.p_impl_            = nullptr;
+		src.use_thread_cache_  = false;
+		src.use_deferred_free_ = false;
+		src.owner_id_          = 0;
 		return *this;
 	}
 
+	if ( use_thread_cache_ ) {
+		offset_malloc_thread_cache::drain_all_threads( p_impl_ );
+	}
+	if ( use_deferred_free_ ) {
+		drain_deferred_free();
+	}
 	offset_malloc_impl::unbind( p_impl_ );
-	p_impl_     = src.p_impl_;
-	src.p_impl_ = nullptr;
+	p_impl_                = src.p_impl_;
+	use_thread_cache_      = src.use_thread_cache_;
+	use_deferred_free_     = src.use_deferred_free_;
+	owner_id_              = src.owner_id_;
+	src.p_impl_            = nullptr;
+	src.use_thread_cache_  = false;
+	src.use_deferred_free_ = false;
+	src.owner_id_          = 0;
 
 	return *this;
 }
@@ -67,15 +221,33 @@ void offset_malloc::swap( offset_malloc& src )
 	offset_malloc_impl* p_tmp = p_impl_;
 	p_impl_                   = src.p_impl_;
 	src.p_impl_               = p_tmp;
+
+	bool tmp_use_thread_cache = use_thread_cache_;
+	use_thread_cache_         = src.use_thread_cache_;
+	src.use_thread_cache_     = tmp_use_thread_cache;
+
+	bool tmp_use_deferred_free = use_deferred_free_;
+	use_deferred_free_         = src.use_deferred_free_;
+	src.use_deferred_free_     = tmp_use_deferred_free;
+
+	unsigned int tmp_owner_id = owner_id_;
+	owner_id_                 = src.owner_id_;
+	src.owner_id_             = tmp_owner_id;
 }
 
-offset_malloc::offset_malloc( void* p_mem, size_t mem_bytes )
-  : p_impl_( offset_malloc_impl::placement_new( p_mem, reinterpret_cast<void*>( reinterpret_cast<uintptr_t>( p_mem ) + mem_bytes ) ) )
+offset_malloc::offset_malloc( void* p_mem, size_t mem_bytes, offset_malloc_policy policy, size_t num_of_arenas )
+  : p_impl_( offset_malloc_impl::placement_new( p_mem, reinterpret_cast<void*>( reinterpret_cast<uintptr_t>( p_mem ) + mem_bytes ), policy, num_of_arenas ) )
+  , use_thread_cache_( false )
+  , use_deferred_free_( false )
+  , owner_id_( 0 )
 {
 }
 
 offset_malloc::offset_malloc( void* p_mem )
   : p_impl_( offset_malloc_impl::bind( reinterpret_cast<offset_malloc_impl*>( p_mem ) ) )
+  , use_thread_cache_( false )
+  , use_deferred_free_( false )
+  , owner_id_( 0 )
 {
 }
 
@@ -85,7 +257,25 @@ void* offset_malloc::allocate( size_t req_bytes, size_t alignment )
 		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to allocate, but p_impl_ is nullptr", this );
 		return nullptr;
 	}
-	return p_impl_->allocate( req_bytes, alignment );
+
+	// スレッドに対応付けられたアリーナから確保し、確保できなければ、他のアリーナから確保する。
+	const size_t num_of_arenas = p_impl_->get_num_of_arenas();
+	const size_t start_idx     = ( num_of_arenas <= 1 ) ? 0 : ( get_arena_seed_of_this_thread() % num_of_arenas );
+	for ( size_t i = 0; i < num_of_arenas; i++ ) {
+		offset_malloc_impl* p_arena = p_impl_->get_arena( ( start_idx + i ) % num_of_arenas );
+		void*               p_ans   = nullptr;
+		if ( use_thread_cache_ && ( owner_id_ == 0 ) ) {
+			p_ans = offset_malloc_thread_cache::allocate( p_arena, req_bytes, alignment );
+		} else {
+			p_ans = p_arena->allocate( req_bytes, alignment, owner_id_ );
+		}
+		if ( p_ans != nullptr ) {
+			return p_ans;
+		}
+	}
+
+	// 全てのアリーナで確保できない場合は、拡張されたヒープから確保する。
+	return allocate_from_additional_heaps( p_impl_, req_bytes, alignment, owner_id_ );
 }
 void offset_malloc::deallocate( void* p, size_t alignment )
 {
@@ -94,7 +284,205 @@ void offset_malloc::deallocate( void* p, size_t alignment )
 		return;
 	}
 
-	p_impl_->deallocate( p, alignment );
+	// アドレスから所属するアリーナを特定して返却する。どのアリーナにも属さない場合のエラー処理は、先頭のアリーナに任せる。
+	offset_malloc_impl* p_arena = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		// 拡張されたヒープは、スレッドキャッシュと遅延解放の対象外とし、直接返却する。
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+		if ( p_arena == nullptr ) {
+			p_arena = p_impl_.get();
+		}
+		p_arena->deallocate( p, alignment );
+		return;
+	}
+
+	// 所有者のあるブロックは、キャッシュから他の確保に渡らないように、キャッシュを経由せずに返却する。
+	if ( use_thread_cache_ && ( p_arena->get_owner_id_of_allocated( p ) == 0 ) ) {
+		offset_malloc_thread_cache::deallocate( p_arena, p, alignment );
+		return;
+	}
+	if ( use_deferred_free_ ) {
+		p_arena->deallocate_deferred( p );
+		return;
+	}
+	p_arena->deallocate( p, alignment );
+}
+
+void offset_malloc::deallocate_sized( void* p, size_t req_bytes, size_t alignment )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to deallocate, but p_impl_ is nullptr", this );
+		return;
+	}
+
+	bool                is_additional_heap = false;
+	offset_malloc_impl* p_arena            = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+		if ( p_arena == nullptr ) {
+			p_impl_->deallocate( p, alignment );
+			return;
+		}
+		is_additional_heap = true;
+	}
+
+#ifndef NDEBUG
+	if ( !p_arena->is_valid_size_of_allocated( p, req_bytes, alignment ) ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: the size of deallocation does not match to the allocated memory block, p=%p, req_bytes=%zu, alignment=%zu", p, req_bytes, alignment );
+		throw std::logic_error( "Error: the size of deallocation does not match to the allocated memory block" );
+	}
+#endif
+
+	if ( is_additional_heap ) {
+		p_arena->deallocate( p, alignment );
+		return;
+	}
+	// 要求サイズからスレッドキャッシュの対象外であることがわかる場合は、キャッシュを経由せずにアリーナへ返却する。
+	// 対象の場合も、サイズクラスは要求サイズから求めたものを渡し、ブロックヘッダからの分類を省く。
+	// 切り出せない1単位分だけ大きなブロックは、要求サイズのサイズクラスにキャッシュされるが、そのサイズクラスの確保にはそのまま使える。
+	const size_t size_class = offset_malloc_impl::get_size_class_of_request( req_bytes, alignment );
+	if ( use_thread_cache_ && ( size_class < offset_malloc_impl::num_of_size_classes ) && ( p_arena->get_owner_id_of_allocated( p ) == 0 ) ) {
+		offset_malloc_thread_cache::deallocate_in_size_class( p_arena, p, size_class, alignment );
+		return;
+	}
+	if ( use_deferred_free_ ) {
+		p_arena->deallocate_deferred( p );
+		return;
+	}
+	p_arena->deallocate( p, alignment );
+}
+
+void* offset_malloc::reallocate( void* p, size_t new_size, size_t alignment )
+{
+	if ( p == nullptr ) {
+		return allocate( new_size, alignment );
+	}
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to reallocate, but p_impl_ is nullptr", this );
+		return nullptr;
+	}
+
+	offset_malloc_impl* p_arena = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+	}
+	if ( p_arena == nullptr ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: incorrect reallocation is requested. p=%p does not belong to offset_malloc(%p)", p, this );
+		return nullptr;
+	}
+
+	size_t cur_size = p_arena->get_usable_size( p );
+	if ( new_size <= cur_size ) {
+		p_arena->shrink( p, new_size );
+		return p;
+	}
+	if ( p_arena->try_expand( p, new_size ) ) {
+		return p;
+	}
+
+	void* p_ans = allocate( new_size, alignment );
+	if ( p_ans == nullptr ) {
+		return nullptr;
+	}
+	std::memcpy( p_ans, p, cur_size );
+	deallocate( p, alignment );
+	return p_ans;
+}
+
+bool offset_malloc::try_expand( void* p, size_t new_size )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to expand, but p_impl_ is nullptr", this );
+		return false;
+	}
+
+	offset_malloc_impl* p_arena = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+	}
+	if ( p_arena == nullptr ) {
+		return false;
+	}
+	return p_arena->try_expand( p, new_size );
+}
+
+void* offset_malloc::relocate_to_lower_address( void* p, size_t alignment, offset_ptr<void>* p_referrer )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to relocate, but p_impl_ is nullptr", this );
+		return p;
+	}
+
+	offset_malloc_impl* p_arena = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+	}
+	if ( p_arena == nullptr ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: incorrect relocation is requested. p=%p does not belong to offset_malloc(%p)", p, this );
+		return p;
+	}
+	return p_arena->relocate_to_lower_address( p, alignment, p_referrer );
+}
+
+size_t offset_malloc::allocate_bulk( size_t req_bytes, size_t alignment, size_t n, void** pp_out )
+{
+	size_t num_of_allocated = 0;
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to allocate, but p_impl_ is nullptr", this );
+	} else {
+		// スレッドに対応付けられたアリーナから確保し、不足分を他のアリーナから確保する。アリーナごとにロックは1回となる。
+		const size_t num_of_arenas = p_impl_->get_num_of_arenas();
+		const size_t start_idx     = ( num_of_arenas <= 1 ) ? 0 : ( get_arena_seed_of_this_thread() % num_of_arenas );
+		for ( size_t i = 0; ( i < num_of_arenas ) && ( num_of_allocated < n ); i++ ) {
+			offset_malloc_impl* p_arena = p_impl_->get_arena( ( start_idx + i ) % num_of_arenas );
+			num_of_allocated += p_arena->allocate_bulk( req_bytes, alignment, n - num_of_allocated, &( pp_out[num_of_allocated] ), owner_id_ );
+		}
+		// 不足分は、拡張されたヒープから1つずつ確保する。
+		for ( ; num_of_allocated < n; num_of_allocated++ ) {
+			pp_out[num_of_allocated] = allocate_from_additional_heaps( p_impl_, req_bytes, alignment, owner_id_ );
+			if ( pp_out[num_of_allocated] == nullptr ) {
+				break;
+			}
+		}
+	}
+
+	for ( size_t i = num_of_allocated; i < n; i++ ) {
+		pp_out[i] = nullptr;
+	}
+	return num_of_allocated;
+}
+
+void offset_malloc::deallocate_bulk( void* const* pp, size_t n, size_t alignment )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to deallocate, but p_impl_ is nullptr", this );
+		return;
+	}
+
+	if ( use_thread_cache_ ) {
+		// スレッドキャッシュが、バッチ単位で一括返却する。
+		for ( size_t i = 0; i < n; i++ ) {
+			if ( pp[i] != nullptr ) {
+				deallocate( pp[i], alignment );
+			}
+		}
+		return;
+	}
+
+	// 呼び出しごとのヒープ確保を避けるため、固定長のスタック上のバッファに分けて並べ替える。
+	void*  sorted_ptrs[bulk_free_chunk_size];
+	size_t k = 0;
+	while ( k < n ) {
+		size_t num_of_ptrs = 0;
+		for ( ; ( k < n ) && ( num_of_ptrs < bulk_free_chunk_size ); k++ ) {
+			if ( pp[k] != nullptr ) {
+				sorted_ptrs[num_of_ptrs] = pp[k];
+				num_of_ptrs++;
+			}
+		}
+		std::sort( sorted_ptrs, sorted_ptrs + num_of_ptrs );
+		deallocate_sorted_ptrs( p_impl_.get(), sorted_ptrs, num_of_ptrs, alignment );
+	}
 }
 
 int offset_malloc::get_bind_count( void ) const
@@ -113,7 +501,203 @@ bool offset_malloc::is_belong_to( void* p_mem ) const noexcept
 		return false;
 	}
 
-	return p_impl_->is_belong_to( p_mem );
+	if ( p_impl_->find_arena( p_mem ) != nullptr ) {
+		return true;
+	}
+	return find_arena_of_additional_heaps( p_impl_, p_mem ) != nullptr;
+}
+
+offset_malloc_stats offset_malloc::get_stats( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kDebug, "Debug: p_impl_ = offset_malloc(%p) is nullptr", this );
+		return offset_malloc_stats {};
+	}
+
+	const size_t                  num_of_arenas = p_impl_->get_num_of_arenas();
+	offset_malloc_growth_handler* p_handler     = offset_malloc_growth::find_handler( p_impl_ );
+	if ( ( num_of_arenas == 1 ) && ( ( p_handler == nullptr ) || ( p_handler->get_heap( 0 ) == nullptr ) ) ) {
+		return p_impl_->get_stats();
+	}
+
+	offset_malloc_stats ans {};
+
+	auto add_arena_stats = [&ans]( offset_malloc_impl* p_arena ) {
+		offset_malloc_stats arena_stats = p_arena->get_stats();
+		ans.total_bytes_ += arena_stats.total_bytes_;
+		ans.free_bytes_ += arena_stats.free_bytes_;
+		ans.num_of_free_blocks_ += arena_stats.num_of_free_blocks_;
+		ans.num_of_allocated_blocks_ += arena_stats.num_of_allocated_blocks_;
+		if ( ans.largest_free_block_bytes_ < arena_stats.largest_free_block_bytes_ ) {
+			ans.largest_free_block_bytes_ = arena_stats.largest_free_block_bytes_;
+		}
+	};
+	for ( size_t i = 0; i < num_of_arenas; i++ ) {
+		add_arena_stats( p_impl_->get_arena( i ) );
+	}
+	if ( p_handler != nullptr ) {
+		for ( size_t i = 0; p_handler->get_heap( i ) != nullptr; i++ ) {
+			offset_malloc_impl* p_heap = p_handler->get_heap( i );
+			for ( size_t j = 0; j < p_heap->get_num_of_arenas(); j++ ) {
+				add_arena_stats( p_heap->get_arena( j ) );
+			}
+		}
+	}
+	ans.fragmentation_ratio_ = ( ans.free_bytes_ == 0 ) ? 0.0 : ( 1.0 - static_cast<double>( ans.largest_free_block_bytes_ ) / static_cast<double>( ans.free_bytes_ ) );
+	return ans;
+}
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+offset_malloc_size_class_histogram offset_malloc::get_size_class_histogram( void ) const
+{
+	offset_malloc_size_class_histogram ans {};
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kDebug, "Debug: p_impl_ = offset_malloc(%p) is nullptr", this );
+		return ans;
+	}
+
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		p_impl_->get_arena( i )->add_size_class_histogram( ans );
+	}
+	offset_malloc_growth_handler* p_handler = offset_malloc_growth::find_handler( p_impl_ );
+	if ( p_handler != nullptr ) {
+		for ( size_t i = 0; p_handler->get_heap( i ) != nullptr; i++ ) {
+			offset_malloc_impl* p_heap = p_handler->get_heap( i );
+			for ( size_t j = 0; j < p_heap->get_num_of_arenas(); j++ ) {
+				p_heap->get_arena( j )->add_size_class_histogram( ans );
+			}
+		}
+	}
+	return ans;
+}
+#endif
+
+size_t offset_malloc::get_num_of_arenas( void ) const noexcept
+{
+	if ( p_impl_ == nullptr ) {
+		return 0;
+	}
+	return p_impl_->get_num_of_arenas();
+}
+
+void offset_malloc::set_thread_cache( bool enable )
+{
+	if ( use_thread_cache_ && !enable ) {
+		offset_malloc_thread_cache::drain_all_threads( p_impl_ );
+	}
+	use_thread_cache_ = enable;
+}
+
+void offset_malloc::set_deferred_free( bool enable )
+{
+	if ( use_deferred_free_ && !enable ) {
+		drain_deferred_free();
+	}
+	use_deferred_free_ = enable;
+}
+
+void offset_malloc::set_deferred_coalescing( bool enable )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to set deferred coalescing, but p_impl_ is nullptr", this );
+		return;
+	}
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		p_impl_->get_arena( i )->set_deferred_coalescing( enable );
+	}
+}
+
+bool offset_malloc::is_deferred_coalescing_enabled( void ) const
+{
+	if ( p_impl_ == nullptr ) {
+		return false;
+	}
+	return p_impl_->is_deferred_coalescing();
+}
+
+void offset_malloc::set_page_bytes( size_t page_bytes )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to set page size, but p_impl_ is nullptr", this );
+		return;
+	}
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		p_impl_->get_arena( i )->set_page_bytes( page_bytes );
+	}
+}
+
+void offset_malloc::disown( void* p )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to disown, but p_impl_ is nullptr", this );
+		return;
+	}
+
+	offset_malloc_impl* p_arena = p_impl_->find_arena( p );
+	if ( p_arena == nullptr ) {
+		p_arena = find_arena_of_additional_heaps( p_impl_, p );
+	}
+	if ( p_arena == nullptr ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: incorrect disown is requested. p=%p does not belong to offset_malloc(%p)", p, this );
+		return;
+	}
+	p_arena->set_owner_id_of_allocated( p, 0 );
+}
+
+size_t offset_malloc::reclaim_owner( unsigned int owner_id )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to reclaim, but p_impl_ is nullptr", this );
+		return 0;
+	}
+
+	size_t num_of_reclaimed = 0;
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		num_of_reclaimed += p_impl_->get_arena( i )->reclaim_owner( owner_id );
+	}
+	offset_malloc_growth_handler* p_handler = offset_malloc_growth::find_handler( p_impl_ );
+	if ( p_handler != nullptr ) {
+		for ( size_t i = 0; p_handler->get_heap( i ) != nullptr; i++ ) {
+			offset_malloc_impl* p_heap = p_handler->get_heap( i );
+			for ( size_t j = 0; j < p_heap->get_num_of_arenas(); j++ ) {
+				num_of_reclaimed += p_heap->get_arena( j )->reclaim_owner( owner_id );
+			}
+		}
+	}
+	return num_of_reclaimed;
+}
+
+size_t offset_malloc::disown_all( void )
+{
+	if ( p_impl_ == nullptr ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: offset_malloc(%p) is required to disown all, but p_impl_ is nullptr", this );
+		return 0;
+	}
+
+	size_t num_of_disowned = 0;
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		num_of_disowned += p_impl_->get_arena( i )->disown_all();
+	}
+	offset_malloc_growth_handler* p_handler = offset_malloc_growth::find_handler( p_impl_ );
+	if ( p_handler != nullptr ) {
+		for ( size_t i = 0; p_handler->get_heap( i ) != nullptr; i++ ) {
+			offset_malloc_impl* p_heap = p_handler->get_heap( i );
+			for ( size_t j = 0; j < p_heap->get_num_of_arenas(); j++ ) {
+				num_of_disowned += p_heap->get_arena( j )->disown_all();
+			}
+		}
+	}
+	return num_of_disowned;
+}
+
+void offset_malloc::drain_deferred_free( void )
+{
+	if ( p_impl_ == nullptr ) {
+		return;
+	}
+	for ( size_t i = 0; i < p_impl_->get_num_of_arenas(); i++ ) {
+		p_impl_->get_arena( i )->drain_deferred();
+	}
 }
 
 }   // namespace ipsm
@@ -9,8 +9,17 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
+#include <limits>
 #include <mutex>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "ipsm_logger_internal.hpp"
 #include "offset_mallloc_impl.hpp"
@@ -40,22 +49,173 @@ constexpr size_t offset_malloc::offset_malloc_impl::bytes2blocksize( size_t byte
 	return ( bytes + sizeof( block::block_header ) - 1 ) / sizeof( block::block_header );
 }
 
-offset_malloc::offset_malloc_impl::offset_malloc_impl( void* end_pointer )
+constexpr size_t offset_malloc::offset_malloc_impl::size_class_counters_units( void )
+{
+	return bytes2blocksize( sizeof( size_class_counter ) * num_of_size_class_counters );
+}
+
+constexpr bool offset_malloc::offset_malloc_impl::is_bin_size( size_t num_of_units )
+{
+	return ( min_bin_units <= num_of_units ) && ( num_of_units < ( min_bin_units + num_of_bins ) );
+}
+
+namespace {
+std::atomic<void ( * )( size_t )> p_undo_hook( nullptr );   // 回復のテスト用のフック。プロセスローカル
+}
+
+void offset_malloc::offset_malloc_impl::test_set_undo_hook( void ( *p_hook )( size_t num_of_entries ) ) noexcept
+{
+	p_undo_hook.store( p_hook, std::memory_order_release );
+}
+
+/**
+ * @brief lock guard of mtx_ that recovers the free lists, if the previous owner of mtx_ died or failed during the update of them
+ */
+class offset_malloc::offset_malloc_impl::recovering_lock_guard {
+public:
+	explicit recovering_lock_guard( const offset_malloc_impl& arena )
+	  : p_arena_( const_cast<offset_malloc_impl*>( &arena ) )
+	{
+		// 統計情報の取得等のconstなメンバ関数も、壊れた空きブロックリストを参照しないように、回復してから参照する。
+		bool is_owner_dead = p_arena_->mtx_.lock_and_check_owner_dead();
+		if ( !is_owner_dead && ( p_arena_->intent_.state_ == intent_record::state::kIdle ) ) {
+			return;
+		}
+		// 所有者が終了していなくても、更新中に例外が発生した場合は、更新が途中の状態で残っている。
+		try {
+			p_arena_->recover_nolock();
+		} catch ( ... ) {
+			p_arena_->mtx_.unlock();
+			throw;
+		}
+	}
+	~recovering_lock_guard()
+	{
+		p_arena_->mtx_.unlock();
+	}
+
+private:
+	recovering_lock_guard( const recovering_lock_guard& )            = delete;
+	recovering_lock_guard& operator=( const recovering_lock_guard& ) = delete;
+
+	offset_malloc_impl* p_arena_;
+};
+
+/*
+ * 空きブロックリストの更新は、journal_begin()とjournal_commit()の間で行い、変更するフィールドの変更前の値をjournal_record()で記録してから変更する。
+ * 更新中にプロセスが終了した場合でも、実行済みのストアは共有メモリに残るため、記録と変更の順序をコンパイラが入れ替えないことだけを保証すればよい。
+ * 空きブロックの本体に新たに作成するブロックヘッダは、取り消し後は空きブロックの本体に戻るため、記録しない。
+ */
+void offset_malloc::offset_malloc_impl::journal_begin( void ) noexcept
+{
+	if ( intent_.depth_ == 0 ) {
+		intent_.num_of_entries_ = 0;
+		std::atomic_signal_fence( std::memory_order_seq_cst );
+		intent_.state_ = intent_record::state::kInProgress;
+		std::atomic_signal_fence( std::memory_order_seq_cst );
+	}
+	intent_.depth_++;
+}
+
+void offset_malloc::offset_malloc_impl::journal_commit( void ) noexcept
+{
+	intent_.depth_--;
+	if ( intent_.depth_ != 0 ) {
+		return;
+	}
+	std::atomic_signal_fence( std::memory_order_seq_cst );
+	intent_.state_ = intent_record::state::kCommitted;
+	std::atomic_signal_fence( std::memory_order_seq_cst );
+	intent_.num_of_entries_ = 0;
+	intent_.state_          = intent_record::state::kIdle;
+}
+
+template <typename T>
+void offset_malloc::offset_malloc_impl::journal_record( T& field )
+{
+	static_assert( sizeof( T ) == sizeof( std::uint64_t ), "undo entry records 8 bytes field" );
+
+	if ( intent_.num_of_entries_ >= max_num_of_undo_entries ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: undo entries of offset_malloc_impl(%p) overflow. this update could not be rolled back", this );
+#ifdef NDEBUG
+		return;
+#else
+		throw std::logic_error( "Error: undo entries of offset_malloc_impl overflow" );
+#endif
+	}
+	intent_record::undo_entry& entry = intent_.entries_[intent_.num_of_entries_];
+	entry.offset_                    = reinterpret_cast<uintptr_t>( &field ) - reinterpret_cast<uintptr_t>( this );
+	std::memcpy( &( entry.old_value_ ), static_cast<const void*>( &field ), sizeof( std::uint64_t ) );
+	std::atomic_signal_fence( std::memory_order_seq_cst );
+	intent_.num_of_entries_++;
+	std::atomic_signal_fence( std::memory_order_seq_cst );
+
+	auto p_hook = p_undo_hook.load( std::memory_order_acquire );
+	if ( p_hook != nullptr ) {
+		p_hook( intent_.num_of_entries_ );
+	}
+}
+
+void offset_malloc::offset_malloc_impl::set_next_ptr_w_undo( block* p_blk, block* p_nxt )
+{
+	journal_record( p_blk->active_header_.op_next_block_ );
+	p_blk->set_next_ptr( p_nxt );
+}
+
+void offset_malloc::offset_malloc_impl::set_blk_size_w_undo( block* p_blk, size_t ns )
+{
+	journal_record( p_blk->active_header_.size_of_this_block_ );
+	p_blk->set_blk_size( ns );
+}
+
+offset_malloc::offset_malloc_impl::offset_malloc_impl( void* end_pointer, offset_malloc_policy policy, size_t num_of_arenas, size_t arena_stride_bytes )
   : op_end_( reinterpret_cast<unsigned char*>( end_pointer ) )
+  , policy_( policy )
+  , num_of_arenas_( num_of_arenas )
+  , arena_stride_bytes_( arena_stride_bytes )
+  , op_deferred_top_()
+  , num_of_deferred_( 0 )
   , mtx_()
+  , intent_ { intent_record::state::kIdle, 0, 0, {} }
+  , op_detached_top_( nullptr )
   , bind_cnt_( 0 )
+  , deferred_coalescing_( false )
+  , page_bytes_( get_page_bytes() )
+  , total_units_( 0 )
+  , allocated_units_( 0 )
+  , num_of_allocated_blocks_( 0 )
+  , num_of_free_blocks_( 0 )
+  , num_of_uncoalesced_blocks_( 0 )
   , op_freep_( nullptr )
+  , op_addr_index_root_( nullptr )
+  , op_size_index_root_( nullptr )
+  , op_bins_ {}
+  , op_quick_list_( nullptr )
+  , op_size_class_counters_( nullptr )
   , base_blk_( nullptr, 0 )
 {
-	uintptr_t addr_end        = reinterpret_cast<uintptr_t>( op_end_.get() );
-	uintptr_t addr_buff       = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
-	uintptr_t addr_top        = ( ( addr_buff + size_of_block_header() - 1 ) / size_of_block_header() ) * size_of_block_header();
-	uintptr_t addr_buff_start = addr_top + reinterpret_cast<uintptr_t>( sizeof( offset_malloc::offset_malloc_impl ) );
+	uintptr_t addr_end  = reinterpret_cast<uintptr_t>( op_end_.get() );
+	uintptr_t addr_buff = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
+	uintptr_t addr_top  = ( ( addr_buff + size_of_block_header() - 1 ) / size_of_block_header() ) * size_of_block_header();
 
-	if ( addr_end <= addr_buff_start ) {
+	// base_blk_はこのクラス構造の末尾のメンバ変数なので、addr_top以降がそのまま割り当て可能な領域になる。
+	if ( addr_end <= addr_top ) {
 		throw std::bad_alloc();
 	}
-	uintptr_t buff_lenght = addr_end - addr_buff_start;
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	// 統計カウンタをクラス構造の外に配置することで、ビルドオプションによらずクラス構造のレイアウトを同じにする。
+	// 小さなヒープでは、割り当て可能な領域を圧迫しないように確保しない。
+	if ( ( size_class_counters_units() * size_class_counters_heap_ratio ) <= ( ( addr_end - addr_top ) / size_of_block_header() ) ) {
+		size_class_counter* p_counters = reinterpret_cast<size_class_counter*>( addr_top );
+		for ( size_t i = 0; i < num_of_size_class_counters; i++ ) {
+			new ( p_counters + i ) size_class_counter {};
+		}
+		op_size_class_counters_ = p_counters;
+		addr_top += size_class_counters_units() * size_of_block_header();
+	}
+#endif
+	uintptr_t buff_lenght = addr_end - addr_top;
 
 	size_t num_of_blocks = buff_lenght / size_of_block_header();
 	if ( num_of_blocks < 2 ) {
@@ -66,76 +226,185 @@ offset_malloc::offset_malloc_impl::offset_malloc_impl( void* end_pointer )
 	base_blk_.set_next_ptr( p_1st_blk );
 
 	op_freep_ = &base_blk_;
+	addr_index_insert( p_1st_blk );
+	size_index_insert( p_1st_blk );
+	total_units_        = p_1st_blk->get_blk_size();
+	num_of_free_blocks_ = 1;
 
 	bind_cnt_ = 1;
 }
 
+constexpr size_t offset_malloc::offset_malloc_impl::calc_req_num_of_blocks_w_header( size_t req_bytes, size_t alignment )
+{
+	// 解放後にサイズクラスのリストやアドレス順インデックスへつなげられるように、アライメントの補正後もブロック本体の最小サイズを確保する。
+	return bytes2blocksize( ( ( req_bytes == 0 ) ? 1 : req_bytes ) + ( ( alignment <= size_of_block_header() ) ? 0 : ( alignment - size_of_block_header() ) ) ) + 1;
+}
+
+size_t offset_malloc::offset_malloc_impl::get_page_bytes( void ) noexcept
+{
+	static const size_t page_bytes = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+	return page_bytes;
+}
+
+bool offset_malloc::offset_malloc_impl::adjust_large_request( size_t& req_bytes, size_t& alignment ) noexcept
+{
+	if ( req_bytes < large_block_threshold_bytes ) {
+		return false;
+	}
+	const size_t page_bytes = get_page_bytes();
+	if ( req_bytes > ( std::numeric_limits<size_t>::max() - page_bytes ) ) {
+		// 割り当てられない大きさなので、補正しない。
+		return false;
+	}
+	// 解放時にページ単位で返却できるように、ブロック本体をページ境界から始まるページ単位の領域にする。
+	req_bytes = ( ( req_bytes + page_bytes - 1 ) / page_bytes ) * page_bytes;
+	if ( alignment < page_bytes ) {
+		alignment = page_bytes;
+	}
+	return true;
+}
+
+bool offset_malloc::offset_malloc_impl::is_large_block( block* p_blk ) noexcept
+{
+	return ( p_blk->get_blk_size() * size_of_block_header() ) >= large_block_threshold_bytes;
+}
+
+void* offset_malloc::offset_malloc_impl::allocate( size_t req_bytes, size_t alignment, unsigned int owner_id )
+{
+	size_t       large_req_bytes            = req_bytes;
+	size_t       large_alignment            = alignment;
+	const bool   is_large                   = adjust_large_request( large_req_bytes, large_alignment );
+	const size_t real_alignment             = ( alignment == 0 ) ? 1 : alignment;
+	const size_t req_num_of_blocks_w_header = calc_req_num_of_blocks_w_header( req_bytes, alignment );
+
+	recovering_lock_guard lk( *this );
+
+	drain_deferred_nolock();
+	void* p_ans = nullptr;
+	if ( is_large ) {
+		p_ans = allocate_nolock( calc_req_num_of_blocks_w_header( large_req_bytes, large_alignment ), large_alignment );
+		// ページ単位に補正した要求が収まらない場合は、ページ境界に揃えない通常の割り当てで再度試みる。
+	}
+	if ( p_ans == nullptr ) {
+		p_ans = allocate_nolock( req_num_of_blocks_w_header, real_alignment );
+	}
+	if ( ( p_ans != nullptr ) && ( owner_id != 0 ) ) {
+		// 割り当て済みのブロックのヘッダは、空きブロックリストの整合性に関係しないため、更新の記録の対象外とする。
+		get_allocated_block( p_ans )->set_owner_id( owner_id );
+	}
+	return p_ans;
+}
+
+size_t offset_malloc::offset_malloc_impl::allocate_bulk( size_t req_bytes, size_t alignment, size_t n, void** pp_out, unsigned int owner_id )
+{
+	if ( req_bytes >= large_block_threshold_bytes ) {
+		// 大きなブロックは、1つずつ割り当てる場合と同じ補正と再試行を行う。
+		size_t i = 0;
+		for ( ; i < n; i++ ) {
+			pp_out[i] = allocate( req_bytes, alignment, owner_id );
+			if ( pp_out[i] == nullptr ) {
+				break;
+			}
+		}
+		return i;
+	}
+
+	const size_t real_alignment             = ( alignment == 0 ) ? 1 : alignment;
+	const size_t req_num_of_blocks_w_header = calc_req_num_of_blocks_w_header( req_bytes, alignment );
+
+	recovering_lock_guard lk( *this );
+
+	drain_deferred_nolock();
+	size_t i = 0;
+	for ( ; i < n; i++ ) {
+		pp_out[i] = allocate_nolock( req_num_of_blocks_w_header, real_alignment );
+		if ( pp_out[i] == nullptr ) {
+			break;
+		}
+		if ( owner_id != 0 ) {
+			get_allocated_block( pp_out[i] )->set_owner_id( owner_id );
+		}
+	}
+	return i;
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::get_top_block( void ) noexcept
+{
+	// ヒープ全体は、コンストラクタで決めた先頭のブロックから、ブロックサイズで隙間なく分割されている。
+	uintptr_t addr_buff = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
+	uintptr_t addr_top  = ( ( addr_buff + size_of_block_header() - 1 ) / size_of_block_header() ) * size_of_block_header();
+	if ( op_size_class_counters_ != nullptr ) {
+		// 統計カウンタは、ビルドオプションの異なるプロセスから参照される場合もあるため、ビルドオプションによらず読み飛ばす。
+		addr_top += size_class_counters_units() * size_of_block_header();
+	}
+	return reinterpret_cast<block*>( addr_top );
+}
+
+void* offset_malloc::offset_malloc_impl::allocate_nolock( size_t req_num_of_blocks_w_header, size_t real_alignment )
+{
+	void* p_ans = nullptr;
+	if ( ( real_alignment <= size_of_block_header() ) && is_bin_size( req_num_of_blocks_w_header ) ) {
+		// block_body_は、block_headerのサイズでアライメントされているため、補正なしでサイズクラスのブロックを再利用できる。
+		block* p_bin_blk = pop_from_bin( req_num_of_blocks_w_header );
+		if ( p_bin_blk != nullptr ) {
+			p_ans = p_bin_blk->block_body_;
+		}
+	} else if ( ( real_alignment <= size_of_block_header() ) && ( op_quick_list_ != nullptr ) ) {
+		// サイズクラスと同様に、結合を遅延したブロックを補正なしで再利用する。
+		block* p_quick_blk = pop_from_quick_list( req_num_of_blocks_w_header );
+		if ( p_quick_blk != nullptr ) {
+			p_ans = p_quick_blk->block_body_;
+		}
+	}
+
+	if ( p_ans == nullptr ) {
+		p_ans = allocate_from_free_list( req_num_of_blocks_w_header, real_alignment );
+	}
+	if ( p_ans == nullptr ) {
+		// サイズクラスのリストに保持している未結合のブロックをK&Rの空きブロックリストに戻して結合し、再度確保を試みる。
+		consolidate_bins();
+		p_ans = allocate_from_free_list( req_num_of_blocks_w_header, real_alignment );
+	}
+	if ( p_ans == nullptr ) {
+		count_failed_allocation( req_num_of_blocks_w_header );
+		return nullptr;
+	}
+
+	const size_t num_of_units = get_allocated_block( p_ans )->get_blk_size();
+	num_of_allocated_blocks_++;
+	allocated_units_ += num_of_units;
+	count_allocation( num_of_units );
+	return p_ans;
+}
+
 /*
  * K&R mallocアルゴリズムをベースに実装している。
  */
-void* offset_malloc::offset_malloc_impl::allocate( size_t req_bytes, size_t alignment )
+void* offset_malloc::offset_malloc_impl::allocate_from_free_list( size_t req_num_of_blocks_w_header, size_t real_alignment )
 {
-	const size_t real_alignment  = ( alignment == 0 ) ? 1 : alignment;
-	const size_t additional_size = ( alignment <= size_of_block_header() ) ? 0 : ( alignment - size_of_block_header() );
-
-	size_t req_num_of_blocks_w_header = bytes2blocksize( req_bytes + additional_size ) + 1;
-
-	std::lock_guard<ipsm_mutex> lk( mtx_ );
+	if ( policy_ == offset_malloc_policy::kBestFit ) {
+		// サイズ順インデックスから、要求ブロック数を満たす最小の空きブロックを選択する。
+		block* p_fit_blk = size_index_find_fit( req_num_of_blocks_w_header );
+		if ( p_fit_blk != nullptr ) {
+			void* p_ans = carve_from_free_block( addr_index_find_prev( p_fit_blk ), p_fit_blk, req_num_of_blocks_w_header, real_alignment );
+			if ( p_ans != nullptr ) {
+				return p_ans;
+			}
+		}
+		// サイズ順インデックスに含まれない小さな空きブロックや、アライメントの補正で選択できなかった空きブロックがあるため、以降のfirst-fitでの探索も行う。
+	}
 
-	block* p_end_blk = op_freep_.get();
-	block* p_cur_blk = p_end_blk;
-	block* p_pre_blk = nullptr;
+	// K&R mallocと同様に、op_freep_の次のブロックから探索を始めることで、すべてのブロックについて直前のブロックが決まった状態で探索する。
+	block* p_pre_blk = op_freep_.get();
+	block* p_cur_blk = get_free_list_next( p_pre_blk );
+	block* p_end_blk = p_cur_blk;
 	block* p_nxt_blk = nullptr;
 	do {
-		p_nxt_blk = p_cur_blk->get_next_ptr();
-
-		if ( p_cur_blk->active_header_.size_of_this_block_ > ( req_num_of_blocks_w_header + 1 ) ) {
-			// 要求ブロック数より大きい空きブロック本体を持つブロックを見つけたので、後ろから切り出す。
-			size_t new_block_size = p_cur_blk->active_header_.size_of_this_block_ - req_num_of_blocks_w_header;
-			block* p_ans          = reinterpret_cast<block*>( &( p_cur_blk->block_body_[new_block_size - 1] ) );
-			// 候補として値を設定し、最適化の余地を確認する。
-			// なお、この確認は、deallocate動作で一意にblockの開始位置を決定できることを保証するためでもある。
-			p_ans->set_next_ptr( nullptr );
-			p_ans->set_blk_size( req_num_of_blocks_w_header );
-			size_t opt_val = p_ans->header_slot_optimize( real_alignment );   // 補正量を算出
-			req_num_of_blocks_w_header -= opt_val;
-			new_block_size = p_cur_blk->active_header_.size_of_this_block_ - req_num_of_blocks_w_header;
-			p_ans          = reinterpret_cast<block*>( &( p_cur_blk->block_body_[new_block_size - 1] ) );
-
-			p_cur_blk->set_blk_size( new_block_size );
-			op_freep_ = p_cur_blk;
+		p_nxt_blk = get_free_list_next( p_cur_blk );
 
-			p_ans->set_next_ptr( nullptr );
-			p_ans->set_blk_size( req_num_of_blocks_w_header );
-			return p_ans->get_body_ptr( real_alignment );
-
-		} else if ( ( p_pre_blk != nullptr ) && ( p_cur_blk->active_header_.size_of_this_block_ >= req_num_of_blocks_w_header ) ) {
-			// 要求ブロック数と同じ大きさの空きブロック本体を持つブロックを見つけたので、このブロックを返す。また、ブロックリストから外す。
-			// 要求ブロック数+ 1の空きブロック本体を持つブロックを見つけたので、このブロックを返す。また、ブロックリストから外す。
-			// また、候補として値を設定し、最適化の余地を確認する。
-			// なお、この確認は、deallocate動作で一意にblockの開始位置を決定できることを保証するためでもある。
-			size_t opt_val = p_cur_blk->header_slot_optimize( real_alignment );   // 補正量を算出
-			block* p_ans   = nullptr;
-			if ( opt_val == 0 ) {
-				// 補正は必要ないので、そのままブロックリストから外す
-				p_pre_blk->set_next_ptr( p_nxt_blk );
-
-				p_ans = p_cur_blk;
-				p_ans->set_next_ptr( nullptr );
-			} else {
-				// 補正分だけ、返す位置を変える
-				p_ans = reinterpret_cast<block*>( &( p_cur_blk->block_body_[opt_val - 1] ) );
-				req_num_of_blocks_w_header -= opt_val;
-				p_ans->set_next_ptr( nullptr );
-				p_ans->set_blk_size( req_num_of_blocks_w_header );
-
-				// 補正分だけ、preのサイズを補正する
-				p_pre_blk->set_next_ptr( p_nxt_blk );
-				size_t pre_blk_new_size = p_pre_blk->get_blk_size() + opt_val;
-				p_pre_blk->set_blk_size( pre_blk_new_size );
-			}
-			op_freep_ = p_pre_blk;
-			return p_ans->get_body_ptr( real_alignment );
+		void* p_ans = carve_from_free_block( p_pre_blk, p_cur_blk, req_num_of_blocks_w_header, real_alignment );
+		if ( p_ans != nullptr ) {
+			return p_ans;
 		}
 
 		// 次のブロックを探す
@@ -146,7 +415,200 @@ void* offset_malloc::offset_malloc_impl::allocate( size_t req_bytes, size_t alig
 	return nullptr;
 }
 
+void* offset_malloc::offset_malloc_impl::carve_from_free_block( block* p_pre_blk, block* p_cur_blk, size_t req_num_of_blocks_w_header, size_t real_alignment )
+{
+	if ( p_cur_blk->active_header_.size_of_this_block_ > ( req_num_of_blocks_w_header + 1 ) ) {
+		// 要求ブロック数より大きい空きブロック本体を持つブロックを見つけたので、後ろから切り出す。
+		// 切り出し位置のヘッダ書き込みでサイズ順インデックスのリンク情報を上書きする可能性があるため、先にインデックスから外す。
+		journal_begin();
+		size_index_erase( p_cur_blk );
+		size_t new_block_size = p_cur_blk->active_header_.size_of_this_block_ - req_num_of_blocks_w_header;
+		block* p_ans          = reinterpret_cast<block*>( &( p_cur_blk->block_body_[new_block_size - 1] ) );
+		// 候補として値を設定し、最適化の余地を確認する。
+		// なお、この確認は、deallocate動作で一意にblockの開始位置を決定できることを保証するためでもある。
+		p_ans->set_next_ptr( nullptr );
+		p_ans->set_blk_size( req_num_of_blocks_w_header );
+		size_t opt_val = p_ans->header_slot_optimize( real_alignment );   // 補正量を算出
+		req_num_of_blocks_w_header -= opt_val;
+		new_block_size = p_cur_blk->active_header_.size_of_this_block_ - req_num_of_blocks_w_header;
+		p_ans          = reinterpret_cast<block*>( &( p_cur_blk->block_body_[new_block_size - 1] ) );
+
+		set_blk_size_w_undo( p_cur_blk, new_block_size );
+		size_index_insert( p_cur_blk );
+		op_freep_ = p_cur_blk;
+
+		p_ans->set_next_ptr( nullptr );
+		p_ans->set_blk_size( req_num_of_blocks_w_header );
+		journal_commit();
+		return p_ans->get_body_ptr( real_alignment );
+
+	} else if ( p_cur_blk->active_header_.size_of_this_block_ >= req_num_of_blocks_w_header ) {
+		// 要求ブロック数と同じ大きさの空きブロック本体を持つブロックを見つけたので、このブロックを返す。また、ブロックリストから外す。
+		// 要求ブロック数+ 1の空きブロック本体を持つブロックを見つけたので、このブロックを返す。また、ブロックリストから外す。
+		// また、候補として値を設定し、最適化の余地を確認する。
+		// なお、この確認は、deallocate動作で一意にblockの開始位置を決定できることを保証するためでもある。
+		size_t opt_val = p_cur_blk->header_slot_optimize( real_alignment );   // 補正量を算出
+		block* p_ans   = nullptr;
+		if ( ( 0 < opt_val ) && ( opt_val < min_bin_units ) ) {
+			// 補正分の先頭部分が、空きブロックとしてインデックスのリンク情報を保持できない大きさになるため、このブロックは選択しない。
+			return nullptr;
+		}
+		journal_begin();
+		if ( opt_val == 0 ) {
+			// 補正は必要ないので、そのままブロックリストから外す
+			set_next_ptr_w_undo( p_pre_blk, get_free_list_next( p_cur_blk ) );
+			addr_index_erase( p_cur_blk );
+			size_index_erase( p_cur_blk );
+
+			p_ans = p_cur_blk;
+			set_next_ptr_w_undo( p_ans, nullptr );
+			op_freep_ = p_pre_blk;
+			num_of_free_blocks_--;
+		} else {
+			// 補正分だけ、返す位置を変える。
+			// 補正分の先頭部分は、アドレス上で隣接しているとは限らないpreには結合せず、空きブロックとしてリストに残す。
+			size_index_erase( p_cur_blk );
+			p_ans = reinterpret_cast<block*>( &( p_cur_blk->block_body_[opt_val - 1] ) );
+			p_ans->set_next_ptr( nullptr );
+			p_ans->set_blk_size( p_cur_blk->get_blk_size() - opt_val );
+
+			set_blk_size_w_undo( p_cur_blk, opt_val );
+			size_index_insert( p_cur_blk );
+			op_freep_ = p_cur_blk;
+		}
+		journal_commit();
+		return p_ans->get_body_ptr( real_alignment );
+	}
+
+	return nullptr;
+}
+
 void offset_malloc::offset_malloc_impl::deallocate( void* p, size_t alignment )
+{
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return;
+	}
+
+	recovering_lock_guard lk( *this );
+
+	const size_t num_of_units = p_target_blk->get_blk_size();
+	deallocate_nolock( p_target_blk );
+	count_deallocation( num_of_units );
+	consolidate_bins_if_exceeded();
+}
+
+void offset_malloc::offset_malloc_impl::deallocate_bulk( void* const* pp, size_t n, size_t alignment )
+{
+	recovering_lock_guard lk( *this );
+
+	// 直前に解放したブロックを含む空きブロックをヒントとして引き継ぐ。アドレス順に解放される場合、インデックスを探索せずに挿入位置が決まる。
+	block* p_hint_blk = nullptr;
+	for ( size_t i = 0; i < n; i++ ) {
+		block* const p_target_blk = get_block_to_deallocate( pp[i] );
+		if ( p_target_blk == nullptr ) {
+			continue;
+		}
+		const size_t num_of_units = p_target_blk->get_blk_size();
+		p_hint_blk                = deallocate_nolock( p_target_blk, p_hint_blk );
+		count_deallocation( num_of_units );
+		if ( consolidate_bins_if_exceeded() ) {
+			// 結合によって、ヒントの空きブロックが他のブロックに吸収される可能性があるため、ヒントは無効にする。
+			p_hint_blk = nullptr;
+		}
+	}
+}
+
+void offset_malloc::offset_malloc_impl::deallocate_deferred( void* p )
+{
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return;
+	}
+
+	// 割り当て済みのブロックのヘッダは解放する側が所有しているため、リンクを書き込んでからCASで公開する。
+	offset_ptr<block> op_cur_top = op_deferred_top_.load( std::memory_order_relaxed );
+	do {
+		p_target_blk->set_next_ptr( op_cur_top.get() );
+	} while ( !op_deferred_top_.compare_exchange_weak( op_cur_top, offset_ptr<block>( p_target_blk ), std::memory_order_release, std::memory_order_relaxed ) );
+
+	if ( ( num_of_deferred_.fetch_add( 1, std::memory_order_relaxed ) + 1 ) < deferred_free_drain_threshold ) {
+		return;
+	}
+
+	// 確保側が長時間mtx_を取得しない場合に備えて、溜まったブロックを解放側で回収する。
+	recovering_lock_guard lk( *this );
+	drain_deferred_nolock();
+}
+
+void offset_malloc::offset_malloc_impl::drain_deferred( void )
+{
+	recovering_lock_guard lk( *this );
+	drain_deferred_nolock();
+}
+
+void offset_malloc::offset_malloc_impl::drain_deferred_nolock( void )
+{
+	if ( op_deferred_top_.load( std::memory_order_relaxed ) == nullptr ) {
+		return;
+	}
+
+	// スタック全体を一度に取り出すため、取り出し側でのABA問題は発生しない。
+	// 取り出したブロックは、解放中に所有者が終了しても失われないように、解放を完了するまでop_detached_top_に保持する。
+	op_detached_top_ = op_deferred_top_.exchange( offset_ptr<block>( nullptr ), std::memory_order_acquire ).get();
+	drain_detached_nolock();
+}
+
+void offset_malloc::offset_malloc_impl::drain_detached_nolock( void )
+{
+	while ( op_detached_top_ != nullptr ) {
+		block* p_cur_blk = op_detached_top_.get();
+		journal_begin();
+		journal_record( op_detached_top_ );
+		op_detached_top_ = p_cur_blk->get_next_ptr();
+		set_next_ptr_w_undo( p_cur_blk, nullptr );
+		const size_t num_of_units = p_cur_blk->get_blk_size();
+		deallocate_nolock( p_cur_blk );
+		journal_commit();
+		count_deallocation( num_of_units );
+		consolidate_bins_if_exceeded();
+		num_of_deferred_.fetch_sub( 1, std::memory_order_relaxed );
+	}
+}
+
+void offset_malloc::offset_malloc_impl::release_pages_of_free_block( block* p_free_blk, block* p_released_blk, size_t released_units ) noexcept
+{
+	// 空きブロックの先頭にあるブロックヘッダとインデックスのリンク情報は保持する必要があるため、それより後ろに完全に含まれるページのみを返却する。
+	// 結合した前後の空きブロックのページは、それぞれの解放時に返却済みのため、解放したブロックに掛かるページのみを対象とする。
+	// 境界のページは、結合によって空きブロックに完全に含まれるようになった場合に返却される。
+	// 他のスレッドやプロセスが、返却中のページを割り当てて書き込まないように、mtx_を保持したまま行う。
+	const uintptr_t page_bytes   = page_bytes_;
+	const uintptr_t released_top = reinterpret_cast<uintptr_t>( p_released_blk );
+	const uintptr_t released_end = released_top + size_of_block_header() * released_units;
+	uintptr_t       addr_top     = reinterpret_cast<uintptr_t>( p_free_blk ) + size_of_block_header() * min_size_index_units;
+	uintptr_t       addr_end     = reinterpret_cast<uintptr_t>( p_free_blk->get_end_ptr() );
+	addr_top                     = std::max( addr_top, ( released_top / page_bytes ) * page_bytes );
+	addr_end                     = std::min( addr_end, ( ( released_end + page_bytes - 1 ) / page_bytes ) * page_bytes );
+	addr_top                     = ( ( addr_top + page_bytes - 1 ) / page_bytes ) * page_bytes;
+	addr_end                     = ( addr_end / page_bytes ) * page_bytes;
+	if ( addr_end <= addr_top ) {
+		return;
+	}
+
+	void*  p_top  = reinterpret_cast<void*>( addr_top );
+	size_t length = addr_end - addr_top;
+	if ( madvise( p_top, length, MADV_REMOVE ) == 0 ) {
+		return;
+	}
+	// 共有メモリオブジェクトをマップした領域ではない場合(プロセスローカルなメモリ上に構築した場合等)は、MADV_REMOVEが使えないため、物理ページの解放のみを行う。
+	int err_remove = errno;
+	if ( madvise( p_top, length, MADV_DONTNEED ) != 0 ) {
+		psm_logoutput( psm_log_lv::kDebug, "Debug: fail to return pages to OS, addr=%p, length=%zu, errno(MADV_REMOVE)=%d, errno(MADV_DONTNEED)=%d",
+		               p_top, length, err_remove, errno );
+	}
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::get_block_to_deallocate( void* p )
 {
 	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p );
 	uintptr_t addr_top = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
@@ -156,7 +618,7 @@ void offset_malloc::offset_malloc_impl::deallocate( void* p, size_t alignment )
 		psm_logoutput( psm_log_lv::kErr, "Error: incorrect deallocation is requested. it is out of range, p=%p, addr_top=%p - addr_end=%p",
 		               p, reinterpret_cast<void*>( addr_top ), reinterpret_cast<void*>( addr_end ) );
 #ifdef NDEBUG
-		return;
+		return nullptr;
 #else
 		throw std::out_of_range( "Error: deallocation requested addr of p is out of range" );
 #endif
@@ -166,113 +628,1086 @@ void offset_malloc::offset_malloc_impl::deallocate( void* p, size_t alignment )
 		psm_logoutput( psm_log_lv::kErr, "Error: incorrect deallocation is requested. it is out of range, p=%p, addr_top=%p - addr_end=%p",
 		               p, reinterpret_cast<void*>( addr_top ), reinterpret_cast<void*>( addr_end ) );
 #ifdef NDEBUG
-		return;
+		return nullptr;
 #else
 		throw std::out_of_range( "Error: deallocation requested addr of p is out of range" );
 #endif
 	}
 
-	uintptr_t    addr_target_blk = ( addr_p / size_of_block_header() - 1 ) * size_of_block_header();
-	block* const p_target_blk    = reinterpret_cast<block*>( addr_target_blk );
-
-	std::lock_guard<ipsm_mutex> lk( mtx_ );
+	uintptr_t addr_target_blk = ( addr_p / size_of_block_header() - 1 ) * size_of_block_header();
+	return reinterpret_cast<block*>( addr_target_blk );
+}
 
-	block* p_end_blk = op_freep_.get();
-	block* p_pre_blk = p_end_blk;
-	block* p_nxt_blk = p_pre_blk->get_next_ptr();
-	do {
-		if ( ( ( p_pre_blk < p_target_blk ) && ( p_target_blk < p_nxt_blk ) ) || ( ( p_pre_blk < p_target_blk ) && ( p_nxt_blk < p_pre_blk ) ) ) {
-			// found
-			if ( ( p_pre_blk->get_end_ptr() == p_target_blk ) && ( p_target_blk->get_end_ptr() == p_nxt_blk ) ) {
-				// 前後のブロックがともに隣接している場合、前後のブロック含めて結合する。
-				p_pre_blk->set_next_ptr( p_nxt_blk->get_next_ptr() );
-				size_t pre_new_blk_num = p_pre_blk->get_blk_size() + p_target_blk->get_blk_size() + p_nxt_blk->get_blk_size();
-				p_pre_blk->set_blk_size( pre_new_blk_num );
-			} else if ( p_pre_blk->get_end_ptr() == p_target_blk ) {
-				// 前側だけ隣接している場合
-				size_t pre_new_blk_num = p_pre_blk->get_blk_size() + p_target_blk->get_blk_size();
-				p_pre_blk->set_blk_size( pre_new_blk_num );
-			} else if ( p_target_blk->get_end_ptr() == p_nxt_blk ) {
-				// 後側だけ隣接している場合
-				p_target_blk->set_next_ptr( p_nxt_blk->get_next_ptr() );
-				p_pre_blk->set_next_ptr( p_target_blk );
-				size_t pre_new_blk_num = p_target_blk->get_blk_size() + p_nxt_blk->get_blk_size();
-				p_target_blk->set_blk_size( pre_new_blk_num );
-			} else {
-				// 前後、ともに隣接していない場合
-				p_target_blk->set_next_ptr( p_nxt_blk );
-				p_pre_blk->set_next_ptr( p_target_blk );
-			}
-			op_freep_ = p_pre_blk;
-			return;
-		}
-		p_pre_blk = p_nxt_blk;
-		p_nxt_blk = p_nxt_blk->get_next_ptr();
-	} while ( p_pre_blk != p_end_blk );
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::deallocate_nolock( block* p_target_blk, block* p_hint_blk )
+{
+	if ( p_target_blk->is_linked_as_free() ) {
+		// 空きブロックのリストにつながっているブロックの解放は、二重解放である。サイズクラスのリストへの追加は、結合しないため、ここで検出する。
+		psm_logoutput( psm_log_lv::kErr, "Error: fail to free, the block(%p) is already free", p_target_blk );
+		throw std::logic_error( "fail to free" );
+	}
 
-	if ( ( p_pre_blk == &base_blk_ ) && ( p_nxt_blk == &base_blk_ ) ) {
-		// すべてを使い切っていて、かつ、どこかを返却されたパターン
-		p_pre_blk->set_next_ptr( p_target_blk );
-		p_target_blk->set_next_ptr( p_pre_blk );
-		return;
+	// 前側の空きブロックと結合すると、ヘッダは空きブロックの本体の一部になるため、大きさは先に取得しておく。
+	const size_t released_units = p_target_blk->get_blk_size();
+	block*       p_ans          = p_hint_blk;
+	if ( is_bin_size( released_units ) ) {
+		// サイズクラスに該当するブロックは、結合せずにサイズクラスのリストにつなぐ。K&Rの空きブロックリストは変化しないため、ヒントはそのまま有効。
+		push_to_bin( p_target_blk );
+	} else if ( is_large_block( p_target_blk ) ) {
+		// 大きなブロックは、同じサイズでの再利用よりもページの返却を優先するため、遅延結合のモードでもすぐに結合する。
+		p_ans = insert_to_free_list( p_target_blk, p_hint_blk );
+		release_pages_of_free_block( p_ans, p_target_blk, released_units );
+	} else if ( deferred_coalescing_ ) {
+		push_to_quick_list( p_target_blk );
+	} else {
+		p_ans = insert_to_free_list( p_target_blk, p_hint_blk );
 	}
 
-	throw std::logic_error( "fail to free" );
+	// 二重解放を検出した場合は例外で抜けるため、カウンタは解放が完了してから更新する。
+	num_of_allocated_blocks_--;
+	allocated_units_ -= released_units;
+	return p_ans;
 }
 
-int offset_malloc::offset_malloc_impl::bind( void )
-{
-	std::lock_guard<ipsm_mutex> lk( mtx_ );
-
-	bind_cnt_++;
-	return bind_cnt_;
-}
-int offset_malloc::offset_malloc_impl::unbind( void )
+bool offset_malloc::offset_malloc_impl::consolidate_bins_if_exceeded( void )
 {
-	std::lock_guard<ipsm_mutex> lk( mtx_ );
-	bind_cnt_--;
-	return bind_cnt_;
+	// 結合は、1ブロックずつ更新を完了しながら行うため、他の更新の途中では呼び出さない。
+	// 遅延結合のモードでなくても、サイズクラスのリストには未結合のブロックが溜まるため、同じ閾値で結合する。
+	if ( num_of_uncoalesced_blocks_ < deferred_coalescing_threshold ) {
+		return false;
+	}
+	consolidate_bins();
+	return true;
 }
 
-int offset_malloc::offset_malloc_impl::get_bind_count( void ) const
+bool offset_malloc::offset_malloc_impl::try_expand( void* p, size_t new_bytes )
 {
-	std::lock_guard<ipsm_mutex> lk( mtx_ );
-	return bind_cnt_;
-}
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return false;
+	}
+	// pはブロックヘッダの直後に位置するため、アライメントの補正は不要。
+	const size_t new_num_of_units = calc_req_num_of_blocks_w_header( new_bytes, size_of_block_header() );
 
-bool offset_malloc::offset_malloc_impl::is_belong_to( void* p_mem ) const noexcept
-{
-	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p_mem );
-	uintptr_t addr_top = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
-	uintptr_t addr_end = reinterpret_cast<uintptr_t>( op_end_.get() );
-	if ( addr_p < addr_top ) {
-		// out of range
+	recovering_lock_guard lk( *this );
+
+	const size_t cur_num_of_units = p_target_blk->get_blk_size();
+	if ( new_num_of_units <= cur_num_of_units ) {
+		return true;
+	}
+
+	// 直後に隣接するブロックが、K&Rの空きブロックリストにあるかを確認する。サイズクラスのリストにあるブロックは、結合対象としない。
+	block* p_pre_blk = addr_index_find_prev( p_target_blk );
+	block* p_nxt_blk = get_free_list_next( p_pre_blk );
+	if ( ( p_nxt_blk == &base_blk_ ) || ( p_nxt_blk != p_target_blk->get_end_ptr() ) ) {
 		return false;
 	}
-	if ( addr_end <= addr_p ) {
-		// out of range
+	const size_t total_num_of_units = cur_num_of_units + p_nxt_blk->get_blk_size();
+	if ( total_num_of_units < new_num_of_units ) {
 		return false;
 	}
 
+	// 隣接する空きブロックをリストとインデックスから外してから、ヘッダを書き換える。
+	block* p_nxt_nxt_blk = get_free_list_next( p_nxt_blk );
+	journal_begin();
+	addr_index_erase( p_nxt_blk );
+	size_index_erase( p_nxt_blk );
+	if ( op_freep_.get() == p_nxt_blk ) {
+		op_freep_ = p_pre_blk;
+	}
+
+	const size_t rest_num_of_units = total_num_of_units - new_num_of_units;
+	if ( rest_num_of_units < min_bin_units ) {
+		// 残りが空きブロックとして保持できない大きさなので、まとめて割り当てる。
+		set_next_ptr_w_undo( p_pre_blk, p_nxt_nxt_blk );
+		set_blk_size_w_undo( p_target_blk, total_num_of_units );
+		journal_commit();
+		allocated_units_ += total_num_of_units - cur_num_of_units;
+		num_of_free_blocks_--;
+		count_deallocation( cur_num_of_units );
+		count_allocation( total_num_of_units );
+		return true;
+	}
+
+	set_blk_size_w_undo( p_target_blk, new_num_of_units );
+	allocated_units_ += new_num_of_units - cur_num_of_units;
+	count_deallocation( cur_num_of_units );
+	count_allocation( new_num_of_units );
+	block* p_rest_blk = p_target_blk->get_end_ptr();
+	p_rest_blk->set_next_ptr( p_nxt_nxt_blk );
+	p_rest_blk->set_blk_size( rest_num_of_units );
+	set_next_ptr_w_undo( p_pre_blk, p_rest_blk );
+	addr_index_insert( p_rest_blk );
+	size_index_insert( p_rest_blk );
+	journal_commit();
 	return true;
 }
 
-offset_malloc::offset_malloc_impl* offset_malloc::offset_malloc_impl::placement_new( void* begin_pointer, void* end_pointer )
+void offset_malloc::offset_malloc_impl::shrink( void* p, size_t new_bytes )
 {
-	if ( begin_pointer == nullptr ) {
-		throw std::bad_alloc();
-	}
-	if ( end_pointer == nullptr ) {
-		throw std::bad_alloc();
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return;
 	}
-	if ( begin_pointer >= end_pointer ) {
-		throw std::bad_alloc();
+	const size_t new_num_of_units = calc_req_num_of_blocks_w_header( new_bytes, size_of_block_header() );
+
+	recovering_lock_guard lk( *this );
+
+	const size_t cur_num_of_units = p_target_blk->get_blk_size();
+	if ( ( new_num_of_units + min_bin_units ) > cur_num_of_units ) {
+		// 切り離す後半部分が、空きブロックとして保持できない大きさなので、何もしない。
+		return;
 	}
-	if ( ( reinterpret_cast<uintptr_t>( begin_pointer ) + sizeof( offset_malloc::offset_malloc_impl ) ) >= reinterpret_cast<uintptr_t>( end_pointer ) ) {
-		throw std::bad_alloc();
+
+	// 切り離す後半部分は、縮小後は使用されない領域であるため、そこに作成するヘッダは記録しない。
+	journal_begin();
+	set_blk_size_w_undo( p_target_blk, new_num_of_units );
+	block* p_tail_blk = p_target_blk->get_end_ptr();
+	p_tail_blk->set_next_ptr( nullptr );
+	p_tail_blk->set_blk_size( cur_num_of_units - new_num_of_units );
+	count_deallocation( cur_num_of_units );
+	count_allocation( new_num_of_units );
+	// 切り離した後半部分を、割り当て済みのブロックとして数えてから解放する。サイズクラスごとの統計には、縮小前後のブロックとしてのみ計上する。
+	num_of_allocated_blocks_++;
+	deallocate_nolock( p_tail_blk );
+	journal_commit();
+	consolidate_bins_if_exceeded();
+}
+
+void* offset_malloc::offset_malloc_impl::relocate_to_lower_address( void* p, size_t alignment, offset_ptr<void>* p_referrer )
+{
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return p;
 	}
+	const size_t real_alignment = ( alignment == 0 ) ? 1 : alignment;
+
+	recovering_lock_guard lk( *this );
 
-	return new ( begin_pointer ) offset_malloc::offset_malloc_impl( end_pointer );
+	// サイズクラスのリストやクイックリストの空きブロックは、アドレス順に並んでいないため、K&Rの空きブロックリストに戻して結合してから探索する。
+	drain_deferred_nolock();
+	consolidate_bins();
+
+	const size_t       target_units = p_target_blk->get_blk_size();
+	const size_t       body_bytes   = ( target_units - 1 ) * size_of_block_header();
+	const bool         is_large     = is_large_block( p_target_blk );   // 移動後は、移動元のブロックヘッダが上書きされる可能性があるため、先に判定する。
+	const unsigned int owner_id     = p_target_blk->get_owner_id();
+
+	// K&Rの空きブロックリストは、base_blk_の次からアドレス順に並んでいるため、先頭から探索すれば、最も低いアドレスの空きブロックが見つかる。
+	block* p_pre_blk = &base_blk_;
+	block* p_cur_blk = get_free_list_next( p_pre_blk );
+	while ( ( p_cur_blk != &base_blk_ ) && ( p_cur_blk < p_target_blk ) ) {
+		const size_t cur_units   = p_cur_blk->get_blk_size();
+		const bool   is_adjacent = ( p_cur_blk->get_end_ptr() == p_target_blk );
+		const bool   is_aligned  = ( reinterpret_cast<uintptr_t>( p_cur_blk->block_body_ ) % real_alignment ) == 0;
+		// 移動先と移動元が重なると、取り消した場合に移動元のデータを戻せないため、移動元以上の大きさの空きブロックのみ使用する。
+		// 隣接していない空きブロックは、さらに、移動先として使った残りが、空きブロックとして保持できる大きさの場合のみ使用する。
+		const bool is_fit = ( cur_units >= target_units ) && ( is_adjacent || ( cur_units == target_units ) || ( cur_units >= ( target_units + min_bin_units ) ) );
+		if ( !is_aligned || !is_fit ) {
+			p_pre_blk = p_cur_blk;
+			p_cur_blk = get_free_list_next( p_cur_blk );
+			continue;
+		}
+
+		// 移動先の空きブロックを、空きブロックリストから外す。リンク情報は、空きブロックの本体にあるため、データを移動する前に外す。
+		journal_begin();
+		set_next_ptr_w_undo( p_pre_blk, get_free_list_next( p_cur_blk ) );
+		addr_index_erase( p_cur_blk );
+		size_index_erase( p_cur_blk );
+		num_of_free_blocks_--;
+		op_freep_ = p_pre_blk;
+		if ( is_adjacent ) {
+			// 移動元のブロックヘッダは、後ろ側の空きブロックのヘッダで上書きされる可能性があるため、記録しておく。移動元の本体は、完了まで変更しない。
+			journal_record( p_target_blk->active_header_.op_next_block_ );
+			journal_record( p_target_blk->active_header_.size_of_this_block_ );
+		}
+
+		// 移動先と移動元は重ならないため、取り消した場合は、移動元のブロックがそのまま有効なブロックに戻る。
+		block* const p_new_blk = p_cur_blk;
+		std::memcpy( static_cast<void*>( p_new_blk->block_body_ ), p, body_bytes );
+		set_next_ptr_w_undo( p_new_blk, nullptr );
+		set_blk_size_w_undo( p_new_blk, target_units );
+		p_new_blk->set_owner_id( owner_id );   // 移動前の値は、set_next_ptr_w_undo()で記録済み
+
+		block* p_free_blk = nullptr;
+		if ( is_adjacent ) {
+			// 移動先の空きブロックと移動元のブロックは連続しているため、移動後の後ろ側は、移動先の空きブロックと同じ大きさの1つの空きブロックになる。
+			block* p_rest_blk = p_new_blk->get_end_ptr();
+			p_rest_blk->set_next_ptr( nullptr );
+			p_rest_blk->set_blk_size( cur_units );
+			p_free_blk = insert_to_free_list( p_rest_blk );
+		} else {
+			if ( cur_units > target_units ) {
+				block* p_rest_blk = p_new_blk->get_end_ptr();
+				p_rest_blk->set_next_ptr( nullptr );
+				p_rest_blk->set_blk_size( cur_units - target_units );
+				insert_to_free_list( p_rest_blk );
+			}
+			p_free_blk = insert_to_free_list( p_target_blk );
+		}
+		if ( p_referrer != nullptr ) {
+			// 参照元も同じ更新の中で書き換えることで、取り消した場合は移動前のブロックを、完了した場合は移動後のブロックを参照する。
+			journal_record( *p_referrer );
+			*p_referrer = static_cast<void*>( p_new_blk->block_body_ );
+		}
+		journal_commit();
+		if ( is_large ) {
+			release_pages_of_free_block( p_free_blk, p_target_blk, target_units );
+		}
+		// ブロックの大きさは変わらないため、割り当て済みのブロック数等の統計は変化しない。
+		return p_new_blk->block_body_;
+	}
+
+	return p;
+}
+
+size_t offset_malloc::offset_malloc_impl::reclaim_owner( unsigned int owner_id )
+{
+	if ( owner_id == 0 ) {
+		return 0;
+	}
+
+	recovering_lock_guard lk( *this );
+
+	// 遅延解放のスタックにあるブロックは、リンクで所有者の値が上書きされているため、先に解放しておく。
+	drain_deferred_nolock();
+
+	// 所有者のブロックは、大きさを変えずにop_detached_top_のリストにつなぐだけなので、ヒープ全体をたどる途中でブロックの並びは変化しない。
+	// 結合を伴う解放は、たどり終えてから行う。途中で所有者が終了した場合も、リストにつないだブロックは回復時に解放される。
+	size_t num_of_reclaimed = 0;
+	size_t walked_units     = 0;
+	block* p_cur_blk        = get_top_block();
+	while ( walked_units < total_units_ ) {
+		size_t cur_units = p_cur_blk->get_blk_size();
+		if ( ( cur_units == 0 ) || ( cur_units > ( total_units_ - walked_units ) ) ) {
+			psm_logoutput( psm_log_lv::kErr, "Error: block sequence of offset_malloc_impl(%p) is broken at %p. stop reclaiming the memory blocks of owner(%u)", this, p_cur_blk, owner_id );
+			break;
+		}
+		if ( p_cur_blk->get_owner_id() == owner_id ) {
+			num_of_deferred_.fetch_add( 1, std::memory_order_relaxed );   // drain_detached_nolock()での減算と釣り合わせる。
+			journal_begin();
+			journal_record( op_detached_top_ );
+			set_next_ptr_w_undo( p_cur_blk, op_detached_top_.get() );
+			op_detached_top_ = p_cur_blk;
+			journal_commit();
+			num_of_reclaimed++;
+		}
+		walked_units += cur_units;
+		p_cur_blk = p_cur_blk->get_end_ptr();
+	}
+
+	drain_detached_nolock();
+	return num_of_reclaimed;
+}
+
+size_t offset_malloc::offset_malloc_impl::disown_all( void )
+{
+	recovering_lock_guard lk( *this );
+
+	// 遅延解放のスタックにあるブロックは、リンクを所有者の値と区別できないため、先に解放しておく。
+	drain_deferred_nolock();
+
+	// 所有者の値を消すだけで、ブロックの並びは変化しない。途中で終了した場合も、残った所有者の値は次の呼び出しで消される。
+	size_t num_of_disowned = 0;
+	size_t walked_units    = 0;
+	block* p_cur_blk       = get_top_block();
+	while ( walked_units < total_units_ ) {
+		size_t cur_units = p_cur_blk->get_blk_size();
+		if ( ( cur_units == 0 ) || ( cur_units > ( total_units_ - walked_units ) ) ) {
+			psm_logoutput( psm_log_lv::kErr, "Error: block sequence of offset_malloc_impl(%p) is broken at %p. stop disowning the memory blocks", this, p_cur_blk );
+			break;
+		}
+		if ( p_cur_blk->get_owner_id() != 0 ) {
+			p_cur_blk->set_owner_id( 0 );
+			num_of_disowned++;
+		}
+		walked_units += cur_units;
+		p_cur_blk = p_cur_blk->get_end_ptr();
+	}
+	return num_of_disowned;
+}
+
+void offset_malloc::offset_malloc_impl::set_owner_id_of_allocated( void* p, unsigned int owner_id )
+{
+	block* const p_target_blk = get_block_to_deallocate( p );
+	if ( p_target_blk == nullptr ) {
+		return;
+	}
+
+	// reclaim_owner()がヘッダを参照するため、mtx_を取得して変更する。
+	recovering_lock_guard lk( *this );
+	p_target_blk->set_owner_id( owner_id );
+}
+
+unsigned int offset_malloc::offset_malloc_impl::get_owner_id_of_allocated( void* p ) const noexcept
+{
+	block* p_target_blk = get_allocated_block( p );
+	if ( p_target_blk == nullptr ) {
+		return 0;
+	}
+	return p_target_blk->get_owner_id();
+}
+
+size_t offset_malloc::offset_malloc_impl::get_usable_size( void* p ) const noexcept
+{
+	block* p_target_blk = get_allocated_block( p );
+	if ( p_target_blk == nullptr ) {
+		return 0;
+	}
+	return reinterpret_cast<uintptr_t>( p_target_blk->get_end_ptr() ) - reinterpret_cast<uintptr_t>( p );
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::get_allocated_block( void* p ) const noexcept
+{
+	if ( !is_belong_to( p ) ) {
+		return nullptr;
+	}
+	// 割り当て済みのブロックのヘッダは、割り当てを受けた側が解放するまで変更されないため、排他制御なしで参照できる。
+	uintptr_t addr_target_blk = ( reinterpret_cast<uintptr_t>( p ) / size_of_block_header() - 1 ) * size_of_block_header();
+	return reinterpret_cast<block*>( addr_target_blk );
+}
+
+size_t offset_malloc::offset_malloc_impl::get_size_class_of_request( size_t req_bytes, size_t alignment ) noexcept
+{
+	size_t req_num_of_blocks_w_header = calc_req_num_of_blocks_w_header( req_bytes, alignment );
+	if ( ( alignment > size_of_block_header() ) || !is_bin_size( req_num_of_blocks_w_header ) ) {
+		return num_of_size_classes;
+	}
+	return req_num_of_blocks_w_header - min_bin_units;
+}
+
+size_t offset_malloc::offset_malloc_impl::get_size_class_of_allocated( void* p ) const noexcept
+{
+	block* p_target_blk = get_allocated_block( p );
+	if ( p_target_blk == nullptr ) {
+		return num_of_size_classes;
+	}
+
+	return get_size_class_of_units( p_target_blk->get_blk_size() );
+}
+
+bool offset_malloc::offset_malloc_impl::is_valid_size_of_allocated( void* p, size_t req_bytes, size_t alignment ) const noexcept
+{
+	block* p_target_blk = get_allocated_block( p );
+	if ( p_target_blk == nullptr ) {
+		return false;
+	}
+
+	if ( ( reinterpret_cast<uintptr_t>( p ) + req_bytes ) > reinterpret_cast<uintptr_t>( p_target_blk->get_end_ptr() ) ) {
+		// 要求サイズがブロックに収まらない。
+		return false;
+	}
+	// アライメントの補正はブロックを小さくする方向にのみ働く。一方で、切り出せない1単位分だけ要求より大きなブロックを割り当てる場合がある。
+	if ( p_target_blk->get_blk_size() <= ( calc_req_num_of_blocks_w_header( req_bytes, alignment ) + 1 ) ) {
+		return true;
+	}
+	// 大きなブロックは、ページ単位に補正した要求で割り当てられている場合がある。
+	if ( !adjust_large_request( req_bytes, alignment ) ) {
+		return false;
+	}
+	return p_target_blk->get_blk_size() <= ( calc_req_num_of_blocks_w_header( req_bytes, alignment ) + 1 );
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::insert_to_free_list( block* p_target_blk, block* p_hint_blk )
+{
+	block* p_pre_blk = nullptr;
+	if ( ( p_hint_blk != nullptr ) && ( p_hint_blk < p_target_blk ) ) {
+		// ヒントの空きブロックと、その次の空きブロックの間に解放対象のブロックがあれば、ヒントが直前の空きブロックとなる。
+		block* p_hint_nxt_blk = get_free_list_next( p_hint_blk );
+		if ( ( p_hint_nxt_blk == &base_blk_ ) || ( p_target_blk < p_hint_nxt_blk ) ) {
+			p_pre_blk = p_hint_blk;
+		}
+	}
+	if ( p_pre_blk == nullptr ) {
+		// アドレス順インデックスから、解放対象のブロックの直前に位置する空きブロックを探す。見つからない場合は、base_blk_が直前の空きブロックとなる。
+		p_pre_blk = addr_index_find_prev( p_target_blk );
+	}
+	block* p_nxt_blk = get_free_list_next( p_pre_blk );
+	block* p_ans     = p_target_blk;
+
+	if ( ( p_target_blk < p_pre_blk->get_end_ptr() ) || ( p_target_blk == p_nxt_blk ) ) {
+		// 解放対象のブロックが、すでに空きブロックに含まれている。二重解放の可能性がある。
+		psm_logoutput( psm_log_lv::kErr, "Error: fail to free, the block(%p) is already free", p_target_blk );
+		throw std::logic_error( "fail to free" );
+	}
+
+	// サイズ順インデックスのキーはブロックサイズなので、サイズを変更するブロックは、変更前にインデックスから外し、変更後に改めて登録する。
+	journal_begin();
+	if ( ( p_pre_blk->get_end_ptr() == p_target_blk ) && ( p_target_blk->get_end_ptr() == p_nxt_blk ) ) {
+		// 前後のブロックがともに隣接している場合、前後のブロック含めて結合する。
+		addr_index_erase( p_nxt_blk );
+		size_index_erase( p_nxt_blk );
+		size_index_erase( p_pre_blk );
+		set_next_ptr_w_undo( p_pre_blk, get_free_list_next( p_nxt_blk ) );
+		size_t pre_new_blk_num = p_pre_blk->get_blk_size() + p_target_blk->get_blk_size() + p_nxt_blk->get_blk_size();
+		set_blk_size_w_undo( p_pre_blk, pre_new_blk_num );
+		size_index_insert( p_pre_blk );
+		p_ans = p_pre_blk;
+		num_of_free_blocks_--;
+	} else if ( p_pre_blk->get_end_ptr() == p_target_blk ) {
+		// 前側だけ隣接している場合
+		size_index_erase( p_pre_blk );
+		size_t pre_new_blk_num = p_pre_blk->get_blk_size() + p_target_blk->get_blk_size();
+		set_blk_size_w_undo( p_pre_blk, pre_new_blk_num );
+		size_index_insert( p_pre_blk );
+		p_ans = p_pre_blk;
+	} else if ( p_target_blk->get_end_ptr() == p_nxt_blk ) {
+		// 後側だけ隣接している場合
+		addr_index_erase( p_nxt_blk );
+		size_index_erase( p_nxt_blk );
+		set_next_ptr_w_undo( p_target_blk, get_free_list_next( p_nxt_blk ) );
+		set_next_ptr_w_undo( p_pre_blk, p_target_blk );
+		size_t pre_new_blk_num = p_target_blk->get_blk_size() + p_nxt_blk->get_blk_size();
+		set_blk_size_w_undo( p_target_blk, pre_new_blk_num );
+		addr_index_insert( p_target_blk );
+		size_index_insert( p_target_blk );
+	} else {
+		// 前後、ともに隣接していない場合
+		set_next_ptr_w_undo( p_target_blk, p_nxt_blk );
+		set_next_ptr_w_undo( p_pre_blk, p_target_blk );
+		addr_index_insert( p_target_blk );
+		size_index_insert( p_target_blk );
+		num_of_free_blocks_++;
+	}
+	op_freep_ = p_pre_blk;
+	journal_commit();
+	return p_ans;
+}
+
+/*
+ * アドレス順インデックスとサイズ順インデックスは、優先度をブロックのオフセットのハッシュ値で決定するtreapとして実装している。
+ * 優先度をメモリ上に保持しないため、リンク情報はインデックスごとにオフセットポインタ2個分となる。
+ * また、ハッシュ値はこのクラス構造の先頭からのオフセットで計算するため、マッピングされたアドレスがプロセスごとに異なっても同じ値となる。
+ */
+struct offset_malloc::offset_malloc_impl::addr_index_traits {
+	static block::tree_link& link( block* p_blk )
+	{
+		return p_blk->get_addr_link();
+	}
+	static bool less( block* p_a, block* p_b )
+	{
+		return p_a < p_b;
+	}
+};
+
+struct offset_malloc::offset_malloc_impl::size_index_traits {
+	static block::tree_link& link( block* p_blk )
+	{
+		return p_blk->get_size_link();
+	}
+	static bool less( block* p_a, block* p_b )
+	{
+		// 同じサイズのブロックは、アドレス順に並べる。これにより、キーが一意になり、かつ、同じサイズのブロックからは低いアドレスのブロックが選択される。
+		if ( p_a->get_blk_size() != p_b->get_blk_size() ) {
+			return p_a->get_blk_size() < p_b->get_blk_size();
+		}
+		return p_a < p_b;
+	}
+};
+
+size_t offset_malloc::offset_malloc_impl::calc_priority( block* p_blk ) const noexcept
+{
+	// splitmix64の最終段の混合関数
+	uint64_t x = static_cast<uint64_t>( reinterpret_cast<uintptr_t>( p_blk ) - reinterpret_cast<uintptr_t>( this ) ) / size_of_block_header();
+	x          = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+	x          = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBULL;
+	x          = x ^ ( x >> 31 );
+	return static_cast<size_t>( x );
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::addr_index_find_prev( block* p_target_blk ) const noexcept
+{
+	block* p_ans = const_cast<block*>( &base_blk_ );
+	block* p_cur = op_addr_index_root_.get();
+	while ( p_cur != nullptr ) {
+		if ( p_cur < p_target_blk ) {
+			p_ans = p_cur;
+			p_cur = p_cur->get_addr_link().op_right_.get();
+		} else {
+			p_cur = p_cur->get_addr_link().op_left_.get();
+		}
+	}
+	return p_ans;
+}
+
+void offset_malloc::offset_malloc_impl::addr_index_insert( block* p_target_blk )
+{
+	index_insert<addr_index_traits>( op_addr_index_root_, p_target_blk );
+}
+
+void offset_malloc::offset_malloc_impl::addr_index_erase( block* p_target_blk )
+{
+	index_erase<addr_index_traits>( op_addr_index_root_, p_target_blk );
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::size_index_find_fit( size_t req_num_of_blocks_w_header ) const noexcept
+{
+	block* p_ans = nullptr;
+	block* p_cur = op_size_index_root_.get();
+	while ( p_cur != nullptr ) {
+		if ( p_cur->get_blk_size() >= req_num_of_blocks_w_header ) {
+			p_ans = p_cur;
+			p_cur = p_cur->get_size_link().op_left_.get();
+		} else {
+			p_cur = p_cur->get_size_link().op_right_.get();
+		}
+	}
+	return p_ans;
+}
+
+bool offset_malloc::offset_malloc_impl::is_size_indexed( block* p_blk ) const noexcept
+{
+	// サイズ順インデックスのリンク情報を保持できない小さなブロックは、インデックスに登録しない。
+	return ( policy_ == offset_malloc_policy::kBestFit ) && ( p_blk->get_blk_size() >= min_size_index_units );
+}
+
+void offset_malloc::offset_malloc_impl::size_index_insert( block* p_target_blk )
+{
+	if ( !is_size_indexed( p_target_blk ) ) {
+		return;
+	}
+	index_insert<size_index_traits>( op_size_index_root_, p_target_blk );
+}
+
+void offset_malloc::offset_malloc_impl::size_index_erase( block* p_target_blk )
+{
+	if ( !is_size_indexed( p_target_blk ) ) {
+		return;
+	}
+	index_erase<size_index_traits>( op_size_index_root_, p_target_blk );
+}
+
+template <typename Traits>
+void offset_malloc::offset_malloc_impl::index_insert( offset_ptr<block>& op_root, block* p_target_blk )
+{
+	block* p_root = op_root.get();
+	if ( ( p_root == nullptr ) || ( calc_priority( p_root ) < calc_priority( p_target_blk ) ) ) {
+		new ( &( Traits::link( p_target_blk ) ) ) block::tree_link;
+		index_split<Traits>( p_root, p_target_blk, Traits::link( p_target_blk ).op_left_, Traits::link( p_target_blk ).op_right_ );
+		op_root = p_target_blk;
+		return;
+	}
+
+	if ( Traits::less( p_target_blk, p_root ) ) {
+		index_insert<Traits>( Traits::link( p_root ).op_left_, p_target_blk );
+	} else {
+		index_insert<Traits>( Traits::link( p_root ).op_right_, p_target_blk );
+	}
+}
+
+template <typename Traits>
+void offset_malloc::offset_malloc_impl::index_erase( offset_ptr<block>& op_root, block* p_target_blk )
+{
+	block* p_root = op_root.get();
+	if ( p_root == nullptr ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: the block(%p) is not found in the index of free list", p_target_blk );
+		throw std::logic_error( "index of free list is broken" );
+	}
+
+	if ( p_root == p_target_blk ) {
+		op_root = index_merge<Traits>( Traits::link( p_root ).op_left_.get(), Traits::link( p_root ).op_right_.get() );
+	} else if ( Traits::less( p_target_blk, p_root ) ) {
+		index_erase<Traits>( Traits::link( p_root ).op_left_, p_target_blk );
+	} else {
+		index_erase<Traits>( Traits::link( p_root ).op_right_, p_target_blk );
+	}
+}
+
+template <typename Traits>
+void offset_malloc::offset_malloc_impl::index_split( block* p_root, block* p_key, offset_ptr<block>& op_left, offset_ptr<block>& op_right )
+{
+	if ( p_root == nullptr ) {
+		op_left  = nullptr;
+		op_right = nullptr;
+		return;
+	}
+
+	if ( Traits::less( p_root, p_key ) ) {
+		index_split<Traits>( Traits::link( p_root ).op_right_.get(), p_key, Traits::link( p_root ).op_right_, op_right );
+		op_left = p_root;
+	} else {
+		index_split<Traits>( Traits::link( p_root ).op_left_.get(), p_key, op_left, Traits::link( p_root ).op_left_ );
+		op_right = p_root;
+	}
+}
+
+template <typename Traits>
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::index_merge( block* p_left, block* p_right )
+{
+	if ( p_left == nullptr ) {
+		return p_right;
+	}
+	if ( p_right == nullptr ) {
+		return p_left;
+	}
+
+	if ( calc_priority( p_left ) > calc_priority( p_right ) ) {
+		Traits::link( p_left ).op_right_ = index_merge<Traits>( Traits::link( p_left ).op_right_.get(), p_right );
+		return p_left;
+	} else {
+		Traits::link( p_right ).op_left_ = index_merge<Traits>( p_left, Traits::link( p_right ).op_left_.get() );
+		return p_right;
+	}
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::get_free_list_next( block* p_blk ) noexcept
+{
+	// offset_ptrは自身を指すことができないため、base_blk_だけが空きブロックリストにつながっている状態では、base_blk_の次のブロックはnullptrとして保持される。
+	block* p_ans = p_blk->get_next_ptr();
+	return ( p_ans == nullptr ) ? &base_blk_ : p_ans;
+}
+
+/*
+ * サイズクラスのリストとクイックリストの末尾のブロックは、nullptrではなくbase_blk_を指す。
+ * これにより、空きブロックのリンクは常に0以外の偶数となり、0または奇数の所有者の値を持つ割り当て済みのブロックと区別できるため、二重解放を検出できる。
+ * リストの先頭を指すop_bins_とop_quick_list_は、空の場合はnullptrのままとする。
+ */
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::get_bin_list_next( block* p_blk ) const noexcept
+{
+	block* p_ans = p_blk->get_next_ptr();
+	return ( p_ans == &base_blk_ ) ? nullptr : p_ans;
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::to_bin_list_link( block* p_nxt ) noexcept
+{
+	return ( p_nxt == nullptr ) ? &base_blk_ : p_nxt;
+}
+
+void offset_malloc::offset_malloc_impl::push_to_bin( block* p_target_blk )
+{
+	offset_ptr<block>& op_bin_top = op_bins_[p_target_blk->get_blk_size() - min_bin_units];
+	journal_begin();
+	set_next_ptr_w_undo( p_target_blk, to_bin_list_link( op_bin_top.get() ) );
+	journal_record( op_bin_top );
+	op_bin_top = p_target_blk;
+	journal_commit();
+	num_of_free_blocks_++;
+	num_of_uncoalesced_blocks_++;
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::pop_from_bin( size_t num_of_units )
+{
+	offset_ptr<block>& op_bin_top = op_bins_[num_of_units - min_bin_units];
+	block*             p_ans      = op_bin_top.get();
+	if ( p_ans == nullptr ) {
+		return nullptr;
+	}
+	journal_begin();
+	journal_record( op_bin_top );
+	op_bin_top = get_bin_list_next( p_ans );
+	set_next_ptr_w_undo( p_ans, nullptr );
+	journal_commit();
+	num_of_free_blocks_--;
+	num_of_uncoalesced_blocks_--;
+	return p_ans;
+}
+
+void offset_malloc::offset_malloc_impl::push_to_quick_list( block* p_target_blk )
+{
+	journal_begin();
+	set_next_ptr_w_undo( p_target_blk, to_bin_list_link( op_quick_list_.get() ) );
+	journal_record( op_quick_list_ );
+	op_quick_list_ = p_target_blk;
+	journal_commit();
+	num_of_free_blocks_++;
+	num_of_uncoalesced_blocks_++;
+}
+
+offset_malloc::offset_malloc_impl::block* offset_malloc::offset_malloc_impl::pop_from_quick_list( size_t req_num_of_blocks_w_header )
+{
+	// 直近に解放されたブロックから、要求ブロック数またはその+1のブロックを探す。切り出しは行わないため、割り当て後のブロックサイズの条件はK&Rの場合と同じになる。
+	offset_ptr<block>* p_op_link = &op_quick_list_;
+	block*             p_cur_blk = op_quick_list_.get();
+	for ( size_t i = 0; ( i < quick_list_scan_limit ) && ( p_cur_blk != nullptr ); i++ ) {
+		size_t cur_units = p_cur_blk->get_blk_size();
+		if ( ( req_num_of_blocks_w_header <= cur_units ) && ( cur_units <= ( req_num_of_blocks_w_header + 1 ) ) ) {
+			// 先頭から外す場合は、リストが空になればnullptrとし、途中から外す場合は、直前のブロックのリンクが末尾を表すbase_blk_を引き継ぐ。
+			journal_begin();
+			journal_record( *p_op_link );
+			*p_op_link = ( p_op_link == &op_quick_list_ ) ? get_bin_list_next( p_cur_blk ) : p_cur_blk->get_next_ptr();
+			set_next_ptr_w_undo( p_cur_blk, nullptr );
+			journal_commit();
+			num_of_free_blocks_--;
+			num_of_uncoalesced_blocks_--;
+			return p_cur_blk;
+		}
+		p_op_link = &( p_cur_blk->active_header_.op_next_block_ );
+		p_cur_blk = get_bin_list_next( p_cur_blk );
+	}
+	return nullptr;
+}
+
+void offset_malloc::offset_malloc_impl::consolidate_bins( void )
+{
+	auto consolidate_list = [this]( offset_ptr<block>& op_list_top ) {
+		// 結合の途中で所有者が終了しても、リストに残っているブロックが失われないように、1ブロックずつリストから外して結合する。
+		while ( op_list_top != nullptr ) {
+			block* p_cur_blk = op_list_top.get();
+			journal_begin();
+			journal_record( op_list_top );
+			op_list_top = get_bin_list_next( p_cur_blk );
+			num_of_free_blocks_--;   // insert_to_free_list()で改めて数える。
+			num_of_uncoalesced_blocks_--;
+			insert_to_free_list( p_cur_blk );
+			journal_commit();
+		}
+	};
+	for ( auto& op_bin_top : op_bins_ ) {
+		consolidate_list( op_bin_top );
+	}
+	// クイックリストも、サイズクラスのリストと同様に結合する。
+	consolidate_list( op_quick_list_ );
+}
+
+void offset_malloc::offset_malloc_impl::set_deferred_coalescing( bool enable )
+{
+	recovering_lock_guard lk( *this );
+
+	deferred_coalescing_ = enable;
+	if ( !enable ) {
+		consolidate_bins();
+	}
+}
+
+bool offset_malloc::offset_malloc_impl::is_deferred_coalescing( void ) const
+{
+	recovering_lock_guard lk( *this );
+	return deferred_coalescing_;
+}
+
+void offset_malloc::offset_malloc_impl::set_page_bytes( size_t page_bytes )
+{
+	if ( ( page_bytes == 0 ) || ( ( page_bytes & ( page_bytes - 1 ) ) != 0 ) ) {
+		psm_logoutput( psm_log_lv::kWarn, "Warning: page size(%zu) of offset_malloc_impl(%p) should be a power of 2. it is ignored", page_bytes, this );
+		return;
+	}
+
+	recovering_lock_guard lk( *this );
+	page_bytes_ = page_bytes;
+}
+
+void offset_malloc::offset_malloc_impl::recover_nolock( void )
+{
+	psm_logoutput( psm_log_lv::kWarn, "Warning: recover the free lists of offset_malloc_impl(%p), because the previous owner of the mutex died or failed during the update. state=%d, num_of_undo_entries=%zu",
+	               this, static_cast<int>( intent_.state_ ), intent_.num_of_entries_ );
+
+	// kCommittedの場合は、更新を完了しているため、取り消しエントリを破棄して更新後の状態を採用する(ロールフォワード)。
+	if ( intent_.state_ == intent_record::state::kInProgress ) {
+		rollback_nolock();
+	}
+	// 回復の途中で所有者が終了した場合は、次の所有者が取り消しから再度行う。取り消しと再構築は、何度行っても同じ結果になる。
+	rebuild_nolock();
+	std::atomic_signal_fence( std::memory_order_seq_cst );
+	intent_.depth_          = 0;
+	intent_.num_of_entries_ = 0;
+	intent_.state_          = intent_record::state::kIdle;
+
+	// 繰延解放スタックから取り出したブロックが残っている場合は、残りの解放を継続する。
+	drain_detached_nolock();
+}
+
+void offset_malloc::offset_malloc_impl::rollback_nolock( void ) noexcept
+{
+	for ( size_t i = intent_.num_of_entries_; i > 0; i-- ) {
+		const intent_record::undo_entry& entry   = intent_.entries_[i - 1];
+		void*                            p_field = reinterpret_cast<void*>( reinterpret_cast<uintptr_t>( this ) + entry.offset_ );
+		std::memcpy( p_field, &( entry.old_value_ ), sizeof( std::uint64_t ) );
+	}
+}
+
+void offset_malloc::offset_malloc_impl::rebuild_nolock( void )
+{
+	// K&Rの空きブロックリストと、サイズクラスのリスト、クイックリストは、取り消しによって整合した状態になっている。
+	// インデックスとカウンタは、これらのリストとヒープ全体のブロックの並びから作り直す。サイズクラスごとの統計は、作り直さない。
+	auto report_broken = [this]( const char* p_where, void* p_blk ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: fail to recover offset_malloc_impl(%p). %s is broken at %p", this, p_where, p_blk );
+		throw std::logic_error( "Error: fail to recover offset_malloc_impl. free list is broken" );
+	};
+
+	op_freep_           = &base_blk_;
+	op_addr_index_root_ = nullptr;
+	op_size_index_root_ = nullptr;
+
+	size_t num_of_free_blocks = 0;
+	size_t free_units         = 0;
+	block* p_pre_blk          = &base_blk_;
+	for ( block* p_cur_blk = get_free_list_next( &base_blk_ ); p_cur_blk != &base_blk_; p_cur_blk = get_free_list_next( p_cur_blk ) ) {
+		// 壊れたリストで無限ループにならないように、アドレス順であることと、ブロック数の上限を確認する。
+		if ( !is_belong_to( p_cur_blk ) || ( p_cur_blk <= p_pre_blk ) || ( num_of_free_blocks >= total_units_ ) ) {
+			report_broken( "K&R free list", p_cur_blk );
+		}
+		addr_index_insert( p_cur_blk );
+		size_index_insert( p_cur_blk );
+		num_of_free_blocks++;
+		free_units += p_cur_blk->get_blk_size();
+		p_pre_blk = p_cur_blk;
+	}
+
+	size_t num_of_uncoalesced_blocks = 0;
+
+	auto count_list = [&]( const offset_ptr<block>& op_list_top, const char* p_where ) {
+		for ( block* p_cur_blk = op_list_top.get(); p_cur_blk != nullptr; p_cur_blk = get_bin_list_next( p_cur_blk ) ) {
+			if ( !is_belong_to( p_cur_blk ) || ( num_of_uncoalesced_blocks >= total_units_ ) ) {
+				report_broken( p_where, p_cur_blk );
+			}
+			num_of_uncoalesced_blocks++;
+			free_units += p_cur_blk->get_blk_size();
+		}
+	};
+	for ( auto& op_bin_top : op_bins_ ) {
+		count_list( op_bin_top, "size class bin" );
+	}
+	count_list( op_quick_list_, "quick list" );
+
+	// ヒープ全体は、ブロックサイズで隙間なく分割されているため、先頭からたどることで割り当て済みのブロックも含めて数えられる。
+	block* p_cur_blk     = get_top_block();
+	size_t walked_units  = 0;
+	size_t num_of_blocks = 0;
+	while ( walked_units < total_units_ ) {
+		size_t cur_units = p_cur_blk->get_blk_size();
+		if ( ( cur_units == 0 ) || ( cur_units > ( total_units_ - walked_units ) ) ) {
+			report_broken( "block sequence", p_cur_blk );
+		}
+		walked_units += cur_units;
+		num_of_blocks++;
+		p_cur_blk = p_cur_blk->get_end_ptr();
+	}
+
+	num_of_free_blocks += num_of_uncoalesced_blocks;
+	if ( ( free_units > total_units_ ) || ( num_of_free_blocks > num_of_blocks ) ) {
+		report_broken( "counters of free blocks", nullptr );
+	}
+	num_of_free_blocks_        = num_of_free_blocks;
+	num_of_uncoalesced_blocks_ = num_of_uncoalesced_blocks;
+	allocated_units_           = total_units_ - free_units;
+	num_of_allocated_blocks_   = num_of_blocks - num_of_free_blocks;
+}
+
+int offset_malloc::offset_malloc_impl::bind( void )
+{
+	recovering_lock_guard lk( *this );
+
+	bind_cnt_++;
+	return bind_cnt_;
+}
+int offset_malloc::offset_malloc_impl::unbind( void )
+{
+	recovering_lock_guard lk( *this );
+	bind_cnt_--;
+	return bind_cnt_;
+}
+
+int offset_malloc::offset_malloc_impl::get_bind_count( void ) const
+{
+	recovering_lock_guard lk( *this );
+	return bind_cnt_;
+}
+
+offset_malloc_stats offset_malloc::offset_malloc_impl::get_stats( void ) const
+{
+	recovering_lock_guard lk( *this );
+
+	offset_malloc_stats ans;
+	ans.total_bytes_              = total_units_ * size_of_block_header();
+	ans.free_bytes_               = ( total_units_ - allocated_units_ ) * size_of_block_header();
+	ans.num_of_free_blocks_       = num_of_free_blocks_;
+	ans.largest_free_block_bytes_ = find_largest_free_units() * size_of_block_header();
+	ans.num_of_allocated_blocks_  = num_of_allocated_blocks_;
+	ans.fragmentation_ratio_      = ( ans.free_bytes_ == 0 ) ? 0.0 : ( 1.0 - static_cast<double>( ans.largest_free_block_bytes_ ) / static_cast<double>( ans.free_bytes_ ) );
+	return ans;
+}
+
+size_t offset_malloc::offset_malloc_impl::find_largest_free_units( void ) const noexcept
+{
+	size_t ans = 0;
+	if ( policy_ == offset_malloc_policy::kBestFit ) {
+		// サイズ順インデックスの最も右のブロックが最大。インデックスに含まれない空きブロックは、min_size_index_unitsより小さい。
+		block* p_cur = op_size_index_root_.get();
+		while ( p_cur != nullptr ) {
+			ans   = p_cur->active_header_.size_of_this_block_;
+			p_cur = p_cur->get_size_link().op_right_.get();
+		}
+		if ( ( ans == 0 ) && ( op_addr_index_root_ != nullptr ) ) {
+			ans = min_bin_units;
+		}
+	} else {
+		const block* p_base = &base_blk_;
+		block*       p_cur  = base_blk_.active_header_.op_next_block_.get();
+		while ( ( p_cur != nullptr ) && ( p_cur != p_base ) ) {
+			if ( ans < p_cur->active_header_.size_of_this_block_ ) {
+				ans = p_cur->active_header_.size_of_this_block_;
+			}
+			p_cur = p_cur->active_header_.op_next_block_.get();
+		}
+	}
+
+	// サイズクラスのリストにある空きブロックは、K&Rの空きブロックリストのブロックと結合されていないため、個別に比較する。
+	for ( size_t i = num_of_bins; i > 0; i-- ) {
+		if ( op_bins_[i - 1] != nullptr ) {
+			size_t bin_units = ( i - 1 ) + min_bin_units;
+			if ( ans < bin_units ) {
+				ans = bin_units;
+			}
+			break;
+		}
+	}
+
+	// クイックリストの空きブロックも結合されていないため、個別に比較する。
+	for ( block* p_cur = op_quick_list_.get(); p_cur != nullptr; p_cur = get_bin_list_next( p_cur ) ) {
+		if ( ans < p_cur->active_header_.size_of_this_block_ ) {
+			ans = p_cur->active_header_.size_of_this_block_;
+		}
+	}
+	return ans;
+}
+
+size_t offset_malloc::offset_malloc_impl::get_size_class_of_units( size_t num_of_units ) noexcept
+{
+	if ( !is_bin_size( num_of_units ) ) {
+		return num_of_size_classes;
+	}
+	return num_of_units - min_bin_units;
+}
+
+void offset_malloc::offset_malloc_impl::count_allocation( size_t num_of_units ) noexcept
+{
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	if ( op_size_class_counters_ == nullptr ) {
+		return;
+	}
+	// 更新はmtx_の保護下で行われるため、他のプロセスからの読み出しとの間で原子性があればよく、順序の保証は不要。
+	size_class_counter& cntr = op_size_class_counters_.get()[get_size_class_of_units( num_of_units )];
+	cntr.num_of_allocations_.fetch_add( 1, std::memory_order_relaxed );
+	cntr.live_units_.fetch_add( num_of_units, std::memory_order_relaxed );
+#else
+	static_cast<void>( num_of_units );
+#endif
+}
+
+void offset_malloc::offset_malloc_impl::count_deallocation( size_t num_of_units ) noexcept
+{
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	if ( op_size_class_counters_ == nullptr ) {
+		return;
+	}
+	size_class_counter& cntr = op_size_class_counters_.get()[get_size_class_of_units( num_of_units )];
+	cntr.num_of_deallocations_.fetch_add( 1, std::memory_order_relaxed );
+	cntr.live_units_.fetch_sub( num_of_units, std::memory_order_relaxed );
+#else
+	static_cast<void>( num_of_units );
+#endif
+}
+
+void offset_malloc::offset_malloc_impl::count_failed_allocation( size_t req_num_of_blocks_w_header ) noexcept
+{
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	if ( op_size_class_counters_ == nullptr ) {
+		return;
+	}
+	op_size_class_counters_.get()[get_size_class_of_units( req_num_of_blocks_w_header )].num_of_failed_allocations_.fetch_add( 1, std::memory_order_relaxed );
+#else
+	static_cast<void>( req_num_of_blocks_w_header );
+#endif
+}
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+void offset_malloc::offset_malloc_impl::add_size_class_histogram( offset_malloc_size_class_histogram& histogram ) const noexcept
+{
+	for ( size_t i = 0; i < offset_malloc_size_class_histogram::num_of_classes; i++ ) {
+		offset_malloc_size_class_stats& ans = histogram.classes_[i];
+
+		ans.block_bytes_ = ( i < num_of_size_classes ) ? ( ( i + min_bin_units ) * size_of_block_header() ) : 0;
+		if ( op_size_class_counters_ == nullptr ) {
+			continue;
+		}
+		const size_class_counter& cntr = op_size_class_counters_.get()[i];
+		ans.num_of_allocations_ += cntr.num_of_allocations_.load( std::memory_order_relaxed );
+		ans.num_of_deallocations_ += cntr.num_of_deallocations_.load( std::memory_order_relaxed );
+		ans.live_bytes_ += cntr.live_units_.load( std::memory_order_relaxed ) * size_of_block_header();
+		ans.num_of_failed_allocations_ += cntr.num_of_failed_allocations_.load( std::memory_order_relaxed );
+	}
+}
+#endif
+
+bool offset_malloc::offset_malloc_impl::is_belong_to( void* p_mem ) const noexcept
+{
+	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p_mem );
+	uintptr_t addr_top = reinterpret_cast<uintptr_t>( base_blk_.block_body_ );
+	uintptr_t addr_end = reinterpret_cast<uintptr_t>( op_end_.get() );
+	if ( addr_p < addr_top ) {
+		// out of range
+		return false;
+	}
+	if ( addr_end <= addr_p ) {
+		// out of range
+		return false;
+	}
+
+	return true;
+}
+
+offset_malloc::offset_malloc_impl* offset_malloc::offset_malloc_impl::get_arena( size_t idx ) noexcept
+{
+	if ( idx == 0 ) {
+		return this;
+	}
+	return reinterpret_cast<offset_malloc_impl*>( reinterpret_cast<uintptr_t>( this ) + arena_stride_bytes_ * idx );
+}
+
+offset_malloc::offset_malloc_impl* offset_malloc::offset_malloc_impl::find_arena( void* p_mem ) noexcept
+{
+	uintptr_t addr_p    = reinterpret_cast<uintptr_t>( p_mem );
+	uintptr_t addr_this = reinterpret_cast<uintptr_t>( this );
+	if ( addr_p < addr_this ) {
+		return nullptr;
+	}
+
+	// アリーナは等間隔に配置されているため、アドレスから所属するアリーナを算出できる。最後のアリーナは、端数を含むため、それ以降のアドレスも最後のアリーナで判定する。
+	size_t idx = ( num_of_arenas_ <= 1 ) ? 0 : ( ( addr_p - addr_this ) / arena_stride_bytes_ );
+	if ( idx >= num_of_arenas_ ) {
+		idx = num_of_arenas_ - 1;
+	}
+	offset_malloc_impl* p_arena = get_arena( idx );
+	if ( !p_arena->is_belong_to( p_mem ) ) {
+		return nullptr;
+	}
+	return p_arena;
+}
+
+offset_malloc::offset_malloc_impl* offset_malloc::offset_malloc_impl::placement_new( void* begin_pointer, void* end_pointer, offset_malloc_policy policy, size_t num_of_arenas )
+{
+	if ( begin_pointer == nullptr ) {
+		throw std::bad_alloc();
+	}
+	if ( end_pointer == nullptr ) {
+		throw std::bad_alloc();
+	}
+	if ( begin_pointer >= end_pointer ) {
+		throw std::bad_alloc();
+	}
+	if ( ( reinterpret_cast<uintptr_t>( begin_pointer ) + sizeof( offset_malloc::offset_malloc_impl ) ) >= reinterpret_cast<uintptr_t>( end_pointer ) ) {
+		throw std::bad_alloc();
+	}
+
+	if ( num_of_arenas <= 1 ) {
+		return new ( begin_pointer ) offset_malloc::offset_malloc_impl( end_pointer, policy, 1, 0 );
+	}
+
+	// 各アリーナの先頭にoffset_malloc_implを配置するため、配置間隔はblock_headerのサイズでアライメントする。
+	uintptr_t addr_begin = reinterpret_cast<uintptr_t>( begin_pointer );
+	uintptr_t addr_end   = reinterpret_cast<uintptr_t>( end_pointer );
+	size_t    stride     = ( ( addr_end - addr_begin ) / num_of_arenas / size_of_block_header() ) * size_of_block_header();
+	if ( stride <= ( sizeof( offset_malloc::offset_malloc_impl ) + size_of_block_header() * 2 ) ) {
+		// 各アリーナに割り当て可能な領域を確保できない。
+		throw std::bad_alloc();
+	}
+
+	offset_malloc_impl* p_ans = new ( begin_pointer ) offset_malloc::offset_malloc_impl( reinterpret_cast<void*>( addr_begin + stride ), policy, num_of_arenas, stride );
+	for ( size_t i = 1; i < num_of_arenas; i++ ) {
+		uintptr_t addr_arena_begin = addr_begin + stride * i;
+		uintptr_t addr_arena_end   = ( i == ( num_of_arenas - 1 ) ) ? addr_end : ( addr_arena_begin + stride );
+		new ( reinterpret_cast<void*>( addr_arena_begin ) ) offset_malloc::offset_malloc_impl( reinterpret_cast<void*>( addr_arena_end ), policy, 1, 0 );
+	}
+	return p_ans;
 }
 
 offset_malloc::offset_malloc_impl* offset_malloc::offset_malloc_impl::bind( offset_malloc_impl* p_mem )
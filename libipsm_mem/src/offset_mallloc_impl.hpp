@@ -12,7 +12,10 @@
 #ifndef OFFSET_MALLOC_IMPL_HPP_
 #define OFFSET_MALLOC_IMPL_HPP_
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 #include "ipsm_logger_internal.hpp"
 #include "ipsm_mutex.hpp"
@@ -25,6 +28,24 @@ namespace ipsm {
  * @brief offset_malloc::offset_malloc_impl implementation
  *
  * this memory allocator implemented K&R memory allocation algorithm.
+ * small blocks are recycled via segregated size-class bins(offset linked free lists per size class) in front of K&R free list.
+ * the bins are not coalesced when the block is freed. they are coalesced into K&R free list when K&R free list could not allocate,
+ * or when the number of uncoalesced blocks reaches deferred_coalescing_threshold.
+ * the blocks in K&R free list are also indexed by an address ordered treap. the link of the treap is placed in the body of the free block.
+ * therefore deallocation finds the neighbor blocks to coalesce in O(log n).
+ * the request of large_block_threshold_bytes or more is allocated as page aligned run of pages if it fits. when the memory block is freed,
+ * the pages of it that are wholly in the coalesced free block are returned to OS by madvise(MADV_REMOVE) in the unit of set_page_bytes().
+ * therefore the usage of the shared memory object really decreases.
+ * if deferred coalescing mode is enabled by set_deferred_coalescing(), the freed blocks that are larger than size classes are also not coalesced.
+ * they are linked to the quick list, and reused by the allocation of the same size. the bins and the quick list are coalesced into K&R free list
+ * when K&R free list could not allocate, or when the number of uncoalesced blocks reaches deferred_coalescing_threshold.
+ * if offset_malloc_policy::kBestFit is selected by placement_new(), the blocks in K&R free list are also indexed by a size ordered treap,
+ * and allocation selects the smallest free block that satisfies the request.
+ * each update of the free lists records the old values of the changed fields in the intent record before the change.
+ * if the owner of the mutex dies during the update, the next owner rolls back the update, and rebuilds the indexes and the counters.
+ * therefore the crash of one process does not require to recreate the shared memory.
+ * the allocated memory block is able to be tagged with the owner id. the tag is placed in the link field of the block header,
+ * that is not used while the memory block is allocated. reclaim_owner() deallocates all memory blocks of the owner at once.
  *
  * this class instance does not become resource owner. caller side of placement_new() should release memory resource.
  *
@@ -32,28 +53,218 @@ namespace ipsm {
  */
 class offset_malloc::offset_malloc_impl {
 public:
-	static offset_malloc_impl* placement_new( void* begin_pointer, void* end_pointer );
+	static constexpr size_t num_of_size_classes           = 16;           //!< number of size classes of small blocks. body size of size classes is 16 bytes .. 256 bytes
+	static constexpr size_t deferred_free_drain_threshold = 64;           //!< number of memory blocks in the deferred free stack that triggers the drain by deallocate_deferred()
+	static constexpr size_t deferred_coalescing_threshold = 256;          //!< number of uncoalesced free blocks that triggers the coalescing of the bins and the quick list
+	static constexpr size_t large_block_threshold_bytes   = 1024 * 128;   //!< request size that is allocated as page aligned run of pages, and whose pages are returned to OS when it is freed
+	static constexpr size_t max_num_of_undo_entries       = 10;           //!< number of undo entries that one update of the free lists is able to record
+
+	/**
+	 * @brief construct the memory allocator on the memory area [begin_pointer, end_pointer)
+	 *
+	 * if num_of_arenas is bigger than 1, the memory area is split into num_of_arenas arenas, and each arena has own offset_malloc_impl, mutex and free lists.
+	 * the returned offset_malloc_impl is the 1st arena and it has the information of all arenas. if num_of_arenas is 0, it is treated as 1.
+	 */
+	static offset_malloc_impl* placement_new( void* begin_pointer, void* end_pointer, offset_malloc_policy policy = offset_malloc_policy::kFirstFit, size_t num_of_arenas = 1 );
 	static offset_malloc_impl* bind( offset_malloc_impl* p_mem );
 	static void                unbind( offset_malloc_impl* p_mem ) noexcept;
 
 #if __has_cpp_attribute( nodiscard )
 	[[nodiscard]]
 #endif
-	void* allocate( size_t req_bytes, size_t alignment = alignof( std::max_align_t ) );
+	void* allocate( size_t req_bytes, size_t alignment = alignof( std::max_align_t ), unsigned int owner_id = 0 );   // owner_id: tag of the allocated memory block. 0 means no owner
 	void  deallocate( void* p, size_t alignment = alignof( std::max_align_t ) );
 
+	/**
+	 * @brief allocate up to n memory blocks of the same size in one critical section
+	 *
+	 * @return the number of allocated memory blocks that are stored from pp_out[0]
+	 */
+	size_t allocate_bulk( size_t req_bytes, size_t alignment, size_t n, void** pp_out, unsigned int owner_id = 0 );
+
+	/**
+	 * @brief deallocate n memory blocks in one critical section
+	 *
+	 * if pp is sorted by ascending address, the free list is walked in one pass to coalesce the memory blocks.
+	 */
+	void deallocate_bulk( void* const* pp, size_t n, size_t alignment = alignof( std::max_align_t ) );
+
+	/**
+	 * @brief deallocate p without the mutex by pushing it to the lock-free deferred free stack
+	 *
+	 * the pushed memory blocks are returned to the free list by the next allocate()/allocate_bulk() that holds the mutex,
+	 * or by the caller of this function when the number of the pushed memory blocks reaches deferred_free_drain_threshold.
+	 * until then, the pushed memory blocks are counted as allocated.
+	 */
+	void deallocate_deferred( void* p );
+
+	/**
+	 * @brief return all memory blocks in the deferred free stack to the free list
+	 */
+	void drain_deferred( void );
+
+	/**
+	 * @brief enable or disable deferred coalescing mode of this arena
+	 *
+	 * if disabled, the blocks in the quick list are coalesced into K&R free list immediately.
+	 */
+	void set_deferred_coalescing( bool enable );
+	bool is_deferred_coalescing( void ) const;
+
+	/**
+	 * @brief set the unit of the pages that are returned to OS when the large memory block is freed
+	 *
+	 * the memory area on hugetlbfs could be returned only by the huge page. the default is the system page size.
+	 * if page_bytes is not a power of 2, this call is ignored.
+	 */
+	void set_page_bytes( size_t page_bytes );
+
+	/**
+	 * @brief try to expand the memory block of p in place by merging the adjacent free block
+	 *
+	 * @return true: the memory block of p has new_bytes at least. false: there is no enough adjacent free block. p is not changed.
+	 */
+	bool try_expand( void* p, size_t new_bytes );
+
+	/**
+	 * @brief shrink the memory block of p in place, and return the tail of the memory block to the free list
+	 *
+	 * if the tail is too small to be a free block, the memory block is not changed.
+	 */
+	void shrink( void* p, size_t new_bytes );
+
+	/**
+	 * @brief move the memory block of p to the lowest free block that is placed at the lower address than p
+	 *
+	 * the contents of the memory block is copied under the lock of this arena.
+	 * the free block that is smaller than the memory block of p is not used, because the destination that overlaps p could not be rolled back.
+	 * so the memory block of p is kept as it is until the move is committed.
+	 *
+	 * @pre no other thread/process accesses the memory block of p during this call.
+	 *
+	 * @param p_referrer if not nullptr, this pointer is updated to the new address in the same update of the free lists.
+	 *                   it should be placed in the same memory region of this arena, because the undo entry records it by the offset from this.
+	 *
+	 * @return new address of the memory block. if there is no free block to move to, return p.
+	 */
+	void* relocate_to_lower_address( void* p, size_t alignment, offset_ptr<void>* p_referrer );
+
+	/**
+	 * @brief deallocate all memory blocks that are tagged with owner_id
+	 *
+	 * the memory blocks are found by walking all blocks of this arena under the mutex.
+	 *
+	 * @return the number of the deallocated memory blocks
+	 */
+	size_t reclaim_owner( unsigned int owner_id );
+
+	/**
+	 * @brief clear the owner id of all allocated memory blocks of this arena
+	 *
+	 * @return the number of the memory blocks whose owner id is cleared
+	 */
+	size_t disown_all( void );
+
+	/**
+	 * @brief change the owner id of the allocated memory block of p. 0 means no owner
+	 */
+	void set_owner_id_of_allocated( void* p, unsigned int owner_id );
+
+	/**
+	 * @brief get the owner id of the allocated memory block of p. if it has no owner, return 0.
+	 */
+	unsigned int get_owner_id_of_allocated( void* p ) const noexcept;
+
+	/**
+	 * @brief get the number of bytes that is available from p in the memory block of p
+	 */
+	size_t get_usable_size( void* p ) const noexcept;
+
+	/**
+	 * @brief get the size class of the request
+	 *
+	 * @return index of the size class. if the request does not belong to any size class, return num_of_size_classes.
+	 */
+	static size_t get_size_class_of_request( size_t req_bytes, size_t alignment ) noexcept;
+
+	/**
+	 * @brief get the size class of the memory block that is allocated by this allocator
+	 *
+	 * @return index of the size class. if the memory block does not belong to any size class or this allocator, return num_of_size_classes.
+	 */
+	size_t get_size_class_of_allocated( void* p ) const noexcept;
+
+	/**
+	 * @brief check whether the size that was passed to allocate() matches the block header of p
+	 *
+	 * @return true: the requested size fits to the memory block of p, and the memory block is not larger than the request.
+	 */
+	bool is_valid_size_of_allocated( void* p, size_t req_bytes, size_t alignment ) const noexcept;
+
 	int get_bind_count( void ) const;
 
+	/**
+	 * @brief get the statistics of this arena as a snapshot under the mutex
+	 *
+	 * the sizes and the numbers of blocks are read from the counters. the largest free block is found by the size ordered index in kBestFit policy,
+	 * and by walking the free list in kFirstFit policy.
+	 */
+	offset_malloc_stats get_stats( void ) const;
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+	/**
+	 * @brief add the counters per size class of this arena to histogram
+	 *
+	 * the counters are read by relaxed atomic load without the mutex. if the heap is too small to reserve the counters, only the block sizes are set.
+	 */
+	void add_size_class_histogram( offset_malloc_size_class_histogram& histogram ) const noexcept;
+#endif
+
+	/**
+	 * @brief check whether p_mem is in the memory area of this arena
+	 */
 	bool is_belong_to( void* p_mem ) const noexcept;
 
+	size_t get_num_of_arenas( void ) const noexcept
+	{
+		return num_of_arenas_;
+	}
+
+	/**
+	 * @brief get the idx-th arena. this should be called for the 1st arena that is returned by placement_new()
+	 */
+	offset_malloc_impl* get_arena( size_t idx ) noexcept;
+
+	/**
+	 * @brief find the arena that p_mem belongs to. this should be called for the 1st arena that is returned by placement_new()
+	 *
+	 * @return pointer to the arena. if p_mem does not belong to any arena, return nullptr.
+	 */
+	offset_malloc_impl* find_arena( void* p_mem ) noexcept;
+
 	inline static constexpr size_t test_block_header_size( void )
 	{
 		return sizeof( block::block_header );
 	}
 
+	/**
+	 * @brief set the hook that is called after each undo entry is recorded. nullptr clears the hook
+	 *
+	 * this is only for the test of the recovery. the hook is able to interrupt the update of the free lists by throwing an exception or by exiting the process.
+	 * the hook is process local.
+	 */
+	static void test_set_undo_hook( void ( *p_hook )( size_t num_of_entries ) ) noexcept;
+
 protected:
 private:
-	offset_malloc_impl( void* end_pointer );
+	static constexpr size_t min_bin_units                  = 2;                         //!< block size in units(including block header) of the smallest size class
+	static constexpr size_t num_of_bins                    = num_of_size_classes;       //!< number of size class bins
+	static constexpr size_t min_size_index_units           = 3;                         //!< block size in units(including block header) that is able to hold the link of the size ordered index
+	static constexpr size_t quick_list_scan_limit          = 8;                         //!< number of blocks in the quick list that are checked by one allocation
+	static constexpr size_t num_of_size_class_counters     = num_of_size_classes + 1;   //!< number of counters per size class. the last one is the counter of the larger blocks
+	static constexpr size_t size_class_counters_heap_ratio = 16;                        //!< the counters per size class are reserved only if the heap is this times bigger than the counters
+
+	offset_malloc_impl( void* end_pointer, offset_malloc_policy policy, size_t num_of_arenas, size_t arena_stride_bytes );
 	~offset_malloc_impl() = default;
 
 	int bind( void );
@@ -67,6 +278,18 @@ private:
 			block_header( block* p_next_arg, std::size_t this_block_size );
 		};
 
+		/**
+		 * @brief link information of the index(treap) of K&R free list
+		 *
+		 * this is placed in the body of a free block that is linked to K&R free list.
+		 * the 1st unit of the body is used for the address ordered index. therefore the block that is linked to K&R free list needs min_bin_units at least.
+		 * the 2nd unit of the body is used for the size ordered index. therefore the block that is linked to the size ordered index needs min_size_index_units at least.
+		 */
+		struct tree_link {
+			offset_ptr<block> op_left_;    // インデックスの左の子へのオフセットポインタ
+			offset_ptr<block> op_right_;   // インデックスの右の子へのオフセットポインタ
+		};
+
 		block( block* p_next_arg, std::size_t this_block_size );
 
 		block* get_next_ptr( void )
@@ -126,15 +349,81 @@ private:
 			return ans;
 		}
 
+		/**
+		 * @brief owner id that is placed in op_next_block_ of the allocated block
+		 *
+		 * the owner id is stored as an odd raw value. the link of the free block is the offset b/w the aligned blocks, and it is always even.
+		 * therefore the tagged block is distinguished from the free block.
+		 */
+		unsigned int get_owner_id( void )
+		{
+			std::uintptr_t raw_value;
+			std::memcpy( &raw_value, static_cast<const void*>( &( active_header_.op_next_block_ ) ), sizeof( raw_value ) );
+			return ( ( raw_value & 1U ) == 0 ) ? 0 : static_cast<unsigned int>( raw_value >> 1 );
+		}
+		void set_owner_id( unsigned int owner_id )
+		{
+			std::uintptr_t raw_value = ( owner_id == 0 ) ? 0 : ( ( static_cast<std::uintptr_t>( owner_id ) << 1 ) | 1U );   // 0はnullptrと同じ値となる。
+			std::memcpy( static_cast<void*>( &( active_header_.op_next_block_ ) ), &raw_value, sizeof( raw_value ) );
+		}
+
+		/**
+		 * @brief check whether this block is linked to one of the free lists
+		 *
+		 * the last block of each free list links to base_blk_ instead of nullptr, so the link of the free block is always even and not zero.
+		 * the allocated block has zero or the odd owner id in op_next_block_.
+		 */
+		bool is_linked_as_free( void )
+		{
+			std::uintptr_t raw_value;
+			std::memcpy( &raw_value, static_cast<const void*>( &( active_header_.op_next_block_ ) ), sizeof( raw_value ) );
+			return ( raw_value != 0 ) && ( ( raw_value & 1U ) == 0 );
+		}
+
 		block* get_end_ptr( void )
 		{
 			return reinterpret_cast<block*>( &( block_body_[get_blk_size() - 1] ) );
 		}
 
+		tree_link& get_addr_link( void )
+		{
+			return *reinterpret_cast<tree_link*>( reinterpret_cast<uintptr_t>( this ) + sizeof( block_header ) );
+		}
+
+		tree_link& get_size_link( void )
+		{
+			return *reinterpret_cast<tree_link*>( reinterpret_cast<uintptr_t>( this ) + sizeof( block_header ) * 2 );
+		}
+
 		block_header active_header_;   // ブロックヘッダ
 		block_header block_body_[0];   // ブロック本体。ブロックをブロックヘッダー単位で分割管理するので、block_header型の配列としてアクセスできるように定義
 	};
 
+	/**
+	 * @brief intent record of the update of the free lists
+	 *
+	 * the old value of each field is recorded as an undo entry before the field is changed. the indexes(treap) and the counters are not recorded,
+	 * because they are rebuilt from the free lists by the recovery.
+	 */
+	struct intent_record {
+		enum class state : int {
+			kIdle,         // 更新中ではない
+			kInProgress,   // 更新中。回復時は、取り消しエントリで更新前に戻す。
+			kCommitted,    // 更新を完了した。回復時は、取り消しエントリを破棄して更新後の状態を採用する。
+		};
+		struct undo_entry {
+			std::size_t   offset_;      // このクラス構造の先頭から変更したフィールドまでのオフセット
+			std::uint64_t old_value_;   // 変更前の値
+		};
+
+		state       state_;                              // 更新の状態
+		std::size_t depth_;                              // 入れ子になった更新の深さ。最も外側の更新の完了で、更新全体を完了する。
+		std::size_t num_of_entries_;                     // 記録済みの取り消しエントリの数
+		undo_entry  entries_[max_num_of_undo_entries];   // 取り消しエントリ
+	};
+
+	class recovering_lock_guard;
+
 	offset_malloc_impl( const offset_malloc_impl& )            = delete;
 	offset_malloc_impl( offset_malloc_impl&& )                 = delete;
 	offset_malloc_impl& operator=( const offset_malloc_impl& ) = delete;
@@ -142,15 +431,115 @@ private:
 
 	static constexpr size_t size_of_block_header( void );
 	static constexpr size_t bytes2blocksize( size_t bytes );
-
-	const offset_ptr<unsigned char> op_end_;     //!< メモリ領域の終端を指すオフセットポインタ。メモリ領域の先頭は、このクラス構造が配置されている位置になる。
-	mutable ipsm_mutex              mtx_;        //!< 以下に宣言されているメンバ変数のアクセスを保護するためのミューテックス
-	int                             bind_cnt_;   //!< このインスタンスが、現在のメモリ領域に対して何個バインドされているかを表す。主にテストでの検査用に使用する。
-	offset_ptr<block>               op_freep_;   //!< 空きブロックリストの先頭を指すオフセットポインタ。
-	block                           base_blk_;   //!< bigger address of this member variable is allocation memory area
+	static constexpr size_t size_class_counters_units( void );
+	static constexpr bool   is_bin_size( size_t num_of_units );
+
+	struct addr_index_traits;
+	struct size_index_traits;
+
+	static constexpr size_t calc_req_num_of_blocks_w_header( size_t req_bytes, size_t alignment );
+	static size_t           get_page_bytes( void ) noexcept;
+	static bool             adjust_large_request( size_t& req_bytes, size_t& alignment ) noexcept;
+	static bool             is_large_block( block* p_blk ) noexcept;
+
+	void*  allocate_nolock( size_t req_num_of_blocks_w_header, size_t real_alignment );
+	block* get_top_block( void ) noexcept;
+	block* get_block_to_deallocate( void* p );
+	block* get_allocated_block( void* p ) const noexcept;
+	block* deallocate_nolock( block* p_target_blk, block* p_hint_blk = nullptr );
+	void*  allocate_from_free_list( size_t req_num_of_blocks_w_header, size_t real_alignment );
+	void*  carve_from_free_block( block* p_pre_blk, block* p_cur_blk, size_t req_num_of_blocks_w_header, size_t real_alignment );
+	block* insert_to_free_list( block* p_target_blk, block* p_hint_blk = nullptr );   // return the free block that includes p_target_blk. it is available as the hint of the next call with higher address
+	block* get_free_list_next( block* p_blk ) noexcept;
+	block* get_bin_list_next( block* p_blk ) const noexcept;   // return nullptr at the end of the size class bin or the quick list
+	block* to_bin_list_link( block* p_nxt ) noexcept;          // return base_blk_ instead of nullptr to terminate the size class bin or the quick list
+	size_t calc_priority( block* p_blk ) const noexcept;
+	block* addr_index_find_prev( block* p_target_blk ) const noexcept;
+	void   addr_index_insert( block* p_target_blk );
+	void   addr_index_erase( block* p_target_blk );
+	block* size_index_find_fit( size_t req_num_of_blocks_w_header ) const noexcept;
+	bool   is_size_indexed( block* p_blk ) const noexcept;
+	void   size_index_insert( block* p_target_blk );
+	void   size_index_erase( block* p_target_blk );
+
+	template <typename Traits>
+	void index_insert( offset_ptr<block>& op_root, block* p_target_blk );
+	template <typename Traits>
+	void index_erase( offset_ptr<block>& op_root, block* p_target_blk );
+	template <typename Traits>
+	void index_split( block* p_root, block* p_key, offset_ptr<block>& op_left, offset_ptr<block>& op_right );
+	template <typename Traits>
+	block* index_merge( block* p_left, block* p_right );
+
+	void   push_to_bin( block* p_target_blk );
+	block* pop_from_bin( size_t num_of_units );
+	void   push_to_quick_list( block* p_target_blk );
+	block* pop_from_quick_list( size_t req_num_of_blocks_w_header );
+	void   consolidate_bins( void );
+	bool   consolidate_bins_if_exceeded( void );   // return true if the bins are consolidated. the hint of the free list becomes invalid
+	void   drain_deferred_nolock( void );
+	void   drain_detached_nolock( void );
+	void   release_pages_of_free_block( block* p_free_blk, block* p_released_blk, size_t released_units ) noexcept;
+	size_t find_largest_free_units( void ) const noexcept;
+
+	void journal_begin( void ) noexcept;
+	void journal_commit( void ) noexcept;
+	template <typename T>
+	void journal_record( T& field );
+	void set_next_ptr_w_undo( block* p_blk, block* p_nxt );
+	void set_blk_size_w_undo( block* p_blk, size_t ns );
+	void recover_nolock( void );
+	void rollback_nolock( void ) noexcept;
+	void rebuild_nolock( void );
+
+	static size_t get_size_class_of_units( size_t num_of_units ) noexcept;
+	void          count_allocation( size_t num_of_units ) noexcept;
+	void          count_deallocation( size_t num_of_units ) noexcept;
+	void          count_failed_allocation( size_t req_num_of_blocks_w_header ) noexcept;
+
+	/**
+	 * @brief counters of one size class
+	 *
+	 * these are updated under the mutex, but they are atomic to be read by the monitoring process without the mutex.
+	 * the array of the counters is placed at the top of the heap area, not in this class structure.
+	 * therefore the layout of this class structure is same regardless of ENABLE_SIZE_CLASS_STATISTICS.
+	 */
+	struct size_class_counter {
+		std::atomic<size_t> num_of_allocations_;          // 割り当てに成功した回数
+		std::atomic<size_t> num_of_deallocations_;        // 解放した回数
+		std::atomic<size_t> live_units_;                  // 割り当て中のブロック数の合計。ヘッダを含む。
+		std::atomic<size_t> num_of_failed_allocations_;   // 割り当てに失敗した回数
+	};
+	static_assert( offset_malloc_size_class_histogram::num_of_classes == num_of_size_class_counters, "number of size classes should be matched with offset_malloc_size_class_histogram" );
+
+	const offset_ptr<unsigned char> op_end_;                      //!< メモリ領域の終端を指すオフセットポインタ。メモリ領域の先頭は、このクラス構造が配置されている位置になる。
+	const offset_malloc_policy      policy_;                      //!< 割り当てポリシー。placement_new()で指定され、以降は変更されない。
+	const size_t                    num_of_arenas_;               //!< アリーナの数。先頭のアリーナ以外は1となる。
+	const size_t                    arena_stride_bytes_;          //!< アリーナの配置間隔。i番目のアリーナは、先頭のアリーナからi * arena_stride_bytes_の位置に配置される。
+	atomic_offset_ptr<block>        op_deferred_top_;             //!< mtx_を取得せずに解放されたブロックのスタック(MPSC)の先頭。リンクは、ブロックヘッダのop_next_block_を使用する。
+	std::atomic<size_t>             num_of_deferred_;             //!< op_deferred_top_のスタックにあるブロック数の目安。回収の契機の判定にのみ使用する。
+	mutable ipsm_mutex              mtx_;                         //!< 以下に宣言されているメンバ変数のアクセスを保護するためのミューテックス
+	intent_record                   intent_;                      //!< 空きブロックリストの更新の取り消しエントリ。mtx_の所有者が更新中に終了した場合、次の所有者が回復に使用する。
+	offset_ptr<block>               op_detached_top_;             //!< op_deferred_top_から取り出し、まだ解放していないブロックのリストの先頭。回復時は、残りのブロックの解放を継続する。
+	int                             bind_cnt_;                    //!< このインスタンスが、現在のメモリ領域に対して何個バインドされているかを表す。主にテストでの検査用に使用する。
+	bool                            deferred_coalescing_;         //!< trueの場合、サイズクラスより大きなブロックも解放時に結合せず、クイックリストにつなぐ。
+	size_t                          page_bytes_;                  //!< OSへページを返却する単位。hugetlbfs上に構築した場合は、huge pageの大きさとなる。
+	size_t                          total_units_;                 //!< 割り当て可能な領域のブロック数。ヘッダを含む。
+	size_t                          allocated_units_;             //!< 割り当て済みのブロック数の合計。ヘッダを含む。
+	size_t                          num_of_allocated_blocks_;     //!< 割り当て済みのメモリブロックの数
+	size_t                          num_of_free_blocks_;          //!< K&Rの空きブロックリストとサイズクラスのリスト、クイックリストにある空きブロックの数
+	size_t                          num_of_uncoalesced_blocks_;   //!< サイズクラスのリストとクイックリストにある、結合されていない空きブロックの数
+	offset_ptr<block>               op_freep_;                    //!< 空きブロックリストの先頭を指すオフセットポインタ。
+	offset_ptr<block>               op_addr_index_root_;          //!< 空きブロックリストのアドレス順インデックス(treap)の根を指すオフセットポインタ。base_blk_はインデックスに含まない。
+	offset_ptr<block>               op_size_index_root_;          //!< 空きブロックリストのサイズ順インデックス(treap)の根を指すオフセットポインタ。kBestFitの場合のみ使用する。
+	offset_ptr<block>               op_bins_[num_of_bins];        //!< サイズクラスごとの空きブロックリストの先頭を指すオフセットポインタ。index 0 is min_bin_units size class
+	offset_ptr<block>               op_quick_list_;               //!< 結合を遅延した、サイズクラスより大きな空きブロックのリストの先頭を指すオフセットポインタ。
+	offset_ptr<size_class_counter>  op_size_class_counters_;      //!< サイズクラスごとの統計カウンタの配列。ヒープ領域の先頭に配置する。統計を有効にしてビルドしていない場合と、ヒープが小さい場合はnullptr
+	block                           base_blk_;                    //!< bigger address of this member variable is allocation memory area
 };
 
 static_assert( std::is_standard_layout<offset_malloc::offset_malloc_impl>::value, "offset_malloc_impl should be standard layout" );
+static_assert( sizeof( offset_ptr<void> ) == sizeof( std::uintptr_t ), "owner id is placed in the link field of the block header" );
 
 }   // namespace ipsm
 
@@ -0,0 +1,99 @@
+/**
+ * @file offset_malloc_growth.cpp
+ * @author PFA03027@nifty.com
+ * @brief process local extension point to add heaps to offset_malloc when it is exhausted
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "offset_malloc_growth.hpp"
+
+namespace ipsm {
+
+namespace {
+
+class growth_handler_registry {
+public:
+	static growth_handler_registry& get_instance( void )
+	{
+		// 静的オブジェクトの破棄後に、offset_mallocのデストラクタから参照される可能性があるため、意図的に破棄しない。
+		static growth_handler_registry* p_singleton = new growth_handler_registry;
+		return *p_singleton;
+	}
+
+	void regist( offset_malloc::offset_malloc_impl* p_impl, offset_malloc_growth_handler* p_handler )
+	{
+		std::lock_guard<std::mutex> lk( mtx_ );
+		auto                        it = find_nolock( p_impl );
+		if ( it != handlers_.end() ) {
+			it->second = p_handler;
+			return;
+		}
+		handlers_.emplace_back( p_impl, p_handler );
+		num_of_handlers_.store( handlers_.size(), std::memory_order_release );
+	}
+
+	void unregist( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+	{
+		std::lock_guard<std::mutex> lk( mtx_ );
+		auto                        it = find_nolock( p_impl );
+		if ( it != handlers_.end() ) {
+			handlers_.erase( it );
+		}
+		num_of_handlers_.store( handlers_.size(), std::memory_order_release );
+	}
+
+	offset_malloc_growth_handler* find( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+	{
+		// 登録がない場合は、ロックせずに終了する。多くのoffset_mallocは、拡張されないため。
+		if ( num_of_handlers_.load( std::memory_order_acquire ) == 0 ) {
+			return nullptr;
+		}
+		std::lock_guard<std::mutex> lk( mtx_ );
+		auto                        it = find_nolock( p_impl );
+		if ( it == handlers_.end() ) {
+			return nullptr;
+		}
+		return it->second;
+	}
+
+private:
+	using element_type = std::pair<offset_malloc::offset_malloc_impl*, offset_malloc_growth_handler*>;
+
+	std::vector<element_type>::iterator find_nolock( offset_malloc::offset_malloc_impl* p_impl )
+	{
+		return std::find_if( handlers_.begin(), handlers_.end(), [p_impl]( const element_type& e ) { return e.first == p_impl; } );
+	}
+
+	std::mutex                mtx_;
+	std::atomic<size_t>       num_of_handlers_ { 0 };
+	std::vector<element_type> handlers_;
+};
+
+}   // namespace
+
+void offset_malloc_growth::regist( offset_malloc::offset_malloc_impl* p_impl, offset_malloc_growth_handler* p_handler )
+{
+	growth_handler_registry::get_instance().regist( p_impl, p_handler );
+}
+
+void offset_malloc_growth::unregist( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+{
+	growth_handler_registry::get_instance().unregist( p_impl );
+}
+
+offset_malloc_growth_handler* offset_malloc_growth::find_handler( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+{
+	return growth_handler_registry::get_instance().find( p_impl );
+}
+
+}   // namespace ipsm
@@ -0,0 +1,69 @@
+/**
+ * @file offset_malloc_growth.hpp
+ * @author PFA03027@nifty.com
+ * @brief process local extension point to add heaps to offset_malloc when it is exhausted
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef OFFSET_MALLOC_GROWTH_HPP_
+#define OFFSET_MALLOC_GROWTH_HPP_
+
+#include <cstddef>
+
+#include "offset_mallloc_impl.hpp"
+#include "offset_malloc.hpp"
+
+namespace ipsm {
+
+/**
+ * @brief interface of the provider of additional heaps of offset_malloc
+ *
+ * the additional heaps are placed in the memory area that is mapped at the same offset from the 1st arena in all processes.
+ * therefore offset_ptr is available between the 1st arena and the additional heaps.
+ *
+ * このクラスのインスタンスは、プロセスローカルなメモリ上に配置される。共有メモリ上には配置されない。
+ */
+class offset_malloc_growth_handler {
+public:
+	virtual ~offset_malloc_growth_handler() = default;
+
+	/**
+	 * @brief get the idx-th additional heap
+	 *
+	 * if the heap is added by the other process and it is not attached in this process yet, it is attached in this call.
+	 *
+	 * @return pointer to the additional heap. if idx-th heap does not exist, return nullptr.
+	 */
+	virtual offset_malloc::offset_malloc_impl* get_heap( size_t idx ) = 0;
+
+	/**
+	 * @brief add a new heap that is able to allocate req_bytes with alignment
+	 *
+	 * @return true: a new heap is added or attached. false: no heap can be added.
+	 */
+	virtual bool grow( size_t req_bytes, size_t alignment ) = 0;
+};
+
+/**
+ * @brief process local registry of offset_malloc_growth_handler per 1st arena of offset_malloc
+ *
+ * offset_malloc refers this registry only when the arenas of offset_malloc_impl could not allocate or could not find the memory block.
+ */
+class offset_malloc_growth {
+public:
+	static void regist( offset_malloc::offset_malloc_impl* p_impl, offset_malloc_growth_handler* p_handler );
+	static void unregist( offset_malloc::offset_malloc_impl* p_impl ) noexcept;
+
+	/**
+	 * @return pointer to the handler that is registered for p_impl. if no handler is registered, return nullptr.
+	 */
+	static offset_malloc_growth_handler* find_handler( offset_malloc::offset_malloc_impl* p_impl ) noexcept;
+};
+
+}   // namespace ipsm
+
+#endif   // OFFSET_MALLOC_GROWTH_HPP_
@@ -0,0 +1,310 @@
+/**
+ * @file offset_malloc_thread_cache.cpp
+ * @author PFA03027@nifty.com
+ * @brief process local per-thread cache of small memory blocks in front of offset_malloc
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <pthread.h>
+
+#include "ipsm_logger_internal.hpp"
+#include "offset_malloc_thread_cache.hpp"
+#include "offset_mallloc_impl.hpp"
+
+namespace ipsm {
+
+namespace {
+
+constexpr size_t max_num_of_heaps_per_thread = 4;                        // 1スレッドがキャッシュを保持できるoffset_malloc_implの数
+constexpr size_t magazine_capacity           = 32;                       // サイズクラスごとにキャッシュできるメモリブロックの数
+constexpr size_t batch_size                  = magazine_capacity / 2;   // 補充、返却を一括で行うメモリブロックの数
+
+// fork()の子プロセスで更新される世代番号。値が異なるthread_cacheは、親プロセスから引き継いだものであることを示す。
+std::atomic<unsigned int> fork_generation( 0 );
+
+struct magazine {
+	size_t count_;                      // キャッシュしているメモリブロックの数
+	void*  slots_[magazine_capacity];   // キャッシュしているメモリブロック
+};
+
+struct heap_cache {
+	offset_malloc::offset_malloc_impl* p_impl_;                                                        // キャッシュ対象のoffset_malloc_impl。nullptrの場合は未使用
+	magazine                           mags_[offset_malloc::offset_malloc_impl::num_of_size_classes];   // サイズクラスごとのキャッシュ
+
+	void flush( void ) noexcept
+	{
+		for ( auto& mag : mags_ ) {
+			if ( mag.count_ == 0 ) {
+				continue;
+			}
+			try {
+				std::sort( &( mag.slots_[0] ), &( mag.slots_[mag.count_] ) );
+				p_impl_->deallocate_bulk( mag.slots_, mag.count_ );
+			} catch ( std::exception& e ) {
+				psm_logoutput( psm_log_lv::kErr, "Error: fail to return the cached memory blocks to offset_malloc_impl(%p): %s", p_impl_, e.what() );
+			}
+			mag.count_ = 0;
+		}
+	}
+
+	void discard( void ) noexcept
+	{
+		for ( auto& mag : mags_ ) {
+			mag.count_ = 0;
+		}
+		p_impl_ = nullptr;
+	}
+};
+
+class thread_cache {
+public:
+	thread_cache( void );
+	~thread_cache();
+
+	heap_cache* find_or_assign( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+	{
+		heap_cache* p_empty = nullptr;
+		for ( auto& hc : heaps_ ) {
+			if ( hc.p_impl_ == p_impl ) {
+				return &hc;
+			}
+			if ( ( p_empty == nullptr ) && ( hc.p_impl_ == nullptr ) ) {
+				p_empty = &hc;
+			}
+		}
+		if ( p_empty != nullptr ) {
+			p_empty->p_impl_ = p_impl;
+		}
+		return p_empty;
+	}
+
+	void drain( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+	{
+		for ( auto& hc : heaps_ ) {
+			if ( hc.p_impl_ == p_impl ) {
+				hc.flush();
+				hc.p_impl_ = nullptr;
+			}
+		}
+	}
+
+	void discard_if_forked( void );
+
+	bool is_inherited_by_fork( void ) const noexcept
+	{
+		return generation_ != fork_generation.load( std::memory_order_acquire );
+	}
+
+	std::mutex mtx_;   // 他のスレッドからのdrain_all_threads()と排他するためのミューテックス。通常は競合しない。
+
+private:
+	unsigned int generation_;   // このインスタンスが、キャッシュを保持し始めた時点のfork_generation
+	heap_cache   heaps_[max_num_of_heaps_per_thread];
+};
+
+/**
+ * @brief registry of thread_cache in this process to drain the cache of the other threads
+ */
+class thread_cache_registry {
+public:
+	static thread_cache_registry& get_instance( void )
+	{
+		// thread_localなthread_cacheのデストラクタは、静的オブジェクトの破棄後に実行される可能性があるため、意図的に破棄しない。
+		static thread_cache_registry* p_singleton = new thread_cache_registry;
+		return *p_singleton;
+	}
+
+	void regist( thread_cache* p_tc )
+	{
+		std::lock_guard<std::mutex> lk( mtx_ );
+		caches_.push_back( p_tc );
+	}
+
+	void unregist( thread_cache* p_tc ) noexcept
+	{
+		std::lock_guard<std::mutex> lk( mtx_ );
+		auto                        it = std::find( caches_.begin(), caches_.end(), p_tc );
+		if ( it != caches_.end() ) {
+			caches_.erase( it );
+		}
+	}
+
+	void drain_all( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+	{
+		std::lock_guard<std::mutex> lk( mtx_ );
+		for ( auto p_tc : caches_ ) {
+			std::lock_guard<std::mutex> lk_tc( p_tc->mtx_ );
+			p_tc->drain( p_impl );
+		}
+	}
+
+private:
+	thread_cache_registry( void )
+	  : mtx_()
+	  , caches_()
+	{
+		int ret = pthread_atfork( prepare_fork, parent_after_fork, child_after_fork );
+		if ( ret != 0 ) {
+			psm_logoutput( psm_log_lv::kErr, "Error: fail to register fork handlers of thread cache, ret=%d", ret );
+		}
+	}
+
+	// fork()の時点で他のスレッドがmtx_を保持していると、子プロセスではmtx_を解放するスレッドが存在しないため、fork()の間はmtx_を確保しておく。
+	static void prepare_fork( void )
+	{
+		get_instance().mtx_.lock();
+	}
+
+	static void parent_after_fork( void )
+	{
+		get_instance().mtx_.unlock();
+	}
+
+	// 子プロセスのthread_cacheは、親プロセスがキャッシュしているメモリブロックと同じものを保持している。
+	// 返却すると、親プロセスが使用中のメモリブロックを解放することになるため、返却せずに破棄させる。
+	// fork()を呼び出したスレッド以外のスレッドは子プロセスに存在しないため、それらのthread_cacheは登録から外す。
+	static void child_after_fork( void )
+	{
+		thread_cache_registry& reg = get_instance();
+		reg.caches_.clear();
+		fork_generation.fetch_add( 1, std::memory_order_acq_rel );
+		reg.mtx_.unlock();
+	}
+
+	std::mutex                 mtx_;
+	std::vector<thread_cache*> caches_;
+};
+
+thread_cache::thread_cache( void )
+  : mtx_()
+  , generation_( fork_generation.load( std::memory_order_acquire ) )
+  , heaps_ {}
+{
+	thread_cache_registry::get_instance().regist( this );
+}
+
+thread_cache::~thread_cache()
+{
+	// 先に登録を解除することで、drain_all_threads()からこのインスタンスが参照されないようにする。
+	thread_cache_registry::get_instance().unregist( this );
+
+	std::lock_guard<std::mutex> lk( mtx_ );
+	if ( is_inherited_by_fork() ) {
+		// 親プロセスから引き継いだキャッシュは、返却しない。
+		return;
+	}
+	for ( auto& hc : heaps_ ) {
+		if ( hc.p_impl_ != nullptr ) {
+			hc.flush();
+			hc.p_impl_ = nullptr;
+		}
+	}
+}
+
+void thread_cache::discard_if_forked( void )
+{
+	if ( !is_inherited_by_fork() ) {
+		return;
+	}
+
+	// 子プロセスでは、このスレッドのみがこのインスタンスを参照するため、mtx_を確保せずに破棄する。
+	for ( auto& hc : heaps_ ) {
+		hc.discard();
+	}
+	generation_ = fork_generation.load( std::memory_order_acquire );
+	thread_cache_registry::get_instance().regist( this );
+}
+
+thread_cache& get_thread_cache( void )
+{
+	thread_local thread_cache tc;
+	tc.discard_if_forked();
+	return tc;
+}
+
+}   // namespace
+
+void* offset_malloc_thread_cache::allocate( offset_malloc::offset_malloc_impl* p_impl, size_t req_bytes, size_t alignment )
+{
+	size_t size_class = offset_malloc::offset_malloc_impl::get_size_class_of_request( req_bytes, alignment );
+	if ( size_class >= offset_malloc::offset_malloc_impl::num_of_size_classes ) {
+		return p_impl->allocate( req_bytes, alignment );
+	}
+
+	thread_cache&               tc = get_thread_cache();
+	std::lock_guard<std::mutex> lk( tc.mtx_ );
+	heap_cache*                 p_hc = tc.find_or_assign( p_impl );
+	if ( p_hc == nullptr ) {
+		// キャッシュできるoffset_malloc_implの数を超えたため、キャッシュを使わない。
+		return p_impl->allocate( req_bytes, alignment );
+	}
+
+	magazine& mag = p_hc->mags_[size_class];
+	if ( mag.count_ == 0 ) {
+		mag.count_ = p_impl->allocate_bulk( req_bytes, alignment, batch_size, mag.slots_ );
+		if ( mag.count_ == 0 ) {
+			// 他のサイズクラスにキャッシュしているメモリブロックを返却して結合できるようにしてから、再度確保を試みる。
+			p_hc->flush();
+			return p_impl->allocate( req_bytes, alignment );
+		}
+	}
+
+	mag.count_--;
+	return mag.slots_[mag.count_];
+}
+
+void offset_malloc_thread_cache::deallocate( offset_malloc::offset_malloc_impl* p_impl, void* p, size_t alignment )
+{
+	deallocate_in_size_class( p_impl, p, p_impl->get_size_class_of_allocated( p ), alignment );
+}
+
+void offset_malloc_thread_cache::deallocate_in_size_class( offset_malloc::offset_malloc_impl* p_impl, void* p, size_t size_class, size_t alignment )
+{
+	if ( size_class >= offset_malloc::offset_malloc_impl::num_of_size_classes ) {
+		p_impl->deallocate( p, alignment );
+		return;
+	}
+
+	thread_cache&               tc = get_thread_cache();
+	std::lock_guard<std::mutex> lk( tc.mtx_ );
+	heap_cache*                 p_hc = tc.find_or_assign( p_impl );
+	if ( p_hc == nullptr ) {
+		// キャッシュできるoffset_malloc_implの数を超えたため、キャッシュを使わない。
+		p_impl->deallocate( p, alignment );
+		return;
+	}
+
+	magazine& mag = p_hc->mags_[size_class];
+	if ( mag.count_ >= magazine_capacity ) {
+		// 古い方から一括で返却する。アドレス順に並べることで、空きブロックリストを1回の走査で結合できる。
+		std::sort( &( mag.slots_[0] ), &( mag.slots_[batch_size] ) );
+		p_impl->deallocate_bulk( mag.slots_, batch_size, alignment );
+		std::copy( &( mag.slots_[batch_size] ), &( mag.slots_[mag.count_] ), &( mag.slots_[0] ) );
+		mag.count_ -= batch_size;
+	}
+
+	mag.slots_[mag.count_] = p;
+	mag.count_++;
+}
+
+void offset_malloc_thread_cache::drain_all_threads( offset_malloc::offset_malloc_impl* p_impl ) noexcept
+{
+	if ( p_impl == nullptr ) {
+		return;
+	}
+	for ( size_t i = 0; i < p_impl->get_num_of_arenas(); i++ ) {
+		thread_cache_registry::get_instance().drain_all( p_impl->get_arena( i ) );
+	}
+}
+
+}   // namespace ipsm
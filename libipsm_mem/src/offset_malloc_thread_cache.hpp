@@ -0,0 +1,62 @@
+/**
+ * @file offset_malloc_thread_cache.hpp
+ * @author PFA03027@nifty.com
+ * @brief process local per-thread cache of small memory blocks in front of offset_malloc
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#ifndef OFFSET_MALLOC_THREAD_CACHE_HPP_
+#define OFFSET_MALLOC_THREAD_CACHE_HPP_
+
+#include <cstddef>
+
+#include "offset_mallloc_impl.hpp"
+#include "offset_malloc.hpp"
+
+namespace ipsm {
+
+/**
+ * @brief process local per-thread cache of small memory blocks
+ *
+ * each thread has a magazine of memory blocks per size class and per offset_malloc_impl.
+ * the magazine is refilled and flushed by batch via allocate_bulk()/deallocate_bulk() of offset_malloc_impl.
+ * therefore the mutex of offset_malloc_impl that is shared by all processes is locked once per batch.
+ *
+ * the cached memory blocks are returned to offset_malloc_impl when the thread exits or drain_all_threads() is called.
+ *
+ * このクラスの情報は、プロセスローカルなメモリ上に配置される。共有メモリ上には配置されない。
+ */
+class offset_malloc_thread_cache {
+public:
+#if __has_cpp_attribute( nodiscard )
+	[[nodiscard]]
+#endif
+	static void* allocate( offset_malloc::offset_malloc_impl* p_impl, size_t req_bytes, size_t alignment );
+	static void  deallocate( offset_malloc::offset_malloc_impl* p_impl, void* p, size_t alignment );
+
+	/**
+	 * @brief deallocate the memory block to the magazine of size_class without reading the size class from the block header
+	 *
+	 * size_class should be the one that is derived from the request by offset_malloc_impl::get_size_class_of_request().
+	 * the block may be one unit bigger than size_class, but it is still usable for the request of size_class.
+	 */
+	static void deallocate_in_size_class( offset_malloc::offset_malloc_impl* p_impl, void* p, size_t size_class, size_t alignment );
+
+	/**
+	 * @brief return all cached memory blocks of all threads in this process to p_impl
+	 *
+	 * p_impl should be the 1st arena. the cached memory blocks of all arenas of p_impl are returned.
+	 *
+	 * @note
+	 * after this call, the cache of p_impl is rebuilt when allocate()/deallocate() is called with p_impl again.
+	 */
+	static void drain_all_threads( offset_malloc::offset_malloc_impl* p_impl ) noexcept;
+};
+
+}   // namespace ipsm
+
+#endif   // OFFSET_MALLOC_THREAD_CACHE_HPP_
@@ -0,0 +1,136 @@
+/**
+ * @file offset_pool.cpp
+ * @author PFA03027@nifty.com
+ * @brief lock-free fixed size memory pool that is shareable b/w processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+
+#include "ipsm_logger_internal.hpp"
+#include "offset_pool.hpp"
+
+namespace ipsm {
+
+offset_pool_base::offset_pool_base( const offset_malloc& src, size_t slot_bytes, size_t slot_alignment, size_t num_of_slots )
+  : allocator_( src )
+  , op_chunk_( nullptr )
+  , slot_bytes_( 0 )
+  , slot_alignment_( 0 )
+  , num_of_slots_( num_of_slots )
+  , head_( 0 )
+{
+	if ( ( num_of_slots == 0 ) || ( num_of_slots >= slot_index_mask ) ) {
+		// スロット番号+1を下位32bitに格納するため、表現できないスロット数は受け付けない。
+		throw std::length_error( "Error: number of slots of offset_pool is out of range" );
+	}
+	if ( ( slot_alignment == 0 ) || ( ( slot_alignment & ( slot_alignment - 1 ) ) != 0 ) ) {
+		throw std::logic_error( "Error: alignment of slot of offset_pool should be power of 2" );
+	}
+
+	// 空きスロットには、次の空きスロットへのリンクを書き込むため、free_slotが格納できるサイズとアライメントを確保する。
+	slot_alignment_ = std::max( slot_alignment, alignof( free_slot ) );
+	slot_bytes_     = std::max( slot_bytes, sizeof( free_slot ) );
+	slot_bytes_     = ( ( slot_bytes_ + slot_alignment_ - 1 ) / slot_alignment_ ) * slot_alignment_;
+
+	void* p_chunk = allocator_.allocate( slot_bytes_ * num_of_slots_, slot_alignment_ );
+	if ( p_chunk == nullptr ) {
+		throw std::bad_alloc();
+	}
+	op_chunk_ = reinterpret_cast<unsigned char*>( p_chunk );
+
+	// 先頭のスロットから順に取り出されるように、末尾から空きリストを構築する。
+	free_slot* p_next = nullptr;
+	for ( size_t i = num_of_slots_; i > 0; i-- ) {
+		free_slot* p_slot = new ( op_chunk_.get() + ( i - 1 ) * slot_bytes_ ) free_slot;
+		p_slot->op_next_.store( offset_ptr<free_slot>( p_next ), std::memory_order_relaxed );
+		p_next = p_slot;
+	}
+	head_.store( make_head( 0, p_next ), std::memory_order_release );
+}
+
+offset_pool_base::~offset_pool_base()
+{
+	if ( op_chunk_ == nullptr ) {
+		return;
+	}
+	allocator_.deallocate( op_chunk_.get(), slot_alignment_ );
+}
+
+void* offset_pool_base::allocate_slot( void ) noexcept
+{
+	uint64_t cur_head = head_.load( std::memory_order_acquire );
+	while ( true ) {
+		free_slot* p_top = get_slot( cur_head );
+		if ( p_top == nullptr ) {
+			return nullptr;
+		}
+		// p_topは、他のスレッドが先に取り出して使用中かもしれない。その場合、読み出したリンクは不正な値となるが、
+		// バージョンタグが更新されているため、下記のCASは失敗する。
+		free_slot* p_next = p_top->op_next_.load( std::memory_order_relaxed ).get();
+		if ( head_.compare_exchange_weak( cur_head, make_head( cur_head, p_next ), std::memory_order_acq_rel, std::memory_order_acquire ) ) {
+			return p_top;
+		}
+	}
+}
+
+void offset_pool_base::deallocate_slot( void* p )
+{
+	if ( p == nullptr ) {
+		return;
+	}
+	if ( !is_belong_to( p ) ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: incorrect deallocation is requested. it is not a slot of this pool, p=%p, chunk=%p, slot_bytes=%zu, num_of_slots=%zu",
+		               p, op_chunk_.get(), slot_bytes_, num_of_slots_ );
+#ifdef NDEBUG
+		return;
+#else
+		throw std::out_of_range( "Error: deallocation requested addr of p is not a slot of this pool" );
+#endif
+	}
+
+	free_slot* p_slot   = new ( p ) free_slot;
+	uint64_t   cur_head = head_.load( std::memory_order_relaxed );
+	do {
+		p_slot->op_next_.store( offset_ptr<free_slot>( get_slot( cur_head ) ), std::memory_order_relaxed );
+	} while ( !head_.compare_exchange_weak( cur_head, make_head( cur_head, p_slot ), std::memory_order_release, std::memory_order_relaxed ) );
+}
+
+bool offset_pool_base::is_belong_to( const void* p ) const noexcept
+{
+	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p );
+	uintptr_t addr_top = reinterpret_cast<uintptr_t>( op_chunk_.get() );
+	uintptr_t addr_end = addr_top + slot_bytes_ * num_of_slots_;
+	if ( ( addr_p < addr_top ) || ( addr_end <= addr_p ) ) {
+		return false;
+	}
+	return ( ( addr_p - addr_top ) % slot_bytes_ ) == 0;
+}
+
+offset_pool_base::free_slot* offset_pool_base::get_slot( uint64_t head ) const noexcept
+{
+	uint64_t idx_p1 = head & slot_index_mask;
+	if ( idx_p1 == 0 ) {
+		return nullptr;
+	}
+	return reinterpret_cast<free_slot*>( op_chunk_.get() + ( idx_p1 - 1 ) * slot_bytes_ );
+}
+
+uint64_t offset_pool_base::make_head( uint64_t old_head, const free_slot* p_slot ) const noexcept
+{
+	uint64_t tag    = ( old_head >> version_tag_shift ) + 1;
+	uint64_t idx_p1 = 0;
+	if ( p_slot != nullptr ) {
+		// 不正なリンクを読み出した場合でもアドレス計算のみで完結させる。その場合でも、CASが失敗するため、この値は使用されない。
+		idx_p1 = ( ( reinterpret_cast<uintptr_t>( p_slot ) - reinterpret_cast<uintptr_t>( op_chunk_.get() ) ) / slot_bytes_ ) + 1;
+	}
+	return ( tag << version_tag_shift ) | ( idx_p1 & slot_index_mask );
+}
+
+}   // namespace ipsm
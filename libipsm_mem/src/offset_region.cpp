@@ -0,0 +1,99 @@
+/**
+ * @file offset_region.cpp
+ * @author PFA03027@nifty.com
+ * @brief lock-free monotonic memory region that is shareable b/w processes and released at once
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <new>
+#include <stdexcept>
+
+#include "ipsm_logger_internal.hpp"
+#include "offset_region.hpp"
+
+namespace ipsm {
+
+offset_region::offset_region( const offset_malloc& src, size_t chunk_bytes )
+  : allocator_( src )
+  , op_chunk_( nullptr )
+  , chunk_bytes_( 0 )
+  , used_bytes_( 0 )
+{
+	if ( chunk_bytes == 0 ) {
+		throw std::length_error( "Error: chunk size of offset_region should be bigger than 0" );
+	}
+
+	void* p_chunk = allocator_.allocate( chunk_bytes, alignof( std::max_align_t ) );
+	if ( p_chunk == nullptr ) {
+		throw std::bad_alloc();
+	}
+	op_chunk_    = reinterpret_cast<unsigned char*>( p_chunk );
+	chunk_bytes_ = chunk_bytes;
+}
+
+offset_region::~offset_region()
+{
+	release();
+}
+
+void* offset_region::allocate( size_t n, size_t alignment ) noexcept
+{
+	if ( ( alignment == 0 ) || ( ( alignment & ( alignment - 1 ) ) != 0 ) ) {
+		psm_logoutput( psm_log_lv::kErr, "Error: alignment of offset_region::allocate() should be power of 2, alignment=%zu", alignment );
+		return nullptr;
+	}
+	unsigned char* p_top = op_chunk_.get();
+	if ( ( p_top == nullptr ) || ( n > chunk_bytes_ ) ) {
+		return nullptr;
+	}
+	if ( n == 0 ) {
+		n = 1;   // mallocと同様に、サイズ0の要求に対しても、他と重ならないアドレスを返す。
+	}
+
+	uintptr_t addr_top = reinterpret_cast<uintptr_t>( p_top );
+	size_t    cur_used = used_bytes_.load( std::memory_order_relaxed );
+	size_t    new_used;
+	uintptr_t addr_ans;
+	do {
+		// チャンクの先頭アドレスは、max_align_tにアライメントされているが、それより大きなアライメントにも対応するため、アドレスでアライメントを計算する。
+		addr_ans = ( addr_top + cur_used + alignment - 1 ) & ~( static_cast<uintptr_t>( alignment ) - 1 );
+		new_used = static_cast<size_t>( addr_ans - addr_top ) + n;
+		if ( ( new_used > chunk_bytes_ ) || ( new_used < cur_used ) ) {
+			return nullptr;
+		}
+		// 確保したメモリブロックは、確保したスレッドだけが使用するため、他のメモリアクセスとの順序付けは不要。
+	} while ( !used_bytes_.compare_exchange_weak( cur_used, new_used, std::memory_order_relaxed, std::memory_order_relaxed ) );
+
+	return reinterpret_cast<void*>( addr_ans );
+}
+
+void offset_region::reset( void ) noexcept
+{
+	used_bytes_.store( 0, std::memory_order_release );
+}
+
+void offset_region::release( void )
+{
+	if ( op_chunk_ == nullptr ) {
+		return;
+	}
+	unsigned char* p_chunk = op_chunk_.get();
+	op_chunk_              = nullptr;
+	chunk_bytes_           = 0;
+	used_bytes_.store( 0, std::memory_order_release );
+	allocator_.deallocate( p_chunk, alignof( std::max_align_t ) );
+}
+
+bool offset_region::is_belong_to( const void* p ) const noexcept
+{
+	uintptr_t addr_p   = reinterpret_cast<uintptr_t>( p );
+	uintptr_t addr_top = reinterpret_cast<uintptr_t>( op_chunk_.get() );
+	uintptr_t addr_end = addr_top + chunk_bytes_;
+	return ( addr_top <= addr_p ) && ( addr_p < addr_end ) && ( op_chunk_ != nullptr );
+}
+
+}   // namespace ipsm
@@ -0,0 +1,729 @@
+/**
+ * @file bench_offset_malloc.cpp
+ * @author PFA03027@nifty.com
+ * @brief microbenchmark of offset_malloc compared with malloc and std::pmr::synchronized_pool_resource
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ * usage: bench_offset_malloc [--ops N] [--max-threads N] [--max-procs N] [--arenas N] [--out FILE]
+ *
+ * the result is written as JSON to FILE or stdout. each entry has ops/s and p50/p99/p999 latency of one allocate() or deallocate() call in nanoseconds.
+ * the latency includes the overhead of reading the clock. the random sequences use fixed seeds, so the sequence of requests is same for every run.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "offset_malloc.hpp"
+
+namespace {
+
+constexpr size_t window_size           = 1024;              // fixed/randomで保持し続けるブロックの数
+constexpr size_t ring_size             = 1024;              // producer/consumer間のキューの容量
+constexpr size_t min_random_bytes      = 16;
+constexpr size_t max_random_bytes      = 1024;
+constexpr size_t fixed_bytes           = 64;
+constexpr size_t heap_bytes_per_worker = 1024 * 1024 * 4;   // 1ワーカが保持する最大のバイト数(約1MB)に対して、断片化を見込んだヒープのサイズ
+constexpr size_t cache_line_bytes      = 64;
+constexpr size_t max_num_of_workers    = 256;
+
+/**
+ * @brief log-linear histogram of latency in nanoseconds
+ *
+ * each power of 2 range is divided into 16 buckets. therefore the relative error of percentile is less than 1/16.
+ * this is trivially copyable and has no pointer, so it is able to be placed on the memory shared with the child processes, and merged exactly.
+ */
+class latency_histogram {
+public:
+	static constexpr unsigned int sub_bits       = 4;
+	static constexpr size_t       num_of_sub     = 1U << sub_bits;
+	static constexpr size_t       num_of_buckets = ( 64 - sub_bits + 1 ) * num_of_sub;
+
+	void record( std::uint64_t ns ) noexcept
+	{
+		counts_[bucket_index( ns )]++;
+		total_count_++;
+		max_ = std::max( max_, ns );
+	}
+
+	void merge( const latency_histogram& src ) noexcept
+	{
+		for ( size_t i = 0; i < num_of_buckets; i++ ) {
+			counts_[i] += src.counts_[i];
+		}
+		total_count_ += src.total_count_;
+		max_ = std::max( max_, src.max_ );
+	}
+
+	/**
+	 * @brief get the upper bound of the bucket that includes q-quantile
+	 */
+	std::uint64_t percentile( double q ) const noexcept
+	{
+		if ( total_count_ == 0 ) {
+			return 0;
+		}
+		std::uint64_t rank = static_cast<std::uint64_t>( q * static_cast<double>( total_count_ ) );
+		if ( rank >= total_count_ ) {
+			rank = total_count_ - 1;
+		}
+		std::uint64_t cum = 0;
+		for ( size_t i = 0; i < num_of_buckets; i++ ) {
+			cum += counts_[i];
+			if ( cum > rank ) {
+				return std::min( bucket_upper_bound( i ), max_ );
+			}
+		}
+		return max_;
+	}
+
+	std::uint64_t max( void ) const noexcept
+	{
+		return max_;
+	}
+
+private:
+	static size_t bucket_index( std::uint64_t v ) noexcept
+	{
+		if ( v < num_of_sub ) {
+			return static_cast<size_t>( v );
+		}
+		unsigned int e   = static_cast<unsigned int>( 63 - __builtin_clzll( v ) );
+		size_t       sub = static_cast<size_t>( ( v >> ( e - sub_bits ) ) & ( num_of_sub - 1 ) );
+		return ( e - sub_bits + 1 ) * num_of_sub + sub;
+	}
+	static std::uint64_t bucket_upper_bound( size_t idx ) noexcept
+	{
+		if ( idx < num_of_sub ) {
+			return idx;
+		}
+		unsigned int  e     = static_cast<unsigned int>( idx / num_of_sub ) + sub_bits - 1;
+		std::uint64_t sub   = idx % num_of_sub;
+		std::uint64_t lower = ( num_of_sub + sub ) << ( e - sub_bits );
+		return lower + ( std::uint64_t( 1 ) << ( e - sub_bits ) ) - 1;
+	}
+
+	std::uint64_t counts_[num_of_buckets];
+	std::uint64_t total_count_;
+	std::uint64_t max_;
+};
+
+struct worker_result {
+	std::uint64_t     num_of_ops_;
+	std::uint64_t     num_of_failures_;   // 確保に失敗した回数
+	std::int64_t      start_ns_;
+	std::int64_t      end_ns_;
+	latency_histogram hist_;
+};
+
+struct alignas( cache_line_bytes ) spsc_ring {
+	struct entry {
+		void*  p_;
+		size_t bytes_;   // std::pmr::memory_resource::deallocate()に渡すサイズ
+	};
+
+	alignas( cache_line_bytes ) std::atomic<size_t> head_;   // consumerが更新する
+	alignas( cache_line_bytes ) std::atomic<size_t> tail_;   // producerが更新する
+	entry slots_[ring_size];
+
+	void push( const entry& e ) noexcept
+	{
+		size_t cur_tail = tail_.load( std::memory_order_relaxed );
+		while ( ( cur_tail - head_.load( std::memory_order_acquire ) ) >= ring_size ) {
+			std::this_thread::yield();
+		}
+		slots_[cur_tail % ring_size] = e;
+		tail_.store( cur_tail + 1, std::memory_order_release );
+	}
+	entry pop( void ) noexcept
+	{
+		size_t cur_head = head_.load( std::memory_order_relaxed );
+		while ( tail_.load( std::memory_order_acquire ) == cur_head ) {
+			std::this_thread::yield();
+		}
+		entry ans = slots_[cur_head % ring_size];
+		head_.store( cur_head + 1, std::memory_order_release );
+		return ans;
+	}
+};
+
+/**
+ * @brief control block that is shared with the worker threads or the child processes
+ */
+struct shared_control {
+	std::atomic<size_t> num_of_ready_;
+	std::atomic<bool>   start_;
+	worker_result       results_[max_num_of_workers];
+	spsc_ring           rings_[max_num_of_workers / 2];
+};
+
+std::int64_t now_ns( void ) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+class bench_allocator {
+public:
+	virtual ~bench_allocator()                    = default;
+	virtual void* allocate( size_t n )            = 0;
+	virtual void  deallocate( void* p, size_t n ) = 0;
+};
+
+/**
+ * @brief allocator under the benchmark. this is prepared by the parent process, and shared with the workers via make_worker()
+ */
+class bench_target {
+public:
+	virtual ~bench_target()                                          = default;
+	virtual const char*                      name( void ) const      = 0;
+	virtual void                             prepare( size_t bytes ) = 0;
+	virtual void                             cleanup( void )         = 0;
+	virtual std::unique_ptr<bench_allocator> make_worker( void )     = 0;
+	virtual bool                             is_shareable_bw_processes( void ) const
+	{
+		return false;
+	}
+};
+
+class offset_malloc_worker : public bench_allocator {
+public:
+	offset_malloc_worker( const ipsm::offset_malloc& src, bool use_thread_cache )
+	  : om_( src )
+	{
+		om_.set_thread_cache( use_thread_cache );
+	}
+	void* allocate( size_t n ) override
+	{
+		return om_.allocate( n );
+	}
+	void deallocate( void* p, size_t ) override
+	{
+		om_.deallocate( p );
+	}
+
+private:
+	ipsm::offset_malloc om_;
+};
+
+class offset_malloc_target : public bench_target {
+public:
+	offset_malloc_target( bool use_thread_cache, size_t num_of_arenas )
+	  : use_thread_cache_( use_thread_cache )
+	  , num_of_arenas_( num_of_arenas )
+	  , p_mem_( nullptr )
+	  , mem_bytes_( 0 )
+	  , up_om_()
+	{
+	}
+	const char* name( void ) const override
+	{
+		return use_thread_cache_ ? "offset_malloc+thread_cache" : "offset_malloc";
+	}
+	void prepare( size_t bytes ) override
+	{
+		// 子プロセスと共有するため、fork()の前に共有マッピングを作成し、同じアドレスで参照させる。
+		p_mem_ = mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		if ( p_mem_ == MAP_FAILED ) {
+			p_mem_ = nullptr;
+			throw std::bad_alloc();
+		}
+		mem_bytes_ = bytes;
+		up_om_     = std::unique_ptr<ipsm::offset_malloc>( new ipsm::offset_malloc( p_mem_, bytes, ipsm::offset_malloc_policy::kFirstFit, num_of_arenas_ ) );
+	}
+	void cleanup( void ) override
+	{
+		up_om_.reset();
+		if ( p_mem_ != nullptr ) {
+			munmap( p_mem_, mem_bytes_ );
+		}
+		p_mem_     = nullptr;
+		mem_bytes_ = 0;
+	}
+	std::unique_ptr<bench_allocator> make_worker( void ) override
+	{
+		return std::unique_ptr<bench_allocator>( new offset_malloc_worker( *up_om_, use_thread_cache_ ) );
+	}
+	bool is_shareable_bw_processes( void ) const override
+	{
+		return true;
+	}
+
+private:
+	bool                                 use_thread_cache_;
+	size_t                               num_of_arenas_;
+	void*                                p_mem_;
+	size_t                               mem_bytes_;
+	std::unique_ptr<ipsm::offset_malloc> up_om_;
+};
+
+class malloc_worker : public bench_allocator {
+public:
+	void* allocate( size_t n ) override
+	{
+		return malloc( n );
+	}
+	void deallocate( void* p, size_t ) override
+	{
+		free( p );
+	}
+};
+
+class malloc_target : public bench_target {
+public:
+	const char* name( void ) const override
+	{
+		return "malloc";
+	}
+	void prepare( size_t ) override
+	{
+	}
+	void cleanup( void ) override
+	{
+	}
+	std::unique_ptr<bench_allocator> make_worker( void ) override
+	{
+		return std::unique_ptr<bench_allocator>( new malloc_worker );
+	}
+};
+
+class pmr_worker : public bench_allocator {
+public:
+	explicit pmr_worker( std::pmr::memory_resource* p_mr )
+	  : p_mr_( p_mr )
+	{
+	}
+	void* allocate( size_t n ) override
+	{
+		try {
+			return p_mr_->allocate( n );
+		} catch ( std::bad_alloc& ) {
+			return nullptr;
+		}
+	}
+	void deallocate( void* p, size_t n ) override
+	{
+		p_mr_->deallocate( p, n );
+	}
+
+private:
+	std::pmr::memory_resource* p_mr_;
+};
+
+class pmr_target : public bench_target {
+public:
+	const char* name( void ) const override
+	{
+		return "std::pmr::synchronized_pool_resource";
+	}
+	void prepare( size_t ) override
+	{
+		up_mr_ = std::unique_ptr<std::pmr::synchronized_pool_resource>( new std::pmr::synchronized_pool_resource );
+	}
+	void cleanup( void ) override
+	{
+		up_mr_.reset();
+	}
+	std::unique_ptr<bench_allocator> make_worker( void ) override
+	{
+		return std::unique_ptr<bench_allocator>( new pmr_worker( up_mr_.get() ) );
+	}
+
+private:
+	std::unique_ptr<std::pmr::synchronized_pool_resource> up_mr_;
+};
+
+enum class bench_pattern {
+	kFixed,              // 固定サイズのブロックを、保持しているブロックと順に入れ替える
+	kRandom,             // ランダムなサイズのブロックを、保持しているブロックとランダムに入れ替える
+	kProducerConsumer,   // producerが確保したブロックを、consumerが解放する
+};
+
+const char* to_string( bench_pattern pattern )
+{
+	switch ( pattern ) {
+		case bench_pattern::kFixed:
+			return "fixed";
+		case bench_pattern::kRandom:
+			return "random";
+		case bench_pattern::kProducerConsumer:
+			return "producer_consumer";
+	}
+	return "unknown";
+}
+
+struct bench_config {
+	size_t      num_of_ops_    = 200000;   // 1ワーカあたりの計測対象の操作の回数
+	size_t      max_threads_   = 0;
+	size_t      max_procs_     = 0;
+	size_t      num_of_arenas_ = 1;
+	const char* p_out_fname_   = nullptr;
+};
+
+void wait_start( shared_control& ctl )
+{
+	ctl.num_of_ready_.fetch_add( 1, std::memory_order_acq_rel );
+	while ( !ctl.start_.load( std::memory_order_acquire ) ) {
+		std::this_thread::yield();
+	}
+}
+
+void run_window_worker( bench_pattern pattern, bench_allocator& a, size_t worker_idx, size_t num_of_ops, shared_control& ctl, worker_result& r )
+{
+	std::mt19937                          engine( static_cast<std::mt19937::result_type>( 1 + worker_idx ) );
+	std::uniform_int_distribution<size_t> size_dist( min_random_bytes, max_random_bytes );
+	std::uniform_int_distribution<size_t> idx_dist( 0, window_size - 1 );
+	std::vector<void*>                    window( window_size, nullptr );
+	std::vector<size_t>                   window_bytes( window_size, 0 );
+	for ( size_t i = 0; i < window_size; i++ ) {
+		window_bytes[i] = ( pattern == bench_pattern::kFixed ) ? fixed_bytes : size_dist( engine );
+		window[i]       = a.allocate( window_bytes[i] );
+	}
+
+	wait_start( ctl );
+	r.start_ns_ = now_ns();
+	for ( size_t i = 0; i < num_of_ops / 2; i++ ) {
+		size_t idx       = ( pattern == bench_pattern::kFixed ) ? ( i % window_size ) : idx_dist( engine );
+		size_t new_bytes = ( pattern == bench_pattern::kFixed ) ? fixed_bytes : size_dist( engine );
+
+		std::int64_t t0 = now_ns();
+		if ( window[idx] != nullptr ) {
+			a.deallocate( window[idx], window_bytes[idx] );
+		}
+		std::int64_t t1 = now_ns();
+		window[idx]     = a.allocate( new_bytes );
+		std::int64_t t2 = now_ns();
+
+		window_bytes[idx] = new_bytes;
+		r.hist_.record( static_cast<std::uint64_t>( t1 - t0 ) );
+		r.hist_.record( static_cast<std::uint64_t>( t2 - t1 ) );
+		r.num_of_ops_ += 2;
+		if ( window[idx] == nullptr ) {
+			r.num_of_failures_++;
+		}
+	}
+	r.end_ns_ = now_ns();
+
+	for ( size_t i = 0; i < window_size; i++ ) {
+		if ( window[i] != nullptr ) {
+			a.deallocate( window[i], window_bytes[i] );
+		}
+	}
+}
+
+void run_producer( bench_allocator& a, size_t worker_idx, size_t num_of_ops, shared_control& ctl, spsc_ring& ring, worker_result& r )
+{
+	std::mt19937                          engine( static_cast<std::mt19937::result_type>( 1 + worker_idx ) );
+	std::uniform_int_distribution<size_t> size_dist( min_random_bytes, max_random_bytes / 4 );
+
+	wait_start( ctl );
+	r.start_ns_ = now_ns();
+	for ( size_t i = 0; i < num_of_ops; i++ ) {
+		size_t       bytes = size_dist( engine );
+		std::int64_t t0    = now_ns();
+		void*        p     = a.allocate( bytes );
+		std::int64_t t1    = now_ns();
+		r.hist_.record( static_cast<std::uint64_t>( t1 - t0 ) );
+		r.num_of_ops_++;
+		if ( p == nullptr ) {
+			r.num_of_failures_++;
+		}
+		ring.push( spsc_ring::entry { p, bytes } );   // consumerの終了判定のため、失敗した場合もnullptrを渡す。
+	}
+	r.end_ns_ = now_ns();
+}
+
+void run_consumer( bench_allocator& a, size_t num_of_ops, shared_control& ctl, spsc_ring& ring, worker_result& r )
+{
+	wait_start( ctl );
+	r.start_ns_ = now_ns();
+	for ( size_t i = 0; i < num_of_ops; i++ ) {
+		spsc_ring::entry e = ring.pop();
+		if ( e.p_ == nullptr ) {
+			continue;
+		}
+		std::int64_t t0 = now_ns();
+		a.deallocate( e.p_, e.bytes_ );
+		std::int64_t t1 = now_ns();
+		r.hist_.record( static_cast<std::uint64_t>( t1 - t0 ) );
+		r.num_of_ops_++;
+	}
+	r.end_ns_ = now_ns();
+}
+
+void run_worker( bench_pattern pattern, bench_target& target, size_t worker_idx, size_t num_of_ops, shared_control& ctl )
+{
+	std::unique_ptr<bench_allocator> up_a = target.make_worker();
+	worker_result&                   r    = ctl.results_[worker_idx];
+	if ( pattern != bench_pattern::kProducerConsumer ) {
+		run_window_worker( pattern, *up_a, worker_idx, num_of_ops, ctl, r );
+		return;
+	}
+	// 偶数番目のワーカがproducer、その次のワーカがconsumerとなり、1つのキューを共有する。
+	spsc_ring& ring = ctl.rings_[worker_idx / 2];
+	if ( ( worker_idx % 2 ) == 0 ) {
+		run_producer( *up_a, worker_idx, num_of_ops / 2, ctl, ring, r );
+	} else {
+		run_consumer( *up_a, num_of_ops / 2, ctl, ring, r );
+	}
+}
+
+struct bench_entry {
+	const char*       p_allocator_;
+	bench_pattern     pattern_;
+	bool              is_procs_;
+	size_t            num_of_workers_;
+	std::uint64_t     num_of_ops_;
+	std::uint64_t     num_of_failures_;
+	double            seconds_;
+	latency_histogram hist_;
+};
+
+bool run_bench( bench_target& target, bench_pattern pattern, bool is_procs, size_t num_of_workers, const bench_config& cfg, bench_entry& out )
+{
+	// 結果の集計領域とキューは、子プロセスからも書き込めるように、共有マッピング上に配置する。
+	void* p_ctl_mem = mmap( nullptr, sizeof( shared_control ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	if ( p_ctl_mem == MAP_FAILED ) {
+		fprintf( stderr, "Error: fail to mmap the control block\n" );
+		return false;
+	}
+	memset( p_ctl_mem, 0, sizeof( shared_control ) );
+	shared_control* p_ctl = new ( p_ctl_mem ) shared_control;
+	p_ctl->num_of_ready_.store( 0 );
+	p_ctl->start_.store( false );
+
+	target.prepare( heap_bytes_per_worker * ( num_of_workers + 1 ) );
+
+	bool                     is_success = true;
+	std::vector<std::thread> threads;
+	std::vector<pid_t>       pids;
+	for ( size_t i = 0; i < num_of_workers; i++ ) {
+		if ( !is_procs ) {
+			threads.emplace_back( [&target, pattern, i, &cfg, p_ctl]() {
+				run_worker( pattern, target, i, cfg.num_of_ops_, *p_ctl );
+			} );
+			continue;
+		}
+		fflush( stdout );
+		pid_t pid = fork();
+		if ( pid == 0 ) {
+			run_worker( pattern, target, i, cfg.num_of_ops_, *p_ctl );
+			_exit( EXIT_SUCCESS );   // 親プロセスのオブジェクトを破棄しないように、デストラクタを実行せずに終了する。
+		}
+		if ( pid < 0 ) {
+			fprintf( stderr, "Error: fail to fork()\n" );
+			is_success = false;
+			break;
+		}
+		pids.push_back( pid );
+	}
+
+	const size_t num_of_started = is_procs ? pids.size() : threads.size();
+	while ( p_ctl->num_of_ready_.load( std::memory_order_acquire ) < num_of_started ) {
+		std::this_thread::yield();
+	}
+	p_ctl->start_.store( true, std::memory_order_release );
+
+	for ( auto& t : threads ) {
+		t.join();
+	}
+	for ( auto pid : pids ) {
+		int wstatus = 0;
+		if ( ( waitpid( pid, &wstatus, 0 ) < 0 ) || !WIFEXITED( wstatus ) || ( WEXITSTATUS( wstatus ) != EXIT_SUCCESS ) ) {
+			fprintf( stderr, "Error: child process %d exits abnormally\n", static_cast<int>( pid ) );
+			is_success = false;
+		}
+	}
+
+	out                    = bench_entry {};
+	out.p_allocator_       = target.name();
+	out.pattern_           = pattern;
+	out.is_procs_          = is_procs;
+	out.num_of_workers_    = num_of_workers;
+	std::int64_t min_start = 0;
+	std::int64_t max_end   = 0;
+	for ( size_t i = 0; i < num_of_started; i++ ) {
+		const worker_result& r = p_ctl->results_[i];
+		out.num_of_ops_ += r.num_of_ops_;
+		out.num_of_failures_ += r.num_of_failures_;
+		out.hist_.merge( r.hist_ );
+		min_start = ( i == 0 ) ? r.start_ns_ : std::min( min_start, r.start_ns_ );
+		max_end   = ( i == 0 ) ? r.end_ns_ : std::max( max_end, r.end_ns_ );
+	}
+	out.seconds_ = static_cast<double>( max_end - min_start ) / 1.0e9;
+
+	target.cleanup();
+	p_ctl->~shared_control();
+	munmap( p_ctl_mem, sizeof( shared_control ) );
+	return is_success && ( num_of_started == num_of_workers );
+}
+
+std::vector<size_t> make_worker_counts( size_t max_num )
+{
+	std::vector<size_t> ans;
+	for ( size_t n = 1; n < max_num; n *= 2 ) {
+		ans.push_back( n );
+	}
+	ans.push_back( max_num );
+	return ans;
+}
+
+void print_json( FILE* fp, const bench_config& cfg, const std::vector<bench_entry>& entries )
+{
+	fprintf( fp, "{\n" );
+	fprintf( fp, "  \"benchmark\": \"bench_offset_malloc\",\n" );
+	fprintf( fp, "  \"schema_version\": 1,\n" );
+	fprintf( fp, "  \"config\": {\n" );
+	fprintf( fp, "    \"ops_per_worker\": %zu,\n", cfg.num_of_ops_ );
+	fprintf( fp, "    \"max_threads\": %zu,\n", cfg.max_threads_ );
+	fprintf( fp, "    \"max_procs\": %zu,\n", cfg.max_procs_ );
+	fprintf( fp, "    \"num_of_arenas\": %zu,\n", cfg.num_of_arenas_ );
+	fprintf( fp, "    \"hardware_concurrency\": %u,\n", std::thread::hardware_concurrency() );
+#ifdef NDEBUG
+	fprintf( fp, "    \"ndebug\": true\n" );
+#else
+	fprintf( fp, "    \"ndebug\": false\n" );
+#endif
+	fprintf( fp, "  },\n" );
+	fprintf( fp, "  \"results\": [\n" );
+	for ( size_t i = 0; i < entries.size(); i++ ) {
+		const bench_entry& e           = entries[i];
+		double             ops_per_sec = ( e.seconds_ > 0.0 ) ? ( static_cast<double>( e.num_of_ops_ ) / e.seconds_ ) : 0.0;
+		fprintf( fp,
+		         "    {\"allocator\": \"%s\", \"pattern\": \"%s\", \"mode\": \"%s\", \"workers\": %zu, \"ops\": %llu, \"failures\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, "
+		         "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}}%s\n",
+		         e.p_allocator_, to_string( e.pattern_ ), e.is_procs_ ? "processes" : "threads", e.num_of_workers_,
+		         static_cast<unsigned long long>( e.num_of_ops_ ), static_cast<unsigned long long>( e.num_of_failures_ ), e.seconds_, ops_per_sec,
+		         static_cast<unsigned long long>( e.hist_.percentile( 0.50 ) ), static_cast<unsigned long long>( e.hist_.percentile( 0.99 ) ),
+		         static_cast<unsigned long long>( e.hist_.percentile( 0.999 ) ), static_cast<unsigned long long>( e.hist_.max() ),
+		         ( ( i + 1 ) < entries.size() ) ? "," : "" );
+	}
+	fprintf( fp, "  ]\n" );
+	fprintf( fp, "}\n" );
+}
+
+bool parse_size( const char* p_str, size_t& out )
+{
+	char*              p_end = nullptr;
+	unsigned long long v     = strtoull( p_str, &p_end, 10 );
+	if ( ( p_end == p_str ) || ( *p_end != '\0' ) || ( v == 0 ) ) {
+		return false;
+	}
+	out = static_cast<size_t>( v );
+	return true;
+}
+
+bool parse_args( int argc, char* argv[], bench_config& cfg )
+{
+	for ( int i = 1; i < argc; i++ ) {
+		std::string opt = argv[i];
+		if ( ( i + 1 ) >= argc ) {
+			return false;
+		}
+		const char* p_val = argv[++i];
+		if ( opt == "--ops" ) {
+			if ( !parse_size( p_val, cfg.num_of_ops_ ) ) {
+				return false;
+			}
+		} else if ( opt == "--max-threads" ) {
+			if ( !parse_size( p_val, cfg.max_threads_ ) ) {
+				return false;
+			}
+		} else if ( opt == "--max-procs" ) {
+			if ( !parse_size( p_val, cfg.max_procs_ ) ) {
+				return false;
+			}
+		} else if ( opt == "--arenas" ) {
+			if ( !parse_size( p_val, cfg.num_of_arenas_ ) ) {
+				return false;
+			}
+		} else if ( opt == "--out" ) {
+			cfg.p_out_fname_ = p_val;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+}   // namespace
+
+int main( int argc, char* argv[] )
+{
+	bench_config cfg;
+	size_t       hw_concurrency = std::max<size_t>( std::thread::hardware_concurrency(), 2 );
+	cfg.max_threads_            = hw_concurrency;
+	cfg.max_procs_              = hw_concurrency;
+	if ( !parse_args( argc, argv, cfg ) ) {
+		fprintf( stderr, "usage: %s [--ops N] [--max-threads N] [--max-procs N] [--arenas N] [--out FILE]\n", argv[0] );
+		return EXIT_FAILURE;
+	}
+	cfg.max_threads_ = std::min( cfg.max_threads_, max_num_of_workers );
+	cfg.max_procs_   = std::min( cfg.max_procs_, max_num_of_workers );
+
+	offset_malloc_target om_target( false, cfg.num_of_arenas_ );
+	offset_malloc_target om_tc_target( true, cfg.num_of_arenas_ );
+	malloc_target        m_target;
+	pmr_target           pmr_target_obj;
+	bench_target*        targets[] = { &om_target, &om_tc_target, &m_target, &pmr_target_obj };
+
+	std::vector<bench_entry> entries;
+	bool                     is_success = true;
+	for ( bool is_procs : { false, true } ) {
+		for ( auto pattern : { bench_pattern::kFixed, bench_pattern::kRandom, bench_pattern::kProducerConsumer } ) {
+			for ( size_t num_of_workers : make_worker_counts( is_procs ? cfg.max_procs_ : cfg.max_threads_ ) ) {
+				for ( auto p_target : targets ) {
+					if ( pattern == bench_pattern::kProducerConsumer ) {
+						// producerとconsumerの組で計測する。他のプロセスが確保したブロックを解放できるのは、プロセス間で共有できるアロケータのみ。
+						if ( ( num_of_workers % 2 ) != 0 ) {
+							continue;
+						}
+						if ( is_procs && !p_target->is_shareable_bw_processes() ) {
+							continue;
+						}
+					}
+					bench_entry e;
+					if ( !run_bench( *p_target, pattern, is_procs, num_of_workers, cfg, e ) ) {
+						is_success = false;
+						continue;
+					}
+					fprintf( stderr, "%-38s %-17s %-9s workers=%3zu %14.0f ops/s\n", e.p_allocator_, to_string( pattern ), is_procs ? "processes" : "threads", num_of_workers,
+					         static_cast<double>( e.num_of_ops_ ) / e.seconds_ );
+					entries.push_back( e );
+				}
+			}
+		}
+	}
+
+	FILE* fp = stdout;
+	if ( cfg.p_out_fname_ != nullptr ) {
+		fp = fopen( cfg.p_out_fname_, "w" );
+		if ( fp == nullptr ) {
+			fprintf( stderr, "Error: fail to open %s\n", cfg.p_out_fname_ );
+			return EXIT_FAILURE;
+		}
+	}
+	print_json( fp, cfg, entries );
+	if ( fp != stdout ) {
+		fclose( fp );
+	}
+
+	return is_success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
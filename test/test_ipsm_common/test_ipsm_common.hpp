@@ -12,8 +12,15 @@
 #ifndef TEST_IPSM_COMMON_HPP_
 #define TEST_IPSM_COMMON_HPP_
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
 
+#include "gtest/gtest.h"
+
+#include "offset_malloc.hpp"
+
 struct ArrowOpTest {
 	int x_;
 	int y_;
@@ -42,4 +49,37 @@ inline bool operator==( const EmplacementTestData& a, const EmplacementTestData&
 	       ( a.y_ == b.y_ );
 }
 
+// offset_mallocを、プロセスローカルなヒープ上に構築するテストフィクスチャ。
+// バッファはmallocで確保し、block::block_headerのサイズである16バイトにアライメントを採る。
+class Offset_Malloc_Heap_Fixture : public testing::Test {
+protected:
+	static constexpr size_t buff_size = 1024 * 64;
+
+	void SetUp() override
+	{
+		setup_heap( ipsm::offset_malloc_policy::kFirstFit, 1 );
+	}
+	void TearDown() override
+	{
+		// バッファを解放する前に、offset_mallocの参照を外す。
+		om_ = ipsm::offset_malloc();
+		free( p_mem_ );
+	}
+
+	void setup_heap( ipsm::offset_malloc_policy policy, size_t num_of_arenas )
+	{
+		p_mem_ = malloc( buff_size + 16 );
+
+		uintptr_t addr = reinterpret_cast<uintptr_t>( p_mem_ );
+		addr           = ( ( addr + 16 - 1 ) / 16 ) * 16;   // block::block_headerのサイズでアライメントを採る。
+
+		p_buff_ = reinterpret_cast<unsigned char*>( addr );
+		om_     = ipsm::offset_malloc( p_buff_, buff_size, policy, num_of_arenas );
+	}
+
+	void*               p_mem_  = nullptr;
+	unsigned char*      p_buff_ = nullptr;
+	ipsm::offset_malloc om_;
+};
+
 #endif   // TEST_IPSM_COMMON_HPP_
\ No newline at end of file
@@ -11,12 +11,15 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <future>
 #include <mutex>
 #include <stdexcept>
 #include <thread>
+#include <vector>
 
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -102,6 +105,23 @@ protected:
 	}
 };
 
+TEST( Test_ipsm_malloc, CanConstructWithArenas_ThenAllocateDeallocate )
+{
+	// Arrange
+	std::string       shm_name            = "/test_ipsm_malloc_arena_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_arena_lifetime_ctrl_" + std::to_string( getpid() );
+	ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 2, 1000, 100, 4 );
+
+	// Act
+	auto p = sut.allocate( 10 );
+
+	// Assert
+	EXPECT_NE( p, nullptr );
+	EXPECT_EQ( sut.get_offset_malloc().get_num_of_arenas(), static_cast<size_t>( 4 ) );
+	EXPECT_TRUE( sut.get_offset_malloc().is_belong_to( p ) );
+	ASSERT_NO_THROW( { sut.deallocate( p ); } );
+}
+
 TEST_F( TestIpsmMallocFixture, CanConstruct_ThenAllocate )
 {
 	// Arrange
@@ -125,6 +145,321 @@ TEST_F( TestIpsmMallocFixture, CanConstruct_ThenAllocateDeallocate )
 	// Assert
 }
 
+TEST_F( TestIpsmMallocFixture, CanAllocateBulk_ThenDeallocateBulk )
+{
+	// Arrange
+	constexpr size_t n = 8;
+	void*            ptrs[n];
+
+	// Act
+	size_t ret = sut_.allocate_bulk( 10, alignof( std::max_align_t ), n, ptrs );
+
+	// Assert
+	EXPECT_EQ( ret, n );
+	for ( auto p : ptrs ) {
+		EXPECT_TRUE( sut_.get_offset_malloc().is_belong_to( p ) );
+	}
+	ASSERT_NO_THROW( { sut_.deallocate_bulk( ptrs, n ); } );
+}
+
+TEST_F( TestIpsmMallocFixture, CanGetStats )
+{
+	// Arrange
+	ipsm::offset_malloc_stats before = sut_.get_stats();
+	void*                     p      = sut_.allocate( 100 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	ipsm::offset_malloc_stats ret = sut_.get_stats();
+
+	// Assert
+	EXPECT_EQ( ret.total_bytes_, before.total_bytes_ );
+	EXPECT_EQ( ret.num_of_allocated_blocks_, before.num_of_allocated_blocks_ + 1 );
+	EXPECT_LE( ret.free_bytes_, before.free_bytes_ - 100 );
+
+	// Cleanup
+	sut_.deallocate( p );
+}
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+TEST( Test_ipsm_malloc, CanGetSizeClassHistogram )
+{
+	// Arrange
+	// 統計カウンタは、十分に大きなヒープにのみ確保されるため、フィクスチャより大きなヒープを使う。
+	std::string                              shm_name            = "/test_ipsm_malloc_histogram_" + std::to_string( getpid() );
+	std::string                              lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_histogram_lifetime_ctrl_" + std::to_string( getpid() );
+	ipsm::ipsm_malloc                        sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 16, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+	ipsm::offset_malloc_size_class_histogram before = sut.get_size_class_histogram();
+	void*                                    p      = sut.allocate( 16 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	ipsm::offset_malloc_size_class_histogram ret = sut.get_size_class_histogram();
+
+	// Assert
+	EXPECT_EQ( ret.classes_[0].num_of_allocations_, before.classes_[0].num_of_allocations_ + 1 );
+	EXPECT_EQ( ret.classes_[0].live_bytes_, before.classes_[0].live_bytes_ + 32 );
+
+	// Cleanup
+	sut.deallocate( p );
+}
+#endif
+
+TEST_F( TestIpsmMallocFixture, CanDeferDeallocation )
+{
+	// Arrange
+	sut_.set_deferred_free( true );
+	size_t num_of_allocated = sut_.get_stats().num_of_allocated_blocks_;
+	void*  p                = sut_.allocate( 100 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	sut_.deallocate( p );
+
+	// Assert
+	EXPECT_EQ( sut_.get_stats().num_of_allocated_blocks_, num_of_allocated + 1 );
+	sut_.set_deferred_free( false );
+	EXPECT_EQ( sut_.get_stats().num_of_allocated_blocks_, num_of_allocated );
+}
+
+TEST( Test_ipsm_malloc, CanReturnPagesOfLargeBlockToOS )
+{
+	// Arrange
+	constexpr size_t  large_size          = 1024 * 1024;
+	std::string       shm_name            = "/test_ipsm_malloc_large_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_large_lifetime_ctrl_" + std::to_string( getpid() );
+	std::string       shm_path            = "/dev/shm" + shm_name;
+	ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), large_size * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+	void*             p = sut.allocate( large_size );
+	ASSERT_NE( p, nullptr );
+	memset( p, 0xAA, large_size );
+	struct stat st_before;
+	ASSERT_EQ( stat( shm_path.c_str(), &st_before ), 0 );
+
+	// Act
+	sut.deallocate( p );
+
+	// Assert
+	struct stat st_after;
+	ASSERT_EQ( stat( shm_path.c_str(), &st_after ), 0 );
+	EXPECT_LE( static_cast<size_t>( st_after.st_blocks ) * 512, static_cast<size_t>( st_before.st_blocks ) * 512 - large_size + 4096 );
+}
+
+TEST( Test_ipsm_malloc, CanGrowByChainedSegment )
+{
+	// Arrange
+	constexpr size_t   block_size          = 1024 * 16;
+	std::string        shm_name            = "/test_ipsm_malloc_grow_" + std::to_string( getpid() );
+	std::string        lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_grow_lifetime_ctrl_" + std::to_string( getpid() );
+	std::string        chained_shm_path    = "/dev/shm" + shm_name + ".1";
+	std::vector<void*> allocated;
+
+	ipsm::ipsm_mem::setup_options options;
+	options.max_length = 1024 * 1024 * 16;
+	{
+		ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 2, 1000, 100, 1, options );
+		size_t            initial_total_bytes = sut.get_stats().total_bytes_;
+
+		// Act
+		for ( size_t i = 0; i < 64; i++ ) {
+			void* p = sut.allocate( block_size );
+			ASSERT_NE( p, nullptr );
+			memset( p, static_cast<int>( i ), block_size );
+			allocated.push_back( p );
+		}
+
+		// Assert
+		EXPECT_GT( sut.get_stats().total_bytes_, initial_total_bytes + block_size * 32 );
+		EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, allocated.size() + 1 );   // +1 is message channels
+		EXPECT_EQ( access( chained_shm_path.c_str(), F_OK ), 0 );
+		for ( size_t i = 0; i < allocated.size(); i++ ) {
+			EXPECT_TRUE( sut.get_offset_malloc().is_belong_to( allocated[i] ) );
+			EXPECT_EQ( reinterpret_cast<unsigned char*>( allocated[i] )[block_size - 1], static_cast<unsigned char>( i ) );
+			ASSERT_NO_THROW( sut.deallocate( allocated[i] ) );
+		}
+		EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );
+	}
+	EXPECT_NE( access( chained_shm_path.c_str(), F_OK ), 0 );   // 最後のプロセスが終了したら、チェーンセグメントも削除される
+}
+
+TEST( Test_ipsm_malloc, PeerCanAttachChainedSegmentLazily )
+{
+	// Arrange
+	using list_type                       = ipsm::offset_list<int, ipsm::offset_allocator<int>>;
+	constexpr int     num_of_elements     = 2000;
+	std::string       shm_name            = "/test_ipsm_malloc_grow_peer_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_grow_peer_lifetime_ctrl_" + std::to_string( getpid() );
+
+	ipsm::ipsm_mem::setup_options options;
+	options.max_length = 1024 * 1024 * 16;
+
+	ipsm::ipsm_malloc sut_a( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 2, 1000, 100, 1, options );
+	ipsm::ipsm_malloc sut_b( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 2, 1000, 100, 1, options );
+	list_type*        p_list = sut_a.new_instance<list_type>( ipsm::offset_allocator<int>( sut_a.get_offset_malloc() ) );
+	ASSERT_NE( p_list, nullptr );
+
+	// Act
+	// リストのノードは、先頭の共有メモリに収まらないため、チェーンセグメントにまたがって配置される。
+	for ( int i = 0; i < num_of_elements; i++ ) {
+		p_list->push_back( i );
+	}
+	sut_a.send( 0, p_list );
+	auto op_received = sut_b.receive( 0 );
+
+	// Assert
+	list_type* p_received_list = reinterpret_cast<list_type*>( op_received.get() );
+	ASSERT_NE( p_received_list, nullptr );
+	EXPECT_EQ( p_received_list->size(), static_cast<size_t>( num_of_elements ) );
+	int expect_value = 0;
+	for ( auto v : *p_received_list ) {
+		EXPECT_EQ( v, expect_value );
+		expect_value++;
+	}
+	EXPECT_GT( sut_b.attach_segments(), static_cast<size_t>( 0 ) );
+	sut_b.delete_instance( p_received_list );
+	EXPECT_EQ( sut_a.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );   // 1 is message channels
+}
+
+TEST( Test_ipsm_malloc, CanConstructWithHugePage_ThenAllocateDeallocate )
+{
+	// Arrange
+	std::string       shm_name            = "/test_ipsm_malloc_hugepage_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_hugepage_lifetime_ctrl_" + std::to_string( getpid() );
+
+	ipsm::ipsm_mem::setup_options options;
+	options.page = ipsm::ipsm_mem::page_type::transparent_huge;
+
+	ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 2, 1000, 100, 1, options );
+
+	// Act
+	void* p = sut.allocate( 4096 * 8 );
+
+	// Assert
+	EXPECT_GE( sut.get_page_size(), static_cast<size_t>( sysconf( _SC_PAGESIZE ) ) );
+	EXPECT_GE( sut.get_stats().total_bytes_, sut.get_page_size() - 4096 );   // ヒュージページのサイズに切り上げた分も、ヒープとして使える
+	ASSERT_NE( p, nullptr );
+	sut.deallocate( p );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );   // 1 is message channels
+}
+
+TEST( Test_ipsm_malloc, CanReclaimBlocksOfDestructedOwner )
+{
+	// Arrange
+	std::string       shm_name            = "/test_ipsm_malloc_owner_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_owner_lifetime_ctrl_" + std::to_string( getpid() );
+	ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+	size_t            num_of_allocated = sut.get_stats().num_of_allocated_blocks_;
+	{
+		ipsm::ipsm_malloc sut_owner( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+		sut_owner.set_owner_tracking( true );
+		for ( int i = 0; i < 10; i++ ) {
+			ASSERT_NE( sut_owner.allocate( 100 ), nullptr );
+		}
+		void* p_disowned = sut_owner.allocate( 100 );
+		ASSERT_NE( p_disowned, nullptr );
+		sut_owner.disown( p_disowned );
+		sut_owner.send( 0, p_disowned );   // 所有権を放棄したブロックは、受信側に引き渡す
+		EXPECT_EQ( sut.reclaim_dead_owners(), static_cast<size_t>( 0 ) );   // 使用中のインスタンスのブロックは回収しない
+	}
+
+	// Act
+	size_t num_of_reclaimed = sut.reclaim_dead_owners();
+
+	// Assert
+	EXPECT_EQ( num_of_reclaimed, static_cast<size_t>( 10 ) );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, num_of_allocated + 2 );   // +2 is the disowned block and the node of the message channel
+
+	// Clean-up
+	sut.deallocate( sut.receive( 0 ).get() );
+}
+
+TEST( Test_ipsm_malloc, PersistentFile_CanRestart_ThenReattachHeapAndMessages )
+{
+	// Arrange
+	std::string file_path           = "/tmp/test_ipsm_malloc_persistent_" + std::to_string( getpid() );
+	std::string lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_persistent_lifetime_ctrl_" + std::to_string( getpid() );
+	size_t      num_of_allocated    = 0;
+	{
+		ipsm::ipsm_malloc sut1( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+		ASSERT_FALSE( sut1.is_reattached() );
+		int* p = sut1.new_instance<int>( 12345 );
+		ASSERT_NE( p, nullptr );
+		sut1.send( 0, p );
+		num_of_allocated = sut1.get_stats().num_of_allocated_blocks_;
+	}
+
+	// Act
+	ipsm::ipsm_malloc sut2( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+
+	// Assert
+	EXPECT_TRUE( sut2.is_reattached() );
+	EXPECT_EQ( sut2.get_bind_count(), 1 + static_cast<int>( sut2.channel_size() ) );   // 前回のインスタンスのバインドは残らない
+	EXPECT_EQ( sut2.get_stats().num_of_allocated_blocks_, num_of_allocated );
+	auto msg = sut2.try_receive( 0 );
+	ASSERT_TRUE( msg.has_value() );
+	int* p_received = static_cast<int*>( msg.value().get() );
+	EXPECT_EQ( *p_received, 12345 );
+
+	// Clean-up
+	sut2.delete_instance( p_received );
+	unlink( file_path.c_str() );
+	unlink( lifetime_ctrl_fname.c_str() );
+}
+
+TEST( Test_ipsm_malloc, PersistentFile_OwnerTrackedBlock_IsNotReclaimedAfterRestart )
+{
+	// Arrange
+	std::string file_path           = "/tmp/test_ipsm_malloc_persistent_" + std::to_string( getpid() );
+	std::string lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_persistent_lifetime_ctrl_" + std::to_string( getpid() );
+	{
+		ipsm::ipsm_malloc sut1( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+		sut1.set_owner_tracking( true );
+		int* p = sut1.new_instance<int>( 12345 );
+		ASSERT_NE( p, nullptr );
+		sut1.send( 0, p );
+	}
+	ipsm::ipsm_malloc sut2( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+	ASSERT_TRUE( sut2.is_reattached() );
+
+	// Act
+	size_t num_of_reclaimed = sut2.reclaim_dead_owners();
+
+	// Assert
+	EXPECT_EQ( num_of_reclaimed, static_cast<size_t>( 0 ) );
+	auto msg = sut2.try_receive( 0 );
+	ASSERT_TRUE( msg.has_value() );
+	int* p_received = static_cast<int*>( msg.value().get() );
+	EXPECT_EQ( *p_received, 12345 );
+
+	// Clean-up
+	sut2.delete_instance( p_received );
+	unlink( file_path.c_str() );
+	unlink( lifetime_ctrl_fname.c_str() );
+}
+
+TEST( Test_ipsm_malloc, PersistentFile_ChannelSizeIsChanged_ThenReinitialized )
+{
+	// Arrange
+	std::string file_path           = "/tmp/test_ipsm_malloc_persistent_" + std::to_string( getpid() );
+	std::string lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_persistent_lifetime_ctrl_" + std::to_string( getpid() );
+	{
+		ipsm::ipsm_malloc sut1( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 0, 2 );
+		sut1.send( 0, sut1.allocate( 100 ) );
+	}
+
+	// Act
+	ipsm::ipsm_malloc sut2( ipsm::persistent_file, file_path.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP, 0, 3 );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_reattached() );
+	EXPECT_EQ( sut2.channel_size(), static_cast<size_t>( 3 ) );
+	EXPECT_FALSE( sut2.try_receive( 0 ).has_value() );
+
+	// Clean-up
+	unlink( file_path.c_str() );
+	unlink( lifetime_ctrl_fname.c_str() );
+}
+
 TEST_F( TestIpsmMallocFixture, CanMoveConstruct_ThenAllocate )
 {
 	// Arrange
@@ -312,6 +647,43 @@ TEST( Test_ipsm_malloc, CanAllocateBwProcess )
 	}
 }
 
+TEST( Test_ipsm_malloc, CanReclaimBlocksOfTerminatedProcess )
+{
+	// Arrange
+	std::string       shm_name            = "/test_ipsm_malloc_owner_proc_" + std::to_string( getpid() );
+	std::string       lifetime_ctrl_fname = "/tmp/test_ipsm_malloc_owner_proc_lifetime_ctrl_" + std::to_string( getpid() );
+	ipsm::ipsm_malloc sut( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+	size_t            num_of_allocated = sut.get_stats().num_of_allocated_blocks_;
+
+	std::packaged_task<child_proc_return_t( std::function<int()> )> task1( call_pred_on_child_process );
+	std::future<child_proc_return_t>                                f1 = task1.get_future();
+
+	// Act
+	std::thread t1( std::move( task1 ), [shm_name, lifetime_ctrl_fname]() -> int {
+		ipsm::ipsm_malloc sut_secondary( shm_name.c_str(), lifetime_ctrl_fname.c_str(), 4096 * 4, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+		sut_secondary.set_owner_tracking( true );
+		for ( int i = 0; i < 10; i++ ) {
+			if ( sut_secondary.allocate( 100 ) == nullptr ) {
+				return 2;
+			}
+		}
+		_exit( 1 );   // 異常終了を模擬するため、デストラクタを実行せずに終了する。
+	} );
+	child_proc_return_t ret = { 0 };
+	ASSERT_NO_THROW( ret = f1.get() );
+	if ( t1.joinable() ) {
+		t1.join();
+	}
+	ASSERT_TRUE( ret.is_exit_normaly_ );
+	ASSERT_EQ( ret.exit_code_, 1 );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, num_of_allocated + 10 );
+	size_t num_of_reclaimed = sut.reclaim_dead_owners();
+
+	// Assert
+	EXPECT_EQ( num_of_reclaimed, static_cast<size_t>( 10 ) );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, num_of_allocated );
+}
+
 struct proc_task_data {
 	std::future<child_proc_return_t> f;
 	std::thread                      t;
@@ -9,11 +9,17 @@
  *
  */
 
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h> /* For mode constants */
 
 #include "ipsm_mem_internal.hpp"
@@ -132,6 +138,33 @@ TEST_F( TestLockFileGuard, AlreadySharedLocked_CanTrySharedLock_ThenReturnTrue )
 	EXPECT_TRUE( ret );
 }
 
+TEST_F( TestLockFileGuard, ExclusiveLocked_CanWaitForUnlock_ThenWokenUpByRelease )
+{
+	// Arrange
+	ipsm::lock_file_guard sut1( fname_, mode_ );
+	ipsm::lock_file_guard sut2( fname_, mode_ );
+	ASSERT_TRUE( sut1.try_exclusive_lock() );
+	std::uint32_t gen = sut2.get_unlock_generation();
+	ASSERT_FALSE( sut2.try_shared_lock() );
+	std::thread t1( [&sut1]() {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+		sut1.release_lock();
+	} );
+
+	// Act
+	auto tp_start = std::chrono::steady_clock::now();
+	sut2.wait_for_unlock( gen, 10000 );
+	auto tp_end = std::chrono::steady_clock::now();
+
+	// Assert
+	EXPECT_LT( tp_end - tp_start, std::chrono::milliseconds( 5000 ) );
+	EXPECT_NE( sut2.get_unlock_generation(), gen );
+	EXPECT_TRUE( sut2.try_shared_lock() );
+
+	// Clean-up
+	t1.join();
+}
+
 // ==============================================================================
 
 class TestSHMeGuard : public testing::Test {
@@ -222,6 +255,40 @@ TEST_F( TestSHMeGuard, Exist_CanOpenSharedMemory_ThenReturnTrue )
 	EXPECT_GE( sut2.mmap_length(), length_ );
 }
 
+TEST_F( TestSHMeGuard, HugetlbfsIsNotAvailable_CanCreateSharedMemory_ThenFallBackToTransparentHugePage )
+{
+	// Arrange
+	ipsm::shm_guard       sut;
+	ipsm::shm_page_config page_cfg( ipsm::ipsm_mem::page_type::hugetlbfs, "/tmp/" );   // /tmpはhugetlbfsではない
+
+	// Act
+	EXPECT_NO_THROW( sut.create( fname_, length_, mode_, 0, nullptr, page_cfg ) );
+
+	// Assert
+	EXPECT_NE( sut.get(), nullptr );
+	EXPECT_FALSE( sut.is_hugetlbfs() );
+	EXPECT_EQ( sut.page_size(), ipsm::shm_guard::get_huge_page_size() );
+	EXPECT_EQ( sut.mmap_length() % sut.page_size(), static_cast<size_t>( 0 ) );
+	EXPECT_NE( access( ( "/tmp" + fname_ ).c_str(), F_OK ), 0 );
+}
+
+TEST_F( TestSHMeGuard, CreatedWithTransparentHugePage_CanOpenSharedMemory_ThenMapWholeObject )
+{
+	// Arrange
+	ipsm::shm_guard sut1;
+	ipsm::shm_guard sut2;
+
+	sut1.create( fname_, length_, mode_, 0, nullptr, ipsm::shm_page_config( ipsm::ipsm_mem::page_type::transparent_huge, nullptr ) );
+
+	// Act
+	bool ret = sut2.open( fname_, length_, mode_ );
+
+	// Assert
+	EXPECT_TRUE( ret );
+	EXPECT_EQ( sut2.mmap_length(), sut1.mmap_length() );
+	EXPECT_EQ( sut2.page_size(), static_cast<size_t>( sysconf( _SC_PAGESIZE ) ) );
+}
+
 // ==============================================================================
 
 class TestIPSMem : public testing::Test {
@@ -290,6 +357,388 @@ TEST_F( TestIPSMem, Exist_CanSetup )
 	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 12345 );
 }
 
+TEST_F( TestIPSMem, HugePageRequested_CanSetup_ThenPeerDetectsPageSize )
+{
+	// Arrange
+	const size_t                  huge_page_size = ipsm::shm_guard::get_huge_page_size();
+	ipsm::ipsm_mem                sut1;
+	ipsm::ipsm_mem                sut2;
+	ipsm::ipsm_mem::setup_options options;
+	options.max_length      = huge_page_size * 4;
+	options.page            = ipsm::ipsm_mem::page_type::hugetlbfs;
+	options.p_hugetlbfs_dir = "/tmp";
+
+	sut1.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options );
+	*static_cast<int*>( sut1.get() ) = 12345;
+
+	// Act
+	EXPECT_NO_THROW( sut2.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options ) );
+
+	// Assert
+	EXPECT_EQ( sut1.get_page_size(), huge_page_size );
+	EXPECT_EQ( sut2.get_page_size(), sut1.get_page_size() );
+	EXPECT_EQ( sut2.available_size(), sut1.available_size() );
+	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 12345 );
+
+	ASSERT_TRUE( sut1.add_chained_segment( 1024, []( void* p, size_t s ) {} ) );
+	EXPECT_EQ( sut1.get_chained_segment_size( 0 ) % huge_page_size, static_cast<size_t>( 0 ) );
+	EXPECT_EQ( reinterpret_cast<std::uintptr_t>( sut1.get_chained_segment( 0 ) ) % huge_page_size, static_cast<std::uintptr_t>( 0 ) );
+	EXPECT_EQ( sut2.attach_chained_segments(), static_cast<size_t>( 1 ) );
+	EXPECT_EQ( sut2.get_chained_segment_size( 0 ), sut1.get_chained_segment_size( 0 ) );
+}
+
+static size_t count_resident_pages( void* p_top, size_t length )
+{
+	// mincore()は、ページ境界のアドレスを要求するため、先頭をページ境界に切り下げる。
+	const size_t               page_size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+	const std::uintptr_t       addr      = reinterpret_cast<std::uintptr_t>( p_top );
+	const std::uintptr_t       aligned   = addr - ( addr % page_size );
+	const size_t               total     = length + ( addr - aligned );
+	std::vector<unsigned char> vec( ( total + page_size - 1 ) / page_size );
+	if ( mincore( reinterpret_cast<void*>( aligned ), total, vec.data() ) != 0 ) {
+		return 0;
+	}
+	size_t ans = 0;
+	for ( auto v : vec ) {
+		ans += ( v & 1 );
+	}
+	return ans;
+}
+
+static size_t count_pages( void* p_top, size_t length )
+{
+	const size_t         page_size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+	const std::uintptr_t addr      = reinterpret_cast<std::uintptr_t>( p_top );
+	return ( ( addr % page_size ) + length + page_size - 1 ) / page_size;
+}
+
+static size_t get_locked_kbytes( void )
+{
+	std::ifstream ifs( "/proc/self/status" );
+	std::string   line;
+	while ( std::getline( ifs, line ) ) {
+		if ( line.compare( 0, 6, "VmLck:" ) == 0 ) {
+			return static_cast<size_t>( std::stoull( line.substr( 6 ) ) );
+		}
+	}
+	return 0;
+}
+
+TEST_F( TestIPSMem, PrefaultRequested_CanSetup_ThenPagesAreResident )
+{
+	const ipsm::ipsm_mem::prefault_type types[] = { ipsm::ipsm_mem::prefault_type::populate, ipsm::ipsm_mem::prefault_type::parallel };
+	for ( auto type : types ) {
+		// Arrange
+		const size_t                  length = 1024 * 1024;
+		ipsm::ipsm_mem                sut;
+		ipsm::ipsm_mem::setup_options options;
+		options.prefault = type;
+
+		// Act
+		sut.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options );
+
+		// Assert
+		EXPECT_EQ( count_resident_pages( sut.get(), sut.available_size() ), count_pages( sut.get(), sut.available_size() ) ) << static_cast<int>( type );
+	}
+}
+
+TEST_F( TestIPSMem, BackgroundPrefaultRequested_CanSetup_ThenPagesBecomeResident )
+{
+	// Arrange
+	const size_t                  length = 1024 * 1024 * 4;
+	ipsm::ipsm_mem                sut;
+	ipsm::ipsm_mem::setup_options options;
+	options.prefault = ipsm::ipsm_mem::prefault_type::background;
+
+	// Act
+	sut.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options );
+
+	// Assert
+	const size_t expect_pages = count_pages( sut.get(), sut.available_size() );
+	const auto   timeout_tp   = std::chrono::steady_clock::now() + std::chrono::seconds( 5 );
+	while ( ( count_resident_pages( sut.get(), sut.available_size() ) < expect_pages ) && ( std::chrono::steady_clock::now() < timeout_tp ) ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	EXPECT_EQ( count_resident_pages( sut.get(), sut.available_size() ), expect_pages );
+}
+
+TEST_F( TestIPSMem, BackgroundPrefaultRequested_CanDestructDuringPrefault )
+{
+	// Arrange
+	ipsm::ipsm_mem                sut;
+	ipsm::ipsm_mem::setup_options options;
+	options.prefault = ipsm::ipsm_mem::prefault_type::background;
+	sut.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), 1024 * 1024 * 64, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options );
+
+	// Act & Assert
+	EXPECT_NO_THROW( sut = ipsm::ipsm_mem() );
+}
+
+TEST_F( TestIPSMem, LockPagesRequested_CanSetup_ThenPagesAreLocked )
+{
+	// Arrange
+	const size_t                  length           = 1024 * 64;
+	const size_t                  locked_kb_before = get_locked_kbytes();
+	ipsm::ipsm_mem                sut;
+	ipsm::ipsm_mem::setup_options options;
+	options.lock_pages = true;
+
+	// Act
+	sut.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1000, 100, options );
+
+	// Assert
+	EXPECT_EQ( count_resident_pages( sut.get(), sut.available_size() ), count_pages( sut.get(), sut.available_size() ) );
+	struct rlimit rlim;
+	if ( ( geteuid() == 0 ) || ( ( getrlimit( RLIMIT_MEMLOCK, &rlim ) == 0 ) && ( rlim.rlim_cur >= length * 2 ) ) ) {
+		// mlock()がRLIMIT_MEMLOCKで失敗しない環境の場合のみ、ロックされたことを確認する。
+		EXPECT_GE( get_locked_kbytes(), locked_kb_before + length / 1024 );
+	}
+}
+
+TEST_F( TestIPSMem, PrimaryInitializing_CanSetup_ThenWokenUpWithoutRetryInterval )
+{
+	// Arrange
+	std::atomic<bool> is_initializing( false );
+	ipsm::ipsm_mem    sut1;
+	std::thread       t1( [this, &sut1, &is_initializing]() {
+        sut1.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, [&is_initializing]( void* p, size_t s ) -> size_t {
+            is_initializing.store( true );
+            std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+            return 0;
+        } );
+    } );
+	while ( !is_initializing.load() ) {
+		std::this_thread::yield();
+	}
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	auto tp_start = std::chrono::steady_clock::now();
+	EXPECT_NO_THROW( sut2.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 20000, 10000 ) );
+	auto tp_end = std::chrono::steady_clock::now();
+
+	// Assert
+	EXPECT_EQ( sut2.get_status(), ipsm::ipsm_mem::status::ready );
+	EXPECT_LT( tp_end - tp_start, std::chrono::milliseconds( 5000 ) );   // 通知がなければ、retry_interval_msecの10秒間待つことになる。
+
+	// Clean-up
+	t1.join();
+}
+
+TEST_F( TestIPSMem, OwnerIdIsNotUsed_CanCycleInstancesMoreThanProcessTable_ThenOwnerIdIsAssigned )
+{
+	// Arrange
+	ipsm::ipsm_mem sut1;
+	ASSERT_TRUE( sut1.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; } ) );
+
+	// Act
+	for ( size_t i = 0; i < ipsm::ipsm_mem::max_num_of_owners * 2; i++ ) {
+		ipsm::ipsm_mem sut_tmp;
+		ASSERT_TRUE( sut_tmp.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; } ) );
+	}
+	ipsm::ipsm_mem sut2;
+	ASSERT_TRUE( sut2.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; } ) );
+
+	// Assert
+	EXPECT_NE( sut2.get_owner_id(), 0U );   // オーナーIDを取得しなかったインスタンスのエントリは、破棄時に解放される
+	EXPECT_EQ( sut1.reclaim_dead_owners( []( unsigned int ) {} ), static_cast<size_t>( 0 ) );
+}
+
+TEST_F( TestIPSMem, OwnerIdIsUsed_CanDestruct_ThenEntryIsKeptUntilReclaimed )
+{
+	// Arrange
+	ipsm::ipsm_mem sut1;
+	ASSERT_TRUE( sut1.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; } ) );
+	unsigned int owner_id = 0;
+	{
+		ipsm::ipsm_mem sut2;
+		ASSERT_TRUE( sut2.setup( shm_name_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; } ) );
+		owner_id = sut2.get_owner_id();
+		ASSERT_NE( owner_id, 0U );
+	}
+	std::vector<unsigned int> reclaimed_ids;
+
+	// Act
+	size_t num_of_reclaimed = sut1.reclaim_dead_owners( [&reclaimed_ids]( unsigned int id ) { reclaimed_ids.push_back( id ); } );
+
+	// Assert
+	EXPECT_EQ( num_of_reclaimed, static_cast<size_t>( 1 ) );
+	ASSERT_EQ( reclaimed_ids.size(), static_cast<size_t>( 1 ) );
+	EXPECT_EQ( reclaimed_ids[0], owner_id );
+}
+
+class TestIPSMemPersistent : public testing::Test {
+protected:
+	std::string file_path_;
+	std::string lifetime_ctrl_fname_;
+	mode_t      mode_;
+	size_t      length_;
+
+	void SetUp() override
+	{
+		file_path_           = "/tmp/test_ipsm_mem_persistent_" + std::to_string( getpid() );
+		lifetime_ctrl_fname_ = "/tmp/test_ipsm_mem_persistent_lifetime_ctrl_" + std::to_string( getpid() );
+		mode_                = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP;
+		length_              = 1024;
+	}
+	void TearDown() override
+	{
+		unlink( file_path_.c_str() );
+		unlink( lifetime_ctrl_fname_.c_str() );
+	}
+
+	bool setup_persistent( ipsm::ipsm_mem& sut, std::uint64_t layout_version, int* p_num_of_init )
+	{
+		return sut.setup_persistent( file_path_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, [p_num_of_init]( void* p, size_t s ) -> size_t {
+			( *p_num_of_init )++;
+			*static_cast<int*>( p ) = 12345;
+			return 54321;
+		},
+		                             layout_version );
+	}
+};
+
+TEST_F( TestIPSMemPersistent, NotExist_CanSetupPersistent_ThenInitialized )
+{
+	// Arrange
+	ipsm::ipsm_mem sut;
+	int            num_of_init = 0;
+
+	// Act
+	ASSERT_TRUE( setup_persistent( sut, 1, &num_of_init ) );
+
+	// Assert
+	EXPECT_FALSE( sut.is_reattached() );
+	EXPECT_EQ( num_of_init, 1 );
+	EXPECT_EQ( sut.get_status(), ipsm::ipsm_mem::status::ready );
+	EXPECT_EQ( sut.get_hint_value(), static_cast<std::uintptr_t>( 54321 ) );
+	EXPECT_GE( sut.available_size(), length_ );
+	EXPECT_EQ( access( file_path_.c_str(), F_OK ), 0 );
+}
+
+TEST_F( TestIPSMemPersistent, Exist_CanSetupPersistent_ThenSharesFileWithoutReattach )
+{
+	// Arrange
+	int            num_of_init = 0;
+	ipsm::ipsm_mem sut1;
+	ASSERT_TRUE( setup_persistent( sut1, 1, &num_of_init ) );
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	ASSERT_TRUE( setup_persistent( sut2, 1, &num_of_init ) );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_reattached() );
+	EXPECT_EQ( num_of_init, 1 );
+	EXPECT_EQ( sut2.get_hint_value(), static_cast<std::uintptr_t>( 54321 ) );
+	*static_cast<int*>( sut2.get() ) = 67890;
+	EXPECT_EQ( *static_cast<int*>( sut1.get() ), 67890 );
+}
+
+TEST_F( TestIPSMemPersistent, CleanShutdown_CanSetupPersistent_ThenReattached )
+{
+	// Arrange
+	int num_of_init = 0;
+	{
+		ipsm::ipsm_mem sut1;
+		ASSERT_TRUE( setup_persistent( sut1, 1, &num_of_init ) );
+		*static_cast<int*>( sut1.get() ) = 67890;
+	}
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	ASSERT_TRUE( setup_persistent( sut2, 1, &num_of_init ) );
+
+	// Assert
+	EXPECT_TRUE( sut2.is_reattached() );
+	EXPECT_EQ( num_of_init, 1 );   // 初期化処理は呼び出されない
+	EXPECT_EQ( sut2.get_status(), ipsm::ipsm_mem::status::ready );
+	EXPECT_EQ( sut2.get_hint_value(), static_cast<std::uintptr_t>( 54321 ) );
+	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 67890 );
+}
+
+TEST_F( TestIPSMemPersistent, LayoutVersionIsChanged_CanSetupPersistent_ThenReinitialized )
+{
+	// Arrange
+	int num_of_init = 0;
+	{
+		ipsm::ipsm_mem sut1;
+		ASSERT_TRUE( setup_persistent( sut1, 1, &num_of_init ) );
+		*static_cast<int*>( sut1.get() ) = 67890;
+	}
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	ASSERT_TRUE( setup_persistent( sut2, 2, &num_of_init ) );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_reattached() );
+	EXPECT_EQ( num_of_init, 2 );
+	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 12345 );
+}
+
+TEST_F( TestIPSMemPersistent, CleanShutdown_CanSetupPersistent_ThenProcessTableIsReset )
+{
+	// Arrange
+	int num_of_init = 0;
+	{
+		ipsm::ipsm_mem sut1;
+		ASSERT_TRUE( setup_persistent( sut1, 1, &num_of_init ) );
+		ipsm::ipsm_mem sut_owner;
+		ASSERT_TRUE( setup_persistent( sut_owner, 1, &num_of_init ) );
+		ASSERT_NE( sut_owner.get_owner_id(), 0U );   // 破棄後も、エントリが残る
+	}
+	int            num_of_reattach = 0;
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	ASSERT_TRUE( sut2.setup_persistent( file_path_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_, []( void* p, size_t s ) -> size_t { return 0; }, 1, 1000, 100, ipsm::ipsm_mem::setup_options(), [&num_of_reattach]( void* p, size_t s ) {
+		num_of_reattach++;
+	} ) );
+
+	// Assert
+	EXPECT_TRUE( sut2.is_reattached() );
+	EXPECT_EQ( num_of_reattach, 1 );
+	EXPECT_EQ( sut2.reclaim_dead_owners( []( unsigned int ) {} ), static_cast<size_t>( 0 ) );   // 前回のオーナーは回収対象とならない
+}
+
+void TestIPSMemPersistent_SetupThen_ProcessAbort(
+	const char* p_file_path,             //!< [in] path of the regular file that backs the shared memory
+	const char* p_lifetime_ctrl_fname,   //!< [in] lifetime control file name.
+	size_t      length,                  //!< [in] shared memory size
+	mode_t      mode                     //!< [in] access mode. e.g. S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP
+)
+{
+	ipsm::ipsm_mem sut1;
+
+	sut1.setup_persistent( p_file_path, p_lifetime_ctrl_fname, length, mode, []( void* p, size_t s ) -> size_t { return 0; }, 1 );
+	int* p = static_cast<int*>( sut1.get() );
+	*p     = 67890;
+
+	std::cerr << "Sending myself unblockable signal" << std::endl;
+	std::abort();   // no call destructor, simulate last process abort
+}
+
+using TestIPSMemPersistentDeathTest = TestIPSMemPersistent;
+
+TEST_F( TestIPSMemPersistentDeathTest, LastProcessAbortThen_CanSetupPersistent_ThenReinitialized )
+{
+	// Arrange
+	ASSERT_EXIT( TestIPSMemPersistent_SetupThen_ProcessAbort( file_path_.c_str(), lifetime_ctrl_fname_.c_str(), length_, mode_ ),
+	             testing::KilledBySignal( SIGABRT ),
+	             "Sending myself unblockable signal" );
+	ipsm::ipsm_mem sut2;
+	int            num_of_init = 0;
+
+	// Act
+	ASSERT_TRUE( setup_persistent( sut2, 1, &num_of_init ) );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_reattached() );   // 正常終了が記録されていないため、引き継がない
+	EXPECT_EQ( num_of_init, 1 );
+	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 12345 );
+}
+
 void TestIPSMem_SetupThen_ProcessAbort(
 	const char* p_shm_name,              //!< [in] shared memory name. this string should start '/' and shorter than NAME_MAX-4
 	const char* p_lifetime_ctrl_fname,   //!< [in] lifetime control file name.
@@ -0,0 +1,236 @@
+/**
+ * @file test_ipsm_memfd_broker.cpp
+ * @author PFA03027@nifty.com
+ * @brief test memfd based shared memory that is handed over by ipsm_memfd_broker
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "ipsm_mem.hpp"
+#include "ipsm_memfd_broker.hpp"
+#include "misc_utility.hpp"
+
+// ==============================================================================
+
+class TestMemfdBroker : public testing::Test {
+protected:
+	std::string broker_name_;
+	std::string shm_name_;
+	size_t      length_;
+
+	void SetUp() override
+	{
+		broker_name_ = "test_ipsm_memfd_broker_" + std::to_string( getpid() );
+		shm_name_    = "test_ipsm_memfd_segment";
+		length_      = 1024;
+	}
+
+	/**
+	 * @brief wait until the broker releases the segments, because the broker handles the disconnection asynchronously
+	 */
+	static size_t wait_for_num_of_segments( const ipsm::ipsm_memfd_broker& broker, size_t expect )
+	{
+		for ( int i = 0; i < 100; i++ ) {
+			if ( broker.get_num_of_segments() == expect ) {
+				break;
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		}
+		return broker.get_num_of_segments();
+	}
+};
+
+TEST_F( TestMemfdBroker, CanConstruct )
+{
+	// Arrange
+
+	// Act
+	ipsm::ipsm_memfd_broker sut( broker_name_.c_str() );
+
+	// Assert
+	EXPECT_EQ( sut.get_num_of_segments(), static_cast<size_t>( 0 ) );
+}
+
+TEST_F( TestMemfdBroker, SameNameBrokerIsRunning_CanNotConstruct )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+
+	// Act & Assert
+	EXPECT_THROW( ipsm::ipsm_memfd_broker sut( broker_name_.c_str() ), ipsm::ipsm_mem_error );
+}
+
+TEST_F( TestMemfdBroker, NoBroker_CanNotSetup_ThenTimeout )
+{
+	// Arrange
+	ipsm::ipsm_mem sut;
+
+	// Act
+	bool ret = sut.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, []( void*, size_t ) -> size_t { return 0; }, 100, 10 );
+
+	// Assert
+	EXPECT_FALSE( ret );
+	EXPECT_EQ( sut.get(), nullptr );
+}
+
+TEST_F( TestMemfdBroker, CanSetupMemfd_ThenPeerSharesSegment )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+	std::atomic<int>        num_of_init( 0 );
+	auto                    init_functor = [&num_of_init]( void* p, size_t s ) -> size_t {
+        num_of_init++;
+        *static_cast<int*>( p ) = 12345;
+        return 54321;
+	};
+	ipsm::ipsm_mem sut1;
+	ipsm::ipsm_mem sut2;
+
+	// Act
+	ASSERT_TRUE( sut1.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, init_functor ) );
+	ASSERT_TRUE( sut2.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, init_functor ) );
+
+	// Assert
+	EXPECT_EQ( num_of_init.load(), 1 );
+	EXPECT_EQ( broker.get_num_of_segments(), static_cast<size_t>( 1 ) );
+	EXPECT_EQ( sut2.get_status(), ipsm::ipsm_mem::status::ready );
+	EXPECT_EQ( sut2.get_hint_value(), static_cast<std::uintptr_t>( 54321 ) );
+	EXPECT_GE( sut2.available_size(), length_ );
+	EXPECT_NE( sut1.get(), sut2.get() );   // 別々にマッピングされる
+	EXPECT_EQ( *static_cast<int*>( sut2.get() ), 12345 );
+	*static_cast<int*>( sut2.get() ) = 67890;
+	EXPECT_EQ( *static_cast<int*>( sut1.get() ), 67890 );
+	EXPECT_NE( sut1.get_owner_id(), sut2.get_owner_id() );
+}
+
+TEST_F( TestMemfdBroker, AllInstancesAreDestructed_ThenSegmentIsReleased )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+	std::atomic<int>        num_of_init( 0 );
+	auto                    init_functor = [&num_of_init]( void* p, size_t s ) -> size_t {
+        num_of_init++;
+        return 0;
+	};
+	{
+		ipsm::ipsm_mem sut1;
+		ipsm::ipsm_mem sut2;
+		ASSERT_TRUE( sut1.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, init_functor ) );
+		ASSERT_TRUE( sut2.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, init_functor ) );
+		ipsm::ipsm_mem().swap( sut1 );   // 一方を破棄しても、セグメントは保持される
+		std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		EXPECT_EQ( broker.get_num_of_segments(), static_cast<size_t>( 1 ) );
+	}
+
+	// Act
+	size_t num_of_segments = wait_for_num_of_segments( broker, 0 );
+
+	// Assert
+	EXPECT_EQ( num_of_segments, static_cast<size_t>( 0 ) );
+	ipsm::ipsm_mem sut3;
+	ASSERT_TRUE( sut3.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, init_functor ) );
+	EXPECT_EQ( num_of_init.load(), 2 );   // 新たなセグメントとして初期化される
+}
+
+TEST_F( TestMemfdBroker, BiggerThanExistingSegment_CanNotSetup )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+	ipsm::ipsm_mem          sut1;
+	ASSERT_TRUE( sut1.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, []( void*, size_t ) -> size_t { return 0; } ) );
+	ipsm::ipsm_mem sut2;
+
+	// Act & Assert
+	EXPECT_THROW( sut2.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_ * 1024, []( void*, size_t ) -> size_t { return 0; } ), ipsm::ipsm_mem_error );
+}
+
+TEST_F( TestMemfdBroker, InitializerFails_ThenWaitingPeerRetriesWithNewSegment )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+	std::atomic<bool>       is_in_init( false );
+	std::atomic<bool>       is_go_fail( false );
+	std::thread             initializer( [this, &is_in_init, &is_go_fail]() {
+        ipsm::ipsm_mem sut1;
+        EXPECT_THROW( sut1.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, [&is_in_init, &is_go_fail]( void*, size_t ) -> size_t {
+			is_in_init.store( true );
+			while ( !is_go_fail.load() ) {
+				std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+			}
+			throw std::runtime_error( "initialization failure for test" );
+		} ),
+		              std::runtime_error );
+	} );
+	while ( !is_in_init.load() ) {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	std::thread fail_trigger( [&is_go_fail]() {
+		std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+		is_go_fail.store( true );
+	} );
+	std::atomic<int> num_of_init( 0 );
+	ipsm::ipsm_mem   sut2;
+
+	// Act
+	bool ret = sut2.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, [&num_of_init]( void*, size_t ) -> size_t {
+		num_of_init++;
+		return 0;
+	} );
+
+	// Assert
+	EXPECT_TRUE( ret );
+	EXPECT_EQ( num_of_init.load(), 1 );
+	EXPECT_EQ( sut2.get_status(), ipsm::ipsm_mem::status::ready );
+
+	// Cleanup
+	fail_trigger.join();
+	initializer.join();
+}
+
+TEST_F( TestMemfdBroker, ForkedProcess_CanSetupMemfd_ThenSharesSegment )
+{
+	// Arrange
+	ipsm::ipsm_memfd_broker broker( broker_name_.c_str() );
+	ipsm::ipsm_mem          sut;
+	ASSERT_TRUE( sut.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, []( void* p, size_t ) -> size_t {
+		*static_cast<int*>( p ) = 12345;
+		return 0;
+	} ) );
+
+	// Act
+	pid_t pid = fork();
+	ASSERT_GE( pid, 0 );
+	if ( pid == 0 ) {
+		// 子プロセスは、親プロセスのインスタンスを使わずに、ブローカーから改めてセグメントを受け取る。
+		ipsm::ipsm_mem peer;
+		if ( !peer.setup_memfd( broker_name_.c_str(), shm_name_.c_str(), length_, []( void*, size_t ) -> size_t { return 0; } ) ) {
+			_exit( 1 );
+		}
+		if ( *static_cast<int*>( peer.get() ) != 12345 ) {
+			_exit( 2 );
+		}
+		*static_cast<int*>( peer.get() ) = 67890;
+		_exit( 0 );
+	}
+	int status = 0;
+	ASSERT_EQ( waitpid( pid, &status, 0 ), pid );
+
+	// Assert
+	ASSERT_TRUE( WIFEXITED( status ) );
+	EXPECT_EQ( WEXITSTATUS( status ), 0 );
+	EXPECT_EQ( *static_cast<int*>( sut.get() ), 67890 );
+}
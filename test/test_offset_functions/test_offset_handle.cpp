@@ -0,0 +1,310 @@
+/**
+ * @file test_offset_handle.cpp
+ * @author PFA03027@nifty.com
+ * @brief test handle based movable memory blocks and the compaction of them
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "offset_handle.hpp"
+#include "offset_malloc.hpp"
+#include "offset_mallloc_impl.hpp"
+
+#include "test_ipsm_common.hpp"
+
+struct HandleTestData {
+	size_t                 id_;
+	std::array<char, 1000> payload_;
+};
+
+class Offset_Handle : public Offset_Malloc_Heap_Fixture {
+protected:
+	/**
+	 * @brief fill the heap by handles, then release every other handle to fragment the heap
+	 */
+	std::vector<ipsm::offset_handle<HandleTestData>> make_fragmented_heap( ipsm::offset_handle_table& sut )
+	{
+		std::vector<ipsm::offset_handle<HandleTestData>> handles;
+		while ( true ) {
+			try {
+				handles.push_back( sut.new_handle<HandleTestData>( HandleTestData { handles.size(), {} } ) );
+			} catch ( std::bad_alloc& ) {
+				break;
+			}
+		}
+		std::vector<ipsm::offset_handle<HandleTestData>> ans;
+		for ( size_t i = 0; i < handles.size(); i++ ) {
+			if ( ( i % 2 ) == 0 ) {
+				sut.delete_handle( handles[i] );
+			} else {
+				ans.push_back( handles[i] );
+			}
+		}
+		return ans;
+	}
+};
+
+TEST_F( Offset_Handle, CanConstruct )
+{
+	// Arrange
+
+	// Act
+	ipsm::offset_handle_table sut( om_, 10 );
+
+	// Assert
+	EXPECT_EQ( sut.capacity(), static_cast<size_t>( 10 ) );
+	EXPECT_EQ( sut.get_num_of_handles(), static_cast<size_t>( 0 ) );
+}
+
+TEST_F( Offset_Handle, CanNewHandle_ThenPin )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 10 );
+
+	// Act
+	auto h = sut.new_handle<int>( 123 );
+
+	// Assert
+	ASSERT_TRUE( h );
+	EXPECT_EQ( sut.get_num_of_handles(), static_cast<size_t>( 1 ) );
+	{
+		auto pp = h.pin();
+		ASSERT_TRUE( pp );
+		EXPECT_EQ( *pp, 123 );
+	}
+
+	// Clean-up
+	sut.delete_handle( h );
+	EXPECT_FALSE( h );
+	EXPECT_EQ( sut.get_num_of_handles(), static_cast<size_t>( 0 ) );
+}
+
+TEST_F( Offset_Handle, FailNewHandleWhenNoSlot )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 1 );
+	auto                      h = sut.new_handle<int>( 1 );
+
+	// Act
+	EXPECT_THROW( sut.new_handle<int>( 2 ), std::bad_alloc );
+
+	// Assert
+	sut.delete_handle( h );
+}
+
+TEST_F( Offset_Handle, CanCompactFragmentedHeap )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 128 );
+	auto                      live_handles = make_fragmented_heap( sut );
+	ASSERT_GT( live_handles.size(), static_cast<size_t>( 10 ) );
+	void* p_fail = om_.allocate( 1024 * 8 );
+	ASSERT_EQ( p_fail, nullptr );   // 空き容量の合計は足りているが、断片化しているため確保できない。
+
+	// Act
+	size_t num_of_moved = sut.compact();
+
+	// Assert
+	EXPECT_GT( num_of_moved, static_cast<size_t>( 0 ) );
+	void* p_big = om_.allocate( 1024 * 8 );
+	EXPECT_NE( p_big, nullptr );
+	for ( auto& h : live_handles ) {
+		auto pp = h.pin();
+		ASSERT_TRUE( pp );
+		EXPECT_EQ( pp->id_ % 2, static_cast<size_t>( 1 ) );
+	}
+	size_t expect_id = 1;
+	for ( auto& h : live_handles ) {
+		EXPECT_EQ( h.pin()->id_, expect_id );
+		expect_id += 2;
+	}
+
+	// Clean-up
+	om_.deallocate( p_big );
+	for ( auto& h : live_handles ) {
+		sut.delete_handle( h );
+	}
+}
+
+TEST_F( Offset_Handle, PinnedBlockIsNotMoved )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 128 );
+	auto                      live_handles = make_fragmented_heap( sut );
+	ASSERT_GT( live_handles.size(), static_cast<size_t>( 0 ) );
+	auto            pp_pinned = live_handles.front().pin();   // 先に確保したブロックほど高いアドレスにあり、移動の対象になる。
+	HandleTestData* p_before  = pp_pinned.get();
+
+	// Act
+	sut.compact();
+
+	// Assert
+	EXPECT_EQ( pp_pinned.get(), p_before );
+	pp_pinned.reset();
+	sut.compact();
+	EXPECT_NE( live_handles.front().pin().get(), p_before );
+
+	// Clean-up
+	for ( auto& h : live_handles ) {
+		sut.delete_handle( h );
+	}
+}
+
+TEST_F( Offset_Handle, CanPinDuringCompaction )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 128 );
+	auto                      live_handles = make_fragmented_heap( sut );
+	std::atomic<bool>         loop_flag( true );
+	std::atomic<size_t>       num_of_errors( 0 );
+
+	// Act
+	std::thread reader( [&live_handles, &loop_flag, &num_of_errors]() {
+		while ( loop_flag.load() ) {
+			for ( size_t i = 0; i < live_handles.size(); i++ ) {
+				auto pp = live_handles[i].pin();
+				if ( pp->id_ != ( i * 2 + 1 ) ) {
+					num_of_errors++;
+				}
+			}
+		}
+	} );
+	for ( int i = 0; i < 10; i++ ) {
+		sut.compact();
+	}
+	loop_flag.store( false );
+	reader.join();
+
+	// Assert
+	EXPECT_EQ( num_of_errors.load(), static_cast<size_t>( 0 ) );
+
+	// Clean-up
+	for ( auto& h : live_handles ) {
+		sut.delete_handle( h );
+	}
+}
+
+TEST_F( Offset_Handle, FailDeleteHandleWhilePinned )
+{
+	// Arrange
+	ipsm::offset_handle_table sut( om_, 4 );
+	auto                      h  = sut.new_handle<int>( 1 );
+	auto                      pp = h.pin();
+
+	// Act
+	bool ret = sut.delete_handle( h, 10 );
+
+	// Assert
+	EXPECT_FALSE( ret );
+	EXPECT_TRUE( h );
+	EXPECT_EQ( sut.get_num_of_handles(), static_cast<size_t>( 1 ) );
+	pp.reset();
+	EXPECT_TRUE( sut.delete_handle( h ) );
+	EXPECT_FALSE( h );
+	EXPECT_EQ( sut.get_num_of_handles(), static_cast<size_t>( 0 ) );
+}
+
+TEST( Offset_Handle_Recovery, CanPinAfterOwnerDiedDuringCompaction )
+{
+	// Arrange
+	constexpr size_t buff_size = 1024 * 64;
+	void*            p_mem     = mmap( nullptr, buff_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	ASSERT_NE( p_mem, MAP_FAILED );
+	ipsm::offset_malloc        om( p_mem, buff_size );
+	ipsm::offset_handle_table* p_sut = om.new_instance<ipsm::offset_handle_table>( om, static_cast<size_t>( 4 ) );
+	auto                       h1    = p_sut->new_handle<HandleTestData>( HandleTestData { 1, {} } );
+	auto                       h2    = p_sut->new_handle<HandleTestData>( HandleTestData { 2, {} } );
+	p_sut->delete_handle( h1 );   // h2を低いアドレスへ移動できるようにする。
+
+	// Act
+	// 子プロセスは、コンパクションでh2を移動している途中で、mutexを保持したまま終了する。
+	child_proc_return_t ret = call_pred_on_child_process( [p_sut]() -> int {
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( []( size_t ) {
+			_exit( 0 );
+		} );
+		p_sut->compact();
+		return 1;
+	} );
+
+	// Assert
+	ASSERT_TRUE( ret.is_exit_normaly_ );
+	ASSERT_EQ( ret.exit_code_, 0 );
+	{
+		auto pp = h2.pin();   // 移動中のまま残ったスロットは、mutexの取得で回復されるため、待ち続けない。
+		ASSERT_TRUE( pp );
+		EXPECT_EQ( pp->id_, static_cast<size_t>( 2 ) );
+	}
+	EXPECT_EQ( p_sut->get_num_of_handles(), static_cast<size_t>( 1 ) );
+	EXPECT_TRUE( p_sut->delete_handle( h2 ) );
+
+	// Clean-up
+	om.delete_instance( p_sut );
+	om = ipsm::offset_malloc();
+	munmap( p_mem, buff_size );
+}
+
+static size_t num_of_records_to_die = 0;   // 子プロセスが終了するまでの取り消しエントリの記録回数
+
+TEST( Offset_Handle_Recovery, CanPinMovedDataAfterOwnerDiedAtAnyPointOfCompaction )
+{
+	constexpr size_t buff_size    = 1024 * 64;
+	bool             is_completed = false;
+	for ( size_t die_at = 1; !is_completed; die_at++ ) {
+		// Arrange
+		void* p_mem = mmap( nullptr, buff_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		ASSERT_NE( p_mem, MAP_FAILED );
+		ipsm::offset_malloc        om( p_mem, buff_size );
+		ipsm::offset_handle_table* p_sut = om.new_instance<ipsm::offset_handle_table>( om, static_cast<size_t>( 4 ) );
+		auto                       h1    = p_sut->new_handle<HandleTestData>( HandleTestData { 1, {} } );
+		HandleTestData             data2 { 2, {} };
+		data2.payload_.fill( 'x' );
+		auto h2 = p_sut->new_handle<HandleTestData>( data2 );
+		p_sut->delete_handle( h1 );   // h2を低いアドレスへ移動できるようにする。
+		num_of_records_to_die = die_at;
+
+		// Act
+		// 子プロセスは、コンパクションでh2を移動している途中の、die_at回目の取り消しエントリの記録で、mutexを保持したまま終了する。
+		child_proc_return_t ret = call_pred_on_child_process( [p_sut]() -> int {
+			ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( []( size_t ) {
+				num_of_records_to_die--;
+				if ( num_of_records_to_die == 0 ) {
+					_exit( 0 );
+				}
+			} );
+			p_sut->compact();
+			return 1;
+		} );
+
+		// Assert
+		ASSERT_TRUE( ret.is_exit_normaly_ );
+		is_completed = ( ret.exit_code_ == 1 );
+		{
+			// 取り消された場合は移動前の、完了した場合は移動後のブロックを参照し、どちらでも内容は壊れていない。
+			auto pp = h2.pin();
+			ASSERT_TRUE( pp ) << "die_at=" << die_at;
+			EXPECT_EQ( pp->id_, static_cast<size_t>( 2 ) ) << "die_at=" << die_at;
+			EXPECT_EQ( pp->payload_, data2.payload_ ) << "die_at=" << die_at;
+		}
+		EXPECT_EQ( p_sut->get_num_of_handles(), static_cast<size_t>( 1 ) );
+		EXPECT_TRUE( p_sut->delete_handle( h2 ) );
+
+		// Clean-up
+		om.delete_instance( p_sut );
+		EXPECT_EQ( om.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) ) << "die_at=" << die_at;
+		om = ipsm::offset_malloc();
+		munmap( p_mem, buff_size );
+	}
+}
@@ -9,9 +9,21 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <future>
+#include <memory>
 #include <mutex>
+#include <random>
+#include <set>
 #include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -272,51 +284,1529 @@ TEST_F( Offset_Malloc, CanDeallocate2 )
 	// Assert
 }
 
-TEST( Offset_Malloc_Highload, CanMulti_Thread_Calling )
+TEST( Offset_Malloc_Policy, CanAllocateWithBestFit )
 {
 	// Arrange
-	const size_t      alloc_size      = 11;
-	constexpr int     test_thread_num = 100;
-	constexpr size_t  buff_size       = alloc_size * 100 * test_thread_num;
-	std::atomic<bool> loop_flag( true );
+	unsigned char       test_buff[2048];
+	ipsm::offset_malloc sut( reinterpret_cast<void*>( test_buff ), 2048, ipsm::offset_malloc_policy::kBestFit );
 
-	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );   // 4MBytes
-	void*                            p_mem = reinterpret_cast<void*>( up_buff.get() );
-	ipsm::offset_malloc              sut( p_mem, buff_size );
+	// Act
+	void* p_allc_mem1 = sut.allocate( 300 );
+	void* p_allc_mem2 = sut.allocate( 10 );
+	void* p_allc_mem3 = sut.allocate( 300 );
+	void* p_allc_mem4 = sut.allocate( 10 );
+	ASSERT_NE( p_allc_mem1, nullptr );
+	ASSERT_NE( p_allc_mem2, nullptr );
+	ASSERT_NE( p_allc_mem3, nullptr );
+	ASSERT_NE( p_allc_mem4, nullptr );
+	sut.deallocate( p_allc_mem1 );
+	sut.deallocate( p_allc_mem3 );
+	void* p_allc_mem5 = sut.allocate( 300 );
 
-	std::packaged_task<int( ipsm::offset_malloc )> fail_count_tasks[test_thread_num];
-	std::future<int>                               fail_count_task_results[test_thread_num];
-	std::thread                                    thread_array[test_thread_num];
+	// Assert
+	EXPECT_TRUE( ( p_allc_mem5 == p_allc_mem1 ) || ( p_allc_mem5 == p_allc_mem3 ) );   // 余りの大きな空きブロックではなく、同じサイズの空きブロックが選択される
+
+	// Clean-up
+	sut.deallocate( p_allc_mem2 );
+	sut.deallocate( p_allc_mem4 );
+	sut.deallocate( p_allc_mem5 );
+}
+
+namespace {
+
+struct alloc_trace_op {
+	bool   is_alloc_;   // true: allocate, false: deallocate
+	size_t value_;      // allocate: request bytes, deallocate: index of allocate operation to free
+};
+
+std::vector<alloc_trace_op> make_mixed_size_trace( void )
+{
+	std::vector<alloc_trace_op>           ans;
+	std::vector<size_t>                   live_alloc_idx;
+	std::mt19937                          engine( 20240601 );
+	std::uniform_int_distribution<int>    op_dist( 0, 9 );
+	std::uniform_int_distribution<size_t> small_dist( 300, 1024 );
+	std::uniform_int_distribution<size_t> large_dist( 2048, 8192 );
+
+	for ( int i = 0; i < 20000; i++ ) {
+		if ( live_alloc_idx.empty() || ( op_dist( engine ) < 5 ) ) {
+			size_t sz = ( op_dist( engine ) < 7 ) ? small_dist( engine ) : large_dist( engine );
+			live_alloc_idx.push_back( ans.size() );
+			ans.push_back( alloc_trace_op { true, sz } );
+		} else {
+			std::uniform_int_distribution<size_t> idx_dist( 0, live_alloc_idx.size() - 1 );
+			size_t                                idx = idx_dist( engine );
+			ans.push_back( alloc_trace_op { false, live_alloc_idx[idx] } );
+			live_alloc_idx[idx] = live_alloc_idx.back();
+			live_alloc_idx.pop_back();
+		}
+	}
+	return ans;
+}
+
+size_t replay_trace_and_get_peak_usable_bytes( ipsm::offset_malloc_policy policy, const std::vector<alloc_trace_op>& trace )
+{
+	constexpr size_t           buff_size = 1024 * 128;
+	std::vector<unsigned char> buff( buff_size );
+	ipsm::offset_malloc        sut( buff.data(), buff_size, policy );
+
+	std::vector<void*> allocated( trace.size(), nullptr );
+	size_t             cur_usable_bytes  = 0;
+	size_t             peak_usable_bytes = 0;
+	for ( size_t i = 0; i < trace.size(); i++ ) {
+		if ( trace[i].is_alloc_ ) {
+			allocated[i] = sut.allocate( trace[i].value_ );
+			if ( allocated[i] != nullptr ) {
+				cur_usable_bytes += trace[i].value_;
+				peak_usable_bytes = std::max( peak_usable_bytes, cur_usable_bytes );
+			}
+		} else {
+			size_t alloc_idx = trace[i].value_;
+			if ( allocated[alloc_idx] != nullptr ) {
+				sut.deallocate( allocated[alloc_idx] );
+				allocated[alloc_idx] = nullptr;
+				cur_usable_bytes -= trace[alloc_idx].value_;
+			}
+		}
+	}
+	for ( auto& p : allocated ) {
+		if ( p != nullptr ) {
+			sut.deallocate( p );
+		}
+	}
+	return peak_usable_bytes;
+}
+
+}   // namespace
+
+TEST( Offset_Malloc_Policy, BestFitKeepsPeakUsableMemoryOfFirstFit )
+{
+	// Arrange
+	std::vector<alloc_trace_op> trace = make_mixed_size_trace();
 
 	// Act
-	for ( int i = 0; i < test_thread_num; i++ ) {
-		fail_count_tasks[i]        = std::packaged_task<int( ipsm::offset_malloc )>( [&loop_flag]( ipsm::offset_malloc ttsut ) -> int {
-            int fail_count_ret = 0;
-            while ( loop_flag.load() ) {
-                auto p_ret = ttsut.allocate( 11 );
-                if ( p_ret == nullptr ) {
-                    fail_count_ret++;
-                }
-                ttsut.deallocate( p_ret );
-            }
+	size_t first_fit_peak = replay_trace_and_get_peak_usable_bytes( ipsm::offset_malloc_policy::kFirstFit, trace );
+	size_t best_fit_peak  = replay_trace_and_get_peak_usable_bytes( ipsm::offset_malloc_policy::kBestFit, trace );
 
-            return fail_count_ret;
-        } );
-		fail_count_task_results[i] = fail_count_tasks[i].get_future();
-		thread_array[i]            = std::thread( std::move( fail_count_tasks[i] ), sut );
+	// Assert
+	printf( "peak usable bytes: first-fit=%zu, best-fit=%zu\n", first_fit_peak, best_fit_peak );
+	EXPECT_GE( best_fit_peak, first_fit_peak );
+}
+
+TEST( Offset_Malloc_ThreadCache, CanReuseCachedBlock )
+{
+	// Arrange
+	unsigned char       test_buff[2048];   // 補充の一括割り当てが、すべて成功する大きさ
+	ipsm::offset_malloc sut( reinterpret_cast<void*>( test_buff ), 2048 );
+	sut.set_thread_cache( true );
+	void* p_allc_mem1 = sut.allocate( 10 );
+	ASSERT_NE( p_allc_mem1, nullptr );
+	sut.deallocate( p_allc_mem1 );
+
+	// Act
+	void* p_allc_mem2 = sut.allocate( 10 );
+
+	// Assert
+	EXPECT_TRUE( sut.is_thread_cache_enabled() );
+	EXPECT_EQ( p_allc_mem1, p_allc_mem2 );
+
+	// Clean-up
+	sut.deallocate( p_allc_mem2 );
+}
+
+TEST( Offset_Malloc_ThreadCache, CopyDoesNotUseThreadCache )
+{
+	// Arrange
+	unsigned char       test_buff[1024];
+	ipsm::offset_malloc sut( reinterpret_cast<void*>( test_buff ), 1024 );
+	sut.set_thread_cache( true );
+
+	// Act
+	ipsm::offset_malloc sut2( sut );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_thread_cache_enabled() );
+}
+
+class Offset_Malloc_ThreadCacheDrain : public Offset_Malloc_Heap_Fixture {
+public:
+	static constexpr size_t big_size   = 1024 * 60;
+	static constexpr size_t small_size = 200;
+	static constexpr size_t small_num  = 250;
+
+	static void alloc_and_free_small_blocks( ipsm::offset_malloc& om )
+	{
+		std::vector<void*> allocated;
+		for ( size_t i = 0; i < small_num; i++ ) {
+			allocated.push_back( om.allocate( small_size ) );
+		}
+		for ( auto& p : allocated ) {
+			om.deallocate( p );
+		}
 	}
-	std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
-	loop_flag.store( false );
+};
+
+TEST_F( Offset_Malloc_ThreadCacheDrain, CanDrainOnThreadExit )
+{
+	// Arrange
+	ipsm::offset_malloc cached_om( om_ );
+	cached_om.set_thread_cache( true );
+
+	// Act
+	std::thread t( [&cached_om]() {
+		alloc_and_free_small_blocks( cached_om );
+	} );
+	t.join();
 
 	// Assert
-	for ( auto& e : thread_array ) {
-		if ( e.joinable() ) {
-			e.join();
+	void* p_big_mem = om_.allocate( big_size );
+	EXPECT_NE( p_big_mem, nullptr );
+
+	// Clean-up
+	om_.deallocate( p_big_mem );
+}
+
+TEST_F( Offset_Malloc_ThreadCacheDrain, CanDrainOnDestruction )
+{
+	// Arrange
+	{
+		ipsm::offset_malloc cached_om( om_ );
+		cached_om.set_thread_cache( true );
+		alloc_and_free_small_blocks( cached_om );
+
+		// Act
+	}
+
+	// Assert
+	void* p_big_mem = om_.allocate( big_size );
+	EXPECT_NE( p_big_mem, nullptr );
+
+	// Clean-up
+	om_.deallocate( p_big_mem );
+}
+
+TEST_F( Offset_Malloc_ThreadCacheDrain, CanDrainOnDisable )
+{
+	// Arrange
+	ipsm::offset_malloc cached_om( om_ );
+	cached_om.set_thread_cache( true );
+	alloc_and_free_small_blocks( cached_om );
+
+	// Act
+	cached_om.set_thread_cache( false );
+
+	// Assert
+	void* p_big_mem = om_.allocate( big_size );
+	EXPECT_NE( p_big_mem, nullptr );
+
+	// Clean-up
+	om_.deallocate( p_big_mem );
+}
+
+TEST( Offset_Malloc_ThreadCache, ForkedChild_DoesNotReuseCachedBlockOfParent )
+{
+	// Arrange
+	constexpr size_t buff_size = 1024 * 64;
+	void*            p_buff    = mmap( nullptr, buff_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	ASSERT_NE( p_buff, MAP_FAILED );
+	int pipe_fds[2];
+	ASSERT_EQ( pipe( pipe_fds ), 0 );
+	{
+		ipsm::offset_malloc sut( p_buff, buff_size );
+		sut.set_thread_cache( true );
+		sut.deallocate( sut.allocate( 64 ) );   // 親プロセスのスレッドキャッシュに、メモリブロックを保持させる
+
+		// Act
+		pid_t pid = fork();
+		ASSERT_GE( pid, 0 );
+		if ( pid == 0 ) {
+			// 子プロセスは、親プロセスから引き継いだキャッシュを使わずに、ヒープから確保する。
+			void* p_child = sut.allocate( 64 );
+			ssize_t ret   = write( pipe_fds[1], &p_child, sizeof( p_child ) );
+			_exit( ( ret == static_cast<ssize_t>( sizeof( p_child ) ) ) ? 0 : 1 );
 		}
+		void* p_child = nullptr;
+		ASSERT_EQ( read( pipe_fds[0], &p_child, sizeof( p_child ) ), static_cast<ssize_t>( sizeof( p_child ) ) );
+		int status = 0;
+		ASSERT_EQ( waitpid( pid, &status, 0 ), pid );
+		void* p_parent = sut.allocate( 64 );
+
+		// Assert
+		ASSERT_TRUE( WIFEXITED( status ) );
+		EXPECT_EQ( WEXITSTATUS( status ), 0 );
+		EXPECT_NE( p_child, nullptr );
+		EXPECT_NE( p_child, p_parent );
+
+		// Clean-up
+		sut.deallocate( p_parent );
 	}
-	int final_fail_count_result = 0;
-	for ( auto& e : fail_count_task_results ) {
-		final_fail_count_result += e.get();
+	close( pipe_fds[0] );
+	close( pipe_fds[1] );
+	munmap( p_buff, buff_size );
+}
+
+class Offset_Malloc_Deferred : public Offset_Malloc_Heap_Fixture {};
+
+TEST_F( Offset_Malloc_Deferred, CanDeferDeallocationUntilNextAllocation )
+{
+	// Arrange
+	ipsm::offset_malloc deferred_om( om_ );
+	deferred_om.set_deferred_free( true );
+	void* p = om_.allocate( 1000 );
+	ASSERT_NE( p, nullptr );
+	size_t num_of_allocated = om_.get_stats().num_of_allocated_blocks_;
+
+	// Act
+	deferred_om.deallocate( p );
+
+	// Assert
+	EXPECT_TRUE( deferred_om.is_deferred_free_enabled() );
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, num_of_allocated );
+	void* p2 = om_.allocate( 1000 );   // 回収されたブロックが結合されていれば、同じ位置から確保される。
+	EXPECT_EQ( p2, p );
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, num_of_allocated );
+
+	// Clean-up
+	om_.deallocate( p2 );
+}
+
+TEST_F( Offset_Malloc_Deferred, CanDrainByThreshold )
+{
+	// Arrange
+	ipsm::offset_malloc deferred_om( om_ );
+	deferred_om.set_deferred_free( true );
+	std::vector<void*>  allocated;
+	for ( int i = 0; i < 100; i++ ) {
+		allocated.push_back( om_.allocate( 100 ) );
 	}
-	EXPECT_EQ( final_fail_count_result, 0 );
+
+	// Act
+	for ( auto p : allocated ) {
+		deferred_om.deallocate( p );
+	}
+
+	// Assert
+	// 閾値に達した時点で解放側が回収するため、残りは閾値未満となる。
+	EXPECT_LT( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 64 ) );
+
+	// Clean-up
+	deferred_om.set_deferred_free( false );
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+}
+
+TEST_F( Offset_Malloc_Deferred, CanDrainOnDestruction )
+{
+	// Arrange
+	void* p = om_.allocate( 100 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	{
+		ipsm::offset_malloc deferred_om( om_ );
+		deferred_om.set_deferred_free( true );
+		deferred_om.deallocate( p );
+	}
+
+	// Assert
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+}
+
+TEST_F( Offset_Malloc_Deferred, CopyDoesNotUseDeferredFree )
+{
+	// Arrange
+	om_.set_deferred_free( true );
+
+	// Act
+	ipsm::offset_malloc sut2( om_ );
+
+	// Assert
+	EXPECT_FALSE( sut2.is_deferred_free_enabled() );
+}
+
+TEST_F( Offset_Malloc_Deferred, CanMultiThreadProducerConsumer )
+{
+	// Arrange
+	constexpr int       num_of_consumers = 4;
+	constexpr int       loop_num         = 10000;
+	ipsm::offset_malloc deferred_om( om_ );
+	deferred_om.set_deferred_free( true );
+	std::vector<std::vector<void*>> blocks( num_of_consumers );
+	for ( int i = 0; i < loop_num; i++ ) {
+		void* p = om_.allocate( 32 );
+		if ( p == nullptr ) {
+			break;
+		}
+		blocks[static_cast<size_t>( i % num_of_consumers )].push_back( p );
+	}
+
+	// Act
+	std::atomic<bool>        start( false );
+	std::vector<std::thread> threads;
+	for ( auto& v : blocks ) {
+		threads.emplace_back( [&deferred_om, &v, &start]() {
+			while ( !start.load() ) {
+				std::this_thread::yield();
+			}
+			for ( auto p : v ) {
+				deferred_om.deallocate( p );
+			}
+		} );
+	}
+	threads.emplace_back( [this, &start]() {
+		while ( !start.load() ) {
+			std::this_thread::yield();
+		}
+		for ( int i = 0; i < loop_num; i++ ) {
+			// ヒープは使い切っているため、解放側がブロックを積むまでは確保に失敗しうる。
+			void* p = om_.allocate( 16 );
+			if ( p != nullptr ) {
+				om_.deallocate( p );
+			}
+		}
+	} );
+	start.store( true );
+	for ( auto& t : threads ) {
+		t.join();
+	}
+
+	// Assert
+	deferred_om.set_deferred_free( false );
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+}
+
+class Offset_Malloc_DeferredCoalescing : public Offset_Malloc_Heap_Fixture {
+public:
+	static constexpr size_t large_size = 1000;   // サイズクラスより大きなブロック
+
+	void SetUp() override
+	{
+		Offset_Malloc_Heap_Fixture::SetUp();
+		om_.set_deferred_coalescing( true );
+	}
+};
+
+TEST_F( Offset_Malloc_DeferredCoalescing, CanReuseUncoalescedBlock )
+{
+	// Arrange
+	void* p1 = om_.allocate( large_size );
+	void* p2 = om_.allocate( large_size );
+	ASSERT_NE( p1, nullptr );
+	ASSERT_NE( p2, nullptr );
+
+	// Act
+	om_.deallocate( p1 );
+	om_.deallocate( p2 );
+	ipsm::offset_malloc_stats ret = om_.get_stats();
+	void*                     p3  = om_.allocate( large_size );
+
+	// Assert
+	EXPECT_TRUE( om_.is_deferred_coalescing_enabled() );
+	EXPECT_EQ( ret.num_of_free_blocks_, static_cast<size_t>( 3 ) );   // 隣接する2つのブロックと残りの空きブロックが結合されない。
+	EXPECT_EQ( p3, p2 );
+
+	// Clean-up
+	om_.deallocate( p3 );
+}
+
+TEST_F( Offset_Malloc_DeferredCoalescing, CanCoalesceWhenAllocationFails )
+{
+	// Arrange
+	std::vector<void*> allocated;
+	while ( true ) {
+		void* p = om_.allocate( large_size );
+		if ( p == nullptr ) {
+			break;
+		}
+		allocated.push_back( p );
+	}
+	for ( auto p : allocated ) {
+		om_.deallocate( p );
+	}
+
+	// Act
+	void* p_big = om_.allocate( buff_size / 2 );
+
+	// Assert
+	EXPECT_NE( p_big, nullptr );
+
+	// Clean-up
+	om_.deallocate( p_big );
+	om_.set_deferred_coalescing( false );
+	EXPECT_EQ( om_.get_stats().num_of_free_blocks_, static_cast<size_t>( 1 ) );
+}
+
+TEST_F( Offset_Malloc_DeferredCoalescing, CanCoalesceByThreshold )
+{
+	// Arrange
+	std::vector<void*> allocated;
+	for ( int i = 0; i < 300; i++ ) {
+		void* p = om_.allocate( 100 );
+		ASSERT_NE( p, nullptr );
+		allocated.push_back( p );
+	}
+
+	// Act
+	for ( auto p : allocated ) {
+		om_.deallocate( p );
+	}
+
+	// Assert
+	// 閾値に達した時点で結合されるため、未結合の空きブロックは閾値未満となる。
+	EXPECT_LT( om_.get_stats().num_of_free_blocks_, static_cast<size_t>( 300 ) );
+}
+
+TEST_F( Offset_Malloc_DeferredCoalescing, CanCoalesceOnDisable )
+{
+	// Arrange
+	void* p1 = om_.allocate( large_size );
+	void* p2 = om_.allocate( large_size );
+	om_.deallocate( p1 );
+	om_.deallocate( p2 );
+
+	// Act
+	om_.set_deferred_coalescing( false );
+
+	// Assert
+	EXPECT_FALSE( om_.is_deferred_coalescing_enabled() );
+	ipsm::offset_malloc_stats ret = om_.get_stats();
+	EXPECT_EQ( ret.num_of_free_blocks_, static_cast<size_t>( 1 ) );
+	EXPECT_EQ( ret.fragmentation_ratio_, 0.0 );
+}
+
+TEST_F( Offset_Malloc_DeferredCoalescing, CanCoalesceBinsByThresholdWhenDisabled )
+{
+	// Arrange
+	om_.set_deferred_coalescing( false );
+	std::vector<void*> allocated;
+	for ( int i = 0; i < 300; i++ ) {
+		void* p = om_.allocate( 100 );
+		ASSERT_NE( p, nullptr );
+		allocated.push_back( p );
+	}
+
+	// Act
+	for ( auto p : allocated ) {
+		om_.deallocate( p );
+	}
+
+	// Assert
+	// 遅延結合のモードでなくても、サイズクラスのリストにある未結合の空きブロックは閾値に達した時点で結合される。
+	EXPECT_LT( om_.get_stats().num_of_free_blocks_, static_cast<size_t>( 300 ) );
+}
+
+TEST_F( Offset_Malloc_DeferredCoalescing, SettingIsSharedByCopy )
+{
+	// Arrange
+
+	// Act
+	ipsm::offset_malloc sut2( om_ );
+
+	// Assert
+	EXPECT_TRUE( sut2.is_deferred_coalescing_enabled() );
+}
+
+class Offset_Malloc_Large : public testing::Test {
+public:
+	static constexpr size_t buff_size  = 1024 * 1024 * 4;
+	static constexpr size_t large_size = 1024 * 1024;
+
+	void SetUp() override
+	{
+		// 共有メモリオブジェクトと同様に、MADV_REMOVEでページを返却できる共有マッピングを使う。
+		p_buff_ = mmap( nullptr, buff_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		ASSERT_NE( p_buff_, MAP_FAILED );
+		page_bytes_ = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+		sut_        = ipsm::offset_malloc( p_buff_, buff_size );
+	}
+	void TearDown() override
+	{
+		sut_ = ipsm::offset_malloc();
+		munmap( p_buff_, buff_size );
+	}
+
+	size_t count_resident_pages( void* p, size_t bytes )
+	{
+		std::vector<unsigned char> vec( bytes / page_bytes_ );
+		EXPECT_EQ( mincore( p, bytes, vec.data() ), 0 );
+		size_t ans = 0;
+		for ( auto v : vec ) {
+			ans += ( v & 1 );
+		}
+		return ans;
+	}
+
+	void*               p_buff_;
+	size_t              page_bytes_;
+	ipsm::offset_malloc sut_;
+};
+
+TEST_F( Offset_Malloc_Large, CanAllocatePageAlignedRun )
+{
+	// Arrange
+
+	// Act
+	void* p = sut_.allocate( large_size + 10 );
+
+	// Assert
+	ASSERT_NE( p, nullptr );
+	EXPECT_EQ( reinterpret_cast<uintptr_t>( p ) % page_bytes_, static_cast<uintptr_t>( 0 ) );
+	EXPECT_NO_THROW( sut_.deallocate_sized( p, large_size + 10 ) );
+}
+
+TEST_F( Offset_Malloc_Large, CanReturnPagesWhenFreed )
+{
+	// Arrange
+	void* p = sut_.allocate( large_size );
+	ASSERT_NE( p, nullptr );
+	memset( p, 0xAA, large_size );
+	ASSERT_EQ( count_resident_pages( p, large_size ), large_size / page_bytes_ );
+
+	// Act
+	sut_.deallocate( p );
+
+	// Assert
+	// 空きブロックの先頭ページは管理情報を保持するため、返却されない場合がある。
+	EXPECT_LE( count_resident_pages( p, large_size ), static_cast<size_t>( 1 ) );
+	void* p2 = sut_.allocate( large_size );
+	ASSERT_NE( p2, nullptr );
+	memset( p2, 0x55, large_size );
+	sut_.deallocate( p2 );
+}
+
+TEST_F( Offset_Malloc_Large, KeepPagesOfCoalescedNeighborWhenFreed )
+{
+	// Arrange
+	// 空きブロックの後ろから切り出されるため、pの直前は空きブロックとなる。そのページは、空きブロックの先頭から離れた位置を選ぶ。
+	void* p = sut_.allocate( large_size );
+	ASSERT_NE( p, nullptr );
+	unsigned char* p_neighbor_page = reinterpret_cast<unsigned char*>( p ) - large_size;
+	memset( p_neighbor_page, 0xAA, page_bytes_ );
+	ASSERT_EQ( count_resident_pages( p_neighbor_page, page_bytes_ ), static_cast<size_t>( 1 ) );
+
+	// Act
+	sut_.deallocate( p );
+
+	// Assert
+	// 結合した前側の空きブロックのページは、解放したブロックのページではないため、返却の対象としない。
+	EXPECT_EQ( count_resident_pages( p_neighbor_page, page_bytes_ ), static_cast<size_t>( 1 ) );
+	EXPECT_LE( count_resident_pages( p, large_size ), static_cast<size_t>( 1 ) );
+}
+
+TEST_F( Offset_Malloc_Large, CanReturnPagesByConfiguredPageSize )
+{
+	// Arrange
+	// hugetlbfs上のヒープと同様に、システムのページより大きな単位でページを返却させる。
+	const size_t config_page_bytes = page_bytes_ * 16;
+	sut_.set_page_bytes( config_page_bytes );
+	void* p = sut_.allocate( large_size );
+	ASSERT_NE( p, nullptr );
+	memset( p, 0xAA, large_size );
+
+	// Act
+	sut_.deallocate( p );
+
+	// Assert
+	// 設定した単位の境界に揃った範囲が返却され、末尾の端数のページは残る。
+	const uintptr_t addr_end  = reinterpret_cast<uintptr_t>( p ) + large_size;
+	const uintptr_t addr_tail = ( addr_end / config_page_bytes ) * config_page_bytes;
+	const uintptr_t addr_body = ( ( reinterpret_cast<uintptr_t>( p ) + config_page_bytes - 1 ) / config_page_bytes ) * config_page_bytes;
+	EXPECT_EQ( count_resident_pages( reinterpret_cast<void*>( addr_body ), addr_tail - addr_body ), static_cast<size_t>( 0 ) );
+	EXPECT_EQ( count_resident_pages( reinterpret_cast<void*>( addr_tail ), addr_end - addr_tail ), ( addr_end - addr_tail ) / page_bytes_ );
+}
+
+TEST_F( Offset_Malloc_Large, CanReturnPagesOfProcessLocalMemory )
+{
+	// Arrange
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            p = sut.allocate( large_size );
+	ASSERT_NE( p, nullptr );
+	memset( p, 0xAA, large_size );
+
+	// Act
+	sut.deallocate( p );
+
+	// Assert
+	void* p2 = sut.allocate( large_size );
+	EXPECT_EQ( p2, p );
+	memset( p2, 0x55, large_size );
+	sut.deallocate( p2 );
+}
+
+class Offset_Malloc_Arena : public Offset_Malloc_Heap_Fixture {
+public:
+	static constexpr size_t num_of_arenas = 4;
+	static constexpr size_t alloc_size    = 512;
+
+	void SetUp() override
+	{
+		setup_heap( ipsm::offset_malloc_policy::kFirstFit, num_of_arenas );
+	}
+
+	std::vector<void*> allocate_all( void )
+	{
+		std::vector<void*> ans;
+		while ( true ) {
+			void* p = om_.allocate( alloc_size );
+			if ( p == nullptr ) {
+				break;
+			}
+			ans.push_back( p );
+		}
+		return ans;
+	}
+};
+
+TEST_F( Offset_Malloc_Arena, CanConstruct )
+{
+	// Arrange
+
+	// Act
+
+	// Assert
+	EXPECT_EQ( om_.get_num_of_arenas(), num_of_arenas );
+	EXPECT_EQ( om_.get_bind_count(), 1 );
+}
+
+TEST_F( Offset_Malloc_Arena, CanAllocateFromAllArenas )
+{
+	// Arrange
+
+	// Act
+	std::vector<void*> allocated = allocate_all();
+
+	// Assert
+	// 1つのアリーナの容量を超えて確保できれば、他のアリーナからも確保できている。
+	EXPECT_GT( allocated.size() * alloc_size, buff_size / num_of_arenas * ( num_of_arenas - 1 ) );
+	for ( auto& p : allocated ) {
+		EXPECT_TRUE( om_.is_belong_to( p ) );
+	}
+	EXPECT_FALSE( om_.is_belong_to( p_buff_ + buff_size ) );
+
+	// Clean-up
+	for ( auto& p : allocated ) {
+		om_.deallocate( p );
+	}
+}
+
+TEST_F( Offset_Malloc_Arena, CanDeallocateToOwningArena )
+{
+	// Arrange
+	std::vector<void*> allocated1 = allocate_all();
+	for ( auto& p : allocated1 ) {
+		om_.deallocate( p );
+	}
+
+	// Act
+	std::vector<void*> allocated2;
+	std::thread        t( [this, &allocated2]() {
+        allocated2 = allocate_all();
+    } );
+	t.join();
+
+	// Assert
+	// 各アリーナに正しく返却されていれば、スレッドに対応付けられたアリーナが異なっても、同じ数だけ確保できる。
+	EXPECT_EQ( allocated1.size(), allocated2.size() );
+
+	// Clean-up
+	for ( auto& p : allocated2 ) {
+		om_.deallocate( p );
+	}
+}
+
+TEST_F( Offset_Malloc_Arena, CanDeallocateBulkOverArenas )
+{
+	// Arrange
+	std::vector<void*> allocated1 = allocate_all();
+
+	// Act
+	om_.deallocate_bulk( allocated1.data(), allocated1.size() );
+
+	// Assert
+	std::vector<void*> allocated2 = allocate_all();
+	EXPECT_EQ( allocated1.size(), allocated2.size() );
+
+	// Clean-up
+	om_.deallocate_bulk( allocated2.data(), allocated2.size() );
+}
+
+TEST( Offset_Malloc_Bulk, CanAllocateBulk_ThenDeallocateBulk )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	constexpr size_t                 n         = 32;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            p_big = sut.allocate( buff_size / 2 );
+	ASSERT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+	void* ptrs[n];
+
+	// Act
+	size_t ret = sut.allocate_bulk( 300, alignof( std::max_align_t ), n, ptrs );
+
+	// Assert
+	ASSERT_EQ( ret, n );
+	std::set<void*> distinct_ptrs( &( ptrs[0] ), &( ptrs[n] ) );
+	EXPECT_EQ( distinct_ptrs.size(), n );
+	for ( auto p : ptrs ) {
+		EXPECT_TRUE( sut.is_belong_to( p ) );
+	}
+
+	// Act
+	std::shuffle( &( ptrs[0] ), &( ptrs[n] ), std::mt19937( 1 ) );
+	sut.deallocate_bulk( ptrs, n );
+
+	// Assert
+	// 解放したブロックが結合されていれば、再度大きなブロックを確保できる。
+	p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+TEST( Offset_Malloc_Bulk, CanDeallocateBulkOverSortChunks )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	constexpr size_t                 n         = 150;   // 並べ替えの単位(64個)を複数回に分けて解放する数
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            ptrs[n + 1];
+	size_t                           ret = sut.allocate_bulk( 100, alignof( std::max_align_t ), n, ptrs );
+	ASSERT_EQ( ret, n );
+	ptrs[n] = nullptr;   // nullptrは無視される。
+	std::shuffle( &( ptrs[0] ), &( ptrs[n + 1] ), std::mt19937( 1 ) );
+
+	// Act
+	sut.deallocate_bulk( ptrs, n + 1 );
+
+	// Assert
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+	void* p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+TEST( Offset_Malloc_Bulk, CanAllocateBulkPartially )
+{
+	// Arrange
+	constexpr size_t    buff_size = 1024;
+	constexpr size_t    n         = 10;
+	unsigned char       test_buff[buff_size];
+	ipsm::offset_malloc sut( test_buff, buff_size );
+	void*               ptrs[n];
+
+	// Act
+	size_t ret = sut.allocate_bulk( 200, alignof( std::max_align_t ), n, ptrs );
+
+	// Assert
+	EXPECT_GT( ret, static_cast<size_t>( 0 ) );
+	EXPECT_LT( ret, n );
+	for ( size_t i = ret; i < n; i++ ) {
+		EXPECT_EQ( ptrs[i], nullptr );
+	}
+
+	// Clean-up
+	sut.deallocate_bulk( ptrs, n );
+}
+
+TEST( Offset_Malloc_Bulk, CanDeallocateBulk_w_ThreadCache )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	constexpr size_t                 n         = 64;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	sut.set_thread_cache( true );
+	void* ptrs[n];
+
+	// Act
+	size_t ret = sut.allocate_bulk( 20, alignof( std::max_align_t ), n, ptrs );
+	ASSERT_EQ( ret, n );
+	sut.deallocate_bulk( ptrs, n );
+	sut.set_thread_cache( false );
+
+	// Assert
+	void* p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+class Offset_Malloc_Sized : public testing::TestWithParam<bool> {};
+
+TEST_P( Offset_Malloc_Sized, CanDeallocateSized )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	sut.set_thread_cache( GetParam() );
+	void* p_small   = sut.allocate( 20 );
+	void* p_large   = sut.allocate( 1000 );
+	void* p_aligned = sut.allocate( 100, 64 );
+	ASSERT_NE( p_small, nullptr );
+	ASSERT_NE( p_large, nullptr );
+	ASSERT_NE( p_aligned, nullptr );
+
+	// Act
+	EXPECT_NO_THROW( sut.deallocate_sized( p_small, 20 ) );
+	EXPECT_NO_THROW( sut.deallocate_sized( p_large, 1000 ) );
+	EXPECT_NO_THROW( sut.deallocate_sized( p_aligned, 100, 64 ) );
+	sut.set_thread_cache( false );
+
+	// Assert
+	void* p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+TEST( Offset_Malloc_Sized_ThreadCache, CanReuseBlockDeallocatedSized )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	sut.set_thread_cache( true );
+	void* p_small = sut.allocate( 20 );
+	ASSERT_NE( p_small, nullptr );
+	sut.deallocate_sized( p_small, 20 );
+
+	// Act
+	void* p_ans = sut.allocate( 20 );
+
+	// Assert
+	EXPECT_EQ( p_ans, p_small );
+
+	// Clean-up
+	sut.deallocate_sized( p_ans, 20 );
+	sut.set_thread_cache( false );
+}
+
+#ifndef NDEBUG
+TEST_P( Offset_Malloc_Sized, DetectSizeMismatch )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	sut.set_thread_cache( GetParam() );
+	void* p = sut.allocate( 100 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	EXPECT_THROW( sut.deallocate_sized( p, 200 ), std::logic_error );
+	EXPECT_THROW( sut.deallocate_sized( p, 10 ), std::logic_error );
+
+	// Clean-up
+	sut.deallocate_sized( p, 100 );
+	sut.set_thread_cache( false );
+}
+#endif
+
+INSTANTIATE_TEST_SUITE_P( ThreadCache, Offset_Malloc_Sized, testing::Bool() );
+
+TEST( Offset_Malloc_Realloc, CanExpandInPlace )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	// 空きブロックの後ろから切り出されるため、後から確保したブロックほど前に配置される。
+	void* p_upper = sut.allocate( 300 );
+	void* p_lower = sut.allocate( 300 );
+	ASSERT_NE( p_upper, nullptr );
+	ASSERT_NE( p_lower, nullptr );
+	ASSERT_LT( p_lower, p_upper );
+
+	// Act
+	bool ret_before_free = sut.try_expand( p_lower, 500 );
+	sut.deallocate( p_upper );
+	bool ret_after_free = sut.try_expand( p_lower, 500 );
+
+	// Assert
+	EXPECT_FALSE( ret_before_free );
+	EXPECT_TRUE( ret_after_free );
+	EXPECT_EQ( sut.reallocate( p_lower, 550 ), p_lower );
+
+	// Clean-up
+	sut.deallocate( p_lower );
+	void* p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+TEST( Offset_Malloc_Realloc, CanShrinkInPlace )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 4096;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            p = sut.allocate( 3000 );
+	ASSERT_NE( p, nullptr );
+	void* p_fail = sut.allocate( 2000 );
+	ASSERT_EQ( p_fail, nullptr );
+
+	// Act
+	void* p_ret = sut.reallocate( p, 100 );
+
+	// Assert
+	EXPECT_EQ( p_ret, p );
+	void* p_tail = sut.allocate( 2000 );
+	EXPECT_NE( p_tail, nullptr );
+
+	// Clean-up
+	sut.deallocate( p_tail );
+	sut.deallocate( p_ret );
+}
+
+TEST( Offset_Malloc_Realloc, CanReallocateByCopy )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            p_upper = sut.allocate( 300 );
+	unsigned char*                   p_lower = reinterpret_cast<unsigned char*>( sut.allocate( 300 ) );
+	ASSERT_NE( p_upper, nullptr );
+	ASSERT_NE( p_lower, nullptr );
+	for ( size_t i = 0; i < 300; i++ ) {
+		p_lower[i] = static_cast<unsigned char>( i );
+	}
+
+	// Act
+	unsigned char* p_ret = reinterpret_cast<unsigned char*>( sut.reallocate( p_lower, 1000 ) );
+
+	// Assert
+	ASSERT_NE( p_ret, nullptr );
+	EXPECT_NE( p_ret, p_lower );
+	for ( size_t i = 0; i < 300; i++ ) {
+		EXPECT_EQ( p_ret[i], static_cast<unsigned char>( i ) );
+	}
+
+	// Clean-up
+	sut.deallocate( p_ret );
+	sut.deallocate( p_upper );
+}
+
+TEST( Offset_Malloc_Realloc, CanReallocateFromNullptr )
+{
+	// Arrange
+	unsigned char       test_buff[1024];
+	ipsm::offset_malloc sut( test_buff, 1024 );
+
+	// Act
+	void* p = sut.reallocate( nullptr, 100 );
+
+	// Assert
+	EXPECT_NE( p, nullptr );
+	EXPECT_EQ( sut.reallocate( p, 2048 ), nullptr );
+
+	// Clean-up
+	sut.deallocate( p );
+}
+
+TEST( Offset_Malloc_Relocate, CanRelocateToLowerAddress )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	// 空きブロックの後ろから切り出されるため、p_targetは領域の末尾に配置される。
+	unsigned char* p_target = reinterpret_cast<unsigned char*>( sut.allocate( 300 ) );
+	ASSERT_NE( p_target, nullptr );
+	for ( size_t i = 0; i < 300; i++ ) {
+		p_target[i] = static_cast<unsigned char>( i );
+	}
+	auto stats_before = sut.get_stats();
+
+	// Act
+	unsigned char* p_ret1 = reinterpret_cast<unsigned char*>( sut.relocate_to_lower_address( p_target ) );
+	unsigned char* p_ret2 = reinterpret_cast<unsigned char*>( sut.relocate_to_lower_address( p_ret1 ) );
+
+	// Assert
+	EXPECT_LT( p_ret1, p_target );
+	EXPECT_EQ( p_ret2, p_ret1 );   // すでに最も低いアドレスにあるため、移動しない。
+	for ( size_t i = 0; i < 300; i++ ) {
+		EXPECT_EQ( p_ret1[i], static_cast<unsigned char>( i ) );
+	}
+	auto stats_after = sut.get_stats();
+	EXPECT_EQ( stats_after.num_of_allocated_blocks_, stats_before.num_of_allocated_blocks_ );
+	EXPECT_EQ( stats_after.free_bytes_, stats_before.free_bytes_ );
+	EXPECT_EQ( stats_after.num_of_free_blocks_, static_cast<size_t>( 1 ) );
+
+	// Clean-up
+	sut.deallocate( p_ret1 );
+	void* p_big = sut.allocate( buff_size / 2 );
+	EXPECT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+}
+
+TEST( Offset_Malloc_Relocate, DoesNotMoveIntoSmallerAdjacentFreeBlock )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	unsigned char*                   p_target = reinterpret_cast<unsigned char*>( sut.allocate( 1000 ) );
+	void*                            p_hole   = sut.allocate( 200 );
+	// 領域の先頭側を埋めて、p_holeより低いアドレスの空きブロックをなくす。
+	std::vector<void*> fillers;
+	while ( void* p = sut.allocate( 16 ) ) {
+		fillers.push_back( p );
+	}
+	ASSERT_NE( p_target, nullptr );
+	ASSERT_NE( p_hole, nullptr );
+	ASSERT_LT( p_hole, p_target );
+	for ( size_t i = 0; i < 1000; i++ ) {
+		p_target[i] = static_cast<unsigned char>( i );
+	}
+	sut.deallocate( p_hole );
+
+	// Act
+	unsigned char* p_ret = reinterpret_cast<unsigned char*>( sut.relocate_to_lower_address( p_target ) );
+
+	// Assert
+	EXPECT_EQ( p_ret, p_target );   // 自身より小さな空きブロックへは、移動元と重なるため移動しない。
+	for ( size_t i = 0; i < 1000; i++ ) {
+		EXPECT_EQ( p_ret[i], static_cast<unsigned char>( i ) );
+	}
+	void* p_reuse = sut.allocate( 200 );   // 直前の空きブロックは、そのまま再利用できる。
+	EXPECT_EQ( p_reuse, p_hole );
+
+	// Clean-up
+	sut.deallocate( p_reuse );
+	sut.deallocate( p_ret );
+	for ( auto p : fillers ) {
+		sut.deallocate( p );
+	}
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+}
+
+class Offset_Malloc_Stats : public testing::TestWithParam<ipsm::offset_malloc_policy> {};
+
+TEST_P( Offset_Malloc_Stats, CanGetStatsOfEmptyHeap )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size, GetParam() );
+
+	// Act
+	ipsm::offset_malloc_stats ret = sut.get_stats();
+
+	// Assert
+	EXPECT_GT( ret.total_bytes_, static_cast<size_t>( 0 ) );
+	EXPECT_LT( ret.total_bytes_, buff_size );
+	EXPECT_EQ( ret.free_bytes_, ret.total_bytes_ );
+	EXPECT_EQ( ret.num_of_free_blocks_, static_cast<size_t>( 1 ) );
+	EXPECT_EQ( ret.largest_free_block_bytes_, ret.free_bytes_ );
+	EXPECT_EQ( ret.num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+	EXPECT_EQ( ret.fragmentation_ratio_, 0.0 );
+}
+
+TEST_P( Offset_Malloc_Stats, CanTrackAllocationAndFragmentation )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size, GetParam() );
+	std::vector<void*>               allocated;
+	for ( int i = 0; i < 10; i++ ) {
+		allocated.push_back( sut.allocate( 500 ) );
+		allocated.push_back( sut.allocate( 20 ) );
+	}
+
+	// Act
+	ipsm::offset_malloc_stats ret1 = sut.get_stats();
+	for ( size_t i = 0; i < allocated.size(); i += 2 ) {
+		sut.deallocate( allocated[i] );
+	}
+	ipsm::offset_malloc_stats ret2 = sut.get_stats();
+	for ( size_t i = 1; i < allocated.size(); i += 2 ) {
+		sut.deallocate( allocated[i] );
+	}
+	ipsm::offset_malloc_stats ret3 = sut.get_stats();
+
+	// Assert
+	EXPECT_EQ( ret1.num_of_allocated_blocks_, static_cast<size_t>( 20 ) );
+	EXPECT_LT( ret1.free_bytes_, ret1.total_bytes_ - 10 * ( 500 + 20 ) );
+	EXPECT_EQ( ret1.num_of_free_blocks_, static_cast<size_t>( 1 ) );
+
+	// 500 bytesのブロックを解放すると、20 bytesのブロックで分断された空きブロックとなる。
+	EXPECT_EQ( ret2.num_of_allocated_blocks_, static_cast<size_t>( 10 ) );
+	EXPECT_EQ( ret2.num_of_free_blocks_, static_cast<size_t>( 11 ) );
+	EXPECT_GT( ret2.fragmentation_ratio_, 0.0 );
+	EXPECT_LT( ret2.largest_free_block_bytes_, ret2.free_bytes_ );
+
+	// 20 bytesのブロックはサイズクラスのリストに保持されるため、結合されずに空きブロックとして数えられる。
+	EXPECT_EQ( ret3.num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+	EXPECT_EQ( ret3.free_bytes_, ret3.total_bytes_ );
+	EXPECT_EQ( ret3.num_of_free_blocks_, static_cast<size_t>( 21 ) );
+
+	// 未結合の空きブロックでは満たせない大きさを確保すると、サイズクラスのリストのブロックが結合され、断片化が解消する。
+	EXPECT_LT( ret3.largest_free_block_bytes_, ret3.total_bytes_ - 256 );
+	void* p_big = sut.allocate( ret3.total_bytes_ - 256 );
+	ASSERT_NE( p_big, nullptr );
+	sut.deallocate( p_big );
+	ipsm::offset_malloc_stats ret4 = sut.get_stats();
+	EXPECT_EQ( ret4.num_of_free_blocks_, static_cast<size_t>( 1 ) );
+	EXPECT_EQ( ret4.fragmentation_ratio_, 0.0 );
+}
+
+INSTANTIATE_TEST_SUITE_P( AllocationPolicy, Offset_Malloc_Stats, testing::Values( ipsm::offset_malloc_policy::kFirstFit, ipsm::offset_malloc_policy::kBestFit ) );
+
+TEST_F( Offset_Malloc_Arena, CanGetStatsOverArenas )
+{
+	// Arrange
+	ipsm::offset_malloc_stats before = om_.get_stats();
+	std::vector<void*>        allocated = allocate_all();
+
+	// Act
+	ipsm::offset_malloc_stats ret = om_.get_stats();
+
+	// Assert
+	EXPECT_EQ( ret.total_bytes_, before.total_bytes_ );
+	EXPECT_EQ( ret.num_of_allocated_blocks_, allocated.size() );
+	EXPECT_EQ( before.num_of_free_blocks_, num_of_arenas );
+
+	// Clean-up
+	om_.deallocate_bulk( allocated.data(), allocated.size() );
+}
+
+#ifdef ENABLE_SIZE_CLASS_STATISTICS
+TEST( Offset_Malloc_Histogram, CanCountPerSizeClass )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	ipsm::offset_malloc              monitor( sut );   // 同じヒープメモリにバインドした別インスタンスから参照する。
+
+	// Act
+	void* p1 = sut.allocate( 16 );
+	void* p2 = sut.allocate( 16 );
+	void* p3 = sut.allocate( 1024 );
+	sut.deallocate( p2 );
+	void*                                    p4  = sut.allocate( buff_size );
+	ipsm::offset_malloc_size_class_histogram ret = monitor.get_size_class_histogram();
+
+	// Assert
+	EXPECT_EQ( p4, nullptr );
+	// 16 bytesの要求は、ヘッダを含めて2単位のブロックとなる。
+	const ipsm::offset_malloc_size_class_stats& small_class = ret.classes_[0];
+	EXPECT_EQ( small_class.block_bytes_, static_cast<size_t>( 32 ) );
+	EXPECT_EQ( small_class.num_of_allocations_, static_cast<size_t>( 2 ) );
+	EXPECT_EQ( small_class.num_of_deallocations_, static_cast<size_t>( 1 ) );
+	EXPECT_EQ( small_class.live_bytes_, static_cast<size_t>( 32 ) );
+	EXPECT_EQ( small_class.num_of_failed_allocations_, static_cast<size_t>( 0 ) );
+
+	const ipsm::offset_malloc_size_class_stats& large_class = ret.classes_[ipsm::offset_malloc_size_class_histogram::num_of_classes - 1];
+	EXPECT_EQ( large_class.block_bytes_, static_cast<size_t>( 0 ) );
+	EXPECT_EQ( large_class.num_of_allocations_, static_cast<size_t>( 1 ) );
+	EXPECT_EQ( large_class.num_of_deallocations_, static_cast<size_t>( 0 ) );
+	EXPECT_GE( large_class.live_bytes_, static_cast<size_t>( 1024 ) );
+	EXPECT_EQ( large_class.num_of_failed_allocations_, static_cast<size_t>( 1 ) );
+
+	// Cleanup
+	sut.deallocate( p1 );
+	sut.deallocate( p3 );
+}
+
+TEST( Offset_Malloc_Histogram, CanCountInPlaceResizeAsMoveOfSizeClass )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 16;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size );
+	void*                            p = sut.allocate( 1024 );
+	ASSERT_NE( p, nullptr );
+
+	// Act
+	void* p2 = sut.reallocate( p, 100 );
+
+	// Assert
+	EXPECT_EQ( p2, p );
+	ipsm::offset_malloc_size_class_histogram ret = sut.get_size_class_histogram();
+	size_t                                   live_bytes = 0;
+	for ( const auto& c : ret.classes_ ) {
+		live_bytes += c.live_bytes_;
+	}
+	EXPECT_EQ( live_bytes, sut.get_stats().total_bytes_ - sut.get_stats().free_bytes_ );
+	EXPECT_EQ( ret.classes_[ipsm::offset_malloc_size_class_histogram::num_of_classes - 1].live_bytes_, static_cast<size_t>( 0 ) );
+
+	// Cleanup
+	sut.deallocate( p2 );
+}
+
+TEST( Offset_Malloc_Histogram, CanAggregateOverArenas )
+{
+	// Arrange
+	constexpr size_t                 buff_size = 1024 * 64;
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	ipsm::offset_malloc              sut( up_buff.get(), buff_size, ipsm::offset_malloc_policy::kFirstFit, 4 );
+	std::vector<void*>               allocated;
+	for ( int i = 0; i < 100; i++ ) {
+		allocated.push_back( sut.allocate( 16 ) );
+	}
+
+	// Act
+	ipsm::offset_malloc_size_class_histogram ret = sut.get_size_class_histogram();
+
+	// Assert
+	EXPECT_EQ( ret.classes_[0].num_of_allocations_, static_cast<size_t>( 100 ) );
+	EXPECT_EQ( ret.classes_[0].live_bytes_, static_cast<size_t>( 100 * 32 ) );
+
+	// Cleanup
+	sut.deallocate_bulk( allocated.data(), allocated.size() );
+	EXPECT_EQ( sut.get_size_class_histogram().classes_[0].live_bytes_, static_cast<size_t>( 0 ) );
+}
+#endif
+
+TEST( Offset_Malloc_Arena_Cntr, FailConstructTooManyArenas )
+{
+	// Arrange
+	unsigned char test_buff[1024];
+
+	// Act
+	EXPECT_ANY_THROW( ipsm::offset_malloc sut( reinterpret_cast<void*>( test_buff ), 1024, ipsm::offset_malloc_policy::kFirstFit, 16 ) );
+
+	// Assert
+
+	// Clean-up
+}
+
+TEST( Offset_Malloc_Highload, CanMulti_Thread_Calling )
+{
+	// Arrange
+	const size_t      alloc_size      = 11;
+	constexpr int     test_thread_num = 100;
+	constexpr size_t  buff_size       = alloc_size * 100 * test_thread_num;
+	std::atomic<bool> loop_flag( true );
+
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );   // 4MBytes
+	void*                            p_mem = reinterpret_cast<void*>( up_buff.get() );
+	ipsm::offset_malloc              sut( p_mem, buff_size );
+
+	std::packaged_task<int( ipsm::offset_malloc )> fail_count_tasks[test_thread_num];
+	std::future<int>                               fail_count_task_results[test_thread_num];
+	std::thread                                    thread_array[test_thread_num];
+
+	// Act
+	for ( int i = 0; i < test_thread_num; i++ ) {
+		fail_count_tasks[i]        = std::packaged_task<int( ipsm::offset_malloc )>( [&loop_flag]( ipsm::offset_malloc ttsut ) -> int {
+            int fail_count_ret = 0;
+            while ( loop_flag.load() ) {
+                auto p_ret = ttsut.allocate( 11 );
+                if ( p_ret == nullptr ) {
+                    fail_count_ret++;
+                }
+                ttsut.deallocate( p_ret );
+            }
+
+            return fail_count_ret;
+        } );
+		fail_count_task_results[i] = fail_count_tasks[i].get_future();
+		thread_array[i]            = std::thread( std::move( fail_count_tasks[i] ), sut );
+	}
+	std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+	loop_flag.store( false );
+
+	// Assert
+	for ( auto& e : thread_array ) {
+		if ( e.joinable() ) {
+			e.join();
+		}
+	}
+	int final_fail_count_result = 0;
+	for ( auto& e : fail_count_task_results ) {
+		final_fail_count_result += e.get();
+	}
+	EXPECT_EQ( final_fail_count_result, 0 );
+}
+
+TEST( Offset_Malloc_Highload, CanMulti_Thread_Calling_w_ThreadCache )
+{
+	// Arrange
+	const size_t      alloc_size      = 11;
+	constexpr int     test_thread_num = 100;
+	constexpr size_t  buff_size       = alloc_size * 100 * test_thread_num;
+	std::atomic<bool> loop_flag( true );
+
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	void*                            p_mem = reinterpret_cast<void*>( up_buff.get() );
+	ipsm::offset_malloc              sut( p_mem, buff_size );
+
+	std::packaged_task<int( ipsm::offset_malloc )> fail_count_tasks[test_thread_num];
+	std::future<int>                               fail_count_task_results[test_thread_num];
+	std::thread                                    thread_array[test_thread_num];
+
+	// Act
+	for ( int i = 0; i < test_thread_num; i++ ) {
+		fail_count_tasks[i]        = std::packaged_task<int( ipsm::offset_malloc )>( [&loop_flag]( ipsm::offset_malloc ttsut ) -> int {
+            int fail_count_ret = 0;
+            ttsut.set_thread_cache( true );
+            while ( loop_flag.load() ) {
+                auto p_ret = ttsut.allocate( 11 );
+                if ( p_ret == nullptr ) {
+                    fail_count_ret++;
+                }
+                ttsut.deallocate( p_ret );
+            }
+
+            return fail_count_ret;
+        } );
+		fail_count_task_results[i] = fail_count_tasks[i].get_future();
+		thread_array[i]            = std::thread( std::move( fail_count_tasks[i] ), sut );
+	}
+	std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+	loop_flag.store( false );
+
+	// Assert
+	for ( auto& e : thread_array ) {
+		if ( e.joinable() ) {
+			e.join();
+		}
+	}
+	int final_fail_count_result = 0;
+	for ( auto& e : fail_count_task_results ) {
+		final_fail_count_result += e.get();
+	}
+	EXPECT_EQ( final_fail_count_result, 0 );
+	EXPECT_EQ( sut.get_bind_count(), 1 );
+}
+
+TEST( Offset_Malloc_Highload, CanMulti_Thread_Calling_w_Arenas )
+{
+	// Arrange
+	const size_t      alloc_size      = 11;
+	constexpr int     test_thread_num = 100;
+	constexpr size_t  buff_size       = alloc_size * 100 * test_thread_num;
+	std::atomic<bool> loop_flag( true );
+
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[buff_size] );
+	void*                            p_mem = reinterpret_cast<void*>( up_buff.get() );
+	ipsm::offset_malloc              sut( p_mem, buff_size, ipsm::offset_malloc_policy::kFirstFit, 8 );
+
+	std::packaged_task<int( ipsm::offset_malloc )> fail_count_tasks[test_thread_num];
+	std::future<int>                               fail_count_task_results[test_thread_num];
+	std::thread                                    thread_array[test_thread_num];
+
+	// Act
+	for ( int i = 0; i < test_thread_num; i++ ) {
+		fail_count_tasks[i]        = std::packaged_task<int( ipsm::offset_malloc )>( [&loop_flag]( ipsm::offset_malloc ttsut ) -> int {
+            int fail_count_ret = 0;
+            while ( loop_flag.load() ) {
+                auto p_ret = ttsut.allocate( 11 );
+                if ( p_ret == nullptr ) {
+                    fail_count_ret++;
+                }
+                ttsut.deallocate( p_ret );
+            }
+
+            return fail_count_ret;
+        } );
+		fail_count_task_results[i] = fail_count_tasks[i].get_future();
+		thread_array[i]            = std::thread( std::move( fail_count_tasks[i] ), sut );
+	}
+	std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+	loop_flag.store( false );
+
+	// Assert
+	for ( auto& e : thread_array ) {
+		if ( e.joinable() ) {
+			e.join();
+		}
+	}
+	int final_fail_count_result = 0;
+	for ( auto& e : fail_count_task_results ) {
+		final_fail_count_result += e.get();
+	}
+	EXPECT_EQ( final_fail_count_result, 0 );
+	EXPECT_EQ( sut.get_bind_count(), 1 );
+}
+
+TEST( Offset_Malloc_Owner, CanReclaimBlocksOfOwner )
+{
+	// Arrange
+	constexpr size_t           buff_size = 1024 * 16;
+	std::vector<unsigned char> buff( buff_size );
+	ipsm::offset_malloc        sut( buff.data(), buff_size );
+	ipsm::offset_malloc        sut_owner( sut );
+	sut_owner.set_owner_id( 3 );
+	void* p_untagged = sut.allocate( 100 );
+	void* p_tagged1  = sut_owner.allocate( 100 );
+	void* p_tagged2  = sut_owner.allocate( 200 );
+	void* p_disowned = sut_owner.allocate( 300 );
+	ASSERT_NE( p_untagged, nullptr );
+	ASSERT_NE( p_tagged1, nullptr );
+	ASSERT_NE( p_tagged2, nullptr );
+	ASSERT_NE( p_disowned, nullptr );
+	sut_owner.disown( p_disowned );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 4 ) );
+
+	// Act
+	size_t num_of_reclaimed = sut.reclaim_owner( 3 );
+
+	// Assert
+	EXPECT_EQ( num_of_reclaimed, static_cast<size_t>( 2 ) );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 2 ) );
+	EXPECT_EQ( sut.reclaim_owner( 3 ), static_cast<size_t>( 0 ) );
+
+	// Clean-up
+	sut.deallocate( p_untagged );
+	sut.deallocate( p_disowned );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+}
+
+TEST( Offset_Malloc_Owner, CanDisownAll_ThenReclaimNothing )
+{
+	// Arrange
+	constexpr size_t           buff_size = 1024 * 16;
+	std::vector<unsigned char> buff( buff_size );
+	ipsm::offset_malloc        sut( buff.data(), buff_size, ipsm::offset_malloc_policy::kFirstFit, 2 );
+	ipsm::offset_malloc        sut_owner1( sut );
+	ipsm::offset_malloc        sut_owner2( sut );
+	sut_owner1.set_owner_id( 3 );
+	sut_owner2.set_owner_id( 4 );
+	void* p_tagged1 = sut_owner1.allocate( 100 );
+	void* p_tagged2 = sut_owner2.allocate( 200 );
+	ASSERT_NE( p_tagged1, nullptr );
+	ASSERT_NE( p_tagged2, nullptr );
+
+	// Act
+	size_t num_of_disowned = sut.disown_all();
+
+	// Assert
+	EXPECT_EQ( num_of_disowned, static_cast<size_t>( 2 ) );
+	EXPECT_EQ( sut.reclaim_owner( 3 ), static_cast<size_t>( 0 ) );
+	EXPECT_EQ( sut.reclaim_owner( 4 ), static_cast<size_t>( 0 ) );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 2 ) );
+
+	// Clean-up
+	sut.deallocate( p_tagged1 );
+	sut.deallocate( p_tagged2 );
+}
+
+TEST( Offset_Malloc_Owner, OwnerIsNotCopied_ThenTagIsKeptByRelocation )
+{
+	// Arrange
+	constexpr size_t           buff_size = 1024 * 16;
+	std::vector<unsigned char> buff( buff_size );
+	ipsm::offset_malloc        sut( buff.data(), buff_size );
+	sut.set_owner_id( 5 );
+	ipsm::offset_malloc sut_copy( sut );
+	EXPECT_EQ( sut_copy.get_owner_id(), 0U );
+	void* p_low  = sut.allocate( 100 );
+	void* p_high = sut.allocate( 100 );
+	ASSERT_NE( p_low, nullptr );
+	ASSERT_NE( p_high, nullptr );
+	sut.deallocate( p_low );
+
+	// Act
+	void* p_moved = sut.relocate_to_lower_address( p_high );
+
+	// Assert
+	EXPECT_NE( p_moved, p_high );
+	EXPECT_EQ( sut.reclaim_owner( 5 ), static_cast<size_t>( 1 ) );
+	EXPECT_EQ( sut.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
 }
@@ -9,6 +9,15 @@
  *
  */
 
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 
 #include "offset_mallloc_impl.hpp"
@@ -204,3 +213,424 @@ TEST_F( ProcShared_Malloc, CanDeallocate3 )
 
 	// Assert
 }
+
+TEST_F( ProcShared_Malloc, CanReuseSmallBlockFromSizeClassBin )
+{
+	// Arrange
+	void* p_allc_mem1 = p_sut_->allocate( 32 );
+	void* p_allc_mem2 = p_sut_->allocate( 32 );
+	ASSERT_NE( p_allc_mem1, nullptr );
+	ASSERT_NE( p_allc_mem2, nullptr );
+	p_sut_->deallocate( p_allc_mem1 );
+
+	// Act
+	void* p_allc_mem3 = p_sut_->allocate( 30 );
+
+	// Assert
+	EXPECT_EQ( p_allc_mem3, p_allc_mem1 );
+
+	// Clean-up
+	p_sut_->deallocate( p_allc_mem2 );
+	p_sut_->deallocate( p_allc_mem3 );
+}
+
+TEST_F( ProcShared_Malloc, CanConsolidateSizeClassBinsWhenExhausted )
+{
+	// Arrange
+	void*  p_allc_mems[alloc_mem_size / 32];
+	size_t num_of_allocated = 0;
+	while ( num_of_allocated < ( alloc_mem_size / 32 ) ) {
+		void* p = p_sut_->allocate( 16 );
+		if ( p == nullptr ) break;
+		p_allc_mems[num_of_allocated] = p;
+		num_of_allocated++;
+	}
+	ASSERT_GT( num_of_allocated, 2 );
+	for ( size_t i = 0; i < num_of_allocated; i++ ) {
+		p_sut_->deallocate( p_allc_mems[i] );
+	}
+
+	// Act
+	void* p_big_mem = p_sut_->allocate( 32 * ( num_of_allocated - 2 ) );
+
+	// Assert
+	EXPECT_NE( p_big_mem, nullptr );
+
+	// Clean-up
+	p_sut_->deallocate( p_big_mem );
+}
+
+TEST_F( ProcShared_Malloc, DetectDoubleFreeOfLargeBlock )
+{
+	// Arrange
+	void* p_allc_mem1 = p_sut_->allocate( 300 );
+	void* p_allc_mem2 = p_sut_->allocate( 10 );   // p_allc_mem1の解放後に、空きブロックと結合されないように間に置く。
+	ASSERT_NE( p_allc_mem1, nullptr );
+	ASSERT_NE( p_allc_mem2, nullptr );
+	p_sut_->deallocate( p_allc_mem1 );
+
+	// Act
+	EXPECT_THROW( p_sut_->deallocate( p_allc_mem1 ), std::logic_error );
+
+	// Clean-up
+	p_sut_->deallocate( p_allc_mem2 );
+}
+
+TEST( ProcShared_Malloc_DoubleFree, KeepCountersWhenDoubleFreeIsDetected )
+{
+	// Arrange
+	constexpr size_t                         buff_size = 1024 * 4;
+	std::vector<unsigned char>               buff( buff_size + 16 );
+	uintptr_t                                addr  = ( ( reinterpret_cast<uintptr_t>( buff.data() ) + 16 - 1 ) / 16 ) * 16;
+	ipsm::offset_malloc::offset_malloc_impl* p_sut = ipsm::offset_malloc::offset_malloc_impl::placement_new( reinterpret_cast<void*>( addr ), reinterpret_cast<void*>( addr + buff_size ) );
+	void*                                    p_allc_mem1 = p_sut->allocate( 300 );
+	void*                                    p_allc_mem2 = p_sut->allocate( 300 );
+	void*                                    p_allc_mem3 = p_sut->allocate( 10 );   // 解放したブロックが、残りの空きブロックと結合されないように間に置く。
+	ASSERT_NE( p_allc_mem1, nullptr );
+	ASSERT_NE( p_allc_mem2, nullptr );
+	ASSERT_NE( p_allc_mem3, nullptr );
+	void* p_lower  = std::min( p_allc_mem1, p_allc_mem2 );
+	void* p_higher = std::max( p_allc_mem1, p_allc_mem2 );
+	p_sut->deallocate( p_lower );
+	p_sut->deallocate( p_higher );   // 前側の空きブロックと結合され、ヘッダは空きブロックの本体の一部になる。
+	ipsm::offset_malloc_stats before = p_sut->get_stats();
+
+	// Act
+	EXPECT_THROW( p_sut->deallocate( p_higher ), std::logic_error );
+
+	// Assert
+	ipsm::offset_malloc_stats after = p_sut->get_stats();
+	EXPECT_EQ( after.num_of_allocated_blocks_, before.num_of_allocated_blocks_ );
+	EXPECT_EQ( after.free_bytes_, before.free_bytes_ );
+
+	// Clean-up
+	p_sut->deallocate( p_allc_mem3 );
+	ipsm::offset_malloc::offset_malloc_impl::unbind( p_sut );
+}
+
+TEST_F( ProcShared_Malloc, DetectDoubleFreeOfSizeClassBlock )
+{
+	// Arrange
+	void* p_allc_mem1 = p_sut_->allocate( 32 );
+	void* p_allc_mem2 = p_sut_->allocate( 32 );
+	ASSERT_NE( p_allc_mem1, nullptr );
+	ASSERT_NE( p_allc_mem2, nullptr );
+	p_sut_->deallocate( p_allc_mem1 );   // サイズクラスのリストの末尾になる。
+	p_sut_->deallocate( p_allc_mem2 );   // サイズクラスのリストの先頭になる。
+	ipsm::offset_malloc_stats before = p_sut_->get_stats();
+
+	// Act
+	EXPECT_THROW( p_sut_->deallocate( p_allc_mem1 ), std::logic_error );
+	EXPECT_THROW( p_sut_->deallocate( p_allc_mem2 ), std::logic_error );
+
+	// Assert
+	ipsm::offset_malloc_stats after = p_sut_->get_stats();
+	EXPECT_EQ( after.num_of_free_blocks_, before.num_of_free_blocks_ );
+	EXPECT_EQ( p_sut_->allocate( 32 ), p_allc_mem2 );
+	EXPECT_EQ( p_sut_->allocate( 32 ), p_allc_mem1 );
+
+	// Clean-up
+	p_sut_->deallocate( p_allc_mem1 );
+	p_sut_->deallocate( p_allc_mem2 );
+}
+
+class ProcShared_KRmalloc_Random : public testing::TestWithParam<ipsm::offset_malloc_policy> {};
+
+TEST_P( ProcShared_KRmalloc_Random, CanAllocateAndDeallocateRandomly )
+{
+	// Arrange
+	constexpr size_t                         buff_size = 1024 * 256;
+	std::vector<unsigned char>               buff( buff_size + 16 );
+	uintptr_t                                addr  = ( ( reinterpret_cast<uintptr_t>( buff.data() ) + 16 - 1 ) / 16 ) * 16;
+	ipsm::offset_malloc::offset_malloc_impl* p_sut = ipsm::offset_malloc::offset_malloc_impl::placement_new( reinterpret_cast<void*>( addr ), reinterpret_cast<void*>( addr + buff_size ), GetParam() );
+
+	struct alloc_info {
+		unsigned char* p_;
+		size_t         size_;
+		unsigned char  pattern_;
+	};
+	std::vector<alloc_info>               allocated;
+	std::mt19937                          engine( 12345 );
+	std::uniform_int_distribution<size_t> size_dist( 1, 2048 );
+	std::uniform_int_distribution<size_t> align_dist( 0, 7 );
+	std::uniform_int_distribution<int>    op_dist( 0, 2 );
+
+	// Act
+	for ( int i = 0; i < 20000; i++ ) {
+		if ( allocated.empty() || ( op_dist( engine ) != 0 ) ) {
+			size_t         sz        = ( size_dist( engine ) % 4 == 0 ) ? size_dist( engine ) : ( size_dist( engine ) % 256 );
+			size_t         alignment = static_cast<size_t>( 1 ) << align_dist( engine );
+			unsigned char* p         = reinterpret_cast<unsigned char*>( p_sut->allocate( sz, alignment ) );
+			if ( p == nullptr ) {
+				continue;
+			}
+			ASSERT_EQ( reinterpret_cast<uintptr_t>( p ) % alignment, 0 );
+			unsigned char pattern = static_cast<unsigned char>( i );
+			memset( p, pattern, sz );
+			allocated.push_back( alloc_info { p, sz, pattern } );
+		} else {
+			std::uniform_int_distribution<size_t> idx_dist( 0, allocated.size() - 1 );
+			size_t                                idx  = idx_dist( engine );
+			alloc_info                            info = allocated[idx];
+			for ( size_t j = 0; j < info.size_; j++ ) {
+				ASSERT_EQ( info.p_[j], info.pattern_ );
+			}
+			allocated[idx] = allocated.back();
+			allocated.pop_back();
+			p_sut->deallocate( info.p_ );
+		}
+	}
+	for ( auto& info : allocated ) {
+		for ( size_t j = 0; j < info.size_; j++ ) {
+			ASSERT_EQ( info.p_[j], info.pattern_ );
+		}
+		p_sut->deallocate( info.p_ );
+	}
+
+	// Assert
+	void* p_big_mem = p_sut->allocate( p_sut->get_stats().total_bytes_ - 64 );
+	EXPECT_NE( p_big_mem, nullptr );
+
+	// Clean-up
+	ipsm::offset_malloc::offset_malloc_impl::unbind( p_sut );
+}
+
+INSTANTIATE_TEST_SUITE_P( AllocationPolicy,
+                          ProcShared_KRmalloc_Random,
+                          testing::Values( ipsm::offset_malloc_policy::kFirstFit, ipsm::offset_malloc_policy::kBestFit ) );
+
+namespace {
+struct interrupt_update {};   // 空きブロックリストの更新の中断を模擬する例外
+
+size_t interrupt_point = 0;   // 更新を中断する取り消しエントリの数
+
+void throw_at_interrupt_point( size_t num_of_entries )
+{
+	if ( num_of_entries == interrupt_point ) {
+		throw interrupt_update {};
+	}
+}
+
+void exit_at_interrupt_point( size_t num_of_entries )
+{
+	if ( num_of_entries == interrupt_point ) {
+		_exit( 0 );   // ミューテックスを保持したまま終了する。
+	}
+}
+
+void expect_same_stats( const ipsm::offset_malloc_stats& actual, const ipsm::offset_malloc_stats& expected )
+{
+	EXPECT_EQ( actual.total_bytes_, expected.total_bytes_ );
+	EXPECT_EQ( actual.free_bytes_, expected.free_bytes_ );
+	EXPECT_EQ( actual.num_of_free_blocks_, expected.num_of_free_blocks_ );
+	EXPECT_EQ( actual.largest_free_block_bytes_, expected.largest_free_block_bytes_ );
+	EXPECT_EQ( actual.num_of_allocated_blocks_, expected.num_of_allocated_blocks_ );
+}
+}   // namespace
+
+class ProcShared_Malloc_Recovery : public testing::TestWithParam<ipsm::offset_malloc_policy> {
+public:
+	static constexpr size_t alloc_mem_size = 1024 * 64;
+	static constexpr size_t num_of_blocks  = 6;
+
+	void SetUp() override
+	{
+		// fork()した子プロセスとヒープを共有するため、共有マッピング上に構築する。
+		p_mem_ = mmap( nullptr, alloc_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		ASSERT_NE( p_mem_, MAP_FAILED );
+		p_sut_ = ipsm::offset_malloc::offset_malloc_impl::placement_new( p_mem_, reinterpret_cast<void*>( reinterpret_cast<uintptr_t>( p_mem_ ) + alloc_mem_size ), GetParam() );
+
+		// K&Rの空きブロックリストとサイズクラスのリストの両方に空きブロックがあり、p_blocks_[1]の解放で前後のブロックと結合する状態にする。
+		for ( size_t i = 0; i < num_of_blocks; i++ ) {
+			p_blocks_[i] = p_sut_->allocate( ( i < 3 ) ? 300 : 20 );
+			ASSERT_NE( p_blocks_[i], nullptr );
+		}
+		p_sut_->deallocate( p_blocks_[0] );
+		p_sut_->deallocate( p_blocks_[2] );
+		p_sut_->deallocate( p_blocks_[4] );
+		p_blocks_[0] = nullptr;
+		p_blocks_[2] = nullptr;
+		p_blocks_[4] = nullptr;
+	}
+	void TearDown() override
+	{
+		// Clean-up
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( nullptr );
+		ipsm::offset_malloc::offset_malloc_impl::unbind( p_sut_ );
+		munmap( p_mem_, alloc_mem_size );
+	}
+
+	/**
+	 * @brief release all memory blocks, then check that whole heap is available again
+	 */
+	void expect_all_free( void )
+	{
+		for ( auto& p : p_blocks_ ) {
+			if ( p != nullptr ) {
+				p_sut_->deallocate( p );
+				p = nullptr;
+			}
+		}
+		ipsm::offset_malloc_stats stats = p_sut_->get_stats();
+		EXPECT_EQ( stats.num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+		EXPECT_EQ( stats.free_bytes_, stats.total_bytes_ );
+		void* p_big_mem = p_sut_->allocate( stats.total_bytes_ - 64 );
+		EXPECT_NE( p_big_mem, nullptr );
+		p_sut_->deallocate( p_big_mem );
+	}
+
+	void*                                    p_mem_;
+	ipsm::offset_malloc::offset_malloc_impl* p_sut_;
+	void*                                    p_blocks_[num_of_blocks];
+};
+
+TEST_P( ProcShared_Malloc_Recovery, CanRollBackInterruptedDeallocation )
+{
+	for ( interrupt_point = 1;; interrupt_point++ ) {
+		// Arrange
+		ipsm::offset_malloc_stats before = p_sut_->get_stats();
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( throw_at_interrupt_point );
+
+		// Act
+		bool is_interrupted = false;
+		try {
+			p_sut_->deallocate( p_blocks_[1] );
+		} catch ( interrupt_update& ) {
+			is_interrupted = true;
+		}
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( nullptr );
+		if ( !is_interrupted ) {
+			p_blocks_[1] = nullptr;
+			break;
+		}
+
+		// Assert
+		expect_same_stats( p_sut_->get_stats(), before );   // 次のロックの取得で回復され、中断した解放は取り消されている。
+	}
+	EXPECT_GT( interrupt_point, static_cast<size_t>( 1 ) );
+	expect_all_free();
+}
+
+TEST_P( ProcShared_Malloc_Recovery, CanRollBackInterruptedAllocation )
+{
+	void* p_allc_mem = nullptr;
+	for ( interrupt_point = 1;; interrupt_point++ ) {
+		// Arrange
+		ipsm::offset_malloc_stats before = p_sut_->get_stats();
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( throw_at_interrupt_point );
+
+		// Act
+		bool is_interrupted = false;
+		try {
+			p_allc_mem = p_sut_->allocate( 1000 );
+		} catch ( interrupt_update& ) {
+			is_interrupted = true;
+		}
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( nullptr );
+		if ( !is_interrupted ) {
+			break;
+		}
+
+		// Assert
+		expect_same_stats( p_sut_->get_stats(), before );
+	}
+	EXPECT_GT( interrupt_point, static_cast<size_t>( 1 ) );
+	ASSERT_NE( p_allc_mem, nullptr );
+	p_sut_->deallocate( p_allc_mem );
+	expect_all_free();
+}
+
+TEST_P( ProcShared_Malloc_Recovery, CanRollForwardInterruptedDrainOfDeferredFree )
+{
+	// Arrange
+	ipsm::offset_malloc_stats before = p_sut_->get_stats();
+	p_sut_->deallocate_deferred( p_blocks_[1] );
+	p_sut_->deallocate_deferred( p_blocks_[3] );
+	p_blocks_[1]    = nullptr;
+	p_blocks_[3]    = nullptr;
+	interrupt_point = 1;
+	ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( throw_at_interrupt_point );
+
+	// Act
+	EXPECT_THROW( p_sut_->drain_deferred(), interrupt_update );
+	ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( nullptr );
+
+	// Assert
+	// 取り出し済みのブロックの解放は、回復時に継続される。
+	ipsm::offset_malloc_stats after = p_sut_->get_stats();
+	EXPECT_EQ( after.num_of_allocated_blocks_, before.num_of_allocated_blocks_ - 2 );
+	EXPECT_GT( after.free_bytes_, before.free_bytes_ );
+	expect_all_free();
+}
+
+TEST_P( ProcShared_Malloc_Recovery, CanRecoverWhenOwnerDiedDuringUpdate )
+{
+	// Arrange
+	ipsm::offset_malloc_stats before = p_sut_->get_stats();
+	interrupt_point                  = 2;
+
+	// Act
+	pid_t child_pid = fork();
+	ASSERT_NE( child_pid, -1 );
+	if ( child_pid == 0 ) {
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( exit_at_interrupt_point );
+		p_sut_->deallocate( p_blocks_[1] );
+		_exit( 1 );   // 更新が中断されなかった。
+	}
+	int status = 0;
+	ASSERT_EQ( waitpid( child_pid, &status, 0 ), child_pid );
+	ASSERT_TRUE( WIFEXITED( status ) );
+	ASSERT_EQ( WEXITSTATUS( status ), 0 );
+
+	// Assert
+	expect_same_stats( p_sut_->get_stats(), before );
+	EXPECT_NO_THROW( p_sut_->deallocate( p_blocks_[1] ) );   // 子プロセスの解放は取り消されているため、二重解放にならない。
+	p_blocks_[1] = nullptr;
+	expect_all_free();
+}
+
+TEST_P( ProcShared_Malloc_Recovery, CanRollBackInterruptedRelocation )
+{
+	unsigned char* p_target = static_cast<unsigned char*>( p_blocks_[1] );
+	for ( size_t i = 0; i < 300; i++ ) {
+		p_target[i] = static_cast<unsigned char>( i );
+	}
+	void* p_moved = nullptr;
+	for ( interrupt_point = 1;; interrupt_point++ ) {
+		// Arrange
+		ipsm::offset_malloc_stats before = p_sut_->get_stats();
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( throw_at_interrupt_point );
+
+		// Act
+		bool is_interrupted = false;
+		try {
+			p_moved = p_sut_->relocate_to_lower_address( p_target, alignof( std::max_align_t ), nullptr );
+		} catch ( interrupt_update& ) {
+			is_interrupted = true;
+		}
+		ipsm::offset_malloc::offset_malloc_impl::test_set_undo_hook( nullptr );
+		if ( !is_interrupted ) {
+			break;
+		}
+
+		// Assert
+		// 取り消された移動では、移動元のブロックの内容は変更されていない。
+		ipsm::offset_malloc_stats after = p_sut_->get_stats();
+		EXPECT_EQ( after.num_of_allocated_blocks_, before.num_of_allocated_blocks_ );
+		EXPECT_EQ( after.free_bytes_, before.free_bytes_ );
+		for ( size_t i = 0; i < 300; i++ ) {
+			ASSERT_EQ( p_target[i], static_cast<unsigned char>( i ) ) << "interrupt_point=" << interrupt_point;
+		}
+	}
+	EXPECT_GT( interrupt_point, static_cast<size_t>( 1 ) );
+	ASSERT_LT( p_moved, p_blocks_[1] );
+	for ( size_t i = 0; i < 300; i++ ) {
+		EXPECT_EQ( static_cast<unsigned char*>( p_moved )[i], static_cast<unsigned char>( i ) );
+	}
+	p_blocks_[1] = p_moved;
+	expect_all_free();
+}
+
+INSTANTIATE_TEST_SUITE_P( AllocationPolicy,
+                          ProcShared_Malloc_Recovery,
+                          testing::Values( ipsm::offset_malloc_policy::kFirstFit, ipsm::offset_malloc_policy::kBestFit ) );
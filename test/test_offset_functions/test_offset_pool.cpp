@@ -0,0 +1,218 @@
+/**
+ * @file test_offset_pool.cpp
+ * @author PFA03027@nifty.com
+ * @brief test lock-free fixed size memory pool
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "offset_list.hpp"
+#include "offset_malloc.hpp"
+#include "offset_pool.hpp"
+
+#include "test_ipsm_common.hpp"
+
+struct PoolTestData {
+	int  a_;
+	char b_[20];
+};
+
+class Offset_Pool : public Offset_Malloc_Heap_Fixture {};
+
+TEST_F( Offset_Pool, CanConstruct )
+{
+	// Arrange
+
+	// Act
+	ipsm::offset_pool<PoolTestData> sut( om_, 10 );
+
+	// Assert
+	EXPECT_EQ( sut.capacity(), static_cast<size_t>( 10 ) );
+	EXPECT_GE( sut.slot_bytes(), sizeof( PoolTestData ) );
+	EXPECT_EQ( sut.slot_bytes() % alignof( PoolTestData ), static_cast<size_t>( 0 ) );
+}
+
+TEST_F( Offset_Pool, FailConstructTooLarge )
+{
+	// Arrange
+
+	// Act
+	EXPECT_THROW( ipsm::offset_pool<PoolTestData> sut( om_, buff_size ), std::bad_alloc );
+
+	// Assert
+}
+
+TEST_F( Offset_Pool, CanAllocateAll_ThenExhausted )
+{
+	// Arrange
+	constexpr size_t                num_of_slots = 10;
+	ipsm::offset_pool<PoolTestData> sut( om_, num_of_slots );
+	std::set<PoolTestData*>         allocated;
+
+	// Act
+	for ( size_t i = 0; i < num_of_slots; i++ ) {
+		PoolTestData* p = sut.allocate();
+		ASSERT_NE( p, nullptr );
+		EXPECT_TRUE( sut.is_belong_to( p ) );
+		EXPECT_EQ( reinterpret_cast<uintptr_t>( p ) % alignof( PoolTestData ), static_cast<uintptr_t>( 0 ) );
+		allocated.insert( p );
+	}
+
+	// Assert
+	EXPECT_EQ( allocated.size(), num_of_slots );
+	EXPECT_EQ( sut.allocate(), nullptr );
+
+	// Cleanup
+	for ( auto p : allocated ) {
+		sut.deallocate( p );
+	}
+}
+
+TEST_F( Offset_Pool, CanReuseDeallocatedSlot )
+{
+	// Arrange
+	ipsm::offset_pool<PoolTestData> sut( om_, 1 );
+	PoolTestData*                   p1 = sut.allocate();
+	ASSERT_NE( p1, nullptr );
+	ASSERT_EQ( sut.allocate(), nullptr );
+
+	// Act
+	sut.deallocate( p1 );
+	PoolTestData* p2 = sut.allocate();
+
+	// Assert
+	EXPECT_EQ( p1, p2 );
+
+	// Cleanup
+	sut.deallocate( p2 );
+}
+
+TEST_F( Offset_Pool, DetectIncorrectDeallocation )
+{
+	// Arrange
+	ipsm::offset_pool<PoolTestData> sut( om_, 2 );
+	PoolTestData*                   p = sut.allocate();
+	ASSERT_NE( p, nullptr );
+	PoolTestData* p_not_slot = reinterpret_cast<PoolTestData*>( reinterpret_cast<unsigned char*>( p ) + 1 );
+
+	// Act
+	EXPECT_FALSE( sut.is_belong_to( p_not_slot ) );
+#ifdef NDEBUG
+	EXPECT_NO_THROW( sut.deallocate( p_not_slot ) );
+#else
+	EXPECT_THROW( sut.deallocate( p_not_slot ), std::out_of_range );
+#endif
+
+	// Cleanup
+	sut.deallocate( p );
+}
+
+TEST_F( Offset_Pool, CanReturnChunkByDestruction )
+{
+	// Arrange
+	void* p_before = om_.allocate( 100 );
+	ASSERT_NE( p_before, nullptr );
+	om_.deallocate( p_before );
+
+	// Act
+	{
+		ipsm::offset_pool<PoolTestData> sut( om_, 100 );
+	}
+
+	// Assert
+	void* p_after = om_.allocate( 100 );
+	EXPECT_EQ( p_before, p_after );
+	om_.deallocate( p_after );
+}
+
+TEST_F( Offset_Pool, CanMultiThreadAllocateDeallocate )
+{
+	// Arrange
+	constexpr int                   test_thread_num = 16;
+	constexpr size_t                num_of_slots    = 64;
+	constexpr int                   loop_num        = 100000;
+	ipsm::offset_pool<PoolTestData> sut( om_, num_of_slots );
+	std::atomic<int>                err_count( 0 );
+	std::vector<std::thread>        threads;
+
+	// Act
+	for ( int i = 0; i < test_thread_num; i++ ) {
+		threads.emplace_back( [&sut, &err_count, i]() {
+			for ( int j = 0; j < loop_num; j++ ) {
+				PoolTestData* p = sut.allocate();
+				if ( p == nullptr ) {
+					continue;
+				}
+				// 同じスロットが複数のスレッドに払い出されていないかを、書き込んだ値で確認する。
+				p->a_ = i;
+				std::this_thread::yield();
+				if ( p->a_ != i ) {
+					err_count++;
+				}
+				sut.deallocate( p );
+			}
+		} );
+	}
+	for ( auto& t : threads ) {
+		t.join();
+	}
+
+	// Assert
+	EXPECT_EQ( err_count.load(), 0 );
+	std::set<PoolTestData*> allocated;
+	for ( size_t i = 0; i < num_of_slots; i++ ) {
+		PoolTestData* p = sut.allocate();
+		ASSERT_NE( p, nullptr );
+		allocated.insert( p );
+	}
+	EXPECT_EQ( allocated.size(), num_of_slots );
+	EXPECT_EQ( sut.allocate(), nullptr );
+	for ( auto p : allocated ) {
+		sut.deallocate( p );
+	}
+}
+
+TEST_F( Offset_Pool, CanUseAsAllocatorOfOffsetList )
+{
+	// Arrange
+	using list_type = ipsm::offset_list<int, ipsm::offset_pool_allocator<int>>;
+	ipsm::offset_pool<list_type::node_storage_type> pool( om_, 4 );
+
+	// Act
+	{
+		list_type sut { ipsm::offset_pool_allocator<int>( pool ) };
+		for ( int i = 0; i < 10; i++ ) {
+			sut.push_back( i );   // 5個目以降は、offset_mallocから確保される。
+		}
+
+		// Assert
+		EXPECT_EQ( sut.size(), static_cast<size_t>( 10 ) );
+		int expect_value = 0;
+		for ( auto v : sut ) {
+			EXPECT_EQ( v, expect_value );
+			expect_value++;
+		}
+		EXPECT_EQ( pool.allocate(), nullptr );
+	}
+
+	// Assert
+	std::set<list_type::node_storage_type*> allocated;
+	for ( size_t i = 0; i < pool.capacity(); i++ ) {
+		auto p = pool.allocate();
+		ASSERT_NE( p, nullptr );
+		allocated.insert( p );
+	}
+	for ( auto p : allocated ) {
+		pool.deallocate( p );
+	}
+}
@@ -476,3 +476,82 @@ TEST( OffsetPtr, CanSubOperator3 )
 	// Assert
 	EXPECT_EQ( d, 1 );
 }
+
+TEST( AtomicOffsetPtr, CanDefaultConstructAsNullptr )
+{
+	// Arrange
+
+	// Act
+	ipsm::atomic_offset_ptr<int> sut;
+
+	// Assert
+	EXPECT_EQ( sut.load().get(), nullptr );
+}
+
+TEST( AtomicOffsetPtr, CanStoreLoad )
+{
+	// Arrange
+	int                          a = 1;
+	ipsm::atomic_offset_ptr<int> sut;
+
+	// Act
+	sut.store( ipsm::offset_ptr<int>( &a ) );
+
+	// Assert
+	EXPECT_EQ( sut.load().get(), &a );
+
+	// Act
+	sut.store( ipsm::offset_ptr<int>( nullptr ) );
+
+	// Assert
+	EXPECT_EQ( sut.load().get(), nullptr );
+}
+
+TEST( AtomicOffsetPtr, CanExchange )
+{
+	// Arrange
+	int                          a = 1;
+	int                          b = 2;
+	ipsm::atomic_offset_ptr<int> sut( &a );
+
+	// Act
+	auto ret = sut.exchange( ipsm::offset_ptr<int>( &b ) );
+
+	// Assert
+	EXPECT_EQ( ret.get(), &a );
+	EXPECT_EQ( sut.load().get(), &b );
+}
+
+TEST( AtomicOffsetPtr, CanCompareExchange_Success )
+{
+	// Arrange
+	int                          a = 1;
+	int                          b = 2;
+	ipsm::atomic_offset_ptr<int> sut( &a );
+	ipsm::offset_ptr<int>        expected( &a );
+
+	// Act
+	bool ret = sut.compare_exchange_strong( expected, ipsm::offset_ptr<int>( &b ) );
+
+	// Assert
+	EXPECT_TRUE( ret );
+	EXPECT_EQ( expected.get(), &a );
+	EXPECT_EQ( sut.load().get(), &b );
+}
+
+TEST( AtomicOffsetPtr, CanCompareExchange_Fail )
+{
+	// Arrange
+	int                          a = 1;
+	int                          b = 2;
+	ipsm::atomic_offset_ptr<int> sut;
+	ipsm::offset_ptr<int>        expected( &a );
+
+	// Act
+	bool ret = sut.compare_exchange_weak( expected, ipsm::offset_ptr<int>( &b ), std::memory_order_acq_rel, std::memory_order_acquire );
+
+	// Assert
+	EXPECT_FALSE( ret );
+	EXPECT_EQ( expected.get(), nullptr );
+	EXPECT_EQ( sut.load().get(), nullptr );
+}
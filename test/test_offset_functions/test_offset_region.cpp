@@ -0,0 +1,190 @@
+/**
+ * @file test_offset_region.cpp
+ * @author PFA03027@nifty.com
+ * @brief test lock-free monotonic memory region
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "offset_list.hpp"
+#include "offset_malloc.hpp"
+#include "offset_region.hpp"
+#include "offset_string.hpp"
+
+#include "test_ipsm_common.hpp"
+
+class Offset_Region : public Offset_Malloc_Heap_Fixture {};
+
+TEST_F( Offset_Region, CanConstruct )
+{
+	// Arrange
+
+	// Act
+	ipsm::offset_region sut( om_, 1024 );
+
+	// Assert
+	EXPECT_EQ( sut.capacity(), static_cast<size_t>( 1024 ) );
+	EXPECT_EQ( sut.used_bytes(), static_cast<size_t>( 0 ) );
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );
+}
+
+TEST_F( Offset_Region, FailConstructTooLarge )
+{
+	// Arrange
+
+	// Act
+	EXPECT_THROW( ipsm::offset_region sut( om_, buff_size ), std::bad_alloc );
+
+	// Assert
+}
+
+TEST_F( Offset_Region, CanAllocateWithAlignment_ThenExhausted )
+{
+	// Arrange
+	ipsm::offset_region sut( om_, 256 );
+
+	// Act
+	void* p1 = sut.allocate( 1, 1 );
+	void* p2 = sut.allocate( 8, 64 );
+	void* p3 = sut.allocate( 256 );
+
+	// Assert
+	ASSERT_NE( p1, nullptr );
+	ASSERT_NE( p2, nullptr );
+	EXPECT_TRUE( sut.is_belong_to( p1 ) );
+	EXPECT_TRUE( sut.is_belong_to( p2 ) );
+	EXPECT_EQ( reinterpret_cast<uintptr_t>( p2 ) % 64, static_cast<uintptr_t>( 0 ) );
+	EXPECT_GT( reinterpret_cast<uintptr_t>( p2 ), reinterpret_cast<uintptr_t>( p1 ) );
+	EXPECT_EQ( p3, nullptr );
+	EXPECT_EQ( sut.allocate( 8, 3 ), nullptr );
+}
+
+TEST_F( Offset_Region, CanReset_ThenReuseChunk )
+{
+	// Arrange
+	ipsm::offset_region sut( om_, 128 );
+	void*               p1 = sut.allocate( 128 );
+	ASSERT_NE( p1, nullptr );
+	ASSERT_EQ( sut.allocate( 1 ), nullptr );
+
+	// Act
+	sut.reset();
+	void* p2 = sut.allocate( 128 );
+
+	// Assert
+	EXPECT_EQ( p1, p2 );
+}
+
+TEST_F( Offset_Region, CanReleaseAtOnce )
+{
+	// Arrange
+	ipsm::offset_region sut( om_, 1024 * 16 );
+	for ( int i = 0; i < 100; i++ ) {
+		ASSERT_NE( sut.allocate( 100 ), nullptr );
+	}
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );
+
+	// Act
+	sut.release();
+
+	// Assert
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 0 ) );
+	EXPECT_EQ( sut.capacity(), static_cast<size_t>( 0 ) );
+	EXPECT_EQ( sut.allocate( 1 ), nullptr );
+}
+
+TEST_F( Offset_Region, CanAllocateFromMultipleThreads )
+{
+	// Arrange
+	constexpr size_t    num_of_threads     = 4;
+	constexpr size_t    num_of_per_threads = 100;
+	ipsm::offset_region sut( om_, num_of_threads * num_of_per_threads * 16 );
+	std::vector<void*>  allocated[num_of_threads];
+
+	// Act
+	std::vector<std::thread> threads;
+	for ( size_t t = 0; t < num_of_threads; t++ ) {
+		threads.emplace_back( [&sut, &allocated, t]() {
+			for ( size_t i = 0; i < num_of_per_threads; i++ ) {
+				allocated[t].push_back( sut.allocate( 16, 16 ) );
+			}
+		} );
+	}
+	for ( auto& th : threads ) {
+		th.join();
+	}
+
+	// Assert
+	std::set<void*> unique_addrs;
+	for ( auto& v : allocated ) {
+		for ( auto p : v ) {
+			ASSERT_NE( p, nullptr );
+			unique_addrs.insert( p );
+		}
+	}
+	EXPECT_EQ( unique_addrs.size(), num_of_threads * num_of_per_threads );
+	EXPECT_EQ( sut.used_bytes(), sut.capacity() );
+}
+
+TEST_F( Offset_Region, CanUseAsAllocatorOfOffsetList )
+{
+	// Arrange
+	using list_type = ipsm::offset_list<int, ipsm::offset_region_allocator<int>>;
+	ipsm::offset_region region( om_, 1024 * 4 );
+
+	// Act
+	{
+		list_type sut { ipsm::offset_region_allocator<int>( region ) };
+		for ( int i = 0; i < 10; i++ ) {
+			sut.push_back( i );
+		}
+
+		// Assert
+		EXPECT_EQ( sut.size(), static_cast<size_t>( 10 ) );
+		int expect_value = 0;
+		for ( auto v : sut ) {
+			EXPECT_EQ( v, expect_value );
+			expect_value++;
+		}
+		EXPECT_GE( region.used_bytes(), sizeof( list_type::node_storage_type ) * 10 );
+	}
+	EXPECT_EQ( om_.get_stats().num_of_allocated_blocks_, static_cast<size_t>( 1 ) );
+}
+
+TEST_F( Offset_Region, CanUseAsAllocatorOfOffsetBasicString )
+{
+	// Arrange
+	using string_type = ipsm::offset_basic_string<char, std::char_traits<char>, ipsm::offset_region_allocator<char>>;
+	ipsm::offset_region region( om_, 1024 * 4 );
+	std::string         long_str( 200, 'a' );   // SOOのバッファに収まらない長さ
+
+	// Act
+	string_type sut( long_str.c_str(), ipsm::offset_region_allocator<char>( region ) );
+
+	// Assert
+	EXPECT_EQ( std::string( sut.c_str() ), long_str );
+	EXPECT_GT( region.used_bytes(), long_str.size() );
+}
+
+TEST_F( Offset_Region, ThrowBadAllocWhenExhausted )
+{
+	// Arrange
+	ipsm::offset_region                region( om_, 64 );
+	ipsm::offset_region_allocator<int> sut( region );
+
+	// Act
+	EXPECT_THROW( { auto p = sut.allocate( 100 ); (void)p; }, std::bad_alloc );
+
+	// Assert
+}
@@ -0,0 +1,122 @@
+/**
+ * @file test_offset_malloc_coalescing_bench.cpp
+ * @author PFA03027@nifty.com
+ * @brief benchmark of deferred coalescing mode of offset_malloc
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2026, PFA03027@nifty.com
+ *
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "offset_allocator.hpp"
+#include "offset_list.hpp"
+#include "offset_malloc.hpp"
+
+namespace {
+
+constexpr size_t heap_bytes = 1024 * 1024 * 16;
+
+struct bench_result {
+	double                    ops_per_sec_;
+	ipsm::offset_malloc_stats stats_;   // 解放前のヒープの状態
+};
+
+void print_result( const char* p_title, bool deferred_coalescing, const bench_result& r )
+{
+	printf( "%-28s deferred_coalescing=%-5s %12.0f ops/s, free_blocks=%8zu, largest_free=%10zu, fragmentation=%.3f\n",
+	        p_title, deferred_coalescing ? "true" : "false", r.ops_per_sec_,
+	        r.stats_.num_of_free_blocks_, r.stats_.largest_free_block_bytes_, r.stats_.fragmentation_ratio_ );
+}
+
+/**
+ * @brief push_back/pop_front churn of offset_list. the node size is decided by T
+ */
+template <typename T>
+bench_result bench_list_churn( bool deferred_coalescing, size_t num_of_live_nodes, size_t loop_num )
+{
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[heap_bytes] );
+	ipsm::offset_malloc              om( up_buff.get(), heap_bytes );
+	om.set_deferred_coalescing( deferred_coalescing );
+
+	bench_result ans {};
+	{
+		ipsm::offset_list<T, ipsm::offset_allocator<T>> l { ipsm::offset_allocator<T>( om ) };
+		for ( size_t i = 0; i < num_of_live_nodes; i++ ) {
+			l.push_back( T {} );
+		}
+
+		auto tp_start = std::chrono::steady_clock::now();
+		for ( size_t i = 0; i < loop_num; i++ ) {
+			l.pop_front();
+			l.push_back( T {} );
+		}
+		auto tp_end = std::chrono::steady_clock::now();
+
+		std::chrono::duration<double> elapsed = tp_end - tp_start;
+		ans.ops_per_sec_                      = static_cast<double>( loop_num * 2 ) / elapsed.count();
+		ans.stats_                            = om.get_stats();
+	}
+	return ans;
+}
+
+/**
+ * @brief random size allocate/deallocate churn that keeps num_of_live_blocks memory blocks
+ */
+bench_result bench_mixed_size_churn( bool deferred_coalescing, size_t num_of_live_blocks, size_t loop_num )
+{
+	std::unique_ptr<unsigned char[]> up_buff( new unsigned char[heap_bytes] );
+	ipsm::offset_malloc              om( up_buff.get(), heap_bytes );
+	om.set_deferred_coalescing( deferred_coalescing );
+
+	std::mt19937                          engine( 1 );   // 比較のため、両モードで同じ系列を使う。
+	std::uniform_int_distribution<size_t> size_dist( 300, 4096 );
+	std::uniform_int_distribution<size_t> idx_dist( 0, num_of_live_blocks - 1 );
+	std::vector<void*>                    live( num_of_live_blocks, nullptr );
+	for ( auto& p : live ) {
+		p = om.allocate( size_dist( engine ) );
+	}
+
+	auto tp_start = std::chrono::steady_clock::now();
+	for ( size_t i = 0; i < loop_num; i++ ) {
+		size_t idx = idx_dist( engine );
+		om.deallocate( live[idx] );
+		live[idx] = om.allocate( size_dist( engine ) );
+	}
+	auto tp_end = std::chrono::steady_clock::now();
+
+	bench_result                  ans {};
+	std::chrono::duration<double> elapsed = tp_end - tp_start;
+	ans.ops_per_sec_                      = static_cast<double>( loop_num * 2 ) / elapsed.count();
+	ans.stats_                            = om.get_stats();
+	for ( auto p : live ) {
+		om.deallocate( p );
+	}
+	return ans;
+}
+
+}   // namespace
+
+int main( void )
+{
+	constexpr size_t loop_num = 1000000;
+
+	for ( bool deferred_coalescing : { false, true } ) {
+		print_result( "offset_list<int> churn", deferred_coalescing, bench_list_churn<int>( deferred_coalescing, 1000, loop_num ) );
+	}
+	for ( bool deferred_coalescing : { false, true } ) {
+		print_result( "offset_list<512 bytes> churn", deferred_coalescing, bench_list_churn<std::array<char, 512>>( deferred_coalescing, 1000, loop_num ) );
+	}
+	for ( bool deferred_coalescing : { false, true } ) {
+		print_result( "mixed size churn", deferred_coalescing, bench_mixed_size_churn( deferred_coalescing, 1000, loop_num ) );
+	}
+
+	return 0;
+}